@@ -0,0 +1,50 @@
+#include "headers/compression_stats.h"
+#include "response_builder.h"
+#include "../../messaging/headers/compression_controller.h"
+#include "../../messaging/headers/create_topic.h"
+#include <string.h>
+#include <stdio.h>
+
+#define DEFAULT_TOPIC_BASE_PATH "./topics"
+
+static enum MHD_Result send_json(struct MHD_Connection *connection, unsigned int status, const char *body) {
+    struct MHD_Response *resp = build_response_from_buffer((int)status, body, strlen(body), "application/json");
+    if (!resp) return MHD_NO;
+    enum MHD_Result ret = MHD_queue_response(connection, status, resp);
+    MHD_destroy_response(resp);
+    return ret;
+}
+
+enum MHD_Result handle_compression_stats_request(struct MHD_Connection *connection) {
+    if (!connection) {
+        return MHD_NO;
+    }
+
+    const char *topic_name = MHD_lookup_connection_value(connection, MHD_GET_ARGUMENT_KIND, "topic");
+
+    if (!topic_name || strlen(topic_name) == 0) {
+        return send_json(connection, MHD_HTTP_BAD_REQUEST,
+                         "{\"error\":\"Invalid request. Expected 'topic' query parameter\"}");
+    }
+
+    if (!topic_exists(topic_name, DEFAULT_TOPIC_BASE_PATH)) {
+        return send_json(connection, MHD_HTTP_NOT_FOUND, "{\"error\":\"Topic not found\"}");
+    }
+
+    char file_path[512];
+    snprintf(file_path, sizeof(file_path), "%s/%s.topic", DEFAULT_TOPIC_BASE_PATH, topic_name);
+
+    CompressionStats stats;
+    if (compression_controller_stats(file_path, &stats) != 0) {
+        return send_json(connection, MHD_HTTP_INTERNAL_SERVER_ERROR, "{\"error\":\"Failed to read compression stats\"}");
+    }
+
+    char body[512];
+    snprintf(body, sizeof(body),
+             "{\"topic\":\"%s\",\"level\":%d,\"min_level\":%d,\"max_level\":%d,"
+             "\"ratio\":%llu.%03llu,\"encode_cpu_permille\":%llu,\"queue_depth\":%d}",
+             topic_name, stats.level, stats.min_level, stats.max_level,
+             (unsigned long long)(stats.ratio_permille / 1000), (unsigned long long)(stats.ratio_permille % 1000),
+             (unsigned long long)stats.cpu_permille, stats.queue_depth);
+    return send_json(connection, MHD_HTTP_OK, body);
+}
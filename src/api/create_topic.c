@@ -1,6 +1,9 @@
 #include "headers/create_topic.h"
 #include "response_builder.h"
 #include "../../messaging/headers/create_topic.h"
+#include "../../messaging/headers/table_view.h"
+#include "../../messaging/headers/compression_controller.h"
+#include "../../messaging/headers/codec.h"
 #include <string.h>
 #include <stdlib.h>
 #include <stdio.h>
@@ -109,6 +112,34 @@ static char* extract_json_string(const char* json, const char* key, size_t* out_
     return result;
 }
 
+static int extract_json_int(const char* json, const char* key, int* out_value) {
+    if (!json || !key || !out_value) {
+        return -1;
+    }
+
+    char search_key[256];
+    snprintf(search_key, sizeof(search_key), "\"%s\"", key);
+
+    const char* key_pos = strstr(json, search_key);
+    if (!key_pos) {
+        return -1;
+    }
+
+    const char* colon = strchr(key_pos + strlen(search_key), ':');
+    if (!colon) {
+        return -1;
+    }
+
+    char* end = NULL;
+    long value = strtol(colon + 1, &end, 10);
+    if (end == colon + 1) {
+        return -1;
+    }
+
+    *out_value = (int)value;
+    return 0;
+}
+
 enum MHD_Result handle_create_topic_request(struct MHD_Connection *connection,
                                            const char *upload_data,
                                            size_t *upload_data_size,
@@ -127,6 +158,8 @@ enum MHD_Result handle_create_topic_request(struct MHD_Connection *connection,
                 size_t base_path_len = 0;
                 char* topic_name = extract_json_string(buf->buffer, "topic", &topic_len);
                 char* base_path = extract_json_string(buf->buffer, "base_path", &base_path_len);
+                size_t key_field_len = 0;
+                char* key_field = extract_json_string(buf->buffer, "key_field", &key_field_len);
 
                 if (!topic_name) {
                     const char* error_body = "{\"error\":\"Invalid request. Expected JSON with 'topic' field\"}";
@@ -135,11 +168,41 @@ enum MHD_Result handle_create_topic_request(struct MHD_Connection *connection,
                         enum MHD_Result ret = MHD_queue_response(connection, MHD_HTTP_BAD_REQUEST, resp);
                         MHD_destroy_response(resp);
                         if (base_path) free(base_path);
+                        if (key_field) free(key_field);
                         free_request_buffer(*con_cls);
                         *con_cls = NULL;
                         return ret;
                     }
                     if (base_path) free(base_path);
+                    if (key_field) free(key_field);
+                    free_request_buffer(*con_cls);
+                    *con_cls = NULL;
+                    return MHD_NO;
+                }
+
+                // Either bound may be given alone; the other keeps its default.
+                int min_level = COMPRESSION_DEFAULT_MIN_LEVEL;
+                int max_level = COMPRESSION_DEFAULT_MAX_LEVEL;
+                int has_min = extract_json_int(buf->buffer, "min_compression_level", &min_level) == 0;
+                int has_max = extract_json_int(buf->buffer, "max_compression_level", &max_level) == 0;
+                int has_bounds = has_min || has_max;
+
+                if (has_bounds && !compression_bounds_valid(min_level, max_level)) {
+                    const char* error_body = "{\"error\":\"Invalid compression levels. Expected non-zero zstd levels with min <= max\"}";
+                    struct MHD_Response* resp = build_response_from_buffer(400, error_body, strlen(error_body), "application/json");
+                    if (resp) {
+                        enum MHD_Result ret = MHD_queue_response(connection, MHD_HTTP_BAD_REQUEST, resp);
+                        MHD_destroy_response(resp);
+                        free(topic_name);
+                        if (base_path) free(base_path);
+                        if (key_field) free(key_field);
+                        free_request_buffer(*con_cls);
+                        *con_cls = NULL;
+                        return ret;
+                    }
+                    free(topic_name);
+                    if (base_path) free(base_path);
+                    if (key_field) free(key_field);
                     free_request_buffer(*con_cls);
                     *con_cls = NULL;
                     return MHD_NO;
@@ -155,18 +218,44 @@ enum MHD_Result handle_create_topic_request(struct MHD_Connection *connection,
                         MHD_destroy_response(resp);
                         free(topic_name);
                         if (base_path) free(base_path);
+                        if (key_field) free(key_field);
                         free_request_buffer(*con_cls);
                         *con_cls = NULL;
                         return ret;
                     }
                     free(topic_name);
                     if (base_path) free(base_path);
+                    if (key_field) free(key_field);
                     free_request_buffer(*con_cls);
                     *con_cls = NULL;
                     return MHD_NO;
                 }
 
                 Topic* topic = create_topic(topic_name, path_to_use);
+
+                if (topic && key_field && !table_view_open(topic->file_path, key_field)) {
+                    delete_topic(topic);
+                    topic_free(topic);
+                    topic = NULL;
+                }
+
+                if (topic && has_bounds && compression_controller_set_bounds(topic->file_path, min_level, max_level) != 0) {
+                    delete_topic(topic);
+                    topic_free(topic);
+                    topic = NULL;
+                }
+
+                size_t codec_name_len = 0;
+                char* codec_name = extract_json_string(buf->buffer, "codec", &codec_name_len);
+                if (topic && codec_name) {
+                    const Codec* codec = codec_by_name(codec_name);
+                    if (!codec || topic_codec_set(topic->file_path, codec->id) != 0) {
+                        delete_topic(topic);
+                        topic_free(topic);
+                        topic = NULL;
+                    }
+                }
+                if (codec_name) free(codec_name);
                 
                 if (topic) {
                     char success_body[512];
@@ -180,6 +269,7 @@ enum MHD_Result handle_create_topic_request(struct MHD_Connection *connection,
                         topic_free(topic);
                         free(topic_name);
                         if (base_path) free(base_path);
+                        if (key_field) free(key_field);
                         free_request_buffer(*con_cls);
                         *con_cls = NULL;
                         return ret;
@@ -193,6 +283,7 @@ enum MHD_Result handle_create_topic_request(struct MHD_Connection *connection,
                         MHD_destroy_response(resp);
                         free(topic_name);
                         if (base_path) free(base_path);
+                        if (key_field) free(key_field);
                         free_request_buffer(*con_cls);
                         *con_cls = NULL;
                         return ret;
@@ -201,6 +292,7 @@ enum MHD_Result handle_create_topic_request(struct MHD_Connection *connection,
 
                 free(topic_name);
                 if (base_path) free(base_path);
+                if (key_field) free(key_field);
                 free_request_buffer(*con_cls);
                 *con_cls = NULL;
                 return MHD_NO;
@@ -2,6 +2,8 @@
 #include "response_builder.h"
 #include "headers/publish_event.h"
 #include "headers/create_topic.h"
+#include "headers/table_lookup.h"
+#include "headers/compression_stats.h"
 #include <string.h>
 #include <stdio.h>
 
@@ -32,10 +34,16 @@ enum MHD_Result route_request(void *cls,
             enum MHD_Result ret = (enum MHD_Result) MHD_queue_response(connection, MHD_HTTP_OK, resp);
             MHD_destroy_response(resp);
             return ret;
+        } else if (strcmp(url, "/table") == 0) {
+            return handle_table_lookup_request(connection);
+        } else if (strcmp(url, "/stats/compression") == 0) {
+            return handle_compression_stats_request(connection);
         }
     } else if (strcmp(method, "POST") == 0) {
         if (strcmp(url, "/publish") == 0) {
             return handle_publish_request(connection, upload_data, upload_data_size, con_cls);
+        } else if (strcmp(url, "/publish_stream") == 0) {
+            return handle_publish_stream_request(connection, upload_data, upload_data_size, con_cls);
         } else if (strcmp(url, "/create_topic") == 0) {
             return handle_create_topic_request(connection, upload_data, upload_data_size, con_cls);
         }
@@ -0,0 +1,8 @@
+#ifndef API_COMPRESSION_STATS_H
+#define API_COMPRESSION_STATS_H
+
+#include <microhttpd.h>
+
+enum MHD_Result handle_compression_stats_request(struct MHD_Connection *connection);
+
+#endif
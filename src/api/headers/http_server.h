@@ -3,7 +3,8 @@
 
 #include <stdint.h>
 
-/* Start HTTP server on the given port */
+/* Start HTTP server on the given port, first recovering the delayed events
+ * pending under ./topics and starting the delay scheduler */
 int start_server(uint16_t port);
 
 /* Stop server gracefully */
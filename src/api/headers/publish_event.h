@@ -9,5 +9,10 @@ enum MHD_Result handle_publish_request(struct MHD_Connection *connection,
                                        size_t *upload_data_size,
                                        void **con_cls);
 
+enum MHD_Result handle_publish_stream_request(struct MHD_Connection *connection,
+                                              const char *upload_data,
+                                              size_t *upload_data_size,
+                                              void **con_cls);
+
 #endif
 
@@ -0,0 +1,8 @@
+#ifndef API_TABLE_LOOKUP_H
+#define API_TABLE_LOOKUP_H
+
+#include <microhttpd.h>
+
+enum MHD_Result handle_table_lookup_request(struct MHD_Connection *connection);
+
+#endif
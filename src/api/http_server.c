@@ -7,6 +7,9 @@
 
 /* Request router */
 #include "handler.h"
+#include "../../messaging/headers/delay_scheduler.h"
+
+#define DEFAULT_TOPIC_BASE_PATH "./topics"
 
 static struct MHD_Daemon *g_daemon = NULL;
 
@@ -30,6 +33,12 @@ int start_server(uint16_t port)
         return 0;
     }
 
+    /* Deliver the delayed events a previous run left pending */
+    if (delay_scheduler_start(DEFAULT_TOPIC_BASE_PATH) != 0) {
+        fprintf(stderr, "Failed to start the delay scheduler\n");
+        return -1;
+    }
+
     g_daemon = MHD_start_daemon(
         MHD_USE_SELECT_INTERNALLY | MHD_USE_DEBUG,
         port,
@@ -39,6 +48,7 @@ int start_server(uint16_t port)
 
     if (g_daemon == NULL) {
         fprintf(stderr, "Failed to start libmicrohttpd daemon on port %u\n", (unsigned)port);
+        delay_scheduler_stop();
         return -1;
     }
 
@@ -51,6 +61,7 @@ void stop_server(void)
     if (g_daemon) {
         MHD_stop_daemon(g_daemon);
         g_daemon = NULL;
+        delay_scheduler_stop();
         printf("HTTP server stopped\n");
     }
 }
@@ -2,6 +2,7 @@
 #include "response_builder.h"
 #include "../../messaging/headers/publish_event.h"
 #include "../../messaging/headers/create_topic.h"
+#include "../../messaging/headers/delay_scheduler.h"
 #include "../../writer/headers/read_write_data.h"
 #include <string.h>
 #include <stdlib.h>
@@ -111,6 +112,47 @@ static char* extract_json_string(const char* json, const char* key, size_t* out_
     return result;
 }
 
+static int extract_json_uint64(const char* json, const char* key, uint64_t* out_value) {
+    if (!json || !key || !out_value) {
+        return -1;
+    }
+
+    char search_key[256];
+    snprintf(search_key, sizeof(search_key), "\"%s\"", key);
+
+    const char* key_pos = strstr(json, search_key);
+    if (!key_pos) {
+        return -1;
+    }
+
+    const char* colon = strchr(key_pos + strlen(search_key), ':');
+    if (!colon) {
+        return -1;
+    }
+
+    const char* start = colon + 1;
+    while (*start && isspace(*start)) {
+        start++;
+    }
+
+    if (*start == '"') {
+        start++;
+    }
+
+    if (!isdigit(*start)) {
+        return -1;
+    }
+
+    char* end = NULL;
+    unsigned long long value = strtoull(start, &end, 10);
+    if (end == start) {
+        return -1;
+    }
+
+    *out_value = (uint64_t)value;
+    return 0;
+}
+
 static Topic* get_or_create_topic(const char* topic_name) {
     if (!topic_name) {
         return NULL;
@@ -218,10 +260,54 @@ enum MHD_Result handle_publish_request(struct MHD_Connection *connection,
                     return MHD_NO;
                 }
 
-                int publish_result = publish_event_string(topic, data);
+                uint64_t not_before_ms = 0;
+                uint64_t delay_ms = 0;
+                int delayed = extract_json_uint64(buf->buffer, "not_before", &not_before_ms) == 0;
+                if (extract_json_uint64(buf->buffer, "delay_ms", &delay_ms) == 0) {
+                    not_before_ms = current_time_ms() + delay_ms;
+                    delayed = 1;
+                }
+
+                uint64_t producer_id = 0;
+                uint64_t sequence = 0;
+                int idempotent = extract_json_uint64(buf->buffer, "producer_id", &producer_id) == 0 &&
+                                 extract_json_uint64(buf->buffer, "sequence", &sequence) == 0 &&
+                                 producer_id != 0;
+
+                size_t compression_len = 0;
+                char* compression = extract_json_string(buf->buffer, "compression", &compression_len);
+                int adaptive = compression && strcmp(compression, "adaptive") == 0;
+                if (compression) free(compression);
+
+                int publish_result;
+                if (idempotent) {
+                    publish_result = publish_event_idempotent(topic, data, data_len, producer_id, sequence,
+                                                              delayed ? not_before_ms : 0);
+                } else if (delayed) {
+                    publish_result = publish_event_at(topic, data, data_len, not_before_ms);
+                } else if (adaptive) {
+                    publish_result = publish_event_adaptive(topic, data, data_len);
+                } else {
+                    publish_result = publish_event_encoded(topic, data, data_len);
+                }
                 
-                if (publish_result == 0) {
-                    const char* success_body = "{\"status\":\"success\",\"message\":\"Event published successfully\"}";
+                if (publish_result == PUBLISH_DUPLICATE) {
+                    const char* duplicate_body = "{\"status\":\"duplicate\",\"message\":\"Event already published\"}";
+                    struct MHD_Response* resp = build_response_from_buffer(200, duplicate_body, strlen(duplicate_body), "application/json");
+                    if (resp) {
+                        enum MHD_Result ret = MHD_queue_response(connection, MHD_HTTP_OK, resp);
+                        MHD_destroy_response(resp);
+                        topic_free(topic);
+                        free(topic_name);
+                        free(data);
+                        free_request_buffer(*con_cls);
+                        *con_cls = NULL;
+                        return ret;
+                    }
+                } else if (publish_result == 0) {
+                    const char* success_body = delayed
+                        ? "{\"status\":\"success\",\"message\":\"Event scheduled for delivery\"}"
+                        : "{\"status\":\"success\",\"message\":\"Event published successfully\"}";
                     struct MHD_Response* resp = build_response_from_buffer(200, success_body, strlen(success_body), "application/json");
                     if (resp) {
                         enum MHD_Result ret = MHD_queue_response(connection, MHD_HTTP_OK, resp);
@@ -290,3 +376,110 @@ enum MHD_Result handle_publish_request(struct MHD_Connection *connection,
     return MHD_YES;
 }
 
+
+typedef struct {
+    Topic* topic;
+    PublishStream* stream;
+    unsigned int error_status;
+    const char* error_body;
+} StreamUpload;
+
+static void stream_upload_fail(StreamUpload* upload, unsigned int status, const char* body) {
+    if (upload->error_status == 0) {
+        upload->error_status = status;
+        upload->error_body = body;
+    }
+    publish_stream_abort(upload->stream);
+    upload->stream = NULL;
+}
+
+static void free_stream_upload(StreamUpload* upload) {
+    if (!upload) {
+        return;
+    }
+    publish_stream_abort(upload->stream);
+    topic_free(upload->topic);
+    free(upload);
+}
+
+static enum MHD_Result queue_json(struct MHD_Connection *connection, unsigned int status, const char *body) {
+    struct MHD_Response* resp = build_response_from_buffer((int)status, body, strlen(body), "application/json");
+    if (!resp) {
+        return MHD_NO;
+    }
+    enum MHD_Result ret = MHD_queue_response(connection, status, resp);
+    MHD_destroy_response(resp);
+    return ret;
+}
+
+// The body is the raw event. It is compressed chunk by chunk as libmicrohttpd
+// hands it over, so only the compressed frame is held while it uploads.
+// Content-Length is required because the size is pledged to the frame.
+enum MHD_Result handle_publish_stream_request(struct MHD_Connection *connection,
+                                              const char *upload_data,
+                                              size_t *upload_data_size,
+                                              void **con_cls) {
+    if (!connection || !upload_data_size) {
+        return MHD_NO;
+    }
+
+    if (!*con_cls) {
+        StreamUpload* upload = (StreamUpload*)calloc(1, sizeof(StreamUpload));
+        if (!upload) {
+            return MHD_NO;
+        }
+        *con_cls = upload;
+
+        const char* topic_name = MHD_lookup_connection_value(connection, MHD_GET_ARGUMENT_KIND, "topic");
+        const char* content_length = MHD_lookup_connection_value(connection, MHD_HEADER_KIND,
+                                                                 MHD_HTTP_HEADER_CONTENT_LENGTH);
+        unsigned long long event_size = content_length ? strtoull(content_length, NULL, 10) : 0;
+
+        if (!topic_name || strlen(topic_name) == 0) {
+            stream_upload_fail(upload, MHD_HTTP_BAD_REQUEST,
+                               "{\"error\":\"Invalid request. Expected 'topic' query parameter\"}");
+        } else if (event_size == 0) {
+            stream_upload_fail(upload, MHD_HTTP_LENGTH_REQUIRED, "{\"error\":\"Content-Length is required\"}");
+        } else if (event_size > MAX_BODY_SIZE) {
+            stream_upload_fail(upload, MHD_HTTP_REQUEST_ENTITY_TOO_LARGE, "{\"error\":\"Request body too large\"}");
+        } else {
+            upload->topic = get_or_create_topic(topic_name);
+            upload->stream = upload->topic ? publish_stream_begin(upload->topic, (size_t)event_size) : NULL;
+            if (!upload->stream) {
+                stream_upload_fail(upload, MHD_HTTP_INTERNAL_SERVER_ERROR,
+                                   "{\"error\":\"Failed to start event stream\"}");
+            }
+        }
+
+        if (*upload_data_size == 0) {
+            return MHD_YES;
+        }
+    }
+
+    StreamUpload* upload = (StreamUpload*)*con_cls;
+
+    if (*upload_data_size > 0) {
+        // After a failure the rest of the body is read and dropped so the
+        // error can still be sent once the upload ends.
+        if (upload->stream && publish_stream_write(upload->stream, upload_data, *upload_data_size) != 0) {
+            stream_upload_fail(upload, MHD_HTTP_INTERNAL_SERVER_ERROR, "{\"error\":\"Failed to compress event\"}");
+        }
+        *upload_data_size = 0;
+        return MHD_YES;
+    }
+
+    enum MHD_Result ret;
+    if (upload->stream) {
+        int result = publish_stream_finish(upload->stream);
+        upload->stream = NULL;
+        ret = result == 0
+            ? queue_json(connection, MHD_HTTP_OK, "{\"status\":\"success\",\"message\":\"Event published successfully\"}")
+            : queue_json(connection, MHD_HTTP_INTERNAL_SERVER_ERROR, "{\"error\":\"Failed to publish event\"}");
+    } else {
+        ret = queue_json(connection, upload->error_status, upload->error_body);
+    }
+
+    free_stream_upload(upload);
+    *con_cls = NULL;
+    return ret;
+}
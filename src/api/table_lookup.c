@@ -0,0 +1,58 @@
+#include "headers/table_lookup.h"
+#include "response_builder.h"
+#include "../../messaging/headers/table_view.h"
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+
+#define DEFAULT_TOPIC_BASE_PATH "./topics"
+
+static enum MHD_Result send_json(struct MHD_Connection *connection, unsigned int status, const char *body) {
+    struct MHD_Response *resp = build_response_from_buffer((int)status, body, strlen(body), "application/json");
+    if (!resp) return MHD_NO;
+    enum MHD_Result ret = MHD_queue_response(connection, status, resp);
+    MHD_destroy_response(resp);
+    return ret;
+}
+
+enum MHD_Result handle_table_lookup_request(struct MHD_Connection *connection) {
+    if (!connection) {
+        return MHD_NO;
+    }
+
+    const char *topic_name = MHD_lookup_connection_value(connection, MHD_GET_ARGUMENT_KIND, "topic");
+    const char *key = MHD_lookup_connection_value(connection, MHD_GET_ARGUMENT_KIND, "key");
+    const char *base_path = MHD_lookup_connection_value(connection, MHD_GET_ARGUMENT_KIND, "base_path");
+
+    if (!topic_name || !key || strlen(topic_name) == 0) {
+        return send_json(connection, MHD_HTTP_BAD_REQUEST,
+                         "{\"error\":\"Invalid request. Expected 'topic' and 'key' query parameters\"}");
+    }
+
+    char file_path[512];
+    snprintf(file_path, sizeof(file_path), "%s/%s.topic", base_path ? base_path : DEFAULT_TOPIC_BASE_PATH, topic_name);
+
+    TableView *view = table_view_find(file_path);
+    if (!view) {
+        return send_json(connection, MHD_HTTP_NOT_FOUND, "{\"error\":\"Topic has no table view\"}");
+    }
+
+    uint8_t *value = NULL;
+    size_t value_size = 0;
+    int result = table_view_get(view, key, strlen(key), &value, &value_size);
+
+    if (result == TABLE_VIEW_NOT_FOUND) {
+        return send_json(connection, MHD_HTTP_NOT_FOUND, "{\"error\":\"Key not found\"}");
+    }
+
+    if (result != 0) {
+        return send_json(connection, MHD_HTTP_INTERNAL_SERVER_ERROR, "{\"error\":\"Failed to read table view\"}");
+    }
+
+    struct MHD_Response *resp = build_response_from_buffer(200, (const char *)value, value_size, "application/json");
+    free(value);
+    if (!resp) return MHD_NO;
+    enum MHD_Result ret = MHD_queue_response(connection, MHD_HTTP_OK, resp);
+    MHD_destroy_response(resp);
+    return ret;
+}
@@ -0,0 +1,203 @@
+// Compares the record codecs on generated JSON events shaped like typical
+// topic traffic. Every event is encoded and decoded on its own, as the
+// broker does per record, and decoded output is checked against the input.
+//
+//   gcc -O2 -Isrc/writer/headers -o codec_bench src/bench/codec_bench.c
+//       src/messaging/*.c src/writer/*.c -lzstd -llz4 -lpthread
+//   ./codec_bench [events]
+
+#include "../messaging/headers/codec.h"
+#include "../messaging/headers/record_format.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define DEFAULT_EVENT_COUNT 20000
+#define MAX_EVENT_SIZE 4096
+
+typedef struct {
+    const char* label;
+    uint8_t codec;
+    int level;
+} BenchCase;
+
+typedef struct {
+    const char* label;
+    int (*generate)(char* buffer, size_t buffer_size, unsigned seed);
+} Workload;
+
+static const char* g_actions[] = { "view", "click", "add_to_cart", "checkout", "search" };
+static const char* g_countries[] = { "DE", "US", "IN", "BR", "JP", "FR" };
+static const char* g_skus[] = { "SKU-10021", "SKU-10388", "SKU-20417", "SKU-33120", "SKU-40877", "SKU-51234" };
+
+static unsigned next_random(unsigned* state) {
+    *state = *state * 1103515245u + 12345u;
+    return (*state >> 16) & 0x7FFF;
+}
+
+static int generate_click(char* buffer, size_t buffer_size, unsigned seed) {
+    unsigned state = seed;
+    return snprintf(buffer, buffer_size,
+                    "{\"event_id\":\"%08x-%04x\",\"user_id\":%u,\"action\":\"%s\",\"country\":\"%s\","
+                    "\"ts\":%u,\"session\":\"s-%05u\"}",
+                    seed * 2654435761u, next_random(&state), 100000 + next_random(&state),
+                    g_actions[next_random(&state) % 5], g_countries[next_random(&state) % 6],
+                    1700000000u + seed, next_random(&state));
+}
+
+static int generate_order(char* buffer, size_t buffer_size, unsigned seed) {
+    unsigned state = seed;
+    int written = snprintf(buffer, buffer_size,
+                           "{\"order_id\":\"ord-%u\",\"customer\":{\"id\":%u,\"tier\":\"%s\",\"country\":\"%s\"},"
+                           "\"currency\":\"EUR\",\"created_at\":\"2024-05-%02uT%02u:%02u:%02uZ\",\"items\":[",
+                           seed, 5000 + next_random(&state) % 2000, next_random(&state) % 2 ? "gold" : "standard",
+                           g_countries[next_random(&state) % 6], 1 + seed % 28, seed % 24, seed % 60,
+                           next_random(&state) % 60);
+
+    unsigned items = 2 + next_random(&state) % 6;
+    for (unsigned i = 0; i < items && written > 0 && (size_t)written < buffer_size; i++) {
+        written += snprintf(buffer + written, buffer_size - (size_t)written,
+                            "%s{\"sku\":\"%s\",\"quantity\":%u,\"unit_price\":%u.%02u,\"discount\":null}",
+                            i ? "," : "", g_skus[next_random(&state) % 6], 1 + next_random(&state) % 4,
+                            next_random(&state) % 200, next_random(&state) % 100);
+    }
+
+    if (written > 0 && (size_t)written < buffer_size) {
+        written += snprintf(buffer + written, buffer_size - (size_t)written,
+                            "],\"shipping\":{\"method\":\"standard\",\"address\":{\"city\":\"Berlin\","
+                            "\"postcode\":\"10%03u\"}},\"status\":\"created\"}",
+                            next_random(&state) % 1000);
+    }
+    return written;
+}
+
+static double now_seconds(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (double)now.tv_sec + (double)now.tv_nsec / 1e9;
+}
+
+static int run_case(const BenchCase* bench, char** events, size_t* sizes, size_t count, size_t raw_total) {
+    const Codec* codec = codec_by_id(bench->codec);
+    if (!codec) {
+        return -1;
+    }
+
+    uint8_t** encoded = (uint8_t**)calloc(count, sizeof(uint8_t*));
+    size_t* encoded_sizes = (size_t*)calloc(count, sizeof(size_t));
+    uint8_t* decoded = (uint8_t*)malloc(MAX_EVENT_SIZE);
+    if (!encoded || !encoded_sizes || !decoded) {
+        free(encoded);
+        free(encoded_sizes);
+        free(decoded);
+        return -1;
+    }
+
+    int result = 0;
+    for (size_t i = 0; i < count && result == 0; i++) {
+        encoded[i] = (uint8_t*)malloc(codec->bound(sizes[i]));
+        if (!encoded[i]) {
+            result = -1;
+        }
+    }
+
+    double encode_start = now_seconds();
+    size_t encoded_total = 0;
+    for (size_t i = 0; i < count && result == 0; i++) {
+        if (codec->encode(NULL, events[i], sizes[i], encoded[i], codec->bound(sizes[i]),
+                          &encoded_sizes[i], bench->level) != 0) {
+            result = -1;
+        }
+        encoded_total += encoded_sizes[i];
+    }
+    double encode_seconds = now_seconds() - encode_start;
+
+    double decode_start = now_seconds();
+    for (size_t i = 0; i < count && result == 0; i++) {
+        size_t decoded_size = 0;
+        if (codec->decode(NULL, encoded[i], encoded_sizes[i], decoded, MAX_EVENT_SIZE, &decoded_size) != 0 ||
+            decoded_size != sizes[i] || memcmp(decoded, events[i], decoded_size) != 0) {
+            result = -1;
+        }
+    }
+    double decode_seconds = now_seconds() - decode_start;
+
+    if (result == 0) {
+        printf("  %-10s %8.3f %10.1f %10.1f %10.0f %10.0f\n", bench->label,
+               (double)raw_total / (double)encoded_total,
+               (double)raw_total / encode_seconds / 1e6, (double)raw_total / decode_seconds / 1e6,
+               encode_seconds * 1e9 / (double)count, decode_seconds * 1e9 / (double)count);
+    } else {
+        printf("  %-10s failed\n", bench->label);
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        free(encoded[i]);
+    }
+    free(encoded);
+    free(encoded_sizes);
+    free(decoded);
+    return result;
+}
+
+int main(int argc, char** argv) {
+    size_t count = argc > 1 ? (size_t)strtoul(argv[1], NULL, 10) : DEFAULT_EVENT_COUNT;
+    if (count == 0) {
+        count = DEFAULT_EVENT_COUNT;
+    }
+
+    const BenchCase cases[] = {
+        { "none", RECORD_CODEC_NONE, 0 },
+        { "lz4", RECORD_CODEC_LZ4, 1 },
+        { "lz4 fast4", RECORD_CODEC_LZ4, -3 },
+        { "zstd -1", RECORD_CODEC_ZSTD, -1 },
+        { "zstd 1", RECORD_CODEC_ZSTD, 1 },
+        { "zstd 3", RECORD_CODEC_ZSTD, 3 },
+        { "zstd 9", RECORD_CODEC_ZSTD, 9 },
+    };
+    const Workload workloads[] = {
+        { "clickstream (~170B events)", generate_click },
+        { "orders (~600B events)", generate_order },
+    };
+
+    int result = 0;
+    for (size_t w = 0; w < sizeof(workloads) / sizeof(workloads[0]); w++) {
+        char** events = (char**)calloc(count, sizeof(char*));
+        size_t* sizes = (size_t*)calloc(count, sizeof(size_t));
+        if (!events || !sizes) {
+            free(events);
+            free(sizes);
+            return 1;
+        }
+
+        size_t raw_total = 0;
+        for (size_t i = 0; i < count; i++) {
+            char buffer[MAX_EVENT_SIZE];
+            int written = workloads[w].generate(buffer, sizeof(buffer), (unsigned)i + 1);
+            if (written <= 0 || (size_t)written >= sizeof(buffer)) {
+                written = 0;
+            }
+            events[i] = strndup(buffer, (size_t)written);
+            sizes[i] = (size_t)written;
+            raw_total += sizes[i];
+        }
+
+        printf("%s, %zu events, %zu bytes\n", workloads[w].label, count, raw_total);
+        printf("  %-10s %8s %10s %10s %10s %10s\n", "codec", "ratio", "enc MB/s", "dec MB/s", "enc ns/op", "dec ns/op");
+        for (size_t c = 0; c < sizeof(cases) / sizeof(cases[0]); c++) {
+            if (run_case(&cases[c], events, sizes, count, raw_total) != 0) {
+                result = 1;
+            }
+        }
+        printf("\n");
+
+        for (size_t i = 0; i < count; i++) {
+            free(events[i]);
+        }
+        free(events);
+        free(sizes);
+    }
+
+    return result;
+}
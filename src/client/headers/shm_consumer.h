@@ -0,0 +1,56 @@
+#ifndef SHM_CONSUMER_H
+#define SHM_CONSUMER_H
+
+#include <stddef.h>
+#include "../../socket/headers/shm_ring.h"
+
+// Client side of the shared-memory transport, for consumers on the
+// broker's host. The connection to the broker's unix socket is only used
+// to set the ring up and, rarely, to say the ring has room again; records
+// arrive through the ring without a system call while the consumer keeps
+// up.
+//
+//     ShmConsumer* consumer = shm_consumer_open("./suparna.sock", "orders", "billing", 0);
+//     ShmRecord record;
+//     while (shm_consumer_poll(consumer, &record, -1) >= 0) {
+//         handle(record.data, record.data_size);
+//         shm_consumer_ack(consumer, &record);
+//         shm_consumer_release(consumer);
+//     }
+//     shm_consumer_close(consumer);
+
+// Times shm_consumer_poll checks the ring before parking on the futex, a
+// few microseconds on current hardware; 0 on single-CPU hosts. Change
+// spin_count after opening to trade CPU for latency.
+#define SHM_CONSUMER_DEFAULT_SPIN 2000
+
+typedef struct {
+    int control_fd;
+    ShmRing ring;
+    unsigned spin_count;
+} ShmConsumer;
+
+// Connects to socket_path, subscribes group to topic and maps the ring the
+// broker creates for it, of capacity bytes (0 for the broker's default).
+// Compressed records are decoded by the broker before they reach the ring.
+// Returns NULL if any step fails.
+ShmConsumer* shm_consumer_open(const char* socket_path, const char* topic, const char* group, size_t capacity);
+
+// Waits up to timeout_ms (-1 for no limit) for the next record. Returns 1
+// with record pointing into the ring, 0 if none came, -1 once the broker
+// closed the ring; shm_consumer_close_reason says why.
+int shm_consumer_poll(ShmConsumer* consumer, ShmRecord* record, int timeout_ms);
+
+// Hands the polled record's space back to the broker. Its data must not be
+// used afterwards. Returns 0, or -1 if the broker could not be told it may
+// write again.
+int shm_consumer_release(ShmConsumer* consumer);
+
+// Acknowledges record and everything before it.
+void shm_consumer_ack(ShmConsumer* consumer, const ShmRecord* record);
+
+uint32_t shm_consumer_close_reason(const ShmConsumer* consumer);
+
+void shm_consumer_close(ShmConsumer* consumer);
+
+#endif
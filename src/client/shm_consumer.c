@@ -0,0 +1,259 @@
+#include "headers/shm_consumer.h"
+#include "../socket/headers/binary_protocol.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+static void put_u16(uint8_t* bytes, uint16_t value) {
+    bytes[0] = (uint8_t)value;
+    bytes[1] = (uint8_t)(value >> 8);
+}
+
+static void put_u32(uint8_t* bytes, uint32_t value) {
+    for (int i = 0; i < 4; i++) {
+        bytes[i] = (uint8_t)(value >> (8 * i));
+    }
+}
+
+static uint32_t get_u32(const uint8_t* bytes) {
+    return (uint32_t)bytes[0] | ((uint32_t)bytes[1] << 8) | ((uint32_t)bytes[2] << 16) | ((uint32_t)bytes[3] << 24);
+}
+
+static int write_all(int fd, const void* data, size_t size) {
+    size_t total = 0;
+    while (total < size) {
+        ssize_t sent = send(fd, (const uint8_t*)data + total, size - total, MSG_NOSIGNAL);
+        if (sent > 0) {
+            total += (size_t)sent;
+        } else if (sent < 0 && errno == EINTR) {
+            continue;
+        } else {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+static int read_all(int fd, void* data, size_t size) {
+    size_t total = 0;
+    while (total < size) {
+        ssize_t received = recv(fd, (uint8_t*)data + total, size - total, 0);
+        if (received > 0) {
+            total += (size_t)received;
+        } else if (received < 0 && errno == EINTR) {
+            continue;
+        } else {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+static int send_frame(int fd, uint8_t opcode, uint16_t flags, const void* payload, size_t payload_size) {
+    uint8_t header[FRAME_HEADER_SIZE];
+    put_u32(header, (uint32_t)(FRAME_HEADER_SIZE - FRAME_LENGTH_SIZE + payload_size));
+    put_u32(header + 4, opcode);
+    header[8] = opcode;
+    header[9] = 0;
+    put_u16(header + 10, flags);
+
+    if (write_all(fd, header, sizeof(header)) != 0) {
+        return -1;
+    }
+    return payload_size > 0 ? write_all(fd, payload, payload_size) : 0;
+}
+
+// Reads a response into body, which has room for body_size bytes, and
+// takes any descriptor passed with it. Returns the response status, or -1.
+static int read_response(int fd, uint8_t* body, size_t body_size, int* passed_fd) {
+    uint8_t header[FRAME_HEADER_SIZE];
+    union {
+        struct cmsghdr header;
+        char space[CMSG_SPACE(sizeof(int))];
+    } control;
+
+    struct iovec iov = { .iov_base = header, .iov_len = sizeof(header) };
+    struct msghdr message = {0};
+    message.msg_iov = &iov;
+    message.msg_iovlen = 1;
+    message.msg_control = control.space;
+    message.msg_controllen = sizeof(control.space);
+
+    ssize_t received = recvmsg(fd, &message, MSG_WAITALL | MSG_CMSG_CLOEXEC);
+    if (received != (ssize_t)sizeof(header)) {
+        return -1;
+    }
+
+    struct cmsghdr* rights = CMSG_FIRSTHDR(&message);
+    if (passed_fd && rights && rights->cmsg_level == SOL_SOCKET && rights->cmsg_type == SCM_RIGHTS) {
+        memcpy(passed_fd, CMSG_DATA(rights), sizeof(int));
+    }
+
+    size_t length = get_u32(header);
+    if (length < FRAME_HEADER_SIZE - FRAME_LENGTH_SIZE) {
+        return -1;
+    }
+
+    size_t size = length - (FRAME_HEADER_SIZE - FRAME_LENGTH_SIZE);
+    size_t kept = size < body_size ? size : body_size;
+    if (kept > 0 && read_all(fd, body, kept) != 0) {
+        return -1;
+    }
+    size -= kept;
+
+    // Error messages and anything else the caller has no room for.
+    uint8_t discard[256];
+    while (size > 0) {
+        size_t step = size < sizeof(discard) ? size : sizeof(discard);
+        if (read_all(fd, discard, step) != 0) {
+            return -1;
+        }
+        size -= step;
+    }
+    return header[9];
+}
+
+static int add_name(uint8_t* payload, size_t offset, const char* name) {
+    size_t size = strlen(name);
+    put_u16(payload + offset, (uint16_t)size);
+    memcpy(payload + offset + 2, name, size);
+    return (int)(offset + 2 + size);
+}
+
+static int subscribe(ShmConsumer* consumer, const char* topic, const char* group, size_t capacity) {
+    int fd = consumer->control_fd;
+    uint8_t hello[BINARY_HELLO_SIZE] = {0};
+    memcpy(hello, BINARY_PROTOCOL_MAGIC, BINARY_PROTOCOL_MAGIC_SIZE);
+    hello[BINARY_PROTOCOL_MAGIC_SIZE] = BINARY_PROTOCOL_VERSION;
+    if (write_all(fd, hello, sizeof(hello)) != 0 || read_all(fd, hello, sizeof(hello)) != 0 ||
+        hello[BINARY_PROTOCOL_MAGIC_SIZE] != BINARY_PROTOCOL_VERSION) {
+        fprintf(stderr, "Broker does not speak the binary protocol\n");
+        return -1;
+    }
+
+    uint8_t names[2 * (MAX_NAME_SIZE + 2)];
+    int size = add_name(names, add_name(names, 0, topic), group);
+    if (send_frame(fd, OP_SUBSCRIBE, 0, names, (size_t)size) != 0 || read_response(fd, NULL, 0, NULL) != STATUS_OK) {
+        fprintf(stderr, "Could not subscribe to %s\n", topic);
+        return -1;
+    }
+
+    uint8_t request[4];
+    put_u32(request, capacity > UINT32_MAX ? UINT32_MAX : (uint32_t)capacity);
+    int ring_fd = -1;
+    uint8_t response[SHM_SUBSCRIBE_RESPONSE_SIZE];
+    if (send_frame(fd, OP_SHM_SUBSCRIBE, 0, request, sizeof(request)) != 0 ||
+        read_response(fd, response, sizeof(response), &ring_fd) != STATUS_OK || ring_fd < 0) {
+        fprintf(stderr, "Broker did not hand over a ring\n");
+        if (ring_fd >= 0) {
+            close(ring_fd);
+        }
+        return -1;
+    }
+    return shm_ring_attach(&consumer->ring, ring_fd);
+}
+
+ShmConsumer* shm_consumer_open(const char* socket_path, const char* topic, const char* group, size_t capacity) {
+    struct sockaddr_un address;
+    if (!socket_path || !topic || !group || !*group || strlen(socket_path) >= sizeof(address.sun_path) ||
+        strlen(topic) > MAX_NAME_SIZE || strlen(group) > MAX_NAME_SIZE) {
+        return NULL;
+    }
+
+    ShmConsumer* consumer = (ShmConsumer*)calloc(1, sizeof(ShmConsumer));
+    if (!consumer) {
+        return NULL;
+    }
+    consumer->ring.fd = -1;
+    // Spinning on a single CPU only keeps the broker from running.
+    consumer->spin_count = sysconf(_SC_NPROCESSORS_ONLN) > 1 ? SHM_CONSUMER_DEFAULT_SPIN : 0;
+
+    consumer->control_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (consumer->control_fd < 0) {
+        perror("Socket creation failed");
+        free(consumer);
+        return NULL;
+    }
+
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    memcpy(address.sun_path, socket_path, strlen(socket_path) + 1);
+    if (connect(consumer->control_fd, (struct sockaddr*)&address, sizeof(address)) != 0) {
+        perror("Failed to connect to broker");
+        shm_consumer_close(consumer);
+        return NULL;
+    }
+
+    if (subscribe(consumer, topic, group, capacity) != 0) {
+        shm_consumer_close(consumer);
+        return NULL;
+    }
+    return consumer;
+}
+
+// The broker stopped on a full ring and is waiting to hear it can go on;
+// an empty ping that wants no reply is enough to run it again.
+static int notify_broker(ShmConsumer* consumer) {
+    if (!shm_ring_writer_waiting(&consumer->ring)) {
+        return 0;
+    }
+    return send_frame(consumer->control_fd, OP_PING, FRAME_FLAG_NO_REPLY, NULL, 0);
+}
+
+int shm_consumer_poll(ShmConsumer* consumer, ShmRecord* record, int timeout_ms) {
+    if (!consumer || !record) {
+        return -1;
+    }
+
+    for (;;) {
+        int result = shm_ring_peek(&consumer->ring, record);
+        if (result != 0) {
+            return result;
+        }
+        // Skipping filler at the end of the data frees space too.
+        if (notify_broker(consumer) != 0) {
+            return -1;
+        }
+        if (!shm_ring_wait(&consumer->ring, consumer->spin_count, timeout_ms) && timeout_ms >= 0) {
+            return 0;
+        }
+    }
+}
+
+int shm_consumer_release(ShmConsumer* consumer) {
+    if (!consumer) {
+        return -1;
+    }
+
+    shm_ring_release(&consumer->ring);
+    return notify_broker(consumer);
+}
+
+void shm_consumer_ack(ShmConsumer* consumer, const ShmRecord* record) {
+    if (consumer) {
+        shm_ring_ack(&consumer->ring, record);
+    }
+}
+
+uint32_t shm_consumer_close_reason(const ShmConsumer* consumer) {
+    if (!consumer || !consumer->ring.header) {
+        return SHM_RING_CLOSED;
+    }
+    return __atomic_load_n(&consumer->ring.header->closed, __ATOMIC_ACQUIRE);
+}
+
+void shm_consumer_close(ShmConsumer* consumer) {
+    if (!consumer) {
+        return;
+    }
+
+    shm_ring_unmap(&consumer->ring);
+    if (consumer->control_fd >= 0) {
+        close(consumer->control_fd);
+    }
+    free(consumer);
+}
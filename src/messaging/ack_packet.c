@@ -1,5 +1,7 @@
 #include "headers/ack_packet.h"
-#include "../writer/headers/read_write_data.h"
+#include "headers/publish_event.h"
+#include "headers/record_format.h"
+#include "../writer/headers/block_cache.h"
 #include <stdlib.h>
 #include <string.h>
 
@@ -14,18 +16,14 @@ int ack_packet(Group* group, Packet* packet) {
         return -1;
     }
 
-    Chunk* chunk = (Chunk*)group->attached_topic->chunk_handle;
-    if (!chunk) {
-        return -1;
-    }
-
-    if (chunk_load(chunk) != 0) {
+    size_t topic_size = get_topic_size(group->attached_topic);
+    if (topic_size == 0) {
         return -1;
     }
 
     size_t total_packet_size = PACKET_SIZE_HEADER_SIZE + packet->packet_size;
     
-    if (packet->offset_in_topic + total_packet_size > chunk->size) {
+    if (packet->offset_in_topic + total_packet_size > topic_size) {
         return -1;
     }
 
@@ -45,16 +43,12 @@ int ack_packet_by_size(Group* group, Topic* topic, size_t packet_size) {
         return -1;
     }
 
-    Chunk* chunk = (Chunk*)topic->chunk_handle;
-    if (!chunk) {
+    size_t topic_size = get_topic_size(topic);
+    if (topic_size == 0) {
         return -1;
     }
 
-    if (chunk_load(chunk) != 0) {
-        return -1;
-    }
-
-    if (group->read_pointer + PACKET_SIZE_HEADER_SIZE + packet_size > chunk->size) {
+    if (group->read_pointer + PACKET_SIZE_HEADER_SIZE + packet_size > topic_size) {
         return -1;
     }
 
@@ -73,18 +67,14 @@ int ack_packet_by_offset(Group* group, Topic* topic, size_t offset, size_t packe
         return -1;
     }
 
-    Chunk* chunk = (Chunk*)topic->chunk_handle;
-    if (!chunk) {
-        return -1;
-    }
-
-    if (chunk_load(chunk) != 0) {
+    size_t topic_size = get_topic_size(topic);
+    if (topic_size == 0) {
         return -1;
     }
 
     size_t total_packet_size = PACKET_SIZE_HEADER_SIZE + packet_size;
     
-    if (offset + total_packet_size > chunk->size) {
+    if (offset + total_packet_size > topic_size) {
         return -1;
     }
 
@@ -104,33 +94,31 @@ int ack_packet_batch(Group* group, Topic* topic, size_t count) {
         return -1;
     }
 
-    Chunk* chunk = (Chunk*)topic->chunk_handle;
-    if (!chunk) {
+    BlockCacheFile* log = block_cache_open(topic->file_path);
+    if (!log) {
         return -1;
     }
 
-    if (chunk_load(chunk) != 0) {
-        return -1;
-    }
+    size_t topic_size = block_cache_file_size(log);
 
     size_t current_offset = group->read_pointer;
     size_t packets_acked = 0;
 
     for (size_t i = 0; i < count; i++) {
-        if (current_offset + PACKET_SIZE_HEADER_SIZE > chunk->size) {
+        if (current_offset + PACKET_SIZE_HEADER_SIZE > topic_size) {
             break;
         }
 
-        uint32_t packet_size;
-        long bytes_read = chunk_read(chunk, &packet_size, PACKET_SIZE_HEADER_SIZE, current_offset);
+        uint32_t header;
+        long bytes_read = block_cache_read(log, &header, PACKET_SIZE_HEADER_SIZE, current_offset);
         
         if (bytes_read != PACKET_SIZE_HEADER_SIZE) {
             break;
         }
 
-        size_t total_packet_size = PACKET_SIZE_HEADER_SIZE + packet_size;
+        size_t total_packet_size = PACKET_SIZE_HEADER_SIZE + RECORD_HEADER_PAYLOAD_SIZE(header);
         
-        if (current_offset + total_packet_size > chunk->size) {
+        if (current_offset + total_packet_size > topic_size) {
             break;
         }
 
@@ -156,12 +144,8 @@ int ack_packet_batch_by_size(Group* group, Topic* topic, size_t* packet_sizes, s
         return -1;
     }
 
-    Chunk* chunk = (Chunk*)topic->chunk_handle;
-    if (!chunk) {
-        return -1;
-    }
-
-    if (chunk_load(chunk) != 0) {
+    size_t topic_size = get_topic_size(topic);
+    if (topic_size == 0) {
         return -1;
     }
 
@@ -174,7 +158,7 @@ int ack_packet_batch_by_size(Group* group, Topic* topic, size_t* packet_sizes, s
         total_bytes += PACKET_SIZE_HEADER_SIZE + packet_sizes[i];
     }
 
-    if (group->read_pointer + total_bytes > chunk->size) {
+    if (group->read_pointer + total_bytes > topic_size) {
         return -1;
     }
 
@@ -0,0 +1,302 @@
+#include "headers/codec.h"
+#include "headers/encoder.h"
+#include "headers/dictionary_registry.h"
+#include "headers/columnar_codec.h"
+#include "headers/record_format.h"
+#include "../utils/header/path_registry.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <lz4.h>
+#include <zstd.h>
+
+// The codec a topic stores new records with is chosen when the topic is
+// created and persisted in "<topic>.codec" by name. Every record carries its
+// own codec in the header, so changing it never affects existing records.
+//
+// LZ4 blocks do not record their decoded size, so the lz4 codec prefixes the
+// block with it as a u32. Columnar records only decode against the shapes of
+// the topic they were written to.
+#define TOPIC_CODEC_EXTENSION ".codec"
+#define LZ4_SIZE_PREFIX 4
+
+static PathRegistry g_topic_codecs = PATH_REGISTRY_INITIALIZER(TopicCodec, topic_file_path);
+
+static size_t none_bound(size_t data_size) {
+    return data_size;
+}
+
+static int none_encode(const char* topic_file_path, const void* data, size_t data_size,
+                       uint8_t* encoded, size_t encoded_capacity, size_t* encoded_size, int level) {
+    (void)topic_file_path;
+    (void)level;
+    if (!data || !encoded || !encoded_size || data_size > encoded_capacity) {
+        return -1;
+    }
+    memcpy(encoded, data, data_size);
+    *encoded_size = data_size;
+    return 0;
+}
+
+static int none_decoded_size(const uint8_t* encoded, size_t encoded_size, size_t* decoded_size) {
+    (void)encoded;
+    if (!decoded_size) {
+        return -1;
+    }
+    *decoded_size = encoded_size;
+    return 0;
+}
+
+static int none_decode(const char* topic_file_path, const uint8_t* encoded, size_t encoded_size,
+                       uint8_t* decoded, size_t decoded_capacity, size_t* decoded_size) {
+    return none_encode(topic_file_path, encoded, encoded_size, decoded, decoded_capacity, decoded_size, 0);
+}
+
+static size_t zstd_bound(size_t data_size) {
+    return encode_bound(data_size);
+}
+
+static int zstd_encode(const char* topic_file_path, const void* data, size_t data_size,
+                       uint8_t* encoded, size_t encoded_capacity, size_t* encoded_size, int level) {
+    if (!topic_file_path) {
+        return encode_string_into((const char*)data, data_size, encoded, encoded_capacity, encoded_size, level);
+    }
+    return dictionaries_encode(dictionaries_for_topic(topic_file_path), (const char*)data, data_size,
+                               encoded, encoded_capacity, encoded_size, level);
+}
+
+static int zstd_decoded_size(const uint8_t* encoded, size_t encoded_size, size_t* decoded_size) {
+    return encoded_content_size(encoded, encoded_size, decoded_size);
+}
+
+static int zstd_decode(const char* topic_file_path, const uint8_t* encoded, size_t encoded_size,
+                       uint8_t* decoded, size_t decoded_capacity, size_t* decoded_size) {
+    if (!topic_file_path) {
+        return decode_string_into(encoded, encoded_size, (char*)decoded, decoded_capacity, decoded_size);
+    }
+    return dictionaries_decode(dictionaries_for_topic(topic_file_path), encoded, encoded_size,
+                               (char*)decoded, decoded_capacity, decoded_size);
+}
+
+static size_t lz4_bound(size_t data_size) {
+    if (data_size > LZ4_MAX_INPUT_SIZE) {
+        return 0;
+    }
+    return LZ4_SIZE_PREFIX + (size_t)LZ4_compressBound((int)data_size);
+}
+
+static int lz4_encode(const char* topic_file_path, const void* data, size_t data_size,
+                      uint8_t* encoded, size_t encoded_capacity, size_t* encoded_size, int level) {
+    (void)topic_file_path;
+    if (!data || !encoded || !encoded_size || data_size == 0 || data_size > LZ4_MAX_INPUT_SIZE ||
+        encoded_capacity <= LZ4_SIZE_PREFIX) {
+        return -1;
+    }
+
+    // Non-positive levels map onto LZ4's acceleration, like zstd's fast levels.
+    int acceleration = level < 1 ? 1 - level : 1;
+    size_t available = encoded_capacity - LZ4_SIZE_PREFIX;
+    int written = LZ4_compress_fast((const char*)data, (char*)encoded + LZ4_SIZE_PREFIX, (int)data_size,
+                                    available > (size_t)LZ4_MAX_INPUT_SIZE ? LZ4_MAX_INPUT_SIZE : (int)available,
+                                    acceleration);
+    if (written <= 0) {
+        return -1;
+    }
+
+    uint32_t prefix = (uint32_t)data_size;
+    memcpy(encoded, &prefix, LZ4_SIZE_PREFIX);
+    *encoded_size = LZ4_SIZE_PREFIX + (size_t)written;
+    return 0;
+}
+
+static int lz4_decoded_size(const uint8_t* encoded, size_t encoded_size, size_t* decoded_size) {
+    if (!encoded || !decoded_size || encoded_size <= LZ4_SIZE_PREFIX) {
+        return -1;
+    }
+
+    uint32_t prefix = 0;
+    memcpy(&prefix, encoded, LZ4_SIZE_PREFIX);
+    *decoded_size = prefix;
+    return 0;
+}
+
+static int lz4_decode(const char* topic_file_path, const uint8_t* encoded, size_t encoded_size,
+                      uint8_t* decoded, size_t decoded_capacity, size_t* decoded_size) {
+    (void)topic_file_path;
+    size_t expected = 0;
+    if (!decoded || lz4_decoded_size(encoded, encoded_size, &expected) != 0 || expected > decoded_capacity ||
+        encoded_size - LZ4_SIZE_PREFIX > (size_t)LZ4_MAX_INPUT_SIZE) {
+        return -1;
+    }
+
+    int read = LZ4_decompress_safe((const char*)encoded + LZ4_SIZE_PREFIX, (char*)decoded,
+                                   (int)(encoded_size - LZ4_SIZE_PREFIX), (int)expected);
+    if (read < 0 || (size_t)read != expected) {
+        return -1;
+    }
+
+    *decoded_size = expected;
+    return 0;
+}
+
+static int columnar_codec_encode(const char* topic_file_path, const void* data, size_t data_size,
+                                 uint8_t* encoded, size_t encoded_capacity, size_t* encoded_size, int level) {
+    (void)level;
+    return columnar_encode(shapes_for_topic(topic_file_path), (const uint8_t*)data, data_size,
+                           encoded, encoded_capacity, encoded_size);
+}
+
+static int columnar_codec_decode(const char* topic_file_path, const uint8_t* encoded, size_t encoded_size,
+                                 uint8_t* decoded, size_t decoded_capacity, size_t* decoded_size) {
+    return columnar_decode(shapes_for_topic(topic_file_path), encoded, encoded_size,
+                           decoded, decoded_capacity, decoded_size);
+}
+
+static const Codec g_codecs[] = {
+    { RECORD_CODEC_NONE, "none", none_bound, none_encode, none_decoded_size, none_decode },
+    { RECORD_CODEC_ZSTD, "zstd", zstd_bound, zstd_encode, zstd_decoded_size, zstd_decode },
+    { RECORD_CODEC_LZ4, "lz4", lz4_bound, lz4_encode, lz4_decoded_size, lz4_decode },
+    { RECORD_CODEC_COLUMNAR, "columnar", columnar_bound, columnar_codec_encode, columnar_decoded_size,
+      columnar_codec_decode },
+};
+
+#define CODEC_COUNT (sizeof(g_codecs) / sizeof(g_codecs[0]))
+
+const Codec* codec_by_id(uint8_t id) {
+    for (size_t i = 0; i < CODEC_COUNT; i++) {
+        if (g_codecs[i].id == id) {
+            return &g_codecs[i];
+        }
+    }
+    return NULL;
+}
+
+const Codec* codec_by_name(const char* name) {
+    if (!name) {
+        return NULL;
+    }
+
+    for (size_t i = 0; i < CODEC_COUNT; i++) {
+        if (strcmp(g_codecs[i].name, name) == 0) {
+            return &g_codecs[i];
+        }
+    }
+    return NULL;
+}
+
+static void build_codec_path(char* buffer, size_t buffer_size, const char* topic_file_path) {
+    snprintf(buffer, buffer_size, "%s%s", topic_file_path, TOPIC_CODEC_EXTENSION);
+}
+
+// Written aside and renamed over, so a crash never leaves a torn file that
+// would read back as NONE.
+static int write_topic_codec(const char* topic_file_path, const Codec* codec) {
+    char codec_path[512];
+    char tmp_path[520];
+    build_codec_path(codec_path, sizeof(codec_path), topic_file_path);
+    snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", codec_path);
+
+    FILE* file = fopen(tmp_path, "w");
+    if (!file) {
+        return -1;
+    }
+
+    int result = fprintf(file, "%s\n", codec->name) < 0 ? -1 : 0;
+    if (fclose(file) != 0) {
+        result = -1;
+    }
+
+    if (result != 0 || rename(tmp_path, codec_path) != 0) {
+        remove(tmp_path);
+        return -1;
+    }
+    return 0;
+}
+
+static uint8_t read_topic_codec(const char* topic_file_path) {
+    char codec_path[512];
+    build_codec_path(codec_path, sizeof(codec_path), topic_file_path);
+
+    FILE* file = fopen(codec_path, "r");
+    if (!file) {
+        return RECORD_CODEC_NONE;
+    }
+
+    char name[32];
+    const Codec* codec = NULL;
+    if (fscanf(file, "%31s", name) == 1) {
+        codec = codec_by_name(name);
+    }
+    fclose(file);
+
+    return codec ? codec->id : RECORD_CODEC_NONE;
+}
+
+static void* create_topic_codec(const char* topic_file_path, void* context) {
+    (void)context;
+    TopicCodec* entry = (TopicCodec*)malloc(sizeof(TopicCodec));
+    if (!entry) {
+        return NULL;
+    }
+
+    entry->topic_file_path = strdup(topic_file_path);
+    if (!entry->topic_file_path) {
+        free(entry);
+        return NULL;
+    }
+
+    entry->codec = read_topic_codec(topic_file_path);
+    return entry;
+}
+
+static TopicCodec* register_topic(const char* topic_file_path) {
+    return (TopicCodec*)path_registry_get(&g_topic_codecs, topic_file_path, create_topic_codec, NULL);
+}
+
+int topic_codec_set(const char* topic_file_path, uint8_t codec) {
+    const Codec* selected = codec_by_id(codec);
+    if (!topic_file_path || !selected) {
+        return -1;
+    }
+
+    TopicCodec* entry = register_topic(topic_file_path);
+    if (!entry) {
+        return -1;
+    }
+
+    pthread_mutex_lock(&g_topic_codecs.mutex);
+    int result = write_topic_codec(topic_file_path, selected);
+    if (result == 0) {
+        __atomic_store_n(&entry->codec, codec, __ATOMIC_RELAXED);
+    }
+    pthread_mutex_unlock(&g_topic_codecs.mutex);
+
+    return result;
+}
+
+int codec_record_portable(uint8_t codec, const uint8_t* encoded, size_t encoded_size) {
+    if (codec != RECORD_CODEC_ZSTD) {
+        return 1;
+    }
+    return encoded && ZSTD_getDictID_fromFrame(encoded, encoded_size) == 0;
+}
+
+uint8_t topic_codec(const char* topic_file_path) {
+    if (!topic_file_path) {
+        return RECORD_CODEC_NONE;
+    }
+
+    TopicCodec* entry = register_topic(topic_file_path);
+    return entry ? __atomic_load_n(&entry->codec, __ATOMIC_RELAXED) : RECORD_CODEC_NONE;
+}
+
+void topic_codecs_free(void) {
+    TopicCodec* entry = (TopicCodec*)path_registry_take_all(&g_topic_codecs);
+    while (entry) {
+        TopicCodec* next = entry->next;
+        free(entry->topic_file_path);
+        free(entry);
+        entry = next;
+    }
+}
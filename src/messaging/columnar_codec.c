@@ -0,0 +1,873 @@
+#include "headers/columnar_codec.h"
+#include "../utils/header/path_registry.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+// Most topics carry flat JSON objects with the same keys in the same order.
+// The columnar codec learns those shapes per topic and stores each record as
+//
+//   [varint shape id][varint JSON size][one value per column]
+//
+// so keys, quotes, colons and commas are not stored at all. Integer columns
+// hold zigzag varints; string columns hold a varint that is either an index
+// + 1 into the column's value dictionary or 0 followed by a length-prefixed
+// literal; anything else (floats, booleans, nested values) is kept as
+// length-prefixed JSON text. Shape id 0 means the rest is the record
+// verbatim, which is how records that are not a flat object are stored.
+//
+// Values are split exactly as they appear, so the JSON rebuilt on decode is
+// byte-identical to what was published.
+//
+// Shapes and dictionary values are appended to "<topic>.shapes" before the
+// first record using them is written, and are never removed or changed, so
+// readers only need the published counts. A string is added to its column's
+// dictionary the second time it is seen among the column's recent literals;
+// learning is skipped when another publish holds the topic's lock.
+#define SHAPES_FILE_EXTENSION ".shapes"
+#define SHAPE_ENTRY 'S'
+#define VALUE_ENTRY 'V'
+#define VERBATIM_SHAPE_ID 0
+#define MAX_VARINT_SIZE 10
+#define MAX_INT_DIGITS 18
+#define MAX_SHAPE_KEY_SIZE 1024
+
+typedef struct {
+    const uint8_t* key;
+    size_t key_size;
+    const uint8_t* value;
+    size_t value_size;
+    uint8_t kind;
+    int64_t number;
+} ParsedField;
+
+typedef struct {
+    uint8_t type;
+    const uint8_t* text;
+    size_t text_size;
+    int64_t number;
+} ColumnValue;
+
+static PathRegistry g_shapes = PATH_REGISTRY_INITIALIZER(TopicShapes, topic_file_path);
+
+static size_t put_varint(uint8_t* out, uint64_t value) {
+    size_t size = 0;
+    while (value >= 0x80) {
+        out[size++] = (uint8_t)(value | 0x80);
+        value >>= 7;
+    }
+    out[size++] = (uint8_t)value;
+    return size;
+}
+
+static int get_varint(const uint8_t** cursor, const uint8_t* end, uint64_t* value) {
+    uint64_t result = 0;
+    for (unsigned shift = 0; shift < 64 && *cursor < end; shift += 7) {
+        uint8_t byte = *(*cursor)++;
+        result |= (uint64_t)(byte & 0x7F) << shift;
+        if (!(byte & 0x80)) {
+            *value = result;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+static uint64_t zigzag_encode(int64_t value) {
+    return ((uint64_t)value << 1) ^ (uint64_t)(value >> 63);
+}
+
+static int64_t zigzag_decode(uint64_t value) {
+    return (int64_t)(value >> 1) ^ -(int64_t)(value & 1);
+}
+
+// Returns the closing quote of a string whose opening quote precedes p.
+static const uint8_t* skip_string(const uint8_t* p, const uint8_t* end) {
+    while (p < end && *p != '"') {
+        p += (*p == '\\') ? 2 : 1;
+    }
+    return p < end ? p : NULL;
+}
+
+// Returns the ',' or '}' that ends a top-level value.
+static const uint8_t* skip_value(const uint8_t* p, const uint8_t* end) {
+    size_t depth = 0;
+    while (p < end) {
+        uint8_t c = *p;
+        if (c == '"') {
+            p = skip_string(p + 1, end);
+            if (!p) {
+                return NULL;
+            }
+        } else if (c == '{' || c == '[') {
+            depth++;
+        } else if (c == '}' || c == ']') {
+            if (depth == 0) {
+                return c == '}' ? p : NULL;
+            }
+            depth--;
+        } else if (c == ',' && depth == 0) {
+            return p;
+        }
+        p++;
+    }
+    return NULL;
+}
+
+// Only integers that print back identically are stored as numbers.
+static int parse_int(const uint8_t* text, size_t text_size, int64_t* number) {
+    size_t i = text_size > 0 && text[0] == '-' ? 1 : 0;
+    size_t digits = text_size - i;
+    if (digits == 0 || digits > MAX_INT_DIGITS || (text[i] == '0' && (digits > 1 || i == 1))) {
+        return -1;
+    }
+
+    int64_t value = 0;
+    for (; i < text_size; i++) {
+        if (text[i] < '0' || text[i] > '9') {
+            return -1;
+        }
+        value = value * 10 + (text[i] - '0');
+    }
+
+    *number = text[0] == '-' ? -value : value;
+    return 0;
+}
+
+static void classify_value(ParsedField* field) {
+    const uint8_t* end = field->value + field->value_size;
+    if (field->value[0] == '"' && field->value_size >= 2 && skip_string(field->value + 1, end) == end - 1) {
+        field->kind = COLUMN_STRING;
+        field->value++;
+        field->value_size -= 2;
+    } else if (parse_int(field->value, field->value_size, &field->number) == 0) {
+        field->kind = COLUMN_INT;
+    } else {
+        field->kind = COLUMN_RAW;
+    }
+}
+
+// Splits a flat object into its fields. Whitespace is only tolerated inside
+// values, where it is kept verbatim.
+static int parse_object(const uint8_t* data, size_t data_size, ParsedField* fields, size_t* field_count) {
+    if (data_size < 2 || data[0] != '{' || data[data_size - 1] != '}' || data[1] == '}') {
+        return -1;
+    }
+
+    const uint8_t* end = data + data_size;
+    const uint8_t* p = data + 1;
+    size_t count = 0;
+
+    for (;;) {
+        if (count == MAX_SHAPE_FIELDS || p >= end || *p != '"') {
+            return -1;
+        }
+
+        const uint8_t* key_end = skip_string(p + 1, end);
+        if (!key_end || key_end + 1 >= end || key_end[1] != ':' || (size_t)(key_end - p - 1) > MAX_SHAPE_KEY_SIZE) {
+            return -1;
+        }
+
+        ParsedField* field = &fields[count++];
+        field->key = p + 1;
+        field->key_size = (size_t)(key_end - p - 1);
+        field->value = key_end + 2;
+
+        const uint8_t* delimiter = skip_value(field->value, end);
+        if (!delimiter || delimiter == field->value) {
+            return -1;
+        }
+        field->value_size = (size_t)(delimiter - field->value);
+        classify_value(field);
+
+        if (*delimiter == '}') {
+            if (delimiter != end - 1) {
+                return -1;
+            }
+            *field_count = count;
+            return 0;
+        }
+        p = delimiter + 1;
+    }
+}
+
+static void build_shapes_path(char* buffer, size_t buffer_size, const char* topic_file_path) {
+    snprintf(buffer, buffer_size, "%s%s", topic_file_path, SHAPES_FILE_EXTENSION);
+}
+
+// Entries are appended whole or not at all, so a failed write never leaves
+// a torn entry in front of later ones.
+static int append_entry(const char* topic_file_path, const uint8_t* entry, size_t entry_size) {
+    char shapes_path[512];
+    build_shapes_path(shapes_path, sizeof(shapes_path), topic_file_path);
+
+    int fd = open(shapes_path, O_WRONLY | O_CREAT | O_APPEND, 0644);
+    if (fd < 0) {
+        return -1;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        close(fd);
+        return -1;
+    }
+
+    size_t written = 0;
+    while (written < entry_size) {
+        ssize_t result = write(fd, entry + written, entry_size - written);
+        if (result <= 0) {
+            if (ftruncate(fd, st.st_size) != 0) {
+                perror("Failed to roll back shapes entry");
+            }
+            close(fd);
+            return -1;
+        }
+        written += (size_t)result;
+    }
+
+    return close(fd) == 0 ? 0 : -1;
+}
+
+static void shape_free(RecordShape* shape) {
+    if (!shape) {
+        return;
+    }
+
+    for (size_t i = 0; i < shape->field_count; i++) {
+        free(shape->columns[i].key);
+        for (unsigned v = 0; v < shape->columns[i].value_count; v++) {
+            free(shape->columns[i].values[v]);
+        }
+    }
+    free(shape);
+}
+
+static RecordShape* shape_create(unsigned id, size_t field_count) {
+    RecordShape* shape = (RecordShape*)calloc(1, sizeof(RecordShape) + field_count * sizeof(ShapeColumn));
+    if (!shape) {
+        return NULL;
+    }
+
+    shape->id = id;
+    shape->field_count = field_count;
+    return shape;
+}
+
+static int column_set_key(ShapeColumn* column, const uint8_t* key, size_t key_size) {
+    column->key = (char*)malloc(key_size + 1);
+    if (!column->key) {
+        return -1;
+    }
+    memcpy(column->key, key, key_size);
+    column->key[key_size] = '\0';
+    column->key_size = key_size;
+    return 0;
+}
+
+static int column_add_value(ShapeColumn* column, const uint8_t* value, size_t value_size) {
+    if (column->value_count >= MAX_COLUMN_VALUES || value_size > MAX_COLUMN_VALUE_SIZE) {
+        return -1;
+    }
+
+    char* copy = (char*)malloc(value_size ? value_size : 1);
+    if (!copy) {
+        return -1;
+    }
+    memcpy(copy, value, value_size);
+
+    unsigned index = column->value_count;
+    column->values[index] = copy;
+    column->value_sizes[index] = (uint8_t)value_size;
+    __atomic_store_n(&column->value_count, index + 1, __ATOMIC_RELEASE);
+    return 0;
+}
+
+static void load_shapes(TopicShapes* shapes) {
+    char shapes_path[512];
+    build_shapes_path(shapes_path, sizeof(shapes_path), shapes->topic_file_path);
+
+    FILE* file = fopen(shapes_path, "rb");
+    if (!file) {
+        return;
+    }
+
+    // Anything after the first entry that does not parse is ignored.
+    int kind;
+    while ((kind = fgetc(file)) != EOF) {
+        if (kind == SHAPE_ENTRY) {
+            int field_count = fgetc(file);
+            if (field_count <= 0 || field_count > MAX_SHAPE_FIELDS || shapes->shape_count >= MAX_TOPIC_SHAPES) {
+                break;
+            }
+
+            RecordShape* shape = shape_create(shapes->shape_count + 1, (size_t)field_count);
+            if (!shape) {
+                break;
+            }
+
+            int valid = 1;
+            for (int i = 0; i < field_count && valid; i++) {
+                uint8_t field_header[3];
+                uint8_t key[MAX_SHAPE_KEY_SIZE];
+                valid = fread(field_header, 1, sizeof(field_header), file) == sizeof(field_header);
+                size_t key_size = valid ? (size_t)field_header[1] | ((size_t)field_header[2] << 8) : 0;
+                valid = valid && key_size <= MAX_SHAPE_KEY_SIZE && field_header[0] >= COLUMN_INT && field_header[0] <= COLUMN_RAW &&
+                        fread(key, 1, key_size, file) == key_size &&
+                        column_set_key(&shape->columns[i], key, key_size) == 0;
+                shape->columns[i].type = field_header[0];
+            }
+
+            if (!valid) {
+                shape_free(shape);
+                break;
+            }
+            shapes->shapes[shapes->shape_count++] = shape;
+        } else if (kind == VALUE_ENTRY) {
+            uint8_t value_header[3];
+            uint8_t value[MAX_COLUMN_VALUE_SIZE];
+            if (fread(value_header, 1, sizeof(value_header), file) != sizeof(value_header) ||
+                value_header[0] >= shapes->shape_count ||
+                value_header[1] >= shapes->shapes[value_header[0]]->field_count ||
+                value_header[2] > MAX_COLUMN_VALUE_SIZE ||
+                fread(value, 1, value_header[2], file) != value_header[2]) {
+                break;
+            }
+
+            ShapeColumn* column = &shapes->shapes[value_header[0]]->columns[value_header[1]];
+            if (column->type != COLUMN_STRING || column_add_value(column, value, value_header[2]) != 0) {
+                break;
+            }
+        } else {
+            break;
+        }
+    }
+
+    fclose(file);
+}
+
+static void* create_shapes(const char* topic_file_path, void* context) {
+    (void)context;
+    TopicShapes* shapes = (TopicShapes*)calloc(1, sizeof(TopicShapes));
+    if (!shapes) {
+        return NULL;
+    }
+
+    shapes->topic_file_path = strdup(topic_file_path);
+    if (!shapes->topic_file_path) {
+        free(shapes);
+        return NULL;
+    }
+
+    pthread_mutex_init(&shapes->mutex, NULL);
+    load_shapes(shapes);
+    return shapes;
+}
+
+TopicShapes* shapes_for_topic(const char* topic_file_path) {
+    return (TopicShapes*)path_registry_get(&g_shapes, topic_file_path, create_shapes, NULL);
+}
+
+static RecordShape* shape_at(TopicShapes* shapes, uint64_t id) {
+    unsigned count = __atomic_load_n(&shapes->shape_count, __ATOMIC_ACQUIRE);
+    return id >= 1 && id <= count ? shapes->shapes[id - 1] : NULL;
+}
+
+static int keys_match(const RecordShape* shape, const ParsedField* fields, size_t field_count) {
+    if (shape->field_count != field_count) {
+        return 0;
+    }
+
+    for (size_t i = 0; i < field_count; i++) {
+        if (shape->columns[i].key_size != fields[i].key_size ||
+            memcmp(shape->columns[i].key, fields[i].key, fields[i].key_size) != 0) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+static int types_match(const RecordShape* shape, const ParsedField* fields) {
+    for (size_t i = 0; i < shape->field_count; i++) {
+        if (shape->columns[i].type != COLUMN_RAW && shape->columns[i].type != fields[i].kind) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+// Sets *same_keys to the last shape with the record's keys, whether or not
+// its column types fit.
+static RecordShape* find_shape(TopicShapes* shapes, const ParsedField* fields, size_t field_count,
+                               RecordShape** same_keys) {
+    unsigned count = __atomic_load_n(&shapes->shape_count, __ATOMIC_ACQUIRE);
+    *same_keys = NULL;
+
+    for (unsigned i = 0; i < count; i++) {
+        RecordShape* shape = shapes->shapes[i];
+        if (!keys_match(shape, fields, field_count)) {
+            continue;
+        }
+        if (types_match(shape, fields)) {
+            return shape;
+        }
+        *same_keys = shape;
+    }
+    return NULL;
+}
+
+// A record whose keys are known but whose values do not fit gets a shape
+// where the conflicting columns are widened to JSON text.
+static RecordShape* register_shape(TopicShapes* shapes, const ParsedField* fields, size_t field_count) {
+    pthread_mutex_lock(&shapes->mutex);
+
+    RecordShape* same_keys = NULL;
+    RecordShape* shape = find_shape(shapes, fields, field_count, &same_keys);
+    if (shape || shapes->shape_count >= MAX_TOPIC_SHAPES) {
+        pthread_mutex_unlock(&shapes->mutex);
+        return shape;
+    }
+
+    shape = shape_create(shapes->shape_count + 1, field_count);
+    size_t entry_size = 2;
+    for (size_t i = 0; i < field_count; i++) {
+        entry_size += 3 + fields[i].key_size;
+    }
+    uint8_t* entry = (uint8_t*)malloc(entry_size);
+
+    int result = shape && entry ? 0 : -1;
+    if (result == 0) {
+        size_t pos = 0;
+        entry[pos++] = SHAPE_ENTRY;
+        entry[pos++] = (uint8_t)field_count;
+
+        for (size_t i = 0; i < field_count && result == 0; i++) {
+            ShapeColumn* column = &shape->columns[i];
+            column->type = fields[i].kind;
+            if (same_keys && same_keys->columns[i].type != fields[i].kind) {
+                column->type = COLUMN_RAW;
+            }
+
+            entry[pos++] = column->type;
+            entry[pos++] = (uint8_t)(fields[i].key_size & 0xFF);
+            entry[pos++] = (uint8_t)(fields[i].key_size >> 8);
+            memcpy(entry + pos, fields[i].key, fields[i].key_size);
+            pos += fields[i].key_size;
+
+            result = column_set_key(column, fields[i].key, fields[i].key_size);
+        }
+    }
+
+    if (result == 0) {
+        result = append_entry(shapes->topic_file_path, entry, entry_size);
+    }
+
+    if (result == 0) {
+        shapes->shapes[shapes->shape_count] = shape;
+        __atomic_store_n(&shapes->shape_count, shapes->shape_count + 1, __ATOMIC_RELEASE);
+    } else {
+        shape_free(shape);
+        shape = NULL;
+    }
+
+    free(entry);
+    pthread_mutex_unlock(&shapes->mutex);
+    return shape;
+}
+
+static int find_value(const ShapeColumn* column, unsigned from, const uint8_t* value, size_t value_size) {
+    unsigned count = __atomic_load_n(&column->value_count, __ATOMIC_ACQUIRE);
+    for (unsigned i = from; i < count; i++) {
+        if (column->value_sizes[i] == value_size && memcmp(column->values[i], value, value_size) == 0) {
+            return (int)i;
+        }
+    }
+    return -1;
+}
+
+// Returns the dictionary index for a string that just became frequent, or
+// -1 to store it as a literal.
+static int learn_value(TopicShapes* shapes, RecordShape* shape, size_t column_index,
+                       const uint8_t* value, size_t value_size) {
+    ShapeColumn* column = &shape->columns[column_index];
+    if (value_size > MAX_COLUMN_VALUE_SIZE ||
+        __atomic_load_n(&column->value_count, __ATOMIC_ACQUIRE) >= MAX_COLUMN_VALUES ||
+        pthread_mutex_trylock(&shapes->mutex) != 0) {
+        return -1;
+    }
+
+    int index = find_value(column, 0, value, value_size);
+    if (index >= 0) {
+        pthread_mutex_unlock(&shapes->mutex);
+        return index;
+    }
+
+    int seen = 0;
+    for (unsigned i = 0; i < COLUMN_CANDIDATES && !seen; i++) {
+        seen = column->candidate_sizes[i] == value_size && value_size > 0 &&
+               memcmp(column->candidates[i], value, value_size) == 0;
+    }
+
+    if (!seen) {
+        unsigned slot = column->next_candidate++ % COLUMN_CANDIDATES;
+        memcpy(column->candidates[slot], value, value_size);
+        column->candidate_sizes[slot] = (uint8_t)value_size;
+        pthread_mutex_unlock(&shapes->mutex);
+        return -1;
+    }
+
+    uint8_t entry[4 + MAX_COLUMN_VALUE_SIZE];
+    entry[0] = VALUE_ENTRY;
+    entry[1] = (uint8_t)(shape->id - 1);
+    entry[2] = (uint8_t)column_index;
+    entry[3] = (uint8_t)value_size;
+    memcpy(entry + 4, value, value_size);
+
+    index = -1;
+    if (append_entry(shapes->topic_file_path, entry, 4 + value_size) == 0 &&
+        column_add_value(column, value, value_size) == 0) {
+        index = (int)column->value_count - 1;
+    }
+
+    pthread_mutex_unlock(&shapes->mutex);
+    return index;
+}
+
+size_t columnar_bound(size_t data_size) {
+    return data_size + 2 * MAX_VARINT_SIZE;
+}
+
+static int encode_verbatim(const uint8_t* data, size_t data_size,
+                           uint8_t* encoded, size_t encoded_capacity, size_t* encoded_size) {
+    if (data_size + 1 > encoded_capacity) {
+        return -1;
+    }
+
+    encoded[0] = VERBATIM_SHAPE_ID;
+    memcpy(encoded + 1, data, data_size);
+    *encoded_size = data_size + 1;
+    return 0;
+}
+
+int columnar_encode(TopicShapes* shapes, const uint8_t* data, size_t data_size,
+                    uint8_t* encoded, size_t encoded_capacity, size_t* encoded_size) {
+    if (!data || data_size == 0 || !encoded || !encoded_size) {
+        return -1;
+    }
+
+    ParsedField fields[MAX_SHAPE_FIELDS];
+    size_t field_count = 0;
+    if (!shapes || parse_object(data, data_size, fields, &field_count) != 0) {
+        return encode_verbatim(data, data_size, encoded, encoded_capacity, encoded_size);
+    }
+
+    RecordShape* same_keys = NULL;
+    RecordShape* shape = find_shape(shapes, fields, field_count, &same_keys);
+    if (!shape) {
+        shape = register_shape(shapes, fields, field_count);
+    }
+    if (!shape || encoded_capacity < 2 * MAX_VARINT_SIZE) {
+        return encode_verbatim(data, data_size, encoded, encoded_capacity, encoded_size);
+    }
+
+    size_t pos = put_varint(encoded, shape->id);
+    pos += put_varint(encoded + pos, data_size);
+
+    for (size_t i = 0; i < field_count; i++) {
+        const ParsedField* field = &fields[i];
+        const ShapeColumn* column = &shape->columns[i];
+
+        // Enough room for the largest prefix plus the value itself.
+        if (pos + 2 * MAX_VARINT_SIZE + field->value_size + 2 > encoded_capacity) {
+            return encode_verbatim(data, data_size, encoded, encoded_capacity, encoded_size);
+        }
+
+        if (column->type == COLUMN_INT) {
+            pos += put_varint(encoded + pos, zigzag_encode(field->number));
+            continue;
+        }
+
+        if (column->type == COLUMN_STRING) {
+            int index = find_value(column, 0, field->value, field->value_size);
+            if (index < 0) {
+                index = learn_value(shapes, shape, i, field->value, field->value_size);
+            }
+            if (index >= 0) {
+                pos += put_varint(encoded + pos, (uint64_t)index + 1);
+                continue;
+            }
+            encoded[pos++] = 0;
+        }
+
+        // Widened columns keep strings with their quotes.
+        const uint8_t* text = field->value;
+        size_t text_size = field->value_size;
+        if (column->type == COLUMN_RAW && field->kind == COLUMN_STRING) {
+            text--;
+            text_size += 2;
+        }
+        pos += put_varint(encoded + pos, text_size);
+        memcpy(encoded + pos, text, text_size);
+        pos += text_size;
+    }
+
+    *encoded_size = pos;
+    return 0;
+}
+
+int columnar_decoded_size(const uint8_t* encoded, size_t encoded_size, size_t* decoded_size) {
+    if (!encoded || !decoded_size) {
+        return -1;
+    }
+
+    const uint8_t* cursor = encoded;
+    const uint8_t* end = encoded + encoded_size;
+    uint64_t shape_id;
+    if (get_varint(&cursor, end, &shape_id) != 0) {
+        return -1;
+    }
+
+    if (shape_id == VERBATIM_SHAPE_ID) {
+        *decoded_size = (size_t)(end - cursor);
+        return 0;
+    }
+
+    uint64_t size;
+    if (get_varint(&cursor, end, &size) != 0) {
+        return -1;
+    }
+    *decoded_size = (size_t)size;
+    return 0;
+}
+
+// Reads the next column value. Strings come back without their quotes.
+static int read_value(const ShapeColumn* column, const uint8_t** cursor, const uint8_t* end, ColumnValue* value) {
+    uint64_t number;
+    if (get_varint(cursor, end, &number) != 0) {
+        return -1;
+    }
+
+    value->type = column->type;
+    if (column->type == COLUMN_INT) {
+        value->number = zigzag_decode(number);
+        return 0;
+    }
+
+    if (column->type == COLUMN_STRING && number > 0) {
+        if (number > __atomic_load_n(&column->value_count, __ATOMIC_ACQUIRE)) {
+            return -1;
+        }
+        value->text = (const uint8_t*)column->values[number - 1];
+        value->text_size = column->value_sizes[number - 1];
+        return 0;
+    }
+
+    if (column->type == COLUMN_STRING && get_varint(cursor, end, &number) != 0) {
+        return -1;
+    }
+    if (number > (uint64_t)(end - *cursor)) {
+        return -1;
+    }
+
+    value->text = *cursor;
+    value->text_size = (size_t)number;
+    *cursor += number;
+    return 0;
+}
+
+static int append_bytes(uint8_t* out, size_t capacity, size_t* pos, const void* bytes, size_t size) {
+    if (*pos + size > capacity) {
+        return -1;
+    }
+    memcpy(out + *pos, bytes, size);
+    *pos += size;
+    return 0;
+}
+
+int columnar_decode(TopicShapes* shapes, const uint8_t* encoded, size_t encoded_size,
+                    uint8_t* decoded, size_t decoded_capacity, size_t* decoded_size) {
+    if (!encoded || !decoded || !decoded_size) {
+        return -1;
+    }
+
+    const uint8_t* cursor = encoded;
+    const uint8_t* end = encoded + encoded_size;
+    uint64_t shape_id;
+    if (get_varint(&cursor, end, &shape_id) != 0) {
+        return -1;
+    }
+
+    if (shape_id == VERBATIM_SHAPE_ID) {
+        size_t size = (size_t)(end - cursor);
+        if (size > decoded_capacity) {
+            return -1;
+        }
+        memcpy(decoded, cursor, size);
+        *decoded_size = size;
+        return 0;
+    }
+
+    RecordShape* shape = shapes ? shape_at(shapes, shape_id) : NULL;
+    uint64_t expected;
+    if (!shape || get_varint(&cursor, end, &expected) != 0 || expected > decoded_capacity) {
+        return -1;
+    }
+
+    size_t pos = 0;
+    int result = append_bytes(decoded, decoded_capacity, &pos, "{", 1);
+
+    for (size_t i = 0; i < shape->field_count && result == 0; i++) {
+        const ShapeColumn* column = &shape->columns[i];
+        ColumnValue value;
+
+        result = read_value(column, &cursor, end, &value);
+        if (result == 0 && i > 0) {
+            result = append_bytes(decoded, decoded_capacity, &pos, ",", 1);
+        }
+        if (result == 0) {
+            result = append_bytes(decoded, decoded_capacity, &pos, "\"", 1);
+        }
+        if (result == 0) {
+            result = append_bytes(decoded, decoded_capacity, &pos, column->key, column->key_size);
+        }
+        if (result == 0) {
+            result = append_bytes(decoded, decoded_capacity, &pos, "\":", 2);
+        }
+        if (result != 0) {
+            break;
+        }
+
+        if (value.type == COLUMN_INT) {
+            char number[24];
+            int length = snprintf(number, sizeof(number), "%lld", (long long)value.number);
+            result = append_bytes(decoded, decoded_capacity, &pos, number, (size_t)length);
+        } else if (value.type == COLUMN_STRING) {
+            result = append_bytes(decoded, decoded_capacity, &pos, "\"", 1);
+            if (result == 0) {
+                result = append_bytes(decoded, decoded_capacity, &pos, value.text, value.text_size);
+            }
+            if (result == 0) {
+                result = append_bytes(decoded, decoded_capacity, &pos, "\"", 1);
+            }
+        } else {
+            result = append_bytes(decoded, decoded_capacity, &pos, value.text, value.text_size);
+        }
+    }
+
+    if (result != 0 || append_bytes(decoded, decoded_capacity, &pos, "}", 1) != 0 ||
+        cursor != end || pos != expected) {
+        return -1;
+    }
+
+    *decoded_size = pos;
+    return 0;
+}
+
+static int is_value_terminator(uint8_t c) {
+    return c == ',' || c == '}' || c == ']' || c == ' ' || c == '\t' || c == '\n' || c == '\r';
+}
+
+// Mirrors the textual json: match on one top-level value.
+static int value_matches(const ColumnValue* value, const FilterClause* clause) {
+    if (value->type == COLUMN_INT) {
+        char number[24];
+        int length = snprintf(number, sizeof(number), "%lld", (long long)value->number);
+        return (size_t)length == clause->value_size && memcmp(number, clause->value, clause->value_size) == 0;
+    }
+
+    const uint8_t* text = value->text;
+    size_t text_size = value->text_size;
+    if (value->type == COLUMN_STRING) {
+        return text_size >= clause->value_size && memcmp(text, clause->value, clause->value_size) == 0 &&
+               (text_size == clause->value_size || text[clause->value_size] == '"');
+    }
+
+    if (text_size > 0 && text[0] == '"') {
+        return text_size > clause->value_size + 1 && memcmp(text + 1, clause->value, clause->value_size) == 0 &&
+               text[clause->value_size + 1] == '"';
+    }
+    return text_size >= clause->value_size && memcmp(text, clause->value, clause->value_size) == 0 &&
+           (text_size == clause->value_size || is_value_terminator(text[clause->value_size]));
+}
+
+int columnar_filter_match(TopicShapes* shapes, const RecordFilter* filter,
+                          const uint8_t* encoded, size_t encoded_size) {
+    if (!filter || !encoded) {
+        return -1;
+    }
+
+    for (size_t i = 0; i < filter->count; i++) {
+        if (filter->clauses[i].op != FILTER_OP_JSON_FIELD) {
+            return -1;
+        }
+    }
+
+    const uint8_t* cursor = encoded;
+    const uint8_t* end = encoded + encoded_size;
+    uint64_t shape_id;
+    if (get_varint(&cursor, end, &shape_id) != 0) {
+        return -1;
+    }
+
+    if (shape_id == VERBATIM_SHAPE_ID) {
+        return record_filter_match(filter, cursor, (size_t)(end - cursor));
+    }
+
+    RecordShape* shape = shapes ? shape_at(shapes, shape_id) : NULL;
+    uint64_t decoded_size;
+    if (!shape || get_varint(&cursor, end, &decoded_size) != 0) {
+        return -1;
+    }
+
+    // A text match can also hit a key inside a nested value, or skip
+    // whitespace in front of one; records with such values are left to the
+    // decoder.
+    ColumnValue values[MAX_SHAPE_FIELDS];
+    int ambiguous = 0;
+    for (size_t i = 0; i < shape->field_count; i++) {
+        if (read_value(&shape->columns[i], &cursor, end, &values[i]) != 0) {
+            return -1;
+        }
+        if (values[i].type == COLUMN_RAW && values[i].text_size > 0) {
+            const uint8_t* text = values[i].text;
+            const uint8_t* text_end = text + values[i].text_size;
+            int single_string = text[0] == '"' && skip_string(text + 1, text_end) == text_end - 1;
+            ambiguous |= is_value_terminator(text[0]) ||
+                         (!single_string && memchr(text, '"', values[i].text_size) != NULL);
+        }
+    }
+
+    for (size_t c = 0; c < filter->count; c++) {
+        const FilterClause* clause = &filter->clauses[c];
+        int matched = 0;
+
+        for (size_t i = 0; i < shape->field_count && !matched; i++) {
+            const ShapeColumn* column = &shape->columns[i];
+            matched = column->key_size + 2 == clause->needle_size &&
+                      memcmp(column->key, clause->needle + 1, column->key_size) == 0 &&
+                      value_matches(&values[i], clause);
+        }
+
+        if (!matched) {
+            return ambiguous ? -1 : 0;
+        }
+    }
+
+    return 1;
+}
+
+void shapes_free_all(void) {
+    TopicShapes* shapes = (TopicShapes*)path_registry_take_all(&g_shapes);
+    while (shapes) {
+        TopicShapes* next = shapes->next;
+        for (unsigned i = 0; i < shapes->shape_count; i++) {
+            shape_free(shapes->shapes[i]);
+        }
+        pthread_mutex_destroy(&shapes->mutex);
+        free(shapes->topic_file_path);
+        free(shapes);
+        shapes = next;
+    }
+}
@@ -0,0 +1,329 @@
+#include "headers/compression_controller.h"
+#include "headers/delay_scheduler.h"
+#include "../utils/header/path_registry.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <zstd.h>
+
+// Adaptive publishes ask the topic's controller for a level, compress, and
+// report back the bytes in and out, the thread CPU time spent encoding, and
+// how many publishes were in flight. Once per window the controller looks at
+// what it saw:
+//
+//  - publishes queueing up or encoding keeping the cores it ran on busy
+//    steps the level down, into zstd's negative fast levels if the bounds
+//    allow;
+//  - an idle window steps the level up, and the next window checks that the
+//    step bought enough ratio, stepping back and holding for a while if not.
+//
+// Bounds are persisted in "<topic>.compression" as "<min> <max>".
+#define COMPRESSION_BOUNDS_EXTENSION ".compression"
+#define DEFAULT_START_LEVEL 3
+#define WINDOW_MS 1000
+#define MIN_WINDOW_RECORDS 16
+#define QUEUE_DEPTH_HIGH 4
+#define QUEUE_DEPTH_LOW 1
+#define CPU_HIGH_PERMILLE 500
+#define CPU_LOW_PERMILLE 150
+#define MIN_STEP_GAIN_PERMILLE 20
+#define STEP_UP_HOLD_MS (60 * 1000)
+
+static PathRegistry g_controllers = PATH_REGISTRY_INITIALIZER(AdaptiveLevel, topic_file_path);
+
+static int clamp_to_bounds(int level, int min_level, int max_level) {
+    if (level < min_level) {
+        return min_level;
+    }
+    if (level > max_level) {
+        return max_level;
+    }
+    return level;
+}
+
+int compression_bounds_valid(int min_level, int max_level) {
+    // Level 0 means "zstd default" rather than a point on the scale.
+    return min_level != 0 && max_level != 0 && min_level <= max_level &&
+           min_level >= ZSTD_minCLevel() && max_level <= ZSTD_maxCLevel();
+}
+
+static int step_down(int level, int min_level) {
+    int next = level - 1 == 0 ? -1 : level - 1;
+    return next < min_level ? level : next;
+}
+
+static int step_up(int level, int max_level) {
+    int next = level + 1 == 0 ? 1 : level + 1;
+    return next > max_level ? level : next;
+}
+
+static unsigned online_cores(void) {
+    static unsigned cores = 0;
+    if (cores == 0) {
+        long count = sysconf(_SC_NPROCESSORS_ONLN);
+        cores = count > 0 ? (unsigned)count : 1;
+    }
+    return cores;
+}
+
+// Each encoding thread marks one bit of a window's encoder mask, so the
+// window can tell how many threads its CPU time was spread over. Threads
+// past 64 share bits, which only makes the share look higher.
+static uint64_t thread_bit(void) {
+    static unsigned next_slot = 0;
+    static __thread uint64_t bit = 0;
+    if (bit == 0) {
+        bit = 1ULL << (__atomic_fetch_add(&next_slot, 1, __ATOMIC_RELAXED) % 64);
+    }
+    return bit;
+}
+
+static void build_bounds_path(char* buffer, size_t buffer_size, const char* topic_file_path) {
+    snprintf(buffer, buffer_size, "%s%s", topic_file_path, COMPRESSION_BOUNDS_EXTENSION);
+}
+
+static int write_bounds(const char* topic_file_path, int min_level, int max_level) {
+    char bounds_path[512];
+    char tmp_path[520];
+    build_bounds_path(bounds_path, sizeof(bounds_path), topic_file_path);
+    snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", bounds_path);
+
+    FILE* file = fopen(tmp_path, "w");
+    if (!file) {
+        return -1;
+    }
+
+    int result = fprintf(file, "%d %d\n", min_level, max_level) < 0 ? -1 : 0;
+    if (fclose(file) != 0) {
+        result = -1;
+    }
+
+    if (result != 0 || rename(tmp_path, bounds_path) != 0) {
+        remove(tmp_path);
+        return -1;
+    }
+
+    return 0;
+}
+
+static void read_bounds(const char* topic_file_path, int* min_level, int* max_level) {
+    char bounds_path[512];
+    build_bounds_path(bounds_path, sizeof(bounds_path), topic_file_path);
+
+    FILE* file = fopen(bounds_path, "r");
+    if (!file) {
+        return;
+    }
+
+    int stored_min = 0;
+    int stored_max = 0;
+    if (fscanf(file, "%d %d", &stored_min, &stored_max) == 2 && compression_bounds_valid(stored_min, stored_max)) {
+        *min_level = stored_min;
+        *max_level = stored_max;
+    }
+    fclose(file);
+}
+
+static void* create_controller(const char* topic_file_path, void* context) {
+    (void)context;
+    AdaptiveLevel* controller = (AdaptiveLevel*)calloc(1, sizeof(AdaptiveLevel));
+    if (!controller) {
+        return NULL;
+    }
+
+    controller->topic_file_path = strdup(topic_file_path);
+    if (!controller->topic_file_path) {
+        free(controller);
+        return NULL;
+    }
+
+    controller->min_level = COMPRESSION_DEFAULT_MIN_LEVEL;
+    controller->max_level = COMPRESSION_DEFAULT_MAX_LEVEL;
+    read_bounds(topic_file_path, &controller->min_level, &controller->max_level);
+    controller->level = clamp_to_bounds(DEFAULT_START_LEVEL, controller->min_level, controller->max_level);
+    controller->window_start_ms = current_time_ms();
+    return controller;
+}
+
+AdaptiveLevel* compression_controller_for_topic(const char* topic_file_path) {
+    return (AdaptiveLevel*)path_registry_get(&g_controllers, topic_file_path, create_controller, NULL);
+}
+
+int compression_controller_set_bounds(const char* topic_file_path, int min_level, int max_level) {
+    if (!topic_file_path || !compression_bounds_valid(min_level, max_level)) {
+        return -1;
+    }
+
+    AdaptiveLevel* controller = compression_controller_for_topic(topic_file_path);
+    if (!controller) {
+        return -1;
+    }
+
+    pthread_mutex_lock(&g_controllers.mutex);
+
+    if (write_bounds(topic_file_path, min_level, max_level) != 0) {
+        pthread_mutex_unlock(&g_controllers.mutex);
+        return -1;
+    }
+
+    __atomic_store_n(&controller->min_level, min_level, __ATOMIC_RELAXED);
+    __atomic_store_n(&controller->max_level, max_level, __ATOMIC_RELAXED);
+    int level = __atomic_load_n(&controller->level, __ATOMIC_RELAXED);
+    __atomic_store_n(&controller->level, clamp_to_bounds(level, min_level, max_level), __ATOMIC_RELAXED);
+
+    pthread_mutex_unlock(&g_controllers.mutex);
+    return 0;
+}
+
+int compression_controller_begin(AdaptiveLevel* controller) {
+    if (!controller) {
+        return DEFAULT_START_LEVEL;
+    }
+
+    int depth = __atomic_add_fetch(&controller->in_flight, 1, __ATOMIC_RELAXED);
+    int peak = __atomic_load_n(&controller->peak_in_flight, __ATOMIC_RELAXED);
+    while (depth > peak &&
+           !__atomic_compare_exchange_n(&controller->peak_in_flight, &peak, depth, 1,
+                                        __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+    }
+
+    return __atomic_load_n(&controller->level, __ATOMIC_RELAXED);
+}
+
+static void evaluate_window(AdaptiveLevel* controller, uint64_t now_ms) {
+    uint64_t elapsed_ms = now_ms - controller->window_start_ms;
+    __atomic_store_n(&controller->window_start_ms, now_ms, __ATOMIC_RELAXED);
+
+    uint64_t records = __atomic_exchange_n(&controller->records, 0, __ATOMIC_RELAXED);
+    uint64_t raw_bytes = __atomic_exchange_n(&controller->raw_bytes, 0, __ATOMIC_RELAXED);
+    uint64_t compressed_bytes = __atomic_exchange_n(&controller->compressed_bytes, 0, __ATOMIC_RELAXED);
+    uint64_t encode_ns = __atomic_exchange_n(&controller->encode_ns, 0, __ATOMIC_RELAXED);
+    uint64_t encoders = (uint64_t)__builtin_popcountll(__atomic_exchange_n(&controller->encoder_mask, 0,
+                                                                           __ATOMIC_RELAXED));
+    int peak = __atomic_exchange_n(&controller->peak_in_flight,
+                                   __atomic_load_n(&controller->in_flight, __ATOMIC_RELAXED), __ATOMIC_RELAXED);
+
+    // Too little traffic to say anything about this level.
+    if (records < MIN_WINDOW_RECORDS || compressed_bytes == 0 || elapsed_ms == 0) {
+        return;
+    }
+
+    uint64_t ratio_permille = raw_bytes * 1000 / compressed_bytes;
+    // Share of one core spent encoding this topic, per thread that encoded:
+    // one thread encoding flat out is 1000 however many cores there are.
+    if (encoders == 0) {
+        encoders = 1;
+    } else if (encoders > online_cores()) {
+        encoders = online_cores();
+    }
+    uint64_t cpu_permille = encode_ns / (elapsed_ms * 1000 * encoders);
+    __atomic_store_n(&controller->ratio_permille, ratio_permille, __ATOMIC_RELAXED);
+    __atomic_store_n(&controller->cpu_permille, cpu_permille, __ATOMIC_RELAXED);
+
+    int min_level = __atomic_load_n(&controller->min_level, __ATOMIC_RELAXED);
+    int max_level = __atomic_load_n(&controller->max_level, __ATOMIC_RELAXED);
+    int level = __atomic_load_n(&controller->level, __ATOMIC_RELAXED);
+    int next = level;
+
+    uint64_t baseline = controller->ratio_before_step_up;
+    controller->ratio_before_step_up = 0;
+
+    if (peak > QUEUE_DEPTH_HIGH || cpu_permille > CPU_HIGH_PERMILLE) {
+        next = step_down(level, min_level);
+    } else if (baseline && ratio_permille * 1000 < baseline * (1000 + MIN_STEP_GAIN_PERMILLE)) {
+        next = step_down(level, min_level);
+        controller->hold_until_ms = now_ms + STEP_UP_HOLD_MS;
+    } else if (peak <= QUEUE_DEPTH_LOW && cpu_permille < CPU_LOW_PERMILLE && now_ms >= controller->hold_until_ms) {
+        next = step_up(level, max_level);
+        if (next != level) {
+            controller->ratio_before_step_up = ratio_permille;
+        }
+    }
+
+    __atomic_store_n(&controller->level, clamp_to_bounds(next, min_level, max_level), __ATOMIC_RELAXED);
+}
+
+int compression_controller_level(AdaptiveLevel* controller) {
+    if (!controller) {
+        return DEFAULT_START_LEVEL;
+    }
+    return __atomic_load_n(&controller->level, __ATOMIC_RELAXED);
+}
+
+void compression_controller_end(AdaptiveLevel* controller, size_t raw_size, size_t compressed_size,
+                                uint64_t encode_ns, int succeeded) {
+    if (!controller) {
+        return;
+    }
+
+    __atomic_sub_fetch(&controller->in_flight, 1, __ATOMIC_RELAXED);
+    compression_controller_observe(controller, raw_size, compressed_size, encode_ns, succeeded);
+}
+
+void compression_controller_observe(AdaptiveLevel* controller, size_t raw_size, size_t compressed_size,
+                                    uint64_t encode_ns, int succeeded) {
+    if (!controller) {
+        return;
+    }
+
+    if (succeeded) {
+        __atomic_fetch_add(&controller->raw_bytes, raw_size, __ATOMIC_RELAXED);
+        __atomic_fetch_add(&controller->compressed_bytes, compressed_size, __ATOMIC_RELAXED);
+        __atomic_fetch_add(&controller->encode_ns, encode_ns, __ATOMIC_RELAXED);
+        __atomic_fetch_or(&controller->encoder_mask, thread_bit(), __ATOMIC_RELAXED);
+        __atomic_fetch_add(&controller->records, 1, __ATOMIC_RELAXED);
+    }
+
+    uint64_t now_ms = current_time_ms();
+    if (now_ms - __atomic_load_n(&controller->window_start_ms, __ATOMIC_RELAXED) < WINDOW_MS) {
+        return;
+    }
+
+    // Whichever publish crosses the window boundary first evaluates it.
+    if (__atomic_exchange_n(&controller->adjusting, 1, __ATOMIC_ACQUIRE)) {
+        return;
+    }
+
+    if (now_ms - controller->window_start_ms >= WINDOW_MS) {
+        evaluate_window(controller, now_ms);
+    }
+    __atomic_store_n(&controller->adjusting, 0, __ATOMIC_RELEASE);
+}
+
+int compression_controller_stats(const char* topic_file_path, CompressionStats* stats) {
+    if (!topic_file_path || !stats) {
+        return -1;
+    }
+
+    // Only looks: a topic nobody has published to adaptively has no
+    // controller yet, and reports the level and bounds it would start with.
+    AdaptiveLevel* controller = (AdaptiveLevel*)path_registry_find(&g_controllers, topic_file_path);
+    if (!controller) {
+        memset(stats, 0, sizeof(*stats));
+        stats->min_level = COMPRESSION_DEFAULT_MIN_LEVEL;
+        stats->max_level = COMPRESSION_DEFAULT_MAX_LEVEL;
+        read_bounds(topic_file_path, &stats->min_level, &stats->max_level);
+        stats->level = clamp_to_bounds(DEFAULT_START_LEVEL, stats->min_level, stats->max_level);
+        return 0;
+    }
+
+    stats->level = __atomic_load_n(&controller->level, __ATOMIC_RELAXED);
+    stats->min_level = __atomic_load_n(&controller->min_level, __ATOMIC_RELAXED);
+    stats->max_level = __atomic_load_n(&controller->max_level, __ATOMIC_RELAXED);
+    stats->queue_depth = __atomic_load_n(&controller->in_flight, __ATOMIC_RELAXED);
+    stats->ratio_permille = __atomic_load_n(&controller->ratio_permille, __ATOMIC_RELAXED);
+    stats->cpu_permille = __atomic_load_n(&controller->cpu_permille, __ATOMIC_RELAXED);
+    return 0;
+}
+
+void compression_controllers_free(void) {
+    AdaptiveLevel* controller = (AdaptiveLevel*)path_registry_take_all(&g_controllers);
+    while (controller) {
+        AdaptiveLevel* next = controller->next;
+        free(controller->topic_file_path);
+        free(controller);
+        controller = next;
+    }
+}
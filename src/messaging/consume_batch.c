@@ -0,0 +1,409 @@
+#include "headers/consume_batch.h"
+#include "headers/codec.h"
+#include "headers/columnar_codec.h"
+#include "headers/record_format.h"
+#include "../writer/headers/block_cache.h"
+#include <stdlib.h>
+#include <string.h>
+
+// Bulk reads for consumers that are behind. Record headers are walked in
+// place in the cached blocks, plain records are handed out as views into
+// those blocks, and encoded records are decoded back to back into one arena
+// that is reused from batch to batch, with the per-thread codec contexts.
+// Nothing is allocated per record once the arena has grown to the batch
+// size. Large records already decoded for another group are taken from the
+// decoded cache segment (small ones decode faster than a locked lookup);
+// the ones decoded here are not added to it, so a catch-up scan does not
+// evict what live consumers are reading.
+#define MAX_PACKET_SIZE (10 * 1024 * 1024) // 10MB max packet size
+#define BATCH_INITIAL_ARENA (256 * 1024)
+#define BATCH_INITIAL_RECORDS 256
+#define BATCH_INITIAL_ENTRIES 16
+#define BATCH_NOT_IN_ARENA ((size_t)-1)
+#define BATCH_CACHED_DECODE_MIN (16 * 1024)
+
+RecordBatch* record_batch_create(void) {
+    return (RecordBatch*)calloc(1, sizeof(RecordBatch));
+}
+
+void record_batch_release(RecordBatch* batch) {
+    if (!batch) {
+        return;
+    }
+
+    for (size_t i = 0; i < batch->entry_count; i++) {
+        block_cache_release((BlockCacheEntry*)batch->entries[i]);
+    }
+    batch->entry_count = 0;
+    batch->count = 0;
+    batch->arena_size = 0;
+}
+
+void record_batch_free(RecordBatch* batch) {
+    if (!batch) {
+        return;
+    }
+
+    record_batch_release(batch);
+    free(batch->records);
+    free(batch->arena);
+    free(batch->entries);
+    free(batch);
+}
+
+static int reserve_arena(RecordBatch* batch, size_t size) {
+    if (batch->arena_size + size <= batch->arena_capacity) {
+        return 0;
+    }
+
+    size_t capacity = batch->arena_capacity ? batch->arena_capacity : BATCH_INITIAL_ARENA;
+    while (capacity < batch->arena_size + size) {
+        capacity *= 2;
+    }
+
+    uint8_t* grown = (uint8_t*)realloc(batch->arena, capacity);
+    if (!grown) {
+        return -1;
+    }
+    batch->arena = grown;
+    batch->arena_capacity = capacity;
+    return 0;
+}
+
+static int hold_entry(RecordBatch* batch, BlockCacheEntry* entry) {
+    if (batch->entry_count == batch->entry_capacity) {
+        size_t capacity = batch->entry_capacity ? batch->entry_capacity * 2 : BATCH_INITIAL_ENTRIES;
+        void** grown = (void**)realloc(batch->entries, capacity * sizeof(void*));
+        if (!grown) {
+            return -1;
+        }
+        batch->entries = grown;
+        batch->entry_capacity = capacity;
+    }
+
+    batch->entries[batch->entry_count++] = entry;
+    return 0;
+}
+
+static int push_record(RecordBatch* batch, const BatchRecord* record) {
+    if (batch->count == batch->capacity) {
+        size_t capacity = batch->capacity ? batch->capacity * 2 : BATCH_INITIAL_RECORDS;
+        BatchRecord* grown = (BatchRecord*)realloc(batch->records, capacity * sizeof(BatchRecord));
+        if (!grown) {
+            return -1;
+        }
+        batch->records = grown;
+        batch->capacity = capacity;
+    }
+
+    batch->records[batch->count++] = *record;
+    return 0;
+}
+
+// Decodes into the arena unless another group already left the decoded
+// record in the cache.
+static int decode_into_batch(RecordBatch* batch, BlockCacheFile* log, Topic* topic, const Codec* codec,
+                             const uint8_t* stored, size_t stored_arena_offset, uint32_t stored_size,
+                             size_t record_offset, BatchRecord* record) {
+    BlockCacheEntry* decoded = stored_size >= BATCH_CACHED_DECODE_MIN
+                                   ? block_cache_lookup(log, BLOCK_CACHE_SEGMENT_DECODED, record_offset)
+                                   : NULL;
+    if (decoded) {
+        if (hold_entry(batch, decoded) != 0) {
+            block_cache_release(decoded);
+            return -1;
+        }
+        record->data = decoded->data;
+        record->data_size = decoded->length;
+        record->arena_offset = BATCH_NOT_IN_ARENA;
+        return 0;
+    }
+
+    size_t content_size = 0;
+    if (codec->decoded_size(stored, stored_size, &content_size) != 0 ||
+        content_size == 0 || content_size > MAX_PACKET_SIZE || reserve_arena(batch, content_size) != 0) {
+        return -1;
+    }
+
+    // Growing the arena may have moved a stored copy that lives in it.
+    if (stored_arena_offset != BATCH_NOT_IN_ARENA) {
+        stored = batch->arena + stored_arena_offset;
+    }
+
+    size_t decoded_size = 0;
+    if (codec->decode(topic->file_path, stored, stored_size, batch->arena + batch->arena_size,
+                      content_size, &decoded_size) != 0) {
+        return -1;
+    }
+
+    record->data = NULL;
+    record->data_size = decoded_size;
+    record->arena_offset = batch->arena_size;
+    batch->arena_size += decoded_size;
+    return 0;
+}
+
+int consume_batch(Group* group, Topic* topic, const RecordFilter* filter, size_t max_records, size_t max_bytes,
+                  unsigned keep_codecs, RecordBatch* batch) {
+    if (!group || !topic || !topic->file_path || !batch || max_records == 0) {
+        return -1;
+    }
+
+    if (group->attached_topic != topic) {
+        return -1;
+    }
+
+    record_batch_release(batch);
+
+    BlockCacheFile* log = block_cache_open(topic->file_path);
+    if (!log) {
+        return -1;
+    }
+
+    size_t log_size = block_cache_file_size(log);
+    size_t offset = group->read_pointer;
+    size_t delivered_bytes = 0;
+    size_t last_size = 0;
+    BlockCacheEntry* block = NULL;
+    int failed = 0;
+
+    while (batch->count < max_records && (max_bytes == 0 || delivered_bytes < max_bytes) &&
+           offset + RECORD_HEADER_SIZE <= log_size) {
+        size_t block_offset = offset - (offset % BLOCK_CACHE_BLOCK_SIZE);
+        if (!block || block->block_offset != block_offset) {
+            size_t needed_end = log_size - block_offset;
+            if (needed_end > BLOCK_CACHE_BLOCK_SIZE) {
+                needed_end = BLOCK_CACHE_BLOCK_SIZE;
+            }
+
+            block = block_cache_acquire(log, block_offset, needed_end);
+            if (!block || hold_entry(batch, block) != 0) {
+                if (block) {
+                    block_cache_release(block);
+                }
+                failed = 1;
+                break;
+            }
+        }
+
+        // Only headers and payloads that straddle a block boundary are copied.
+        size_t within = offset - block_offset;
+        uint32_t header;
+        if (within + RECORD_HEADER_SIZE <= block->length) {
+            memcpy(&header, block->data + within, RECORD_HEADER_SIZE);
+        } else if (block_cache_read(log, &header, RECORD_HEADER_SIZE, offset) != (long)RECORD_HEADER_SIZE) {
+            failed = 1;
+            break;
+        }
+
+        uint32_t stored_size = RECORD_HEADER_PAYLOAD_SIZE(header);
+        uint8_t codec_id = RECORD_HEADER_CODEC(header);
+        size_t payload_offset = offset + RECORD_HEADER_SIZE;
+        if (stored_size == 0 || stored_size > MAX_PACKET_SIZE || payload_offset + stored_size > log_size) {
+            break;
+        }
+
+        size_t arena_mark = batch->arena_size;
+        const uint8_t* stored = NULL;
+        size_t stored_arena_offset = BATCH_NOT_IN_ARENA;
+        if (within + RECORD_HEADER_SIZE + stored_size <= block->length) {
+            stored = block->data + within + RECORD_HEADER_SIZE;
+        } else {
+            if (reserve_arena(batch, stored_size) != 0 ||
+                block_cache_read(log, batch->arena + batch->arena_size, stored_size, payload_offset) !=
+                    (long)stored_size) {
+                failed = 1;
+                break;
+            }
+            stored_arena_offset = batch->arena_size;
+            stored = batch->arena + stored_arena_offset;
+            batch->arena_size += stored_size;
+        }
+
+        BatchRecord record;
+        record.offset_in_topic = offset;
+        record.packet_size = stored_size;
+        record.codec = codec_id;
+        record.data = stored_arena_offset == BATCH_NOT_IN_ARENA ? stored : NULL;
+        record.data_size = stored_size;
+        record.arena_offset = stored_arena_offset;
+
+        int verdict = -1;
+        if (filter && codec_id == RECORD_CODEC_COLUMNAR) {
+            verdict = columnar_filter_match(shapes_for_topic(topic->file_path), filter, stored, stored_size);
+        }
+
+        int keep = codec_id != RECORD_CODEC_NONE && (keep_codecs & RECORD_CODEC_BIT(codec_id)) &&
+                   codec_record_portable(codec_id, stored, stored_size);
+        int needs_decode = codec_id != RECORD_CODEC_NONE && (!keep || (filter && verdict < 0));
+        int matched = verdict != 0;
+
+        if (matched && needs_decode) {
+            const Codec* codec = codec_by_id(codec_id);
+            BatchRecord decoded = record;
+            size_t decoded_mark = batch->arena_size;
+            if (!codec || decode_into_batch(batch, log, topic, codec, stored, stored_arena_offset, stored_size,
+                                            offset, &decoded) != 0) {
+                batch->arena_size = arena_mark;
+                failed = 1;
+                break;
+            }
+
+            if (filter && verdict < 0) {
+                const uint8_t* data = decoded.data ? decoded.data : batch->arena + decoded.arena_offset;
+                matched = record_filter_match(filter, data, decoded.data_size);
+            }
+
+            if (keep) {
+                batch->arena_size = decoded_mark;
+            } else {
+                decoded.codec = RECORD_CODEC_NONE;
+                record = decoded;
+            }
+        } else if (matched && filter && codec_id == RECORD_CODEC_NONE) {
+            matched = record_filter_match(filter, stored, stored_size);
+        }
+
+        offset = payload_offset + stored_size;
+        if (!matched) {
+            batch->arena_size = arena_mark;
+            continue;
+        }
+
+        if (push_record(batch, &record) != 0) {
+            batch->arena_size = arena_mark;
+            offset = record.offset_in_topic;
+            failed = 1;
+            break;
+        }
+        delivered_bytes += record.data_size;
+        last_size = RECORD_HEADER_SIZE + stored_size;
+    }
+
+    // The arena is final now, so records living in it can point into it.
+    for (size_t i = 0; i < batch->count; i++) {
+        if (batch->records[i].arena_offset != BATCH_NOT_IN_ARENA) {
+            batch->records[i].data = batch->arena + batch->records[i].arena_offset;
+        }
+    }
+
+    group->read_pointer = offset;
+    if (last_size > 0) {
+        group->last_read_size = last_size;
+    }
+
+    if (failed && batch->count == 0) {
+        return -1;
+    }
+    return (int)batch->count;
+}
+
+// Only the record headers are read, through the cached blocks they sit in;
+// the caller moves the payload bytes. Blocks a large record's payload
+// spans are stepped over without being loaded.
+int consume_range(Group* group, Topic* topic, size_t max_bytes, LogRange* range) {
+    if (!group || !topic || !topic->file_path || !range || max_bytes == 0) {
+        return -1;
+    }
+
+    if (group->attached_topic != topic) {
+        return -1;
+    }
+
+    BlockCacheFile* log = block_cache_open(topic->file_path);
+    if (!log) {
+        return -1;
+    }
+
+    size_t log_size = block_cache_file_size(log);
+    size_t start = group->read_pointer;
+    size_t offset = start;
+    size_t count = 0;
+    size_t last_size = 0;
+    BlockCacheEntry* block = NULL;
+    int failed = 0;
+
+    while (offset + RECORD_HEADER_SIZE <= log_size) {
+        size_t block_offset = offset - (offset % BLOCK_CACHE_BLOCK_SIZE);
+        size_t within = offset - block_offset;
+        if (!block || block->block_offset != block_offset) {
+            if (block) {
+                block_cache_release(block);
+            }
+            block = block_cache_acquire(log, block_offset, within + RECORD_HEADER_SIZE);
+            if (!block) {
+                failed = 1;
+                break;
+            }
+        }
+
+        uint32_t header;
+        if (within + RECORD_HEADER_SIZE <= block->length) {
+            memcpy(&header, block->data + within, RECORD_HEADER_SIZE);
+        } else if (block_cache_read(log, &header, RECORD_HEADER_SIZE, offset) != (long)RECORD_HEADER_SIZE) {
+            failed = 1;
+            break;
+        }
+
+        uint32_t stored_size = RECORD_HEADER_PAYLOAD_SIZE(header);
+        size_t record_size = RECORD_HEADER_SIZE + (size_t)stored_size;
+        if (stored_size == 0 || stored_size > MAX_PACKET_SIZE || offset + record_size > log_size) {
+            break;
+        }
+        if (count > 0 && offset + record_size - start > max_bytes) {
+            break;
+        }
+
+        offset += record_size;
+        last_size = record_size;
+        count++;
+    }
+
+    if (block) {
+        block_cache_release(block);
+    }
+
+    if (count == 0) {
+        return failed ? -1 : 0;
+    }
+
+    range->fd = log->fd;
+    range->offset = start;
+    range->size = offset - start;
+    range->count = count;
+    group->read_pointer = offset;
+    group->last_read_size = last_size;
+    return (int)count;
+}
+
+long consume_batch_each(Group* group, Topic* topic, const RecordFilter* filter, size_t max_records,
+                        RecordBatchCallback callback, void* context) {
+    if (!callback) {
+        return -1;
+    }
+
+    RecordBatch* batch = record_batch_create();
+    if (!batch) {
+        return -1;
+    }
+
+    long delivered = 0;
+    for (;;) {
+        int count = consume_batch(group, topic, filter, max_records, 0, 0, batch);
+        if (count < 0) {
+            delivered = -1;
+            break;
+        }
+        if (count == 0) {
+            break;
+        }
+
+        delivered += count;
+        if (callback(context, batch->records, batch->count) != 0) {
+            break;
+        }
+    }
+
+    record_batch_free(batch);
+    return delivered;
+}
@@ -1,70 +1,141 @@
 #include "headers/consume_packet.h"
-#include "../writer/headers/read_write_data.h"
+#include "headers/record_filter.h"
+#include "headers/record_format.h"
+#include "headers/codec.h"
+#include "headers/columnar_codec.h"
+#include "../writer/headers/block_cache.h"
 #include <stdlib.h>
 #include <string.h>
 
-#define PACKET_SIZE_HEADER_SIZE sizeof(uint32_t)
+#define PACKET_SIZE_HEADER_SIZE RECORD_HEADER_SIZE
 #define MAX_PACKET_SIZE (10 * 1024 * 1024) // 10MB max packet size
 
-static int read_packet_size_header(Group* group, Topic* topic, uint32_t* size_out) {
-    if (!group || !topic || !size_out) {
-        return -1;
+typedef struct {
+    const uint8_t* data;
+    BlockCacheEntry* entry;
+    uint8_t* owned;
+} RecordView;
+
+static BlockCacheFile* topic_log(Topic* topic) {
+    if (!topic || !topic->file_path) {
+        return NULL;
     }
 
-    Chunk* chunk = (Chunk*)topic->chunk_handle;
-    if (!chunk) {
+    return block_cache_open(topic->file_path);
+}
+
+static int read_header_at(BlockCacheFile* log, size_t offset, uint32_t* size_out, uint8_t* codec_out) {
+    uint32_t header;
+    long bytes_read = block_cache_read(log, &header, PACKET_SIZE_HEADER_SIZE, offset);
+
+    if (bytes_read != (long)PACKET_SIZE_HEADER_SIZE) {
         return -1;
     }
 
-    if (chunk_load(chunk) != 0) {
-        return -1;
+    *size_out = RECORD_HEADER_PAYLOAD_SIZE(header);
+    if (codec_out) {
+        *codec_out = RECORD_HEADER_CODEC(header);
     }
+    return 0;
+}
 
-    if (group->read_pointer + PACKET_SIZE_HEADER_SIZE > chunk->size) {
+// Records that fit in one cached block are referenced in place; only the
+// ones straddling a block boundary are copied.
+static int view_record(BlockCacheFile* log, size_t offset, uint32_t size, RecordView* view) {
+    size_t block_offset = offset - (offset % BLOCK_CACHE_BLOCK_SIZE);
+    size_t within = offset - block_offset;
+
+    view->data = NULL;
+    view->entry = NULL;
+    view->owned = NULL;
+
+    if (within + size <= BLOCK_CACHE_BLOCK_SIZE) {
+        BlockCacheEntry* entry = block_cache_acquire(log, block_offset, within + size);
+        if (!entry) {
+            return -1;
+        }
+        if (entry->length < within + size) {
+            block_cache_release(entry);
+            return -1;
+        }
+        view->entry = entry;
+        view->data = entry->data + within;
+        return 0;
+    }
+
+    view->owned = (uint8_t*)malloc(size);
+    if (!view->owned) {
         return -1;
     }
 
-    uint32_t size_buffer;
-    long bytes_read = chunk_read(chunk, &size_buffer, PACKET_SIZE_HEADER_SIZE, group->read_pointer);
-    
-    if (bytes_read != PACKET_SIZE_HEADER_SIZE) {
+    if (block_cache_read(log, view->owned, size, offset) != (long)size) {
+        free(view->owned);
+        view->owned = NULL;
         return -1;
     }
 
-    *size_out = size_buffer;
+    view->data = view->owned;
     return 0;
 }
 
-int peek_packet_size(Group* group, Topic* topic, uint32_t* packet_size) {
-    if (!group || !topic || !packet_size) {
-        return -1;
+static void release_view(RecordView* view) {
+    if (view->entry) {
+        block_cache_release(view->entry);
     }
+    if (view->owned) {
+        free(view->owned);
+    }
+    view->entry = NULL;
+    view->owned = NULL;
+    view->data = NULL;
+}
 
-    Chunk* chunk = (Chunk*)topic->chunk_handle;
-    if (!chunk) {
+static Packet* packet_from_view(RecordView* view, uint32_t packet_size, size_t offset, uint8_t codec) {
+    Packet* packet = (Packet*)malloc(sizeof(Packet));
+    if (!packet) {
+        release_view(view);
+        return NULL;
+    }
+
+    packet->packet_size = packet_size;
+    packet->data = (uint8_t*)view->data;
+    packet->data_size = packet_size;
+    packet->offset_in_topic = offset;
+    packet->codec = codec;
+    packet->cache_entry = view->entry;
+    return packet;
+}
+
+static int read_packet_size_header(Group* group, Topic* topic, uint32_t* size_out) {
+    if (!group || !topic || !size_out) {
         return -1;
     }
 
-    if (chunk_load(chunk) != 0) {
+    BlockCacheFile* log = topic_log(topic);
+    if (!log) {
         return -1;
     }
 
-    if (group->read_pointer + PACKET_SIZE_HEADER_SIZE > chunk->size) {
+    if (group->read_pointer + PACKET_SIZE_HEADER_SIZE > block_cache_file_size(log)) {
         return -1;
     }
 
-    uint32_t size_buffer;
-    long bytes_read = chunk_read(chunk, &size_buffer, PACKET_SIZE_HEADER_SIZE, group->read_pointer);
-    
-    if (bytes_read != PACKET_SIZE_HEADER_SIZE) {
+    return read_header_at(log, group->read_pointer, size_out, NULL);
+}
+
+int peek_packet_size(Group* group, Topic* topic, uint32_t* packet_size) {
+    if (!group || !topic || !packet_size) {
         return -1;
     }
 
-    *packet_size = size_buffer;
-    return 0;
+    return read_packet_size_header(group, topic, packet_size);
 }
 
 Packet* consume_packet(Group* group, Topic* topic) {
+    return consume_packet_filtered(group, topic, NULL);
+}
+
+Packet* consume_packet_filtered(Group* group, Topic* topic, const RecordFilter* filter) {
     if (!group || !topic) {
         return NULL;
     }
@@ -73,113 +144,175 @@ Packet* consume_packet(Group* group, Topic* topic) {
         return NULL;
     }
 
-    Chunk* chunk = (Chunk*)topic->chunk_handle;
-    if (!chunk) {
+    BlockCacheFile* log = topic_log(topic);
+    if (!log) {
         return NULL;
     }
 
-    if (chunk_load(chunk) != 0) {
-        return NULL;
+    size_t log_size = block_cache_file_size(log);
+    size_t offset = group->read_pointer;
+
+    // Non-matching records are evaluated against the cached block and skipped
+    // without being copied out. Encoded records are matched on their decoded
+    // form, which is then what gets delivered; columnar records can usually
+    // be matched as stored, so only the ones delivered get decoded.
+    while (offset + PACKET_SIZE_HEADER_SIZE <= log_size) {
+        uint32_t packet_size;
+        uint8_t codec;
+        if (read_header_at(log, offset, &packet_size, &codec) != 0) {
+            break;
+        }
+
+        if (packet_size == 0 || packet_size > MAX_PACKET_SIZE ||
+            offset + PACKET_SIZE_HEADER_SIZE + packet_size > log_size) {
+            break;
+        }
+
+        RecordView view;
+        if (view_record(log, offset + PACKET_SIZE_HEADER_SIZE, packet_size, &view) != 0) {
+            break;
+        }
+
+        if (filter && codec != RECORD_CODEC_NONE) {
+            int verdict = codec == RECORD_CODEC_COLUMNAR
+                              ? columnar_filter_match(shapes_for_topic(topic->file_path), filter, view.data, packet_size)
+                              : -1;
+            if (verdict == 0) {
+                release_view(&view);
+                offset += PACKET_SIZE_HEADER_SIZE + packet_size;
+                continue;
+            }
+
+            Packet* packet = packet_from_view(&view, packet_size, offset, codec);
+            if (!packet || packet_decode(packet, topic) != 0) {
+                packet_free(packet);
+                group->read_pointer = offset;
+                return NULL;
+            }
+
+            if (verdict == 1 || record_filter_match(filter, packet->data, packet->data_size)) {
+                group->read_pointer = offset + PACKET_SIZE_HEADER_SIZE + packet_size;
+                group->last_read_size = PACKET_SIZE_HEADER_SIZE + packet_size;
+                return packet;
+            }
+
+            packet_free(packet);
+            offset += PACKET_SIZE_HEADER_SIZE + packet_size;
+            continue;
+        }
+
+        if (!filter || record_filter_match(filter, view.data, packet_size)) {
+            Packet* packet = packet_from_view(&view, packet_size, offset, codec);
+            if (packet) {
+                group->read_pointer = offset + PACKET_SIZE_HEADER_SIZE + packet_size;
+                group->last_read_size = PACKET_SIZE_HEADER_SIZE + packet_size;
+            } else {
+                group->read_pointer = offset;
+            }
+            return packet;
+        }
+
+        release_view(&view);
+        offset += PACKET_SIZE_HEADER_SIZE + packet_size;
     }
 
-    if (group->read_pointer >= chunk->size) {
-        return NULL;
-    }
+    group->read_pointer = offset;
+    return NULL;
+}
 
-    uint32_t packet_size;
-    if (read_packet_size_header(group, topic, &packet_size) != 0) {
+Packet* consume_packet_with_size(Group* group, Topic* topic, size_t packet_size) {
+    if (!group || !topic || packet_size == 0 || packet_size > MAX_PACKET_SIZE) {
         return NULL;
     }
 
-    if (packet_size == 0 || packet_size > MAX_PACKET_SIZE) {
+    if (group->attached_topic != topic) {
         return NULL;
     }
 
-    if (group->read_pointer + PACKET_SIZE_HEADER_SIZE + packet_size > chunk->size) {
+    BlockCacheFile* log = topic_log(topic);
+    if (!log) {
         return NULL;
     }
 
-    Packet* packet = (Packet*)malloc(sizeof(Packet));
-    if (!packet) {
+    if (group->read_pointer + packet_size > block_cache_file_size(log)) {
         return NULL;
     }
 
-    packet->packet_size = packet_size;
-    packet->offset_in_topic = group->read_pointer;
-    packet->data = (uint8_t*)malloc(packet_size);
-    
-    if (!packet->data) {
-        free(packet);
+    RecordView view;
+    if (view_record(log, group->read_pointer, (uint32_t)packet_size, &view) != 0) {
         return NULL;
     }
 
-    size_t read_offset = group->read_pointer + PACKET_SIZE_HEADER_SIZE;
-    long bytes_read = chunk_read(chunk, packet->data, packet_size, read_offset);
-    
-    if (bytes_read != (long)packet_size) {
-        free(packet->data);
-        free(packet);
+    Packet* packet = packet_from_view(&view, (uint32_t)packet_size, group->read_pointer, RECORD_CODEC_NONE);
+    if (!packet) {
         return NULL;
     }
 
-    packet->data_size = packet_size;
-
-    group->read_pointer += PACKET_SIZE_HEADER_SIZE + packet_size;
-    group->last_read_size = PACKET_SIZE_HEADER_SIZE + packet_size;
+    group->read_pointer += packet_size;
+    group->last_read_size = packet_size;
 
     return packet;
 }
 
-Packet* consume_packet_with_size(Group* group, Topic* topic, size_t packet_size) {
-    if (!group || !topic || packet_size == 0 || packet_size > MAX_PACKET_SIZE) {
-        return NULL;
-    }
-
-    if (group->attached_topic != topic) {
-        return NULL;
-    }
-
-    Chunk* chunk = (Chunk*)topic->chunk_handle;
-    if (!chunk) {
-        return NULL;
+// Decoded records live in their own cache segment keyed by record offset, so
+// a record read by many groups (or re-read after a rewind) is decoded once.
+int packet_decode(Packet* packet, Topic* topic) {
+    if (!packet || !topic) {
+        return -1;
     }
 
-    if (chunk_load(chunk) != 0) {
-        return NULL;
+    if (packet->codec == RECORD_CODEC_NONE) {
+        return 0;
     }
 
-    if (group->read_pointer + packet_size > chunk->size) {
-        return NULL;
+    const Codec* codec = codec_by_id(packet->codec);
+    if (!codec) {
+        return -1;
     }
 
-    Packet* packet = (Packet*)malloc(sizeof(Packet));
-    if (!packet) {
-        return NULL;
+    BlockCacheFile* log = topic_log(topic);
+    if (!log) {
+        return -1;
     }
 
-    packet->packet_size = (uint32_t)packet_size;
-    packet->offset_in_topic = group->read_pointer;
-    packet->data = (uint8_t*)malloc(packet_size);
-    
-    if (!packet->data) {
-        free(packet);
-        return NULL;
+    BlockCacheEntry* decoded = block_cache_lookup(log, BLOCK_CACHE_SEGMENT_DECODED, packet->offset_in_topic);
+    if (!decoded) {
+        size_t content_size = 0;
+        if (codec->decoded_size(packet->data, packet->data_size, &content_size) != 0 ||
+            content_size == 0 || content_size > MAX_PACKET_SIZE) {
+            return -1;
+        }
+
+        uint8_t* buffer = (uint8_t*)malloc(content_size);
+        if (!buffer) {
+            return -1;
+        }
+
+        size_t decoded_size = 0;
+        if (codec->decode(topic->file_path, packet->data, packet->data_size,
+                          buffer, content_size, &decoded_size) != 0) {
+            free(buffer);
+            return -1;
+        }
+
+        decoded = block_cache_insert(log, BLOCK_CACHE_SEGMENT_DECODED, packet->offset_in_topic,
+                                     buffer, decoded_size);
+        if (!decoded) {
+            return -1;
+        }
     }
 
-    long bytes_read = chunk_read(chunk, packet->data, packet_size, group->read_pointer);
-    
-    if (bytes_read != (long)packet_size) {
+    if (packet->cache_entry) {
+        block_cache_release((BlockCacheEntry*)packet->cache_entry);
+    } else if (packet->data) {
         free(packet->data);
-        free(packet);
-        return NULL;
     }
 
-    packet->data_size = packet_size;
-
-    group->read_pointer += packet_size;
-    group->last_read_size = packet_size;
-
-    return packet;
+    packet->cache_entry = decoded;
+    packet->data = decoded->data;
+    packet->data_size = decoded->length;
+    packet->codec = RECORD_CODEC_NONE;
+    return 0;
 }
 
 void packet_free(Packet* packet) {
@@ -187,9 +320,11 @@ void packet_free(Packet* packet) {
         return;
     }
 
-    if (packet->data) {
+    if (packet->cache_entry) {
+        block_cache_release((BlockCacheEntry*)packet->cache_entry);
+    } else if (packet->data) {
         free(packet->data);
     }
 
     free(packet);
-}
\ No newline at end of file
+}
@@ -1,5 +1,6 @@
 #include "headers/create_topic.h"
 #include "../writer/headers/read_write_data.h"
+#include "../writer/headers/block_cache.h"
 #include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
@@ -98,8 +99,7 @@ Topic* create_topic(const char* topic_name, const char* base_path) {
         return NULL;
     }
 
-    const char* initial_data = "{}";
-    if (chunk_append(chunk, initial_data, strlen(initial_data)) != 0) {
+    if (chunk_append(chunk, TOPIC_FILE_HEADER, TOPIC_FILE_HEADER_SIZE) != 0) {
         chunk_free(chunk);
         free(file_path);
         return NULL;
@@ -111,6 +111,8 @@ Topic* create_topic(const char* topic_name, const char* base_path) {
         return NULL;
     }
 
+    block_cache_invalidate(file_path);
+
     Topic* topic = (Topic*)malloc(sizeof(Topic));
     if (!topic) {
         chunk_free(chunk);
@@ -167,6 +169,7 @@ int delete_topic(Topic* topic) {
         if (remove(topic->file_path) != 0) {
             return -1;
         }
+        block_cache_invalidate(topic->file_path);
     }
 
     return 0;
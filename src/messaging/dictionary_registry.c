@@ -0,0 +1,408 @@
+#include "headers/dictionary_registry.h"
+#include "headers/encoder.h"
+#include "../utils/header/path_registry.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <dirent.h>
+
+// Every dictionary generation of a topic is stored as "<topic>.dict.<id>",
+// where id is the zstd dictionary ID embedded in the dictionary and in every
+// frame compressed with it. "<topic>.dict.active" names the generation new
+// publishes use. Generations are digested once: the DDict up front, a CDict
+// per compression level on first use. They are never dropped while the
+// broker runs, so frames from older generations stay readable and digested
+// dictionaries can be used without holding a lock.
+#define DICTIONARY_FILE_INFIX ".dict."
+#define DICTIONARY_ACTIVE_NAME "active"
+
+static PathRegistry g_dictionaries = PATH_REGISTRY_INITIALIZER(TopicDictionaries, topic_file_path);
+
+static DictionaryGeneration* find_generation(TopicDictionaries* dictionaries, unsigned dictionary_id) {
+    DictionaryGeneration* head = __atomic_load_n(&dictionaries->generations, __ATOMIC_ACQUIRE);
+    for (DictionaryGeneration* generation = head; generation; generation = generation->next) {
+        if (generation->dictionary_id == dictionary_id) {
+            return generation;
+        }
+    }
+    return NULL;
+}
+
+static void generation_free(DictionaryGeneration* generation) {
+    if (!generation) {
+        return;
+    }
+
+    DigestedCDict* digested = generation->cdicts;
+    while (digested) {
+        DigestedCDict* next = digested->next;
+        ZSTD_freeCDict(digested->cdict);
+        free(digested);
+        digested = next;
+    }
+    ZSTD_freeDDict(generation->ddict);
+    free(generation->dictionary);
+    free(generation);
+}
+
+static DictionaryGeneration* generation_create(const void* dictionary, size_t dictionary_size) {
+    unsigned dictionary_id = ZSTD_getDictID_fromDict(dictionary, dictionary_size);
+    if (dictionary_id == 0) {
+        // Raw-content dictionaries carry no ID, so frames could not name them.
+        return NULL;
+    }
+
+    DictionaryGeneration* generation = (DictionaryGeneration*)calloc(1, sizeof(DictionaryGeneration));
+    if (!generation) {
+        return NULL;
+    }
+
+    generation->dictionary_id = dictionary_id;
+    generation->dictionary_size = dictionary_size;
+    generation->dictionary = malloc(dictionary_size);
+    if (!generation->dictionary) {
+        free(generation);
+        return NULL;
+    }
+    memcpy(generation->dictionary, dictionary, dictionary_size);
+
+    generation->ddict = ZSTD_createDDict(generation->dictionary, dictionary_size);
+    if (!generation->ddict) {
+        generation_free(generation);
+        return NULL;
+    }
+
+    return generation;
+}
+
+static const ZSTD_CDict* generation_cdict(TopicDictionaries* dictionaries, DictionaryGeneration* generation,
+                                          int compression_level) {
+    DigestedCDict* head = __atomic_load_n(&generation->cdicts, __ATOMIC_ACQUIRE);
+    for (DigestedCDict* digested = head; digested; digested = digested->next) {
+        if (digested->compression_level == compression_level) {
+            return digested->cdict;
+        }
+    }
+
+    pthread_mutex_lock(&dictionaries->mutex);
+
+    for (DigestedCDict* digested = generation->cdicts; digested; digested = digested->next) {
+        if (digested->compression_level == compression_level) {
+            pthread_mutex_unlock(&dictionaries->mutex);
+            return digested->cdict;
+        }
+    }
+
+    DigestedCDict* digested = (DigestedCDict*)malloc(sizeof(DigestedCDict));
+    if (digested) {
+        digested->compression_level = compression_level;
+        digested->cdict = ZSTD_createCDict(generation->dictionary, generation->dictionary_size, compression_level);
+        if (!digested->cdict) {
+            free(digested);
+            digested = NULL;
+        } else {
+            digested->next = generation->cdicts;
+            __atomic_store_n(&generation->cdicts, digested, __ATOMIC_RELEASE);
+        }
+    }
+
+    pthread_mutex_unlock(&dictionaries->mutex);
+    return digested ? digested->cdict : NULL;
+}
+
+static void build_dictionary_path(char* buffer, size_t buffer_size, const char* topic_file_path, const char* suffix) {
+    snprintf(buffer, buffer_size, "%s%s%s", topic_file_path, DICTIONARY_FILE_INFIX, suffix);
+}
+
+static int write_active_id(const char* topic_file_path, unsigned dictionary_id) {
+    char active_path[512];
+    char tmp_path[520];
+    build_dictionary_path(active_path, sizeof(active_path), topic_file_path, DICTIONARY_ACTIVE_NAME);
+    snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", active_path);
+
+    FILE* file = fopen(tmp_path, "w");
+    if (!file) {
+        return -1;
+    }
+
+    int result = fprintf(file, "%u\n", dictionary_id) < 0 ? -1 : 0;
+    if (fclose(file) != 0) {
+        result = -1;
+    }
+
+    // rename() swaps the pointer atomically, so a crash never leaves it torn.
+    if (result != 0 || rename(tmp_path, active_path) != 0) {
+        remove(tmp_path);
+        return -1;
+    }
+
+    return 0;
+}
+
+static unsigned read_active_id(const char* topic_file_path) {
+    char active_path[512];
+    build_dictionary_path(active_path, sizeof(active_path), topic_file_path, DICTIONARY_ACTIVE_NAME);
+
+    FILE* file = fopen(active_path, "r");
+    if (!file) {
+        return 0;
+    }
+
+    unsigned dictionary_id = 0;
+    if (fscanf(file, "%u", &dictionary_id) != 1) {
+        dictionary_id = 0;
+    }
+    fclose(file);
+    return dictionary_id;
+}
+
+static void register_generation_locked(TopicDictionaries* dictionaries, DictionaryGeneration* generation) {
+    generation->next = dictionaries->generations;
+    __atomic_store_n(&dictionaries->generations, generation, __ATOMIC_RELEASE);
+}
+
+static void load_generations(TopicDictionaries* dictionaries) {
+    const char* topic_file_path = dictionaries->topic_file_path;
+    const char* slash = strrchr(topic_file_path, '/');
+    const char* topic_file_name = slash ? slash + 1 : topic_file_path;
+
+    char directory[512];
+    if (slash) {
+        snprintf(directory, sizeof(directory), "%.*s", (int)(slash - topic_file_path), topic_file_path);
+    } else {
+        snprintf(directory, sizeof(directory), ".");
+    }
+
+    DIR* dir = opendir(directory);
+    if (!dir) {
+        return;
+    }
+
+    char prefix[512];
+    snprintf(prefix, sizeof(prefix), "%s%s", topic_file_name, DICTIONARY_FILE_INFIX);
+    size_t prefix_len = strlen(prefix);
+
+    struct dirent* entry;
+    while ((entry = readdir(dir)) != NULL) {
+        if (strncmp(entry->d_name, prefix, prefix_len) != 0) {
+            continue;
+        }
+
+        const char* suffix = entry->d_name + prefix_len;
+        if (*suffix == '\0' || strspn(suffix, "0123456789") != strlen(suffix)) {
+            continue;
+        }
+
+        char dictionary_path[512];
+        build_dictionary_path(dictionary_path, sizeof(dictionary_path), topic_file_path, suffix);
+
+        void* dictionary = NULL;
+        size_t dictionary_size = 0;
+        if (fetch_dictionary(dictionary_path, &dictionary, &dictionary_size) != 0) {
+            fprintf(stderr, "Failed to load dictionary %s\n", dictionary_path);
+            continue;
+        }
+
+        DictionaryGeneration* generation = generation_create(dictionary, dictionary_size);
+        free(dictionary);
+        if (!generation) {
+            fprintf(stderr, "Failed to digest dictionary %s\n", dictionary_path);
+            continue;
+        }
+
+        if (find_generation(dictionaries, generation->dictionary_id)) {
+            generation_free(generation);
+            continue;
+        }
+
+        register_generation_locked(dictionaries, generation);
+    }
+
+    closedir(dir);
+
+    unsigned active_id = read_active_id(topic_file_path);
+    if (active_id != 0) {
+        __atomic_store_n(&dictionaries->active, find_generation(dictionaries, active_id), __ATOMIC_RELEASE);
+    }
+}
+
+static void* create_dictionaries(const char* topic_file_path, void* context) {
+    (void)context;
+    TopicDictionaries* dictionaries = (TopicDictionaries*)calloc(1, sizeof(TopicDictionaries));
+    if (!dictionaries) {
+        return NULL;
+    }
+
+    dictionaries->topic_file_path = strdup(topic_file_path);
+    if (!dictionaries->topic_file_path || pthread_mutex_init(&dictionaries->mutex, NULL) != 0) {
+        free(dictionaries->topic_file_path);
+        free(dictionaries);
+        return NULL;
+    }
+
+    load_generations(dictionaries);
+    return dictionaries;
+}
+
+TopicDictionaries* dictionaries_for_topic(const char* topic_file_path) {
+    return (TopicDictionaries*)path_registry_get(&g_dictionaries, topic_file_path, create_dictionaries, NULL);
+}
+
+int dictionaries_add(TopicDictionaries* dictionaries, const void* dictionary, size_t dictionary_size,
+                     int activate) {
+    if (!dictionaries || !dictionary || dictionary_size == 0) {
+        return -1;
+    }
+
+    unsigned dictionary_id = ZSTD_getDictID_fromDict(dictionary, dictionary_size);
+    if (dictionary_id == 0) {
+        return -1;
+    }
+
+    pthread_mutex_lock(&dictionaries->mutex);
+
+    DictionaryGeneration* generation = find_generation(dictionaries, dictionary_id);
+    if (!generation) {
+        char dictionary_path[512];
+        char id_text[16];
+        snprintf(id_text, sizeof(id_text), "%u", dictionary_id);
+        build_dictionary_path(dictionary_path, sizeof(dictionary_path), dictionaries->topic_file_path, id_text);
+
+        generation = generation_create(dictionary, dictionary_size);
+        if (!generation || save_dictionary(dictionary, dictionary_size, dictionary_path) != 0) {
+            generation_free(generation);
+            pthread_mutex_unlock(&dictionaries->mutex);
+            return -1;
+        }
+
+        register_generation_locked(dictionaries, generation);
+    }
+
+    if (activate && write_active_id(dictionaries->topic_file_path, dictionary_id) == 0) {
+        __atomic_store_n(&dictionaries->active, generation, __ATOMIC_RELEASE);
+    }
+
+    pthread_mutex_unlock(&dictionaries->mutex);
+    return (int)dictionary_id;
+}
+
+int dictionaries_activate(TopicDictionaries* dictionaries, unsigned dictionary_id) {
+    if (!dictionaries) {
+        return -1;
+    }
+
+    pthread_mutex_lock(&dictionaries->mutex);
+
+    DictionaryGeneration* generation = dictionary_id ? find_generation(dictionaries, dictionary_id) : NULL;
+    if ((dictionary_id && !generation) || write_active_id(dictionaries->topic_file_path, dictionary_id) != 0) {
+        pthread_mutex_unlock(&dictionaries->mutex);
+        return -1;
+    }
+
+    __atomic_store_n(&dictionaries->active, generation, __ATOMIC_RELEASE);
+    pthread_mutex_unlock(&dictionaries->mutex);
+    return 0;
+}
+
+unsigned dictionaries_active_id(TopicDictionaries* dictionaries) {
+    if (!dictionaries) {
+        return 0;
+    }
+
+    DictionaryGeneration* active = __atomic_load_n(&dictionaries->active, __ATOMIC_ACQUIRE);
+    return active ? active->dictionary_id : 0;
+}
+
+int dictionaries_encode(TopicDictionaries* dictionaries, const char* data, size_t data_size,
+                        uint8_t* compressed_data, size_t compressed_capacity,
+                        size_t* compressed_size, int compression_level) {
+    DictionaryGeneration* active = dictionaries ? __atomic_load_n(&dictionaries->active, __ATOMIC_ACQUIRE) : NULL;
+    if (!active) {
+        return encode_string_into(data, data_size, compressed_data, compressed_capacity,
+                                  compressed_size, compression_level);
+    }
+
+    const ZSTD_CDict* cdict = generation_cdict(dictionaries, active, encoder_clamp_level(compression_level));
+    if (!cdict) {
+        return -2;
+    }
+
+    return encode_string_into_with_cdict(data, data_size, cdict, compressed_data, compressed_capacity,
+                                         compressed_size);
+}
+
+int dictionaries_active_cdict(TopicDictionaries* dictionaries, int compression_level, const ZSTD_CDict** cdict) {
+    if (!cdict) {
+        return -1;
+    }
+
+    *cdict = NULL;
+    DictionaryGeneration* active = dictionaries ? __atomic_load_n(&dictionaries->active, __ATOMIC_ACQUIRE) : NULL;
+    if (!active) {
+        return 0;
+    }
+
+    *cdict = generation_cdict(dictionaries, active, encoder_clamp_level(compression_level));
+    return *cdict ? 0 : -1;
+}
+
+int dictionaries_decode(TopicDictionaries* dictionaries, const uint8_t* compressed_data, size_t compressed_size,
+                        char* decompressed_data, size_t decompressed_capacity, size_t* decompressed_size) {
+    if (!compressed_data || compressed_size == 0) {
+        return -1;
+    }
+
+    unsigned dictionary_id = ZSTD_getDictID_fromFrame(compressed_data, compressed_size);
+    if (dictionary_id == 0) {
+        return decode_string_into(compressed_data, compressed_size, decompressed_data, decompressed_capacity,
+                                  decompressed_size);
+    }
+
+    DictionaryGeneration* generation = dictionaries ? find_generation(dictionaries, dictionary_id) : NULL;
+    if (!generation) {
+        return -4;
+    }
+
+    return decode_string_into_with_ddict(compressed_data, compressed_size, generation->ddict,
+                                         decompressed_data, decompressed_capacity, decompressed_size);
+}
+
+int dictionaries_ddict_for_frame(TopicDictionaries* dictionaries, const uint8_t* compressed_data,
+                                 size_t compressed_size, const ZSTD_DDict** ddict) {
+    if (!compressed_data || compressed_size == 0 || !ddict) {
+        return -1;
+    }
+
+    *ddict = NULL;
+    unsigned dictionary_id = ZSTD_getDictID_fromFrame(compressed_data, compressed_size);
+    if (dictionary_id == 0) {
+        return 0;
+    }
+
+    DictionaryGeneration* generation = dictionaries ? find_generation(dictionaries, dictionary_id) : NULL;
+    if (!generation) {
+        return -1;
+    }
+
+    *ddict = generation->ddict;
+    return 0;
+}
+
+void dictionaries_free_all(void) {
+    TopicDictionaries* dictionaries = (TopicDictionaries*)path_registry_take_all(&g_dictionaries);
+    while (dictionaries) {
+        TopicDictionaries* next = dictionaries->next;
+
+        DictionaryGeneration* generation = dictionaries->generations;
+        while (generation) {
+            DictionaryGeneration* next_generation = generation->next;
+            generation_free(generation);
+            generation = next_generation;
+        }
+
+        pthread_mutex_destroy(&dictionaries->mutex);
+        free(dictionaries->topic_file_path);
+        free(dictionaries);
+        dictionaries = next;
+    }
+}
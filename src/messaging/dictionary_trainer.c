@@ -0,0 +1,373 @@
+#include "headers/dictionary_trainer.h"
+#include "headers/dictionary_registry.h"
+#include "headers/delay_scheduler.h"
+#include "headers/create_topic.h"
+#include "headers/encoder.h"
+#include "headers/codec.h"
+#include "headers/record_format.h"
+#include "../writer/headers/block_cache.h"
+#include "../utils/header/path_registry.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <errno.h>
+#include <pthread.h>
+
+// Topics are registered the first time something is published to them
+// compressed. The trainer thread wakes up periodically and retrains a topic
+// once enough records arrived since the last pass and either it has no
+// dictionary yet, the retrain interval elapsed, or the compression ratio
+// drifted below the baseline measured after the last training.
+//
+// Each pass reservoir-samples the records appended since the previous pass by
+// offset only, then reads the chosen records straight from the block cache
+// into one contiguous training buffer (decoding the ones stored compressed).
+// The new generation is published through the dictionary registry, which
+// switches new publishes over atomically.
+#define TRAINER_CHECK_INTERVAL_MS 5000
+#define RETRAIN_INTERVAL_MS (10 * 60 * 1000)
+#define MIN_TRAINING_RECORDS 1000
+#define MIN_TRAINING_SAMPLES 256
+#define MAX_TRAINING_SAMPLES 4096
+#define TARGET_DICTIONARY_SIZE (16 * 1024)
+#define SAMPLE_BUFFER_SIZE (100 * TARGET_DICTIONARY_SIZE)
+#define RATIO_DRIFT_PERCENT 15
+#define RECORD_SIZE_HEADER_SIZE RECORD_HEADER_SIZE
+#define MAX_RECORD_SIZE (10 * 1024 * 1024) // 10MB max record size
+
+typedef struct {
+    PathRegistry topics;
+    pthread_mutex_t mutex;
+    pthread_cond_t wakeup;
+    pthread_t thread;
+    int running;
+} DictionaryTrainer;
+
+static DictionaryTrainer g_trainer = {
+    PATH_REGISTRY_INITIALIZER(TrainedTopic, topic_file_path), PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER, 0, 0
+};
+
+typedef struct {
+    size_t offset;
+    uint32_t size;
+    uint8_t codec;
+} SampleRef;
+
+static int compare_samples(const void* a, const void* b) {
+    const SampleRef* left = (const SampleRef*)a;
+    const SampleRef* right = (const SampleRef*)b;
+    return (left->offset > right->offset) - (left->offset < right->offset);
+}
+
+static uint64_t next_random(uint64_t* state) {
+    uint64_t x = *state;
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+    *state = x;
+    return x;
+}
+
+static void* create_trained_topic(const char* topic_file_path, void* context) {
+    (void)context;
+    TrainedTopic* topic = (TrainedTopic*)calloc(1, sizeof(TrainedTopic));
+    if (!topic) {
+        return NULL;
+    }
+
+    topic->topic_file_path = strdup(topic_file_path);
+    if (!topic->topic_file_path) {
+        free(topic);
+        return NULL;
+    }
+
+    topic->next_offset = TOPIC_FILE_HEADER_SIZE;
+    return topic;
+}
+
+static TrainedTopic* register_topic(const char* topic_file_path) {
+    return (TrainedTopic*)path_registry_get(&g_trainer.topics, topic_file_path, create_trained_topic, NULL);
+}
+
+// Reservoir-sample record positions in [*offset, end of log) and advance
+// *offset past the last complete record.
+static size_t sample_records(BlockCacheFile* log, size_t* offset, SampleRef* samples) {
+    size_t log_size = block_cache_file_size(log);
+    size_t position = *offset;
+    size_t seen = 0;
+    size_t taken = 0;
+    uint64_t random_state = (uint64_t)current_time_ms() | 1;
+
+    if (position > log_size) {
+        position = TOPIC_FILE_HEADER_SIZE;
+    }
+
+    while (position + RECORD_SIZE_HEADER_SIZE <= log_size) {
+        uint32_t header;
+        if (block_cache_read(log, &header, RECORD_SIZE_HEADER_SIZE, position) != (long)RECORD_SIZE_HEADER_SIZE) {
+            break;
+        }
+
+        uint32_t record_size = RECORD_HEADER_PAYLOAD_SIZE(header);
+        if (record_size == 0 || record_size > MAX_RECORD_SIZE ||
+            position + RECORD_SIZE_HEADER_SIZE + record_size > log_size) {
+            break;
+        }
+
+        SampleRef sample = { position + RECORD_SIZE_HEADER_SIZE, record_size, RECORD_HEADER_CODEC(header) };
+        if (taken < MAX_TRAINING_SAMPLES) {
+            samples[taken++] = sample;
+        } else {
+            uint64_t slot = next_random(&random_state) % (seen + 1);
+            if (slot < MAX_TRAINING_SAMPLES) {
+                samples[slot] = sample;
+            }
+        }
+
+        seen++;
+        position += RECORD_SIZE_HEADER_SIZE + record_size;
+    }
+
+    *offset = position;
+    return taken;
+}
+
+static int run_training_pass(TrainedTopic* topic) {
+    BlockCacheFile* log = block_cache_open(topic->topic_file_path);
+    if (!log) {
+        return -1;
+    }
+
+    TopicDictionaries* dictionaries = dictionaries_for_topic(topic->topic_file_path);
+    SampleRef* samples = (SampleRef*)malloc(MAX_TRAINING_SAMPLES * sizeof(SampleRef));
+    size_t* sample_sizes = (size_t*)malloc(MAX_TRAINING_SAMPLES * sizeof(size_t));
+    uint8_t* sample_buffer = (uint8_t*)malloc(SAMPLE_BUFFER_SIZE);
+
+    if (!dictionaries || !samples || !sample_sizes || !sample_buffer) {
+        free(samples);
+        free(sample_sizes);
+        free(sample_buffer);
+        return -1;
+    }
+
+    size_t offset = topic->next_offset;
+    size_t taken = sample_records(log, &offset, samples);
+
+    // Read in log order so neighbouring samples share cached blocks.
+    qsort(samples, taken, sizeof(SampleRef), compare_samples);
+
+    size_t used = 0;
+    size_t count = 0;
+    for (size_t i = 0; i < taken && used < SAMPLE_BUFFER_SIZE; i++) {
+        size_t remaining = SAMPLE_BUFFER_SIZE - used;
+
+        if (samples[i].codec == RECORD_CODEC_NONE) {
+            if (samples[i].size > remaining ||
+                block_cache_read(log, sample_buffer + used, samples[i].size, samples[i].offset) != (long)samples[i].size) {
+                continue;
+            }
+            sample_sizes[count++] = samples[i].size;
+            used += samples[i].size;
+        } else {
+            const Codec* codec = codec_by_id(samples[i].codec);
+            uint8_t* encoded = encoder_scratch_buffer(samples[i].size);
+            size_t decoded_size = 0;
+            if (!codec || !encoded ||
+                block_cache_read(log, encoded, samples[i].size, samples[i].offset) != (long)samples[i].size ||
+                codec->decode(topic->topic_file_path, encoded, samples[i].size, sample_buffer + used,
+                              remaining, &decoded_size) != 0) {
+                continue;
+            }
+            sample_sizes[count++] = decoded_size;
+            used += decoded_size;
+        }
+    }
+
+    int result = -1;
+    if (count >= MIN_TRAINING_SAMPLES) {
+        void* dictionary = NULL;
+        size_t dictionary_size = 0;
+
+        if (train_dictionary_from_buffer(sample_buffer, sample_sizes, count, TARGET_DICTIONARY_SIZE,
+                                         &dictionary, &dictionary_size) == 0) {
+            if (dictionaries_add(dictionaries, dictionary, dictionary_size, 1) > 0) {
+                result = 0;
+            }
+            free(dictionary);
+        }
+    }
+
+    free(samples);
+    free(sample_sizes);
+    free(sample_buffer);
+
+    if (result == 0) {
+        topic->next_offset = offset;
+        __atomic_store_n(&topic->raw_bytes, 0, __ATOMIC_RELAXED);
+        __atomic_store_n(&topic->compressed_bytes, 0, __ATOMIC_RELAXED);
+        __atomic_store_n(&topic->records, 0, __ATOMIC_RELAXED);
+        topic->baseline_ratio_permille = 0;
+        topic->last_trained_ms = current_time_ms();
+    } else {
+        fprintf(stderr, "Dictionary training skipped for %s (%zu usable samples)\n",
+                topic->topic_file_path, count);
+    }
+
+    return result;
+}
+
+static int train_topic(TrainedTopic* topic) {
+    // A manual run and the trainer thread never work on the same topic at once.
+    if (__atomic_exchange_n(&topic->training, 1, __ATOMIC_ACQUIRE)) {
+        return -1;
+    }
+
+    int result = run_training_pass(topic);
+    __atomic_store_n(&topic->training, 0, __ATOMIC_RELEASE);
+    return result;
+}
+
+static int should_train(TrainedTopic* topic, uint64_t now_ms) {
+    uint64_t records = __atomic_load_n(&topic->records, __ATOMIC_RELAXED);
+    if (records < MIN_TRAINING_RECORDS) {
+        return 0;
+    }
+
+    uint64_t raw_bytes = __atomic_load_n(&topic->raw_bytes, __ATOMIC_RELAXED);
+    uint64_t compressed_bytes = __atomic_load_n(&topic->compressed_bytes, __ATOMIC_RELAXED);
+    uint64_t ratio_permille = compressed_bytes ? raw_bytes * 1000 / compressed_bytes : 0;
+
+    if (dictionaries_active_id(dictionaries_for_topic(topic->topic_file_path)) == 0) {
+        return 1;
+    }
+
+    if (now_ms - topic->last_trained_ms >= RETRAIN_INTERVAL_MS) {
+        return 1;
+    }
+
+    // The first full window after a training sets the baseline later windows
+    // are compared against.
+    if (topic->baseline_ratio_permille == 0) {
+        topic->baseline_ratio_permille = ratio_permille;
+        __atomic_store_n(&topic->raw_bytes, 0, __ATOMIC_RELAXED);
+        __atomic_store_n(&topic->compressed_bytes, 0, __ATOMIC_RELAXED);
+        __atomic_store_n(&topic->records, 0, __ATOMIC_RELAXED);
+        return 0;
+    }
+
+    return ratio_permille * 100 < topic->baseline_ratio_permille * (100 - RATIO_DRIFT_PERCENT);
+}
+
+static void* trainer_thread_main(void* arg) {
+    (void)arg;
+
+    pthread_mutex_lock(&g_trainer.mutex);
+    while (g_trainer.running) {
+        struct timespec deadline;
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_sec += TRAINER_CHECK_INTERVAL_MS / 1000;
+        deadline.tv_nsec += (long)(TRAINER_CHECK_INTERVAL_MS % 1000) * 1000000L;
+        if (deadline.tv_nsec >= 1000000000L) {
+            deadline.tv_sec++;
+            deadline.tv_nsec -= 1000000000L;
+        }
+
+        int wait_result = 0;
+        while (g_trainer.running && wait_result != ETIMEDOUT) {
+            wait_result = pthread_cond_timedwait(&g_trainer.wakeup, &g_trainer.mutex, &deadline);
+        }
+        if (!g_trainer.running) {
+            break;
+        }
+        pthread_mutex_unlock(&g_trainer.mutex);
+
+        // Training runs without the trainer lock so publishes can keep
+        // registering topics and counting bytes meanwhile.
+        uint64_t now_ms = current_time_ms();
+        TrainedTopic* head = __atomic_load_n(&g_trainer.topics.head, __ATOMIC_ACQUIRE);
+        for (TrainedTopic* topic = head; topic; topic = topic->next) {
+            if (should_train(topic, now_ms)) {
+                train_topic(topic);
+            }
+        }
+
+        pthread_mutex_lock(&g_trainer.mutex);
+    }
+    pthread_mutex_unlock(&g_trainer.mutex);
+
+    return NULL;
+}
+
+int dictionary_trainer_start(void) {
+    pthread_mutex_lock(&g_trainer.mutex);
+
+    if (g_trainer.running) {
+        pthread_mutex_unlock(&g_trainer.mutex);
+        return 0;
+    }
+
+    g_trainer.running = 1;
+    if (pthread_create(&g_trainer.thread, NULL, trainer_thread_main, NULL) != 0) {
+        perror("Failed to create dictionary trainer thread");
+        g_trainer.running = 0;
+        pthread_mutex_unlock(&g_trainer.mutex);
+        return -1;
+    }
+
+    pthread_mutex_unlock(&g_trainer.mutex);
+    return 0;
+}
+
+void dictionary_trainer_stop(void) {
+    pthread_mutex_lock(&g_trainer.mutex);
+    if (!g_trainer.running) {
+        pthread_mutex_unlock(&g_trainer.mutex);
+        return;
+    }
+    g_trainer.running = 0;
+    pthread_cond_signal(&g_trainer.wakeup);
+    pthread_mutex_unlock(&g_trainer.mutex);
+
+    pthread_join(g_trainer.thread, NULL);
+
+    TrainedTopic* topic = (TrainedTopic*)path_registry_take_all(&g_trainer.topics);
+    while (topic) {
+        TrainedTopic* next = topic->next;
+        free(topic->topic_file_path);
+        free(topic);
+        topic = next;
+    }
+}
+
+void dictionary_trainer_observe(const char* topic_file_path, size_t raw_size, size_t compressed_size) {
+    if (!topic_file_path) {
+        return;
+    }
+
+    TrainedTopic* topic = register_topic(topic_file_path);
+    if (!topic) {
+        return;
+    }
+
+    __atomic_fetch_add(&topic->raw_bytes, raw_size, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&topic->compressed_bytes, compressed_size, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&topic->records, 1, __ATOMIC_RELAXED);
+
+    if (!__atomic_load_n(&g_trainer.running, __ATOMIC_RELAXED)) {
+        dictionary_trainer_start();
+    }
+}
+
+int dictionary_trainer_train(const char* topic_file_path) {
+    if (!topic_file_path) {
+        return -1;
+    }
+
+    TrainedTopic* topic = register_topic(topic_file_path);
+    if (!topic) {
+        return -1;
+    }
+
+    return train_topic(topic);
+}
@@ -1,39 +1,270 @@
 #include "headers/encoder.h"
+#include "headers/stream_codec.h"
 #include <zstd.h>
+#include <zdict.h>
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
 #include <errno.h>
+#include <pthread.h>
 
 #define DEFAULT_COMPRESSION_LEVEL 3
 #define MIN_DICTIONARY_SIZE 1024
 #define MAX_DICTIONARY_SIZE (1024 * 1024) // 1MB max
+#define MAX_STREAMED_DECODE_SIZE (64 * 1024 * 1024) // frames without a content size
+
+// Each thread keeps one compression and one decompression context alive and
+// only touches their parameters when the level or dictionary changes, so the
+// hot path never allocates a context or re-digests a dictionary. Dictionaries
+// are remembered by address, size and dictionary ID. They are copied into the
+// context when loaded, so the caller's buffer is not retained.
+typedef struct {
+    ZSTD_CCtx* cctx;
+    int cctx_level;
+    const ZSTD_CDict* cctx_cdict;
+    const void* cctx_dictionary;
+    size_t cctx_dictionary_size;
+    unsigned cctx_dictionary_id;
+    ZSTD_DCtx* dctx;
+    const ZSTD_DDict* dctx_ddict;
+    const void* dctx_dictionary;
+    size_t dctx_dictionary_size;
+    unsigned dctx_dictionary_id;
+    uint8_t* scratch;
+    size_t scratch_capacity;
+} EncoderContexts;
+
+static pthread_key_t g_contexts_key;
+static pthread_once_t g_contexts_once = PTHREAD_ONCE_INIT;
+
+static void free_contexts(void* arg) {
+    EncoderContexts* contexts = (EncoderContexts*)arg;
+    if (!contexts) {
+        return;
+    }
+
+    ZSTD_freeCCtx(contexts->cctx);
+    ZSTD_freeDCtx(contexts->dctx);
+    free(contexts->scratch);
+    free(contexts);
+}
 
-int encode_string(const char* json_string, size_t json_size, 
-                  uint8_t** compressed_data, size_t* compressed_size, 
-                  int compression_level) {
-    if (!json_string || !compressed_data || !compressed_size || json_size == 0) {
+static void create_contexts_key(void) {
+    pthread_key_create(&g_contexts_key, free_contexts);
+}
+
+static EncoderContexts* thread_contexts(void) {
+    pthread_once(&g_contexts_once, create_contexts_key);
+
+    EncoderContexts* contexts = (EncoderContexts*)pthread_getspecific(g_contexts_key);
+    if (contexts) {
+        return contexts;
+    }
+
+    contexts = (EncoderContexts*)calloc(1, sizeof(EncoderContexts));
+    if (!contexts) {
+        return NULL;
+    }
+
+    if (pthread_setspecific(g_contexts_key, contexts) != 0) {
+        free(contexts);
+        return NULL;
+    }
+
+    return contexts;
+}
+
+int encoder_clamp_level(int compression_level) {
+    // Negative levels are zstd's fast modes; 0 and out-of-range values get the default.
+    if (compression_level == 0 || compression_level < ZSTD_minCLevel() || compression_level > ZSTD_maxCLevel()) {
+        return DEFAULT_COMPRESSION_LEVEL;
+    }
+    return compression_level;
+}
+
+static ZSTD_CCtx* acquire_cctx(int compression_level, const void* dictionary, size_t dictionary_size) {
+    EncoderContexts* contexts = thread_contexts();
+    if (!contexts) {
+        return NULL;
+    }
+
+    if (!contexts->cctx) {
+        contexts->cctx = ZSTD_createCCtx();
+        if (!contexts->cctx) {
+            return NULL;
+        }
+        contexts->cctx_level = 0;
+    }
+
+    if (!dictionary) {
+        dictionary_size = 0;
+    }
+
+    unsigned dictionary_id = dictionary_size > 0 ? ZSTD_getDictID_fromDict(dictionary, dictionary_size) : 0;
+    if (contexts->cctx_cdict || contexts->cctx_dictionary != dictionary ||
+        contexts->cctx_dictionary_size != dictionary_size || contexts->cctx_dictionary_id != dictionary_id) {
+        // Loading a raw dictionary also drops any referenced CDict.
+        contexts->cctx_cdict = NULL;
+        if (ZSTD_isError(ZSTD_CCtx_loadDictionary(contexts->cctx, dictionary, dictionary_size))) {
+            contexts->cctx_dictionary = NULL;
+            contexts->cctx_dictionary_size = 0;
+            ZSTD_CCtx_loadDictionary(contexts->cctx, NULL, 0);
+            return NULL;
+        }
+        contexts->cctx_dictionary = dictionary;
+        contexts->cctx_dictionary_size = dictionary_size;
+        contexts->cctx_dictionary_id = dictionary_id;
+    }
+
+    if (contexts->cctx_level != compression_level) {
+        if (ZSTD_isError(ZSTD_CCtx_setParameter(contexts->cctx, ZSTD_c_compressionLevel, compression_level))) {
+            return NULL;
+        }
+        contexts->cctx_level = compression_level;
+    }
+
+    return contexts->cctx;
+}
+
+static ZSTD_DCtx* acquire_dctx(const void* dictionary, size_t dictionary_size) {
+    EncoderContexts* contexts = thread_contexts();
+    if (!contexts) {
+        return NULL;
+    }
+
+    if (!contexts->dctx) {
+        contexts->dctx = ZSTD_createDCtx();
+        if (!contexts->dctx) {
+            return NULL;
+        }
+    }
+
+    if (!dictionary) {
+        dictionary_size = 0;
+    }
+
+    unsigned dictionary_id = dictionary_size > 0 ? ZSTD_getDictID_fromDict(dictionary, dictionary_size) : 0;
+    if (contexts->dctx_ddict || contexts->dctx_dictionary != dictionary ||
+        contexts->dctx_dictionary_size != dictionary_size || contexts->dctx_dictionary_id != dictionary_id) {
+        contexts->dctx_ddict = NULL;
+        if (ZSTD_isError(ZSTD_DCtx_loadDictionary(contexts->dctx, dictionary, dictionary_size))) {
+            contexts->dctx_dictionary = NULL;
+            contexts->dctx_dictionary_size = 0;
+            ZSTD_DCtx_loadDictionary(contexts->dctx, NULL, 0);
+            return NULL;
+        }
+        contexts->dctx_dictionary = dictionary;
+        contexts->dctx_dictionary_size = dictionary_size;
+        contexts->dctx_dictionary_id = dictionary_id;
+    }
+
+    return contexts->dctx;
+}
+
+static ZSTD_CCtx* acquire_cctx_with_cdict(const ZSTD_CDict* cdict) {
+    EncoderContexts* contexts = thread_contexts();
+    if (!contexts) {
+        return NULL;
+    }
+
+    if (!contexts->cctx) {
+        contexts->cctx = ZSTD_createCCtx();
+        if (!contexts->cctx) {
+            return NULL;
+        }
+        contexts->cctx_level = 0;
+    }
+
+    if (contexts->cctx_cdict != cdict) {
+        if (ZSTD_isError(ZSTD_CCtx_refCDict(contexts->cctx, cdict))) {
+            return NULL;
+        }
+        contexts->cctx_cdict = cdict;
+        contexts->cctx_dictionary = NULL;
+        contexts->cctx_dictionary_size = 0;
+        contexts->cctx_dictionary_id = 0;
+    }
+
+    return contexts->cctx;
+}
+
+static ZSTD_DCtx* acquire_dctx_with_ddict(const ZSTD_DDict* ddict) {
+    EncoderContexts* contexts = thread_contexts();
+    if (!contexts) {
+        return NULL;
+    }
+
+    if (!contexts->dctx) {
+        contexts->dctx = ZSTD_createDCtx();
+        if (!contexts->dctx) {
+            return NULL;
+        }
+    }
+
+    if (contexts->dctx_ddict != ddict) {
+        if (ZSTD_isError(ZSTD_DCtx_refDDict(contexts->dctx, ddict))) {
+            return NULL;
+        }
+        contexts->dctx_ddict = ddict;
+        contexts->dctx_dictionary = NULL;
+        contexts->dctx_dictionary_size = 0;
+        contexts->dctx_dictionary_id = 0;
+    }
+
+    return contexts->dctx;
+}
+
+size_t encode_bound(size_t input_size) {
+    return ZSTD_compressBound(input_size);
+}
+
+int encoded_content_size(const uint8_t* compressed_data, size_t compressed_size, size_t* content_size) {
+    if (!compressed_data || !content_size || compressed_size == 0) {
         return -1;
     }
 
-    if (compression_level < 1 || compression_level > ZSTD_maxCLevel()) {
-        compression_level = DEFAULT_COMPRESSION_LEVEL;
+    unsigned long long const size = ZSTD_getFrameContentSize(compressed_data, compressed_size);
+    if (size == ZSTD_CONTENTSIZE_ERROR || size == ZSTD_CONTENTSIZE_UNKNOWN) {
+        return -1;
     }
 
-    size_t const max_compressed_size = ZSTD_compressBound(json_size);
-    
-    *compressed_data = (uint8_t*)malloc(max_compressed_size);
-    if (!*compressed_data) {
-        return -2;
+    *content_size = (size_t)size;
+    return 0;
+}
+
+uint8_t* encoder_scratch_buffer(size_t size) {
+    EncoderContexts* contexts = thread_contexts();
+    if (!contexts) {
+        return NULL;
+    }
+
+    if (size > contexts->scratch_capacity) {
+        uint8_t* scratch = (uint8_t*)realloc(contexts->scratch, size);
+        if (!scratch) {
+            return NULL;
+        }
+        contexts->scratch = scratch;
+        contexts->scratch_capacity = size;
+    }
+
+    return contexts->scratch;
+}
+
+int encode_string_into_with_dict(const char* json_string, size_t json_size,
+                                 const void* dictionary, size_t dictionary_size,
+                                 uint8_t* compressed_data, size_t compressed_capacity,
+                                 size_t* compressed_size, int compression_level) {
+    if (!json_string || !compressed_data || !compressed_size || json_size == 0) {
+        return -1;
     }
 
-    size_t const result = ZSTD_compress(*compressed_data, max_compressed_size,
-                                       json_string, json_size,
-                                       compression_level);
+    ZSTD_CCtx* cctx = acquire_cctx(encoder_clamp_level(compression_level), dictionary, dictionary_size);
+    if (!cctx) {
+        return -2;
+    }
 
+    size_t const result = ZSTD_compress2(cctx, compressed_data, compressed_capacity, json_string, json_size);
     if (ZSTD_isError(result)) {
-        free(*compressed_data);
-        *compressed_data = NULL;
         return -3;
     }
 
@@ -41,57 +272,102 @@ int encode_string(const char* json_string, size_t json_size,
     return 0;
 }
 
-int decode_string(const uint8_t* compressed_data, size_t compressed_size,
-                  char** decompressed_string, size_t* decompressed_size) {
+int encode_string_into(const char* json_string, size_t json_size,
+                       uint8_t* compressed_data, size_t compressed_capacity,
+                       size_t* compressed_size, int compression_level) {
+    return encode_string_into_with_dict(json_string, json_size, NULL, 0,
+                                        compressed_data, compressed_capacity,
+                                        compressed_size, compression_level);
+}
+
+int decode_string_into_with_dict(const uint8_t* compressed_data, size_t compressed_size,
+                                 const void* dictionary, size_t dictionary_size,
+                                 char* decompressed_string, size_t decompressed_capacity,
+                                 size_t* decompressed_size) {
     if (!compressed_data || !decompressed_string || !decompressed_size || compressed_size == 0) {
         return -1;
     }
 
-    unsigned long long const decompressed_size_ll = ZSTD_getFrameContentSize(compressed_data, compressed_size);
-    
-    if (decompressed_size_ll == ZSTD_CONTENTSIZE_ERROR) {
+    ZSTD_DCtx* dctx = acquire_dctx(dictionary, dictionary_size);
+    if (!dctx) {
         return -2;
     }
-    
-    if (decompressed_size_ll == ZSTD_CONTENTSIZE_UNKNOWN) {
-        size_t estimated_size = compressed_size * 4;
-        *decompressed_string = (char*)malloc(estimated_size);
-        if (!*decompressed_string) {
-            return -3;
-        }
 
-        size_t const result = ZSTD_decompress(*decompressed_string, estimated_size,
-                                             compressed_data, compressed_size);
-        
-        if (ZSTD_isError(result)) {
-            free(*decompressed_string);
-            *decompressed_string = NULL;
-            return -4;
-        }
+    size_t const result = ZSTD_decompressDCtx(dctx, decompressed_string, decompressed_capacity,
+                                              compressed_data, compressed_size);
+    if (ZSTD_isError(result)) {
+        return -3;
+    }
+
+    *decompressed_size = result;
+    return 0;
+}
 
-        *decompressed_size = result;
-        return 0;
+int decode_string_into(const uint8_t* compressed_data, size_t compressed_size,
+                       char* decompressed_string, size_t decompressed_capacity,
+                       size_t* decompressed_size) {
+    return decode_string_into_with_dict(compressed_data, compressed_size, NULL, 0,
+                                        decompressed_string, decompressed_capacity,
+                                        decompressed_size);
+}
+
+int encode_string_into_with_cdict(const char* json_string, size_t json_size, const ZSTD_CDict* cdict,
+                                  uint8_t* compressed_data, size_t compressed_capacity,
+                                  size_t* compressed_size) {
+    if (!json_string || !cdict || !compressed_data || !compressed_size || json_size == 0) {
+        return -1;
     }
 
-    *decompressed_string = (char*)malloc((size_t)decompressed_size_ll + 1);
-    if (!*decompressed_string) {
-        return -3; 
+    // The level is the one the CDict was digested with.
+    ZSTD_CCtx* cctx = acquire_cctx_with_cdict(cdict);
+    if (!cctx) {
+        return -2;
+    }
+
+    size_t const result = ZSTD_compress2(cctx, compressed_data, compressed_capacity, json_string, json_size);
+    if (ZSTD_isError(result)) {
+        return -3;
+    }
+
+    *compressed_size = result;
+    return 0;
+}
+
+int decode_string_into_with_ddict(const uint8_t* compressed_data, size_t compressed_size, const ZSTD_DDict* ddict,
+                                  char* decompressed_string, size_t decompressed_capacity,
+                                  size_t* decompressed_size) {
+    if (!compressed_data || !ddict || !decompressed_string || !decompressed_size || compressed_size == 0) {
+        return -1;
     }
 
-    size_t const result = ZSTD_decompress(*decompressed_string, (size_t)decompressed_size_ll,
-                                         compressed_data, compressed_size);
+    ZSTD_DCtx* dctx = acquire_dctx_with_ddict(ddict);
+    if (!dctx) {
+        return -2;
+    }
 
+    size_t const result = ZSTD_decompressDCtx(dctx, decompressed_string, decompressed_capacity,
+                                              compressed_data, compressed_size);
     if (ZSTD_isError(result)) {
-        free(*decompressed_string);
-        *decompressed_string = NULL;
-        return -4;
+        return -3;
     }
 
-    (*decompressed_string)[result] = '\0';
     *decompressed_size = result;
     return 0;
 }
 
+int encode_string(const char* json_string, size_t json_size, 
+                  uint8_t** compressed_data, size_t* compressed_size, 
+                  int compression_level) {
+    return encode_string_with_dict(json_string, json_size, NULL, 0,
+                                   compressed_data, compressed_size, compression_level);
+}
+
+int decode_string(const uint8_t* compressed_data, size_t compressed_size,
+                  char** decompressed_string, size_t* decompressed_size) {
+    return decode_string_with_dict(compressed_data, compressed_size, NULL, 0,
+                                   decompressed_string, decompressed_size);
+}
+
 int encode_string_with_dict(const char* json_string, size_t json_size,
                             const void* dictionary, size_t dictionary_size,
                             uint8_t** compressed_data, size_t* compressed_size,
@@ -100,49 +376,82 @@ int encode_string_with_dict(const char* json_string, size_t json_size,
         return -1;
     }
 
-    if (compression_level < 1 || compression_level > ZSTD_maxCLevel()) {
-        compression_level = DEFAULT_COMPRESSION_LEVEL;
+    size_t const max_compressed_size = ZSTD_compressBound(json_size);
+    
+    *compressed_data = (uint8_t*)malloc(max_compressed_size);
+    if (!*compressed_data) {
+        return -2;
     }
 
-    ZSTD_CCtx* const cctx = ZSTD_createCCtx();
-    if (!cctx) {
-        return -2;
+    int result = encode_string_into_with_dict(json_string, json_size, dictionary, dictionary_size,
+                                              *compressed_data, max_compressed_size,
+                                              compressed_size, compression_level);
+    if (result != 0) {
+        free(*compressed_data);
+        *compressed_data = NULL;
+        return result;
     }
 
-    if (dictionary && dictionary_size > 0) {
-        size_t const dict_result = ZSTD_CCtx_loadDictionary(cctx, dictionary, dictionary_size);
-        if (ZSTD_isError(dict_result)) {
-            ZSTD_freeCCtx(cctx);
-            return -3;
+    return 0;
+}
+
+typedef struct {
+    char* data;
+    size_t size;
+    size_t capacity;
+} DecodedString;
+
+static int append_decoded(void* context, const uint8_t* data, size_t size) {
+    DecodedString* decoded = (DecodedString*)context;
+    if (decoded->size + size + 1 > decoded->capacity) {
+        size_t capacity = decoded->capacity ? decoded->capacity : ZSTD_DStreamOutSize();
+        while (decoded->size + size + 1 > capacity) {
+            capacity *= 2;
         }
-    }
 
-    size_t const level_result = ZSTD_CCtx_setParameter(cctx, ZSTD_c_compressionLevel, compression_level);
-    if (ZSTD_isError(level_result)) {
-        ZSTD_freeCCtx(cctx);
-        return -4;
+        char* grown = (char*)realloc(decoded->data, capacity);
+        if (!grown) {
+            return -1;
+        }
+        decoded->data = grown;
+        decoded->capacity = capacity;
     }
 
-    size_t const max_compressed_size = ZSTD_compressBound(json_size);
-    
-    *compressed_data = (uint8_t*)malloc(max_compressed_size);
-    if (!*compressed_data) {
-        ZSTD_freeCCtx(cctx);
-        return -5;
-    }
+    memcpy(decoded->data + decoded->size, data, size);
+    decoded->size += size;
+    return 0;
+}
 
-    size_t const result = ZSTD_compress2(cctx, *compressed_data, max_compressed_size,
-                                         json_string, json_size);
+// Frames written by a stream without a pledged size do not record how large
+// they decode; grow the output as the stream produces it instead of guessing.
+static int decode_unknown_size(const uint8_t* compressed_data, size_t compressed_size,
+                               const void* dictionary, size_t dictionary_size,
+                               char** decompressed_string, size_t* decompressed_size) {
+    ZSTD_DDict* ddict = NULL;
+    if (dictionary && dictionary_size > 0) {
+        ddict = ZSTD_createDDict(dictionary, dictionary_size);
+        if (!ddict) {
+            return -5;
+        }
+    }
 
-    ZSTD_freeCCtx(cctx);
+    DecodedString decoded = { NULL, 0, 0 };
+    DecodeStream* stream = decode_stream_create(ddict, MAX_STREAMED_DECODE_SIZE, append_decoded, &decoded);
+    int result = stream &&
+                 decode_stream_write(stream, compressed_data, compressed_size) == 0 &&
+                 decode_stream_finish(stream) == 0 &&
+                 append_decoded(&decoded, (const uint8_t*)"", 0) == 0 ? 0 : -6;
+    decode_stream_free(stream);
+    ZSTD_freeDDict(ddict);
 
-    if (ZSTD_isError(result)) {
-        free(*compressed_data);
-        *compressed_data = NULL;
-        return -6;
+    if (result != 0) {
+        free(decoded.data);
+        return result;
     }
 
-    *compressed_size = result;
+    decoded.data[decoded.size] = '\0';
+    *decompressed_string = decoded.data;
+    *decompressed_size = decoded.size;
     return 0;
 }
 
@@ -153,50 +462,34 @@ int decode_string_with_dict(const uint8_t* compressed_data, size_t compressed_si
         return -1;
     }
 
-    ZSTD_DCtx* const dctx = ZSTD_createDCtx();
-    if (!dctx) {
-        return -2;
-    }
-
-    if (dictionary && dictionary_size > 0) {
-        size_t const dict_result = ZSTD_DCtx_loadDictionary(dctx, dictionary, dictionary_size);
-        if (ZSTD_isError(dict_result)) {
-            ZSTD_freeDCtx(dctx);
-            return -3;
-        }
-    }
-
     unsigned long long const decompressed_size_ll = ZSTD_getFrameContentSize(compressed_data, compressed_size);
     
     size_t buffer_size;
     if (decompressed_size_ll == ZSTD_CONTENTSIZE_ERROR) {
-        ZSTD_freeDCtx(dctx);
         return -4;
     } else if (decompressed_size_ll == ZSTD_CONTENTSIZE_UNKNOWN) {
-        buffer_size = compressed_size * 4;
+        return decode_unknown_size(compressed_data, compressed_size, dictionary, dictionary_size,
+                                   decompressed_string, decompressed_size);
     } else {
         buffer_size = (size_t)decompressed_size_ll;
     }
 
     *decompressed_string = (char*)malloc(buffer_size + 1); // +1 for null terminator
     if (!*decompressed_string) {
-        ZSTD_freeDCtx(dctx);
         return -5;
     }
 
-    size_t const result = ZSTD_decompressDCtx(dctx, *decompressed_string, buffer_size,
-                                             compressed_data, compressed_size);
-
-    ZSTD_freeDCtx(dctx);
-
-    if (ZSTD_isError(result)) {
+    size_t result_size = 0;
+    int result = decode_string_into_with_dict(compressed_data, compressed_size, dictionary, dictionary_size,
+                                              *decompressed_string, buffer_size, &result_size);
+    if (result != 0) {
         free(*decompressed_string);
         *decompressed_string = NULL;
         return -6;
     }
 
-    (*decompressed_string)[result] = '\0';
-    *decompressed_size = result;
+    (*decompressed_string)[result_size] = '\0';
+    *decompressed_size = result_size;
     return 0;
 }
 
@@ -270,9 +563,9 @@ int fetch_dictionary(const char* filepath, void** dictionary, size_t* dictionary
     return 0;
 }
 
-int train_dictionary(const char** samples, const size_t* sample_sizes, 
-                     size_t num_samples, size_t dictionary_size,
-                     void** dictionary, size_t* actual_dict_size) {
+int train_dictionary_from_buffer(const void* samples, const size_t* sample_sizes,
+                                 size_t num_samples, size_t dictionary_size,
+                                 void** dictionary, size_t* actual_dict_size) {
     if (!samples || !sample_sizes || num_samples == 0 || !dictionary || !actual_dict_size) {
         return -1;
     }
@@ -281,42 +574,15 @@ int train_dictionary(const char** samples, const size_t* sample_sizes,
         dictionary_size = 1024 * 10;
     }
 
-    void** sample_buffers = (void**)malloc(num_samples * sizeof(void*));
-    if (!sample_buffers) {
-        return -2;
-    }
-
-    for (size_t i = 0; i < num_samples; i++) {
-        sample_buffers[i] = malloc(sample_sizes[i]);
-        if (!sample_buffers[i]) {
-            for (size_t j = 0; j < i; j++) {
-                free(sample_buffers[j]);
-            }
-            free(sample_buffers);
-            return -2;
-        }
-        memcpy(sample_buffers[i], samples[i], sample_sizes[i]);
-    }
-
     *dictionary = malloc(dictionary_size);
     if (!*dictionary) {
-        for (size_t i = 0; i < num_samples; i++) {
-            free(sample_buffers[i]);
-        }
-        free(sample_buffers);
         return -2;
     }
 
-    size_t const result = ZSTD_trainFromBuffer(*dictionary, dictionary_size,
-                                               sample_buffers, sample_sizes,
-                                               num_samples);
-
-    for (size_t i = 0; i < num_samples; i++) {
-        free(sample_buffers[i]);
-    }
-    free(sample_buffers);
+    size_t const result = ZDICT_trainFromBuffer(*dictionary, dictionary_size,
+                                                samples, sample_sizes, (unsigned)num_samples);
 
-    if (ZSTD_isError(result)) {
+    if (ZDICT_isError(result)) {
         free(*dictionary);
         *dictionary = NULL;
         return -3;
@@ -326,3 +592,32 @@ int train_dictionary(const char** samples, const size_t* sample_sizes,
     return 0;
 }
 
+int train_dictionary(const char** samples, const size_t* sample_sizes, 
+                     size_t num_samples, size_t dictionary_size,
+                     void** dictionary, size_t* actual_dict_size) {
+    if (!samples || !sample_sizes || num_samples == 0 || !dictionary || !actual_dict_size) {
+        return -1;
+    }
+
+    // The trainer wants every sample back to back in one buffer.
+    size_t total_size = 0;
+    for (size_t i = 0; i < num_samples; i++) {
+        total_size += sample_sizes[i];
+    }
+
+    uint8_t* sample_buffer = (uint8_t*)malloc(total_size ? total_size : 1);
+    if (!sample_buffer) {
+        return -2;
+    }
+
+    size_t offset = 0;
+    for (size_t i = 0; i < num_samples; i++) {
+        memcpy(sample_buffer + offset, samples[i], sample_sizes[i]);
+        offset += sample_sizes[i];
+    }
+
+    int result = train_dictionary_from_buffer(sample_buffer, sample_sizes, num_samples,
+                                              dictionary_size, dictionary, actual_dict_size);
+    free(sample_buffer);
+    return result;
+}
@@ -0,0 +1,43 @@
+#ifndef CODEC_H
+#define CODEC_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// A codec turns a payload into what is stored after the record header and
+// back. The topic path lets zstd pick up the topic's dictionaries; the other
+// codecs ignore it, and NULL means "no topic".
+typedef struct Codec {
+    uint8_t id;
+    const char* name;
+    size_t (*bound)(size_t data_size);
+    int (*encode)(const char* topic_file_path, const void* data, size_t data_size,
+                  uint8_t* encoded, size_t encoded_capacity, size_t* encoded_size, int level);
+    int (*decoded_size)(const uint8_t* encoded, size_t encoded_size, size_t* decoded_size);
+    int (*decode)(const char* topic_file_path, const uint8_t* encoded, size_t encoded_size,
+                  uint8_t* decoded, size_t decoded_capacity, size_t* decoded_size);
+} Codec;
+
+typedef struct TopicCodec {
+    char* topic_file_path;
+    uint8_t codec;
+    struct TopicCodec* next;
+} TopicCodec;
+
+const Codec* codec_by_id(uint8_t id);
+
+const Codec* codec_by_name(const char* name);
+
+int topic_codec_set(const char* topic_file_path, uint8_t codec);
+
+// Whether a client that accepts the record's codec can decode it alone. zstd
+// frames made with a topic dictionary need the dictionary, which only the
+// broker has, so they are decoded for every client.
+int codec_record_portable(uint8_t codec, const uint8_t* encoded, size_t encoded_size);
+
+// The codec new records of a topic are stored with; none unless set.
+uint8_t topic_codec(const char* topic_file_path);
+
+void topic_codecs_free(void);
+
+#endif
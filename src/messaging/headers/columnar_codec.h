@@ -0,0 +1,66 @@
+#ifndef COLUMNAR_CODEC_H
+#define COLUMNAR_CODEC_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <pthread.h>
+#include "record_filter.h"
+
+#define COLUMN_INT 1
+#define COLUMN_STRING 2
+#define COLUMN_RAW 3
+
+#define MAX_SHAPE_FIELDS 64
+#define MAX_TOPIC_SHAPES 64
+#define MAX_COLUMN_VALUES 255
+#define MAX_COLUMN_VALUE_SIZE 64
+#define COLUMN_CANDIDATES 8
+
+typedef struct ShapeColumn {
+    uint8_t type;
+    char* key;
+    size_t key_size;
+    char* values[MAX_COLUMN_VALUES];
+    uint8_t value_sizes[MAX_COLUMN_VALUES];
+    unsigned value_count;
+    char candidates[COLUMN_CANDIDATES][MAX_COLUMN_VALUE_SIZE];
+    uint8_t candidate_sizes[COLUMN_CANDIDATES];
+    unsigned next_candidate;
+} ShapeColumn;
+
+typedef struct RecordShape {
+    unsigned id;
+    size_t field_count;
+    ShapeColumn columns[];
+} RecordShape;
+
+typedef struct TopicShapes {
+    char* topic_file_path;
+    RecordShape* shapes[MAX_TOPIC_SHAPES];
+    unsigned shape_count;
+    pthread_mutex_t mutex;
+    struct TopicShapes* next;
+} TopicShapes;
+
+TopicShapes* shapes_for_topic(const char* topic_file_path);
+
+size_t columnar_bound(size_t data_size);
+
+// Records that are not a flat JSON object, or whose shape cannot be
+// registered, are stored verbatim behind a one-byte marker.
+int columnar_encode(TopicShapes* shapes, const uint8_t* data, size_t data_size,
+                    uint8_t* encoded, size_t encoded_capacity, size_t* encoded_size);
+
+int columnar_decoded_size(const uint8_t* encoded, size_t encoded_size, size_t* decoded_size);
+
+int columnar_decode(TopicShapes* shapes, const uint8_t* encoded, size_t encoded_size,
+                    uint8_t* decoded, size_t decoded_capacity, size_t* decoded_size);
+
+// 1 or 0 when the filter could be evaluated on the encoded record, -1 when
+// the record has to be decoded first.
+int columnar_filter_match(TopicShapes* shapes, const RecordFilter* filter,
+                          const uint8_t* encoded, size_t encoded_size);
+
+void shapes_free_all(void);
+
+#endif
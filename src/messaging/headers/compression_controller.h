@@ -0,0 +1,67 @@
+#ifndef COMPRESSION_CONTROLLER_H
+#define COMPRESSION_CONTROLLER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Bounds of a topic that was not given its own.
+#define COMPRESSION_DEFAULT_MIN_LEVEL -5
+#define COMPRESSION_DEFAULT_MAX_LEVEL 9
+
+typedef struct AdaptiveLevel {
+    char* topic_file_path;
+    int min_level;
+    int max_level;
+    int level;
+    int in_flight;
+    int peak_in_flight;
+    int adjusting;
+    uint64_t window_start_ms;
+    uint64_t raw_bytes;
+    uint64_t compressed_bytes;
+    uint64_t encode_ns;
+    uint64_t encoder_mask;
+    uint64_t records;
+    uint64_t ratio_permille;
+    uint64_t cpu_permille;
+    uint64_t ratio_before_step_up;
+    uint64_t hold_until_ms;
+    struct AdaptiveLevel* next;
+} AdaptiveLevel;
+
+typedef struct {
+    int level;
+    int min_level;
+    int max_level;
+    int queue_depth;
+    uint64_t ratio_permille;
+    uint64_t cpu_permille;
+} CompressionStats;
+
+AdaptiveLevel* compression_controller_for_topic(const char* topic_file_path);
+
+// Whether min_level..max_level can bound a topic: zstd levels, neither 0
+// (which means zstd's default), in order.
+int compression_bounds_valid(int min_level, int max_level);
+
+int compression_controller_set_bounds(const char* topic_file_path, int min_level, int max_level);
+
+// Returns the level the next publish should compress at; pair with _end.
+int compression_controller_begin(AdaptiveLevel* controller);
+
+void compression_controller_end(AdaptiveLevel* controller, size_t raw_size, size_t compressed_size,
+                                uint64_t encode_ns, int succeeded);
+
+// The level as it stands, for encodes that should not count as queued
+// publishes while they run, such as uploads paced by the client.
+int compression_controller_level(AdaptiveLevel* controller);
+
+// Reports such an encode, as _end does for a bracketed one.
+void compression_controller_observe(AdaptiveLevel* controller, size_t raw_size, size_t compressed_size,
+                                    uint64_t encode_ns, int succeeded);
+
+int compression_controller_stats(const char* topic_file_path, CompressionStats* stats);
+
+void compression_controllers_free(void);
+
+#endif
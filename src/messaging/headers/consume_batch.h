@@ -0,0 +1,70 @@
+#ifndef CONSUME_BATCH_H
+#define CONSUME_BATCH_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "manage_groups.h"
+#include "record_filter.h"
+
+typedef struct {
+    const uint8_t* data;
+    size_t data_size;
+    size_t offset_in_topic;
+    uint32_t packet_size;   // Stored payload size, as ACK expects it
+    uint8_t codec;          // Codec data is in; RECORD_CODEC_NONE once decoded
+    size_t arena_offset;    // Where data lives until the batch is complete
+} BatchRecord;
+
+// Views into a batch stay valid until the next consume_batch on it or
+// record_batch_release. The arena and arrays are kept for reuse.
+typedef struct {
+    BatchRecord* records;
+    size_t count;
+    size_t capacity;
+    uint8_t* arena;
+    size_t arena_size;
+    size_t arena_capacity;
+    void** entries;
+    size_t entry_count;
+    size_t entry_capacity;
+} RecordBatch;
+
+// Whole records as they lie in the topic file, [u32 header][payload] each,
+// for consumers that parse the log themselves. fd belongs to the block
+// cache and stays open for the life of the process.
+typedef struct {
+    int fd;
+    size_t offset;
+    size_t size;
+    size_t count;
+} LogRange;
+
+// Returns 0 to keep going, anything else stops consume_batch_each.
+typedef int (*RecordBatchCallback)(void* context, const BatchRecord* records, size_t count);
+
+RecordBatch* record_batch_create(void);
+
+// Reads up to max_records matching records (and roughly max_bytes of
+// payload, 0 for no limit) from the group's read pointer and advances it.
+// Records stored with a codec in keep_codecs are returned as stored, unless
+// they need one of the topic's dictionaries to decode.
+// Returns the number of records, 0 when caught up, -1 on error.
+int consume_batch(Group* group, Topic* topic, const RecordFilter* filter, size_t max_records, size_t max_bytes,
+                  unsigned keep_codecs, RecordBatch* batch);
+
+// Feeds batches of decoded records to callback until the group is caught
+// up. Returns the number of records delivered, or -1 on error.
+long consume_batch_each(Group* group, Topic* topic, const RecordFilter* filter, size_t max_records,
+                        RecordBatchCallback callback, void* context);
+
+// Finds the run of whole records from the group's read pointer that fits
+// in max_bytes (at least one record, however large) and advances past it.
+// Filters and codecs do not apply. Returns the number of records, 0 when
+// caught up, -1 on error.
+int consume_range(Group* group, Topic* topic, size_t max_bytes, LogRange* range);
+
+void record_batch_release(RecordBatch* batch);
+
+void record_batch_free(RecordBatch* batch);
+
+#endif
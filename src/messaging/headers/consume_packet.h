@@ -4,20 +4,27 @@
 #include <stddef.h>
 #include <stdint.h>
 #include "manage_groups.h"
+#include "record_filter.h"
 
 typedef struct {
     uint32_t packet_size;
     uint8_t* data;
     size_t data_size;
     size_t offset_in_topic;
+    uint8_t codec;
+    void* cache_entry;
 } Packet;
 
 Packet* consume_packet(Group* group, Topic* topic);
 
+Packet* consume_packet_filtered(Group* group, Topic* topic, const RecordFilter* filter);
+
 Packet* consume_packet_with_size(Group* group, Topic* topic, size_t packet_size);
 
 int peek_packet_size(Group* group, Topic* topic, uint32_t* packet_size);
 
+int packet_decode(Packet* packet, Topic* topic);
+
 void packet_free(Packet* packet);
 
 #endif
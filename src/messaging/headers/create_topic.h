@@ -3,6 +3,9 @@
 
 #include <stddef.h>
 
+#define TOPIC_FILE_HEADER "{}"
+#define TOPIC_FILE_HEADER_SIZE (sizeof(TOPIC_FILE_HEADER) - 1)
+
 typedef struct {
     char* topic_name;
     char* file_path;
@@ -0,0 +1,29 @@
+#ifndef DELAY_SCHEDULER_H
+#define DELAY_SCHEDULER_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "create_topic.h"
+
+// Delayed events wait in a <topic>.topic.delay log next to the topic until
+// they are due. Delivery is at-least-once: an entry is marked delivered only
+// after its record was appended, so a crash between the two appends it again
+// after restart.
+
+// Recovers the pending entries of every delay log under base_path and
+// starts the timer thread. Call it once on server start (start_server does);
+// until then only topics that get a new delayed event are recovered.
+int delay_scheduler_start(const char* base_path);
+
+void delay_scheduler_stop(void);
+
+int schedule_delayed_event(Topic* topic, const void* data, size_t data_size, uint64_t not_before_ms);
+
+// Loads one topic's delay log, if not already loaded.
+int delay_scheduler_recover(const char* topic_name, const char* topic_file_path);
+
+size_t delay_scheduler_pending(void);
+
+uint64_t current_time_ms(void);
+
+#endif
@@ -0,0 +1,58 @@
+#ifndef DICTIONARY_REGISTRY_H
+#define DICTIONARY_REGISTRY_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <zstd.h>
+
+typedef struct DigestedCDict {
+    int compression_level;
+    ZSTD_CDict* cdict;
+    struct DigestedCDict* next;
+} DigestedCDict;
+
+typedef struct DictionaryGeneration {
+    unsigned dictionary_id;
+    void* dictionary;
+    size_t dictionary_size;
+    DigestedCDict* cdicts;
+    ZSTD_DDict* ddict;
+    struct DictionaryGeneration* next;
+} DictionaryGeneration;
+
+typedef struct TopicDictionaries {
+    char* topic_file_path;
+    DictionaryGeneration* generations;
+    DictionaryGeneration* active;
+    pthread_mutex_t mutex;
+    struct TopicDictionaries* next;
+} TopicDictionaries;
+
+TopicDictionaries* dictionaries_for_topic(const char* topic_file_path);
+
+int dictionaries_add(TopicDictionaries* dictionaries, const void* dictionary, size_t dictionary_size,
+                     int activate);
+
+int dictionaries_activate(TopicDictionaries* dictionaries, unsigned dictionary_id);
+
+unsigned dictionaries_active_id(TopicDictionaries* dictionaries);
+
+int dictionaries_encode(TopicDictionaries* dictionaries, const char* data, size_t data_size,
+                        uint8_t* compressed_data, size_t compressed_capacity,
+                        size_t* compressed_size, int compression_level);
+
+int dictionaries_decode(TopicDictionaries* dictionaries, const uint8_t* compressed_data, size_t compressed_size,
+                        char* decompressed_data, size_t decompressed_capacity, size_t* decompressed_size);
+
+// Sets *cdict to the active dictionary digested at compression_level, or
+// to NULL when the topic has none yet. The CDict lives as long as the topic.
+int dictionaries_active_cdict(TopicDictionaries* dictionaries, int compression_level, const ZSTD_CDict** cdict);
+
+// Sets *ddict to NULL for frames compressed without a dictionary.
+int dictionaries_ddict_for_frame(TopicDictionaries* dictionaries, const uint8_t* compressed_data,
+                                 size_t compressed_size, const ZSTD_DDict** ddict);
+
+void dictionaries_free_all(void);
+
+#endif
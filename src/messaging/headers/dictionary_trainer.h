@@ -0,0 +1,27 @@
+#ifndef DICTIONARY_TRAINER_H
+#define DICTIONARY_TRAINER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+typedef struct TrainedTopic {
+    char* topic_file_path;
+    size_t next_offset;
+    uint64_t raw_bytes;
+    uint64_t compressed_bytes;
+    uint64_t records;
+    uint64_t baseline_ratio_permille;
+    uint64_t last_trained_ms;
+    int training;
+    struct TrainedTopic* next;
+} TrainedTopic;
+
+int dictionary_trainer_start(void);
+
+void dictionary_trainer_stop(void);
+
+void dictionary_trainer_observe(const char* topic_file_path, size_t raw_size, size_t compressed_size);
+
+int dictionary_trainer_train(const char* topic_file_path);
+
+#endif
@@ -3,6 +3,7 @@
 
 #include <stddef.h>
 #include <stdint.h>
+#include <zstd.h>
 
 int encode_string(const char* json_string, size_t json_size, 
                   uint8_t** compressed_data, size_t* compressed_size, 
@@ -20,10 +21,51 @@ int decode_string_with_dict(const uint8_t* compressed_data, size_t compressed_si
                             const void* dictionary, size_t dictionary_size,
                             char** decompressed_string, size_t* decompressed_size);
 
+int encoder_clamp_level(int compression_level);
+
+size_t encode_bound(size_t input_size);
+
+// Decoded size recorded in a frame header; fails for frames without one.
+int encoded_content_size(const uint8_t* compressed_data, size_t compressed_size, size_t* content_size);
+
+// Returns a buffer owned by the calling thread, valid until its next call.
+uint8_t* encoder_scratch_buffer(size_t size);
+
+int encode_string_into(const char* json_string, size_t json_size,
+                       uint8_t* compressed_data, size_t compressed_capacity,
+                       size_t* compressed_size, int compression_level);
+
+int decode_string_into(const uint8_t* compressed_data, size_t compressed_size,
+                       char* decompressed_string, size_t decompressed_capacity,
+                       size_t* decompressed_size);
+
+int encode_string_into_with_dict(const char* json_string, size_t json_size,
+                                 const void* dictionary, size_t dictionary_size,
+                                 uint8_t* compressed_data, size_t compressed_capacity,
+                                 size_t* compressed_size, int compression_level);
+
+int decode_string_into_with_dict(const uint8_t* compressed_data, size_t compressed_size,
+                                 const void* dictionary, size_t dictionary_size,
+                                 char* decompressed_string, size_t decompressed_capacity,
+                                 size_t* decompressed_size);
+
+int encode_string_into_with_cdict(const char* json_string, size_t json_size, const ZSTD_CDict* cdict,
+                                  uint8_t* compressed_data, size_t compressed_capacity,
+                                  size_t* compressed_size);
+
+int decode_string_into_with_ddict(const uint8_t* compressed_data, size_t compressed_size, const ZSTD_DDict* ddict,
+                                  char* decompressed_string, size_t decompressed_capacity,
+                                  size_t* decompressed_size);
+
 int save_dictionary(const void* dictionary, size_t dictionary_size, const char* filepath);
 
 int fetch_dictionary(const char* filepath, void** dictionary, size_t* dictionary_size);
 
+// Samples are laid out back to back in one buffer, as ZDICT expects.
+int train_dictionary_from_buffer(const void* samples, const size_t* sample_sizes,
+                                 size_t num_samples, size_t dictionary_size,
+                                 void** dictionary, size_t* actual_dict_size);
+
 int train_dictionary(const char** samples, const size_t* sample_sizes, 
                      size_t num_samples, size_t dictionary_size,
                      void** dictionary, size_t* actual_dict_size);
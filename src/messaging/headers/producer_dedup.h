@@ -0,0 +1,41 @@
+#ifndef PRODUCER_DEDUP_H
+#define PRODUCER_DEDUP_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <pthread.h>
+
+typedef struct {
+    uint64_t producer_id;
+    uint64_t last_sequence;
+} ProducerEntry;
+
+typedef struct ProducerTable {
+    char* topic_file_path;
+    char* state_path;
+    ProducerEntry* entries;
+    size_t capacity;
+    size_t count;
+    size_t logged_entries;
+    int state_fd;
+    pthread_mutex_t mutex;
+    struct ProducerTable* next;
+} ProducerTable;
+
+ProducerTable* producer_table_for_topic(const char* topic_file_path);
+
+// Returns 1 when sequence is not newer than the producer's last one, -1 on
+// error, and 0 when the event should be written. A 0 return holds the
+// table's mutex, across the whole publish, until the matching
+// producer_table_commit, which every 0 must be paired with.
+int producer_table_begin(ProducerTable* table, uint64_t producer_id, uint64_t sequence);
+
+// Records sequence if written is set and releases the mutex either way.
+// Returns -1 if the sequence could not be persisted.
+int producer_table_commit(ProducerTable* table, uint64_t producer_id, uint64_t sequence, int written);
+
+int producer_table_last_sequence(ProducerTable* table, uint64_t producer_id, uint64_t* sequence);
+
+void producer_tables_free(void);
+
+#endif
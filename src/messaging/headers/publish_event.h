@@ -4,13 +4,55 @@
 #include <stddef.h>
 #include <stdint.h>
 #include "create_topic.h"
+#include "compression_controller.h"
+#include "stream_codec.h"
+
+#define PUBLISH_DUPLICATE 1
+
+typedef struct PublishStream {
+    Topic* topic;
+    AdaptiveLevel* controller;
+    EncodeStream* encoder;      // NULL when the topic's codec cannot stream
+    uint8_t codec;
+    uint8_t* frame;
+    size_t frame_size;
+    size_t frame_capacity;
+    size_t event_size;
+    size_t received;
+    uint64_t encode_ns;
+} PublishStream;
 
 int publish_event(Topic* topic, const void* data, size_t data_size);
 
+int publish_event_with_codec(Topic* topic, const void* data, size_t data_size, uint8_t codec);
+
+int publish_event_at(Topic* topic, const void* data, size_t data_size, uint64_t not_before_ms);
+
+int publish_event_idempotent(Topic* topic, const void* data, size_t data_size,
+                             uint64_t producer_id, uint64_t sequence, uint64_t not_before_ms);
+
 int publish_event_string(Topic* topic, const char* data);
 
 int publish_event_compressed(Topic* topic, const void* data, size_t data_size, int compression_level);
 
+// Compresses at the level the topic's compression controller picks.
+int publish_event_adaptive(Topic* topic, const void* data, size_t data_size);
+
+// Stores the event with the codec the topic was created with.
+int publish_event_encoded(Topic* topic, const void* data, size_t data_size);
+
+// Stores an event of a known size with the topic's codec as it arrives. zstd
+// topics compress it on the fly, so only the frame is held; for the other
+// codecs the event is gathered and stored whole once it is complete.
+PublishStream* publish_stream_begin(Topic* topic, size_t event_size);
+
+int publish_stream_write(PublishStream* stream, const void* data, size_t data_size);
+
+// Appends the record and frees the stream, whatever the outcome.
+int publish_stream_finish(PublishStream* stream);
+
+void publish_stream_abort(PublishStream* stream);
+
 int publish_event_batch(Topic* topic, const void** data_array, const size_t* sizes, size_t count);
 
 int flush_topic(Topic* topic);
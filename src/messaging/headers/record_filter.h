@@ -0,0 +1,40 @@
+#ifndef RECORD_FILTER_H
+#define RECORD_FILTER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define MAX_FILTER_CLAUSES 8
+#define MAX_FILTER_PATTERN_SIZE 256
+
+typedef enum {
+    FILTER_OP_EQUALS,
+    FILTER_OP_PREFIX,
+    FILTER_OP_CONTAINS,
+    FILTER_OP_JSON_FIELD
+} FilterOp;
+
+typedef struct {
+    FilterOp op;
+    uint8_t needle[MAX_FILTER_PATTERN_SIZE];
+    size_t needle_size;
+    uint8_t value[MAX_FILTER_PATTERN_SIZE];
+    size_t value_size;
+} FilterClause;
+
+typedef struct {
+    FilterClause clauses[MAX_FILTER_CLAUSES];
+    size_t count;
+} RecordFilter;
+
+RecordFilter* record_filter_compile(const char* expression);
+
+int record_filter_match(const RecordFilter* filter, const uint8_t* data, size_t data_size);
+
+int record_filter_extract_json_field(const uint8_t* data, size_t data_size,
+                                     const uint8_t* quoted_field, size_t quoted_field_size,
+                                     const uint8_t** value, size_t* value_size);
+
+void record_filter_free(RecordFilter* filter);
+
+#endif
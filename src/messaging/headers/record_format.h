@@ -0,0 +1,26 @@
+#ifndef RECORD_FORMAT_H
+#define RECORD_FORMAT_H
+
+#include <stdint.h>
+
+// Every record in a topic file is [u32 header][payload]. The low 24 bits of
+// the header hold the payload size (records are capped well below 16MB) and
+// the top byte names the codec the payload was stored with, so records
+// written before codecs existed read back as RECORD_CODEC_NONE.
+#define RECORD_HEADER_SIZE sizeof(uint32_t)
+#define RECORD_SIZE_MASK 0x00FFFFFFu
+#define RECORD_CODEC_SHIFT 24
+
+#define RECORD_CODEC_NONE 0
+#define RECORD_CODEC_ZSTD 1
+#define RECORD_CODEC_LZ4 2
+#define RECORD_CODEC_COLUMNAR 3
+
+#define RECORD_HEADER(size, codec) ((uint32_t)(size) | ((uint32_t)(codec) << RECORD_CODEC_SHIFT))
+#define RECORD_HEADER_PAYLOAD_SIZE(header) ((uint32_t)(header) & RECORD_SIZE_MASK)
+#define RECORD_HEADER_CODEC(header) ((uint8_t)((uint32_t)(header) >> RECORD_CODEC_SHIFT))
+
+// Bit for a codec in a consumer's accepted-codec mask.
+#define RECORD_CODEC_BIT(codec) (1u << (codec))
+
+#endif
@@ -0,0 +1,53 @@
+#ifndef STREAM_CODEC_H
+#define STREAM_CODEC_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <zstd.h>
+
+// Receives each chunk of stream output; returning non-zero aborts the stream.
+typedef int (*StreamSink)(void* context, const uint8_t* data, size_t size);
+
+typedef struct EncodeStream {
+    ZSTD_CCtx* cctx;
+    uint8_t* output;
+    size_t output_capacity;
+    StreamSink sink;
+    void* sink_context;
+    uint64_t input_size;
+    uint64_t output_size;
+} EncodeStream;
+
+typedef struct DecodeStream {
+    ZSTD_DCtx* dctx;
+    uint8_t* output;
+    size_t output_capacity;
+    StreamSink sink;
+    void* sink_context;
+    uint64_t output_size;
+    uint64_t max_output_size;
+    int finished;
+} DecodeStream;
+
+// pledged_size is the total input size, or 0 if unknown. Frames written with
+// a pledged size record it, so they can also be decoded in one shot.
+EncodeStream* encode_stream_create(int compression_level, uint64_t pledged_size, const ZSTD_CDict* cdict,
+                                   StreamSink sink, void* sink_context);
+
+int encode_stream_write(EncodeStream* stream, const void* data, size_t data_size);
+
+int encode_stream_finish(EncodeStream* stream);
+
+void encode_stream_free(EncodeStream* stream);
+
+DecodeStream* decode_stream_create(const ZSTD_DDict* ddict, uint64_t max_output_size,
+                                   StreamSink sink, void* sink_context);
+
+int decode_stream_write(DecodeStream* stream, const void* data, size_t data_size);
+
+// Fails unless a whole frame was consumed.
+int decode_stream_finish(DecodeStream* stream);
+
+void decode_stream_free(DecodeStream* stream);
+
+#endif
@@ -0,0 +1,50 @@
+#ifndef TABLE_VIEW_H
+#define TABLE_VIEW_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <pthread.h>
+
+#define TABLE_VIEW_NOT_FOUND 1
+
+typedef struct {
+    uint64_t key_hash;
+    uint64_t record_offset;
+    uint8_t* key;
+    size_t key_size;
+} TableViewSlot;
+
+typedef struct TableView {
+    char* topic_file_path;
+    char* key_field;
+    uint8_t* quoted_key;
+    size_t quoted_key_size;
+    TableViewSlot* slots;
+    size_t capacity;
+    size_t count;
+    size_t indexed_upto;
+    int fd;
+    uint8_t* scratch;
+    size_t scratch_capacity;
+    uint8_t* decoded;
+    size_t decoded_capacity;
+    pthread_mutex_t mutex;
+    struct TableView* next;
+} TableView;
+
+TableView* table_view_open(const char* topic_file_path, const char* key_field);
+
+TableView* table_view_find(const char* topic_file_path);
+
+int table_view_refresh(TableView* view);
+
+void table_view_notify(const char* topic_file_path);
+
+int table_view_get(TableView* view, const char* key, size_t key_size,
+                   uint8_t** value, size_t* value_size);
+
+int table_view_start(const char* base_path);
+
+void table_views_free(void);
+
+#endif
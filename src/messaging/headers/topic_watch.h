@@ -0,0 +1,35 @@
+#ifndef TOPIC_WATCH_H
+#define TOPIC_WATCH_H
+
+#include <stddef.h>
+#include <pthread.h>
+
+// Called on the publishing thread after records were appended, so it must
+// only flag or wake whoever is waiting.
+typedef void (*TopicWatchCallback)(void* context);
+
+struct TopicWatchers;
+
+typedef struct TopicWatch {
+    TopicWatchCallback callback;
+    void* context;
+    struct TopicWatchers* watchers;
+    struct TopicWatch* next;
+} TopicWatch;
+
+typedef struct TopicWatchers {
+    char* topic_file_path;
+    TopicWatch* watches;
+    size_t watch_count;
+    pthread_mutex_t mutex;
+    struct TopicWatchers* next;
+} TopicWatchers;
+
+TopicWatch* topic_watch_add(const char* topic_file_path, TopicWatchCallback callback, void* context);
+
+// Once this returns the callback is not running and will not run again.
+void topic_watch_remove(TopicWatch* watch);
+
+void topic_watch_notify(const char* topic_file_path);
+
+#endif
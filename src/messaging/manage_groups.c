@@ -1,5 +1,6 @@
 #include "headers/manage_groups.h"
-#include "../writer/headers/read_write_data.h"
+#include "headers/publish_event.h"
+#include "../writer/headers/block_cache.h"
 #include <stdlib.h>
 #include <string.h>
 
@@ -57,7 +58,7 @@ Group* create_group(const char* group_id, Topic* topic) {
     }
 
     group->attached_topic = topic;
-    group->read_pointer = 0;
+    group->read_pointer = TOPIC_FILE_HEADER_SIZE;
     group->last_read_size = 0;
 
     return group;
@@ -138,17 +139,13 @@ int set_group_pointer(Group* group, size_t offset) {
         return -1;
     }
 
-    Chunk* chunk = (Chunk*)group->attached_topic->chunk_handle;
-    if (!chunk) {
+    size_t topic_size = get_topic_size(group->attached_topic);
+    if (topic_size == 0) {
         return -1;
     }
 
-    if (chunk_load(chunk) != 0) {
-        return -1;
-    }
-
-    if (offset > chunk->size) {
-        offset = chunk->size;
+    if (offset > topic_size) {
+        offset = topic_size;
     }
 
     group->read_pointer = offset;
@@ -168,18 +165,14 @@ int advance_group_pointer(Group* group, size_t bytes) {
         return -1;
     }
 
-    Chunk* chunk = (Chunk*)group->attached_topic->chunk_handle;
-    if (!chunk) {
-        return -1;
-    }
-
-    if (chunk_load(chunk) != 0) {
+    size_t topic_size = get_topic_size(group->attached_topic);
+    if (topic_size == 0) {
         return -1;
     }
 
     size_t new_pointer = group->read_pointer + bytes;
-    if (new_pointer > chunk->size) {
-        new_pointer = chunk->size;
+    if (new_pointer > topic_size) {
+        new_pointer = topic_size;
     }
 
     group->read_pointer = new_pointer;
@@ -187,7 +180,7 @@ int advance_group_pointer(Group* group, size_t bytes) {
 }
 
 int reset_group_pointer(Group* group) {
-    return set_group_pointer(group, 0);
+    return set_group_pointer(group, TOPIC_FILE_HEADER_SIZE);
 }
 
 long read_from_group(Group* group, void* buffer, size_t size) {
@@ -195,16 +188,17 @@ long read_from_group(Group* group, void* buffer, size_t size) {
         return -1;
     }
 
-    Chunk* chunk = (Chunk*)group->attached_topic->chunk_handle;
-    if (!chunk) {
+    size_t topic_size = get_topic_size(group->attached_topic);
+    if (topic_size == 0) {
         return -1;
     }
 
-    if (chunk_load(chunk) != 0) {
+    BlockCacheFile* log = block_cache_open(group->attached_topic->file_path);
+    if (!log) {
         return -1;
     }
 
-    long bytes_read = chunk_read(chunk, buffer, size, group->read_pointer);
+    long bytes_read = block_cache_read(log, buffer, size, group->read_pointer);
     
     if (bytes_read > 0) {
         group->last_read_size = (size_t)bytes_read;
@@ -219,16 +213,12 @@ int group_has_more_data(Group* group) {
         return 0;
     }
 
-    Chunk* chunk = (Chunk*)group->attached_topic->chunk_handle;
-    if (!chunk) {
-        return 0;
-    }
-
-    if (chunk_load(chunk) != 0) {
+    size_t topic_size = get_topic_size(group->attached_topic);
+    if (topic_size == 0) {
         return 0;
     }
 
-    return (group->read_pointer < chunk->size) ? 1 : 0;
+    return (group->read_pointer < topic_size) ? 1 : 0;
 }
 
 void group_free(Group* group) {
@@ -0,0 +1,265 @@
+#include "headers/producer_dedup.h"
+#include "../utils/header/path_registry.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+// Per-topic high-water marks live in an open-addressing table (linear probing,
+// producer id 0 marks an empty slot). Every accepted sequence is appended to
+// "<topic>.producers" and the file is rewritten from the table when the log
+// grows well past the number of producers.
+#define PRODUCER_STATE_EXTENSION ".producers"
+#define INITIAL_PRODUCER_CAPACITY 64
+#define PRODUCER_LOAD_FACTOR_PERCENT 70
+#define PRODUCER_COMPACT_SLACK 4096
+
+static PathRegistry g_tables = PATH_REGISTRY_INITIALIZER(ProducerTable, topic_file_path);
+
+static size_t hash_producer_id(uint64_t producer_id) {
+    producer_id ^= producer_id >> 33;
+    producer_id *= 0xff51afd7ed558ccdULL;
+    producer_id ^= producer_id >> 33;
+    producer_id *= 0xc4ceb9fe1a85ec53ULL;
+    producer_id ^= producer_id >> 33;
+    return (size_t)producer_id;
+}
+
+static ProducerEntry* find_slot(ProducerEntry* entries, size_t capacity, uint64_t producer_id) {
+    size_t mask = capacity - 1;
+    size_t index = hash_producer_id(producer_id) & mask;
+
+    while (entries[index].producer_id != 0 && entries[index].producer_id != producer_id) {
+        index = (index + 1) & mask;
+    }
+
+    return &entries[index];
+}
+
+static int grow_table(ProducerTable* table) {
+    size_t new_capacity = table->capacity * 2;
+    ProducerEntry* new_entries = (ProducerEntry*)calloc(new_capacity, sizeof(ProducerEntry));
+    if (!new_entries) {
+        return -1;
+    }
+
+    for (size_t i = 0; i < table->capacity; i++) {
+        if (table->entries[i].producer_id != 0) {
+            *find_slot(new_entries, new_capacity, table->entries[i].producer_id) = table->entries[i];
+        }
+    }
+
+    free(table->entries);
+    table->entries = new_entries;
+    table->capacity = new_capacity;
+    return 0;
+}
+
+static int store_sequence(ProducerTable* table, uint64_t producer_id, uint64_t sequence) {
+    if ((table->count + 1) * 100 > table->capacity * PRODUCER_LOAD_FACTOR_PERCENT) {
+        if (grow_table(table) != 0) {
+            return -1;
+        }
+    }
+
+    ProducerEntry* slot = find_slot(table->entries, table->capacity, producer_id);
+    if (slot->producer_id == 0) {
+        slot->producer_id = producer_id;
+        slot->last_sequence = sequence;
+        table->count++;
+    } else if (sequence > slot->last_sequence) {
+        slot->last_sequence = sequence;
+    }
+
+    return 0;
+}
+
+static int load_state(ProducerTable* table) {
+    ProducerEntry record;
+    off_t offset = 0;
+
+    while (pread(table->state_fd, &record, sizeof(ProducerEntry), offset) == (ssize_t)sizeof(ProducerEntry)) {
+        if (record.producer_id != 0 && store_sequence(table, record.producer_id, record.last_sequence) != 0) {
+            return -1;
+        }
+        table->logged_entries++;
+        offset += sizeof(ProducerEntry);
+    }
+
+    // Drop a torn trailing record so later appends stay aligned.
+    if (ftruncate(table->state_fd, offset) != 0) {
+        return -1;
+    }
+    lseek(table->state_fd, 0, SEEK_END);
+    return 0;
+}
+
+static int compact_state(ProducerTable* table) {
+    size_t tmp_len = strlen(table->state_path) + 5;
+    char* tmp_path = (char*)malloc(tmp_len);
+    if (!tmp_path) {
+        return -1;
+    }
+    snprintf(tmp_path, tmp_len, "%s.tmp", table->state_path);
+
+    int fd = open(tmp_path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        free(tmp_path);
+        return -1;
+    }
+
+    size_t written_entries = 0;
+    for (size_t i = 0; i < table->capacity; i++) {
+        if (table->entries[i].producer_id == 0) {
+            continue;
+        }
+        if (write(fd, &table->entries[i], sizeof(ProducerEntry)) != (ssize_t)sizeof(ProducerEntry)) {
+            close(fd);
+            unlink(tmp_path);
+            free(tmp_path);
+            return -1;
+        }
+        written_entries++;
+    }
+    close(fd);
+
+    if (rename(tmp_path, table->state_path) != 0) {
+        unlink(tmp_path);
+        free(tmp_path);
+        return -1;
+    }
+    free(tmp_path);
+
+    int new_fd = open(table->state_path, O_WRONLY | O_APPEND);
+    if (new_fd < 0) {
+        return -1;
+    }
+
+    close(table->state_fd);
+    table->state_fd = new_fd;
+    table->logged_entries = written_entries;
+    return 0;
+}
+
+static void producer_table_free(ProducerTable* table) {
+    if (!table) {
+        return;
+    }
+
+    if (table->state_fd >= 0) {
+        close(table->state_fd);
+    }
+    pthread_mutex_destroy(&table->mutex);
+    free(table->entries);
+    free(table->state_path);
+    free(table->topic_file_path);
+    free(table);
+}
+
+static void* producer_table_open(const char* topic_file_path, void* context) {
+    (void)context;
+    ProducerTable* table = (ProducerTable*)calloc(1, sizeof(ProducerTable));
+    if (!table) {
+        return NULL;
+    }
+    table->state_fd = -1;
+
+    if (pthread_mutex_init(&table->mutex, NULL) != 0) {
+        free(table);
+        return NULL;
+    }
+
+    size_t path_len = strlen(topic_file_path) + strlen(PRODUCER_STATE_EXTENSION) + 1;
+    table->topic_file_path = strdup(topic_file_path);
+    table->state_path = (char*)malloc(path_len);
+    table->entries = (ProducerEntry*)calloc(INITIAL_PRODUCER_CAPACITY, sizeof(ProducerEntry));
+    table->capacity = INITIAL_PRODUCER_CAPACITY;
+
+    if (!table->topic_file_path || !table->state_path || !table->entries) {
+        producer_table_free(table);
+        return NULL;
+    }
+    snprintf(table->state_path, path_len, "%s%s", topic_file_path, PRODUCER_STATE_EXTENSION);
+
+    table->state_fd = open(table->state_path, O_RDWR | O_CREAT | O_APPEND, 0644);
+    if (table->state_fd < 0 || load_state(table) != 0) {
+        perror("Failed to load producer state");
+        producer_table_free(table);
+        return NULL;
+    }
+
+    return table;
+}
+
+ProducerTable* producer_table_for_topic(const char* topic_file_path) {
+    return (ProducerTable*)path_registry_get(&g_tables, topic_file_path, producer_table_open, NULL);
+}
+
+int producer_table_begin(ProducerTable* table, uint64_t producer_id, uint64_t sequence) {
+    if (!table || producer_id == 0) {
+        return -1;
+    }
+
+    pthread_mutex_lock(&table->mutex);
+
+    ProducerEntry* slot = find_slot(table->entries, table->capacity, producer_id);
+    if (slot->producer_id == producer_id && sequence <= slot->last_sequence) {
+        pthread_mutex_unlock(&table->mutex);
+        return 1;
+    }
+
+    return 0;
+}
+
+int producer_table_commit(ProducerTable* table, uint64_t producer_id, uint64_t sequence, int written) {
+    if (!table) {
+        return -1;
+    }
+
+    int result = 0;
+
+    if (written) {
+        ProducerEntry record = { producer_id, sequence };
+
+        if (store_sequence(table, producer_id, sequence) != 0) {
+            result = -1;
+        } else if (write(table->state_fd, &record, sizeof(ProducerEntry)) != (ssize_t)sizeof(ProducerEntry)) {
+            perror("Failed to persist producer sequence");
+            result = -1;
+        } else {
+            table->logged_entries++;
+            if (table->logged_entries > table->count * 2 + PRODUCER_COMPACT_SLACK) {
+                compact_state(table);
+            }
+        }
+    }
+
+    pthread_mutex_unlock(&table->mutex);
+    return result;
+}
+
+int producer_table_last_sequence(ProducerTable* table, uint64_t producer_id, uint64_t* sequence) {
+    if (!table || producer_id == 0 || !sequence) {
+        return -1;
+    }
+
+    pthread_mutex_lock(&table->mutex);
+    ProducerEntry* slot = find_slot(table->entries, table->capacity, producer_id);
+    int found = slot->producer_id == producer_id;
+    if (found) {
+        *sequence = slot->last_sequence;
+    }
+    pthread_mutex_unlock(&table->mutex);
+
+    return found ? 0 : -1;
+}
+
+void producer_tables_free(void) {
+    ProducerTable* table = (ProducerTable*)path_registry_take_all(&g_tables);
+    while (table) {
+        ProducerTable* next = table->next;
+        producer_table_free(table);
+        table = next;
+    }
+}
@@ -1,13 +1,25 @@
 #include "headers/publish_event.h"
 #include "../writer/headers/read_write_data.h"
+#include "../writer/headers/block_cache.h"
 #include "headers/encoder.h"
+#include "headers/dictionary_trainer.h"
+#include "headers/delay_scheduler.h"
+#include "headers/producer_dedup.h"
+#include "headers/table_view.h"
+#include "headers/topic_watch.h"
+#include "headers/record_format.h"
+#include "headers/compression_controller.h"
+#include "headers/codec.h"
+#include "headers/dictionary_registry.h"
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 
-#define PACKET_SIZE_HEADER_SIZE sizeof(uint32_t)
 #define MAX_EVENT_SIZE (10 * 1024 * 1024) // 10MB max event size
+#define STREAM_FRAME_INITIAL_CAPACITY (64 * 1024)
 
-int publish_event(Topic* topic, const void* data, size_t data_size) {
+int publish_event_with_codec(Topic* topic, const void* data, size_t data_size, uint8_t codec) {
     if (!topic || !data || data_size == 0) {
         return -1;
     }
@@ -21,21 +33,66 @@ int publish_event(Topic* topic, const void* data, size_t data_size) {
         return -1;
     }
 
-    uint32_t packet_size = (uint32_t)data_size;
+    uint32_t header = RECORD_HEADER(data_size, codec);
 
-    if (chunk_append(chunk, &packet_size, PACKET_SIZE_HEADER_SIZE) != 0) {
+    if (chunk_append_record(chunk, &header, RECORD_HEADER_SIZE, data, data_size) != 0) {
         return -1;
     }
 
-    if (chunk_append(chunk, data, data_size) != 0) {
+    if (chunk_save_delta(chunk) != 0) {
         return -1;
     }
 
-    if (chunk_save_delta(chunk) != 0) {
+    table_view_notify(topic->file_path);
+    topic_watch_notify(topic->file_path);
+    return 0;
+}
+
+int publish_event(Topic* topic, const void* data, size_t data_size) {
+    return publish_event_with_codec(topic, data, data_size, RECORD_CODEC_NONE);
+}
+
+int publish_event_at(Topic* topic, const void* data, size_t data_size, uint64_t not_before_ms) {
+    if (!topic || !data || data_size == 0) {
         return -1;
     }
 
-    return 0;
+    if (data_size > MAX_EVENT_SIZE) {
+        return -2;
+    }
+
+    if (not_before_ms <= current_time_ms()) {
+        return publish_event_encoded(topic, data, data_size);
+    }
+
+    return schedule_delayed_event(topic, data, data_size, not_before_ms);
+}
+
+int publish_event_idempotent(Topic* topic, const void* data, size_t data_size,
+                             uint64_t producer_id, uint64_t sequence, uint64_t not_before_ms) {
+    if (!topic || !topic->file_path || !data || data_size == 0 || producer_id == 0) {
+        return -1;
+    }
+
+    ProducerTable* table = producer_table_for_topic(topic->file_path);
+    if (!table) {
+        return -1;
+    }
+
+    int begin_result = producer_table_begin(table, producer_id, sequence);
+    if (begin_result != 0) {
+        return begin_result > 0 ? PUBLISH_DUPLICATE : -1;
+    }
+
+    // If the commit fails the event is in the log but its sequence is not
+    // on disk. The publish still succeeded; only its idempotence is lost.
+    int result = publish_event_at(topic, data, data_size, not_before_ms);
+    if (producer_table_commit(table, producer_id, sequence, result == 0) != 0) {
+        fprintf(stderr, "Sequence %llu of producer %llu was not persisted; a retry after a restart may be "
+                "appended twice\n", (unsigned long long)sequence, (unsigned long long)producer_id);
+    }
+
+    return result;
 }
 
 int publish_event_string(Topic* topic, const char* data) {
@@ -51,8 +108,36 @@ int publish_event_string(Topic* topic, const char* data) {
     return publish_event(topic, data, data_size);
 }
 
-int publish_event_compressed(Topic* topic, const void* data, size_t data_size, int compression_level) {
-    if (!topic || !data || data_size == 0) {
+static uint64_t thread_cpu_ns(void) {
+    struct timespec now;
+    if (clock_gettime(CLOCK_THREAD_CPUTIME_ID, &now) != 0) {
+        return 0;
+    }
+    return (uint64_t)now.tv_sec * 1000000000ULL + (uint64_t)now.tv_nsec;
+}
+
+// The encoded record goes into a per-thread scratch buffer and is copied
+// into the chunk on append, so nothing is allocated per event. zstd topics
+// with an active dictionary compress with it; the frame records its ID.
+static int encode_record(Topic* topic, const Codec* codec, const void* data, size_t data_size, int level,
+                         uint8_t** encoded, size_t* encoded_size, uint64_t* encode_ns) {
+    size_t capacity = codec->bound(data_size);
+    *encoded = capacity ? encoder_scratch_buffer(capacity) : NULL;
+    if (!*encoded) {
+        return -1;
+    }
+
+    uint64_t encode_start = thread_cpu_ns();
+    if (codec->encode(topic->file_path, data, data_size, *encoded, capacity, encoded_size, level) != 0) {
+        return -1;
+    }
+    *encode_ns = thread_cpu_ns() - encode_start;
+    return 0;
+}
+
+static int publish_encoded_at_level(Topic* topic, const Codec* codec, const void* data, size_t data_size,
+                                    int level, size_t* encoded_size, uint64_t* encode_ns) {
+    if (!topic || !codec || !data || data_size == 0) {
         return -1;
     }
 
@@ -60,47 +145,226 @@ int publish_event_compressed(Topic* topic, const void* data, size_t data_size, i
         return -2;
     }
 
-    uint8_t* compressed_data = NULL;
+    uint8_t* encoded = NULL;
+    if (encode_record(topic, codec, data, data_size, level, &encoded, encoded_size, encode_ns) != 0) {
+        return -1;
+    }
+
+    int result = publish_event_with_codec(topic, encoded, *encoded_size, codec->id);
+    if (result == 0 && codec->id == RECORD_CODEC_ZSTD) {
+        dictionary_trainer_observe(topic->file_path, data_size, *encoded_size);
+    }
+    return result;
+}
+
+int publish_event_compressed(Topic* topic, const void* data, size_t data_size, int compression_level) {
     size_t compressed_size = 0;
+    uint64_t encode_ns = 0;
+    return publish_encoded_at_level(topic, codec_by_id(RECORD_CODEC_ZSTD), data, data_size, compression_level,
+                                    &compressed_size, &encode_ns);
+}
+
+int publish_event_adaptive(Topic* topic, const void* data, size_t data_size) {
+    if (!topic || !topic->file_path) {
+        return -1;
+    }
+
+    AdaptiveLevel* controller = compression_controller_for_topic(topic->file_path);
+    if (!controller) {
+        return -1;
+    }
+
+    size_t compressed_size = 0;
+    uint64_t encode_ns = 0;
+    int compression_level = compression_controller_begin(controller);
+    int result = publish_encoded_at_level(topic, codec_by_id(RECORD_CODEC_ZSTD), data, data_size,
+                                          compression_level, &compressed_size, &encode_ns);
+    compression_controller_end(controller, data_size, compressed_size, encode_ns, result == 0);
+
+    return result;
+}
+
+int publish_event_encoded(Topic* topic, const void* data, size_t data_size) {
+    if (!topic || !topic->file_path) {
+        return -1;
+    }
+
+    uint8_t codec = topic_codec(topic->file_path);
+    if (codec == RECORD_CODEC_NONE) {
+        return publish_event(topic, data, data_size);
+    }
+    if (codec == RECORD_CODEC_ZSTD) {
+        return publish_event_adaptive(topic, data, data_size);
+    }
+
+    size_t encoded_size = 0;
+    uint64_t encode_ns = 0;
+    return publish_encoded_at_level(topic, codec_by_id(codec), data, data_size, 0, &encoded_size, &encode_ns);
+}
 
-    int encode_result = encode_string((const char*)data, data_size, 
-                                     &compressed_data, &compressed_size, 
-                                     compression_level);
-    
-    if (encode_result != 0 || !compressed_data) {
+static int append_to_frame(void* context, const uint8_t* data, size_t size) {
+    PublishStream* stream = (PublishStream*)context;
+    if (stream->frame_size + size > MAX_EVENT_SIZE) {
         return -1;
     }
 
-    int result = publish_event(topic, compressed_data, compressed_size);
-    
-    free(compressed_data);
-    
+    if (stream->frame_size + size > stream->frame_capacity) {
+        size_t capacity = stream->frame_capacity ? stream->frame_capacity : STREAM_FRAME_INITIAL_CAPACITY;
+        while (capacity < stream->frame_size + size) {
+            capacity *= 2;
+        }
+        if (capacity > MAX_EVENT_SIZE) {
+            capacity = MAX_EVENT_SIZE;
+        }
+
+        uint8_t* grown = (uint8_t*)realloc(stream->frame, capacity);
+        if (!grown) {
+            return -1;
+        }
+        stream->frame = grown;
+        stream->frame_capacity = capacity;
+    }
+
+    memcpy(stream->frame + stream->frame_size, data, size);
+    stream->frame_size += size;
+    return 0;
+}
+
+// For zstd only the compressed frame is kept while the event streams in,
+// with the topic's active dictionary. Its size is pledged up front, so the
+// frame records it and readers can decode it in one shot like any other
+// record. The upload is paced by the client, so it is not counted as a
+// queued publish; only its encode time and ratio go to the controller.
+PublishStream* publish_stream_begin(Topic* topic, size_t event_size) {
+    if (!topic || !topic->file_path || event_size == 0 || event_size > MAX_EVENT_SIZE) {
+        return NULL;
+    }
+
+    PublishStream* stream = (PublishStream*)calloc(1, sizeof(PublishStream));
+    if (!stream) {
+        return NULL;
+    }
+
+    stream->topic = topic;
+    stream->event_size = event_size;
+    stream->codec = topic_codec(topic->file_path);
+    if (stream->codec != RECORD_CODEC_ZSTD) {
+        return stream;
+    }
+
+    stream->controller = compression_controller_for_topic(topic->file_path);
+    int compression_level = compression_controller_level(stream->controller);
+    const ZSTD_CDict* cdict = NULL;
+    if (dictionaries_active_cdict(dictionaries_for_topic(topic->file_path), compression_level, &cdict) == 0) {
+        stream->encoder = encode_stream_create(compression_level, event_size, cdict, append_to_frame, stream);
+    }
+    if (!stream->encoder) {
+        publish_stream_abort(stream);
+        return NULL;
+    }
+
+    return stream;
+}
+
+int publish_stream_write(PublishStream* stream, const void* data, size_t data_size) {
+    if (!stream || !data || data_size > stream->event_size - stream->received) {
+        return -1;
+    }
+
+    if (!stream->encoder) {
+        int result = append_to_frame(stream, (const uint8_t*)data, data_size);
+        if (result == 0) {
+            stream->received += data_size;
+        }
+        return result;
+    }
+
+    uint64_t encode_start = thread_cpu_ns();
+    int result = encode_stream_write(stream->encoder, data, data_size);
+    stream->encode_ns += thread_cpu_ns() - encode_start;
+
+    if (result == 0) {
+        stream->received += data_size;
+    }
     return result;
 }
 
+static void publish_stream_free(PublishStream* stream, int succeeded) {
+    if (stream->encoder) {
+        compression_controller_observe(stream->controller, stream->event_size, stream->frame_size,
+                                       stream->encode_ns, succeeded);
+    }
+    encode_stream_free(stream->encoder);
+    free(stream->frame);
+    free(stream);
+}
+
+int publish_stream_finish(PublishStream* stream) {
+    if (!stream) {
+        return -1;
+    }
+
+    int result = -1;
+    if (stream->received == stream->event_size && !stream->encoder) {
+        result = publish_event_encoded(stream->topic, stream->frame, stream->frame_size);
+    } else if (stream->received == stream->event_size) {
+        uint64_t encode_start = thread_cpu_ns();
+        result = encode_stream_finish(stream->encoder);
+        stream->encode_ns += thread_cpu_ns() - encode_start;
+        if (result == 0) {
+            result = publish_event_with_codec(stream->topic, stream->frame, stream->frame_size, RECORD_CODEC_ZSTD);
+        }
+        if (result == 0) {
+            dictionary_trainer_observe(stream->topic->file_path, stream->event_size, stream->frame_size);
+        }
+    }
+
+    publish_stream_free(stream, result == 0);
+    return result;
+}
+
+void publish_stream_abort(PublishStream* stream) {
+    if (stream) {
+        publish_stream_free(stream, 0);
+    }
+}
+
 int publish_event_batch(Topic* topic, const void** data_array, const size_t* sizes, size_t count) {
     if (!topic || !data_array || !sizes || count == 0) {
         return -1;
     }
 
     Chunk* chunk = (Chunk*)topic->chunk_handle;
-    if (!chunk) {
+    const Codec* codec = codec_by_id(topic_codec(topic->file_path));
+    if (!chunk || !codec) {
         return -1;
     }
 
+    // Each record is stored with the topic's codec at its default level.
     for (size_t i = 0; i < count; i++) {
         if (!data_array[i] || sizes[i] == 0 || sizes[i] > MAX_EVENT_SIZE) {
             return -1;
         }
 
-        uint32_t packet_size = (uint32_t)sizes[i];
+        const void* payload = data_array[i];
+        size_t payload_size = sizes[i];
+        if (codec->id != RECORD_CODEC_NONE) {
+            uint8_t* encoded = NULL;
+            uint64_t encode_ns = 0;
+            if (encode_record(topic, codec, data_array[i], sizes[i], 0, &encoded, &payload_size, &encode_ns) != 0) {
+                return -1;
+            }
+            payload = encoded;
+        }
 
-        if (chunk_append(chunk, &packet_size, PACKET_SIZE_HEADER_SIZE) != 0) {
+        uint32_t header = RECORD_HEADER(payload_size, codec->id);
+
+        if (chunk_append_record(chunk, &header, RECORD_HEADER_SIZE, payload, payload_size) != 0) {
             return -1;
         }
 
-        if (chunk_append(chunk, data_array[i], sizes[i]) != 0) {
-            return -1;
+        if (codec->id == RECORD_CODEC_ZSTD) {
+            dictionary_trainer_observe(topic->file_path, sizes[i], payload_size);
         }
     }
 
@@ -108,6 +372,8 @@ int publish_event_batch(Topic* topic, const void** data_array, const size_t* siz
         return -1;
     }
 
+    table_view_notify(topic->file_path);
+    topic_watch_notify(topic->file_path);
     return 0;
 }
 
@@ -129,15 +395,11 @@ size_t get_topic_size(Topic* topic) {
         return 0;
     }
 
-    Chunk* chunk = (Chunk*)topic->chunk_handle;
-    if (!chunk) {
-        return 0;
-    }
-
-    if (chunk_load(chunk) != 0) {
+    BlockCacheFile* log = block_cache_open(topic->file_path);
+    if (!log) {
         return 0;
     }
 
-    return chunk->size;
+    return block_cache_file_size(log);
 }
 
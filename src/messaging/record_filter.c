@@ -0,0 +1,321 @@
+#include "headers/record_filter.h"
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#define FILTER_CLAUSE_SEPARATOR "&&"
+#define FILTER_PREFIX_EQUALS "equals:"
+#define FILTER_PREFIX_PREFIX "prefix:"
+#define FILTER_PREFIX_CONTAINS "contains:"
+#define FILTER_PREFIX_JSON "json:"
+
+static const uint8_t* find_bytes(const uint8_t* haystack, size_t haystack_size,
+                                 const uint8_t* needle, size_t needle_size) {
+    if (!haystack || !needle) {
+        return NULL;
+    }
+
+    if (needle_size == 0) {
+        return haystack;
+    }
+
+    if (needle_size > haystack_size) {
+        return NULL;
+    }
+
+    size_t last_start = haystack_size - needle_size;
+    size_t i = 0;
+
+#if defined(__SSE2__)
+    // Compare the first and last needle byte against 16 candidate positions at
+    // once and only fall back to memcmp where both of them line up.
+    const __m128i first = _mm_set1_epi8((char)needle[0]);
+    const __m128i last = _mm_set1_epi8((char)needle[needle_size - 1]);
+
+    for (; i + 16 <= last_start + 1; i += 16) {
+        __m128i block_first = _mm_loadu_si128((const __m128i*)(haystack + i));
+        __m128i block_last = _mm_loadu_si128((const __m128i*)(haystack + i + needle_size - 1));
+        unsigned int mask = (unsigned int)_mm_movemask_epi8(
+            _mm_and_si128(_mm_cmpeq_epi8(first, block_first), _mm_cmpeq_epi8(last, block_last)));
+
+        while (mask) {
+            unsigned int bit = (unsigned int)__builtin_ctz(mask);
+            if (memcmp(haystack + i + bit, needle, needle_size) == 0) {
+                return haystack + i + bit;
+            }
+            mask &= mask - 1;
+        }
+    }
+#endif
+
+    while (i <= last_start) {
+        const uint8_t* candidate = memchr(haystack + i, needle[0], last_start - i + 1);
+        if (!candidate) {
+            return NULL;
+        }
+        if (memcmp(candidate, needle, needle_size) == 0) {
+            return candidate;
+        }
+        i = (size_t)(candidate - haystack) + 1;
+    }
+
+    return NULL;
+}
+
+static const uint8_t* skip_whitespace(const uint8_t* p, const uint8_t* end) {
+    while (p < end && (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r')) {
+        p++;
+    }
+    return p;
+}
+
+static int is_value_terminator(uint8_t c) {
+    return c == ',' || c == '}' || c == ']' || c == ' ' || c == '\t' || c == '\n' || c == '\r';
+}
+
+static int match_json_field(const FilterClause* clause, const uint8_t* data, size_t data_size) {
+    const uint8_t* end = data + data_size;
+    size_t pos = 0;
+
+    while (pos < data_size) {
+        const uint8_t* hit = find_bytes(data + pos, data_size - pos, clause->needle, clause->needle_size);
+        if (!hit) {
+            return 0;
+        }
+
+        const uint8_t* p = skip_whitespace(hit + clause->needle_size, end);
+        if (p < end && *p == ':') {
+            p = skip_whitespace(p + 1, end);
+
+            if (p < end && *p == '"') {
+                p++;
+                if ((size_t)(end - p) > clause->value_size &&
+                    memcmp(p, clause->value, clause->value_size) == 0 &&
+                    p[clause->value_size] == '"') {
+                    return 1;
+                }
+            } else if ((size_t)(end - p) >= clause->value_size &&
+                       memcmp(p, clause->value, clause->value_size) == 0) {
+                const uint8_t* after = p + clause->value_size;
+                if (after == end || is_value_terminator(*after)) {
+                    return 1;
+                }
+            }
+        }
+
+        pos = (size_t)(hit - data) + 1;
+    }
+
+    return 0;
+}
+
+int record_filter_extract_json_field(const uint8_t* data, size_t data_size,
+                                     const uint8_t* quoted_field, size_t quoted_field_size,
+                                     const uint8_t** value, size_t* value_size) {
+    if (!data || !quoted_field || !value || !value_size) {
+        return -1;
+    }
+
+    const uint8_t* end = data + data_size;
+    size_t pos = 0;
+
+    while (pos < data_size) {
+        const uint8_t* hit = find_bytes(data + pos, data_size - pos, quoted_field, quoted_field_size);
+        if (!hit) {
+            return -1;
+        }
+
+        const uint8_t* p = skip_whitespace(hit + quoted_field_size, end);
+        if (p < end && *p == ':') {
+            p = skip_whitespace(p + 1, end);
+
+            if (p < end && *p == '"') {
+                const uint8_t* start = ++p;
+                while (p < end && *p != '"') {
+                    p += (*p == '\\' && p + 1 < end) ? 2 : 1;
+                }
+                if (p < end) {
+                    *value = start;
+                    *value_size = (size_t)(p - start);
+                    return 0;
+                }
+                return -1;
+            }
+
+            const uint8_t* start = p;
+            while (p < end && !is_value_terminator(*p)) {
+                p++;
+            }
+            if (p > start) {
+                *value = start;
+                *value_size = (size_t)(p - start);
+                return 0;
+            }
+        }
+
+        pos = (size_t)(hit - data) + 1;
+    }
+
+    return -1;
+}
+
+static int match_clause(const FilterClause* clause, const uint8_t* data, size_t data_size) {
+    switch (clause->op) {
+        case FILTER_OP_EQUALS:
+            return data_size == clause->needle_size &&
+                   memcmp(data, clause->needle, clause->needle_size) == 0;
+        case FILTER_OP_PREFIX:
+            return data_size >= clause->needle_size &&
+                   memcmp(data, clause->needle, clause->needle_size) == 0;
+        case FILTER_OP_CONTAINS:
+            return find_bytes(data, data_size, clause->needle, clause->needle_size) != NULL;
+        case FILTER_OP_JSON_FIELD:
+            return match_json_field(clause, data, data_size);
+    }
+    return 0;
+}
+
+int record_filter_match(const RecordFilter* filter, const uint8_t* data, size_t data_size) {
+    if (!filter || filter->count == 0) {
+        return 1;
+    }
+
+    if (!data) {
+        return 0;
+    }
+
+    for (size_t i = 0; i < filter->count; i++) {
+        if (!match_clause(&filter->clauses[i], data, data_size)) {
+            return 0;
+        }
+    }
+
+    return 1;
+}
+
+static int copy_pattern(uint8_t* dest, size_t* dest_size, const char* src, size_t src_size) {
+    if (src_size >= MAX_FILTER_PATTERN_SIZE) {
+        return -1;
+    }
+
+    memcpy(dest, src, src_size);
+    *dest_size = src_size;
+    return 0;
+}
+
+static int compile_clause(FilterClause* clause, const char* text, size_t text_size) {
+    while (text_size > 0 && isspace((unsigned char)*text)) {
+        text++;
+        text_size--;
+    }
+    while (text_size > 0 && isspace((unsigned char)text[text_size - 1])) {
+        text_size--;
+    }
+
+    size_t equals_len = strlen(FILTER_PREFIX_EQUALS);
+    size_t prefix_len = strlen(FILTER_PREFIX_PREFIX);
+    size_t contains_len = strlen(FILTER_PREFIX_CONTAINS);
+    size_t json_len = strlen(FILTER_PREFIX_JSON);
+
+    memset(clause, 0, sizeof(FilterClause));
+
+    if (text_size >= equals_len && strncmp(text, FILTER_PREFIX_EQUALS, equals_len) == 0) {
+        clause->op = FILTER_OP_EQUALS;
+        return copy_pattern(clause->needle, &clause->needle_size, text + equals_len, text_size - equals_len);
+    }
+
+    if (text_size >= prefix_len && strncmp(text, FILTER_PREFIX_PREFIX, prefix_len) == 0) {
+        clause->op = FILTER_OP_PREFIX;
+        return copy_pattern(clause->needle, &clause->needle_size, text + prefix_len, text_size - prefix_len);
+    }
+
+    if (text_size >= contains_len && strncmp(text, FILTER_PREFIX_CONTAINS, contains_len) == 0) {
+        clause->op = FILTER_OP_CONTAINS;
+        if (text_size == contains_len) {
+            return -1;
+        }
+        return copy_pattern(clause->needle, &clause->needle_size, text + contains_len, text_size - contains_len);
+    }
+
+    if (text_size >= json_len && strncmp(text, FILTER_PREFIX_JSON, json_len) == 0) {
+        const char* field = text + json_len;
+        size_t rest = text_size - json_len;
+        const char* separator = memchr(field, '=', rest);
+        if (!separator || separator == field) {
+            return -1;
+        }
+
+        size_t field_size = (size_t)(separator - field);
+        const char* value = separator + 1;
+        size_t value_size = rest - field_size - 1;
+
+        if (value_size >= 2 && value[0] == '"' && value[value_size - 1] == '"') {
+            value++;
+            value_size -= 2;
+        }
+
+        // The field is matched as a quoted JSON key so "id" never hits "user_id".
+        if (field_size + 2 >= MAX_FILTER_PATTERN_SIZE) {
+            return -1;
+        }
+
+        clause->op = FILTER_OP_JSON_FIELD;
+        clause->needle[0] = '"';
+        memcpy(clause->needle + 1, field, field_size);
+        clause->needle[field_size + 1] = '"';
+        clause->needle_size = field_size + 2;
+        return copy_pattern(clause->value, &clause->value_size, value, value_size);
+    }
+
+    return -1;
+}
+
+RecordFilter* record_filter_compile(const char* expression) {
+    if (!expression) {
+        return NULL;
+    }
+
+    RecordFilter* filter = (RecordFilter*)calloc(1, sizeof(RecordFilter));
+    if (!filter) {
+        return NULL;
+    }
+
+    const char* cursor = expression;
+    size_t separator_len = strlen(FILTER_CLAUSE_SEPARATOR);
+
+    while (*cursor) {
+        const char* separator = strstr(cursor, FILTER_CLAUSE_SEPARATOR);
+        size_t clause_size = separator ? (size_t)(separator - cursor) : strlen(cursor);
+
+        if (filter->count >= MAX_FILTER_CLAUSES ||
+            compile_clause(&filter->clauses[filter->count], cursor, clause_size) != 0) {
+            free(filter);
+            return NULL;
+        }
+        filter->count++;
+
+        if (!separator) {
+            break;
+        }
+        cursor = separator + separator_len;
+    }
+
+    if (filter->count == 0) {
+        free(filter);
+        return NULL;
+    }
+
+    return filter;
+}
+
+void record_filter_free(RecordFilter* filter) {
+    if (!filter) {
+        return;
+    }
+
+    free(filter);
+}
@@ -0,0 +1,220 @@
+#include "headers/stream_codec.h"
+#include "headers/encoder.h"
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+// Streams own their contexts instead of borrowing the per-thread ones, since
+// an upload or a send can be resumed on a different thread. Memory per stream
+// is the context plus one output buffer of ZSTD_CStreamOutSize() or
+// ZSTD_DStreamOutSize(); the decoder also refuses frames whose window would
+// need more than 2^STREAM_WINDOW_LOG_MAX bytes.
+//
+// Inputs of STREAM_MT_THRESHOLD bytes or more are compressed with zstd's
+// worker threads when the library was built with them.
+#define STREAM_WINDOW_LOG_MAX 24
+#define STREAM_MT_THRESHOLD (4 * 1024 * 1024)
+#define STREAM_MAX_WORKERS 4
+
+static unsigned stream_workers(void) {
+    long cores = sysconf(_SC_NPROCESSORS_ONLN);
+    if (cores <= 1) {
+        return 0;
+    }
+    return cores > STREAM_MAX_WORKERS ? STREAM_MAX_WORKERS : (unsigned)cores;
+}
+
+EncodeStream* encode_stream_create(int compression_level, uint64_t pledged_size, const ZSTD_CDict* cdict,
+                                   StreamSink sink, void* sink_context) {
+    if (!sink) {
+        return NULL;
+    }
+
+    EncodeStream* stream = (EncodeStream*)calloc(1, sizeof(EncodeStream));
+    if (!stream) {
+        return NULL;
+    }
+
+    stream->sink = sink;
+    stream->sink_context = sink_context;
+    stream->output_capacity = ZSTD_CStreamOutSize();
+    stream->output = (uint8_t*)malloc(stream->output_capacity);
+    stream->cctx = ZSTD_createCCtx();
+    if (!stream->output || !stream->cctx) {
+        encode_stream_free(stream);
+        return NULL;
+    }
+
+    if (cdict) {
+        // The level is the one the CDict was digested with.
+        if (ZSTD_isError(ZSTD_CCtx_refCDict(stream->cctx, cdict))) {
+            encode_stream_free(stream);
+            return NULL;
+        }
+    } else if (ZSTD_isError(ZSTD_CCtx_setParameter(stream->cctx, ZSTD_c_compressionLevel,
+                                                   encoder_clamp_level(compression_level)))) {
+        encode_stream_free(stream);
+        return NULL;
+    }
+
+    if (pledged_size > 0 && ZSTD_isError(ZSTD_CCtx_setPledgedSrcSize(stream->cctx, pledged_size))) {
+        encode_stream_free(stream);
+        return NULL;
+    }
+
+    if (pledged_size >= STREAM_MT_THRESHOLD) {
+        unsigned workers = stream_workers();
+        if (workers > 0) {
+            // Fails harmlessly on a single-threaded libzstd.
+            ZSTD_CCtx_setParameter(stream->cctx, ZSTD_c_nbWorkers, (int)workers);
+        }
+    }
+
+    return stream;
+}
+
+static int encode_stream_drive(EncodeStream* stream, const void* data, size_t data_size, ZSTD_EndDirective mode) {
+    ZSTD_inBuffer input = { data, data_size, 0 };
+    size_t remaining;
+
+    do {
+        ZSTD_outBuffer output = { stream->output, stream->output_capacity, 0 };
+        remaining = ZSTD_compressStream2(stream->cctx, &output, &input, mode);
+        if (ZSTD_isError(remaining)) {
+            return -1;
+        }
+
+        if (output.pos > 0) {
+            if (stream->sink(stream->sink_context, stream->output, output.pos) != 0) {
+                return -1;
+            }
+            stream->output_size += output.pos;
+        }
+    } while (mode == ZSTD_e_end ? remaining != 0 : input.pos < input.size);
+
+    return 0;
+}
+
+int encode_stream_write(EncodeStream* stream, const void* data, size_t data_size) {
+    if (!stream || (!data && data_size > 0)) {
+        return -1;
+    }
+
+    if (data_size == 0) {
+        return 0;
+    }
+
+    if (encode_stream_drive(stream, data, data_size, ZSTD_e_continue) != 0) {
+        return -1;
+    }
+
+    stream->input_size += data_size;
+    return 0;
+}
+
+int encode_stream_finish(EncodeStream* stream) {
+    if (!stream) {
+        return -1;
+    }
+
+    return encode_stream_drive(stream, NULL, 0, ZSTD_e_end);
+}
+
+void encode_stream_free(EncodeStream* stream) {
+    if (!stream) {
+        return;
+    }
+
+    ZSTD_freeCCtx(stream->cctx);
+    free(stream->output);
+    free(stream);
+}
+
+DecodeStream* decode_stream_create(const ZSTD_DDict* ddict, uint64_t max_output_size,
+                                   StreamSink sink, void* sink_context) {
+    if (!sink) {
+        return NULL;
+    }
+
+    DecodeStream* stream = (DecodeStream*)calloc(1, sizeof(DecodeStream));
+    if (!stream) {
+        return NULL;
+    }
+
+    stream->sink = sink;
+    stream->sink_context = sink_context;
+    stream->max_output_size = max_output_size;
+    stream->output_capacity = ZSTD_DStreamOutSize();
+    stream->output = (uint8_t*)malloc(stream->output_capacity);
+    stream->dctx = ZSTD_createDCtx();
+    if (!stream->output || !stream->dctx ||
+        ZSTD_isError(ZSTD_DCtx_setParameter(stream->dctx, ZSTD_d_windowLogMax, STREAM_WINDOW_LOG_MAX)) ||
+        (ddict && ZSTD_isError(ZSTD_DCtx_refDDict(stream->dctx, ddict)))) {
+        decode_stream_free(stream);
+        return NULL;
+    }
+
+    return stream;
+}
+
+static int decode_stream_emit(DecodeStream* stream, size_t size) {
+    stream->output_size += size;
+    if (stream->max_output_size > 0 && stream->output_size > stream->max_output_size) {
+        return -1;
+    }
+    return stream->sink(stream->sink_context, stream->output, size);
+}
+
+int decode_stream_write(DecodeStream* stream, const void* data, size_t data_size) {
+    if (!stream || (!data && data_size > 0)) {
+        return -1;
+    }
+
+    ZSTD_inBuffer input = { data, data_size, 0 };
+    for (;;) {
+        if (stream->finished) {
+            // Anything after the end of the frame is not ours to decode.
+            return input.pos < input.size ? -1 : 0;
+        }
+
+        ZSTD_outBuffer output = { stream->output, stream->output_capacity, 0 };
+        size_t hint = ZSTD_decompressStream(stream->dctx, &output, &input);
+        if (ZSTD_isError(hint)) {
+            return -1;
+        }
+        if (hint == 0) {
+            stream->finished = 1;
+        }
+
+        if (output.pos > 0 && decode_stream_emit(stream, output.pos) != 0) {
+            return -1;
+        }
+
+        // A full output buffer means the decoder may still be holding data.
+        if (input.pos == input.size && output.pos < output.size) {
+            return 0;
+        }
+    }
+}
+
+int decode_stream_finish(DecodeStream* stream) {
+    if (!stream) {
+        return -1;
+    }
+
+    if (!stream->finished && decode_stream_write(stream, NULL, 0) != 0) {
+        return -1;
+    }
+
+    return stream->finished ? 0 : -1;
+}
+
+void decode_stream_free(DecodeStream* stream) {
+    if (!stream) {
+        return;
+    }
+
+    ZSTD_freeDCtx(stream->dctx);
+    free(stream->output);
+    free(stream);
+}
@@ -0,0 +1,576 @@
+#include "headers/table_view.h"
+#include "headers/create_topic.h"
+#include "headers/record_filter.h"
+#include "headers/record_format.h"
+#include "headers/codec.h"
+#include "../writer/headers/block_cache.h"
+#include "../utils/header/path_registry.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/stat.h>
+
+// A table view maps the value of one JSON field (the key) to the offset of the
+// latest record carrying it. The index is an open-addressing table with linear
+// probing; record_offset 0 marks an empty slot since no record can start
+// inside the topic file header. The view keeps its own descriptor and catches
+// up incrementally from indexed_upto, so neither appends nor lookups ever
+// rescan the log. The key field is persisted in "<topic>.topic.view" so the
+// view can be rebuilt from the log after a restart.
+#define TABLE_VIEW_EXTENSION ".view"
+#define TABLE_VIEW_TOPIC_SUFFIX ".topic"
+#define RECORD_SIZE_HEADER_SIZE RECORD_HEADER_SIZE
+#define MAX_RECORD_SIZE (10 * 1024 * 1024) // 10MB max record size
+#define MAX_KEY_FIELD_SIZE 255
+#define INITIAL_VIEW_CAPACITY 1024
+#define VIEW_LOAD_FACTOR_PERCENT 70
+#define VIEW_SCAN_BUFFER_SIZE (64 * 1024)
+
+static PathRegistry g_views = PATH_REGISTRY_INITIALIZER(TableView, topic_file_path);
+
+static uint64_t hash_key(const uint8_t* key, size_t key_size) {
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    for (size_t i = 0; i < key_size; i++) {
+        hash ^= key[i];
+        hash *= 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+static TableViewSlot* find_slot(TableViewSlot* slots, size_t capacity, uint64_t key_hash,
+                                const uint8_t* key, size_t key_size) {
+    size_t mask = capacity - 1;
+    size_t index = (size_t)key_hash & mask;
+
+    while (slots[index].record_offset != 0) {
+        if (slots[index].key_hash == key_hash && slots[index].key_size == key_size &&
+            memcmp(slots[index].key, key, key_size) == 0) {
+            break;
+        }
+        index = (index + 1) & mask;
+    }
+
+    return &slots[index];
+}
+
+static void clear_slots(TableView* view) {
+    for (size_t i = 0; i < view->capacity; i++) {
+        free(view->slots[i].key);
+    }
+    memset(view->slots, 0, view->capacity * sizeof(TableViewSlot));
+    view->count = 0;
+}
+
+static int grow_slots(TableView* view) {
+    size_t new_capacity = view->capacity * 2;
+    TableViewSlot* new_slots = (TableViewSlot*)calloc(new_capacity, sizeof(TableViewSlot));
+    if (!new_slots) {
+        return -1;
+    }
+
+    for (size_t i = 0; i < view->capacity; i++) {
+        TableViewSlot* slot = &view->slots[i];
+        if (slot->record_offset != 0) {
+            *find_slot(new_slots, new_capacity, slot->key_hash, slot->key, slot->key_size) = *slot;
+        }
+    }
+
+    free(view->slots);
+    view->slots = new_slots;
+    view->capacity = new_capacity;
+    return 0;
+}
+
+static int index_record(TableView* view, const uint8_t* key, size_t key_size, size_t record_offset) {
+    if ((view->count + 1) * 100 > view->capacity * VIEW_LOAD_FACTOR_PERCENT) {
+        if (grow_slots(view) != 0) {
+            return -1;
+        }
+    }
+
+    uint64_t key_hash = hash_key(key, key_size);
+    TableViewSlot* slot = find_slot(view->slots, view->capacity, key_hash, key, key_size);
+
+    if (slot->record_offset == 0) {
+        slot->key = (uint8_t*)malloc(key_size ? key_size : 1);
+        if (!slot->key) {
+            return -1;
+        }
+        memcpy(slot->key, key, key_size);
+        slot->key_size = key_size;
+        slot->key_hash = key_hash;
+        view->count++;
+    }
+
+    slot->record_offset = record_offset;
+    return 0;
+}
+
+static int reserve_scratch(TableView* view, size_t needed) {
+    if (needed <= view->scratch_capacity) {
+        return 0;
+    }
+
+    uint8_t* scratch = (uint8_t*)realloc(view->scratch, needed);
+    if (!scratch) {
+        return -1;
+    }
+
+    view->scratch = scratch;
+    view->scratch_capacity = needed;
+    return 0;
+}
+
+// Decode an encoded payload into buffer (grown as needed) and point *payload
+// at the result.
+static int decode_payload(const char* topic_file_path, uint8_t codec, const uint8_t** payload, size_t* payload_size,
+                          uint8_t** buffer, size_t* buffer_capacity) {
+    if (codec == RECORD_CODEC_NONE) {
+        return 0;
+    }
+
+    const Codec* decoder = codec_by_id(codec);
+    size_t content_size = 0;
+    if (!decoder || decoder->decoded_size(*payload, *payload_size, &content_size) != 0 ||
+        content_size == 0 || content_size > MAX_RECORD_SIZE) {
+        return -1;
+    }
+
+    if (content_size > *buffer_capacity) {
+        uint8_t* grown = (uint8_t*)realloc(*buffer, content_size);
+        if (!grown) {
+            return -1;
+        }
+        *buffer = grown;
+        *buffer_capacity = content_size;
+    }
+
+    size_t decoded_size = 0;
+    if (decoder->decode(topic_file_path, *payload, *payload_size, *buffer, content_size, &decoded_size) != 0) {
+        return -1;
+    }
+
+    *payload = *buffer;
+    *payload_size = decoded_size;
+    return 0;
+}
+
+static int reopen_if_replaced(TableView* view) {
+    struct stat path_stat;
+    struct stat fd_stat;
+
+    if (stat(view->topic_file_path, &path_stat) != 0) {
+        return -1;
+    }
+
+    if (view->fd >= 0 && fstat(view->fd, &fd_stat) == 0 &&
+        fd_stat.st_ino == path_stat.st_ino && fd_stat.st_dev == path_stat.st_dev &&
+        (size_t)fd_stat.st_size >= view->indexed_upto) {
+        return 0;
+    }
+
+    // The topic was deleted and recreated (or truncated): start over.
+    int fd = open(view->topic_file_path, O_RDONLY);
+    if (fd < 0) {
+        return -1;
+    }
+
+    if (view->fd >= 0) {
+        close(view->fd);
+    }
+    view->fd = fd;
+    view->indexed_upto = TOPIC_FILE_HEADER_SIZE;
+    clear_slots(view);
+    return 0;
+}
+
+// Index every complete record appended since the last call. Records are read
+// through a sliding window so a rebuild costs one pread per 64KB of log.
+static int catch_up_locked(TableView* view) {
+    if (reopen_if_replaced(view) != 0) {
+        return -1;
+    }
+
+    struct stat st;
+    if (fstat(view->fd, &st) != 0) {
+        return -1;
+    }
+
+    size_t file_size = (size_t)st.st_size;
+    size_t offset = view->indexed_upto;
+    size_t window_start = 0;
+    size_t window_length = 0;
+
+    while (offset + RECORD_SIZE_HEADER_SIZE <= file_size) {
+        if (offset < window_start || offset + RECORD_SIZE_HEADER_SIZE > window_start + window_length) {
+            ssize_t bytes_read = pread(view->fd, view->scratch, view->scratch_capacity, (off_t)offset);
+            if (bytes_read < (ssize_t)RECORD_SIZE_HEADER_SIZE) {
+                break;
+            }
+            window_start = offset;
+            window_length = (size_t)bytes_read;
+        }
+
+        uint32_t header;
+        memcpy(&header, view->scratch + (offset - window_start), RECORD_SIZE_HEADER_SIZE);
+        uint32_t record_size = RECORD_HEADER_PAYLOAD_SIZE(header);
+
+        if (record_size == 0 || record_size > MAX_RECORD_SIZE) {
+            fprintf(stderr, "Table view stopped at corrupt record in %s at offset %zu\n",
+                    view->topic_file_path, offset);
+            break;
+        }
+
+        size_t record_end = offset + RECORD_SIZE_HEADER_SIZE + record_size;
+        if (record_end > file_size) {
+            break;
+        }
+
+        if (record_end > window_start + window_length) {
+            if (reserve_scratch(view, RECORD_SIZE_HEADER_SIZE + record_size) != 0) {
+                return -1;
+            }
+            ssize_t bytes_read = pread(view->fd, view->scratch, view->scratch_capacity, (off_t)offset);
+            if (bytes_read < (ssize_t)(RECORD_SIZE_HEADER_SIZE + record_size)) {
+                break;
+            }
+            window_start = offset;
+            window_length = (size_t)bytes_read;
+        }
+
+        const uint8_t* payload = view->scratch + (offset - window_start) + RECORD_SIZE_HEADER_SIZE;
+        size_t payload_size = record_size;
+        const uint8_t* key;
+        size_t key_size;
+
+        if (decode_payload(view->topic_file_path, RECORD_HEADER_CODEC(header), &payload, &payload_size,
+                           &view->decoded, &view->decoded_capacity) == 0 &&
+            record_filter_extract_json_field(payload, payload_size, view->quoted_key, view->quoted_key_size,
+                                             &key, &key_size) == 0) {
+            if (index_record(view, key, key_size, offset) != 0) {
+                view->indexed_upto = offset;
+                return -1;
+            }
+        }
+
+        offset = record_end;
+    }
+
+    view->indexed_upto = offset;
+    return 0;
+}
+
+static char* build_view_path(const char* topic_file_path) {
+    size_t path_len = strlen(topic_file_path) + strlen(TABLE_VIEW_EXTENSION) + 1;
+    char* view_path = (char*)malloc(path_len);
+    if (view_path) {
+        snprintf(view_path, path_len, "%s%s", topic_file_path, TABLE_VIEW_EXTENSION);
+    }
+    return view_path;
+}
+
+static int write_definition(const char* topic_file_path, const char* key_field) {
+    char* view_path = build_view_path(topic_file_path);
+    if (!view_path) {
+        return -1;
+    }
+
+    FILE* file = fopen(view_path, "w");
+    free(view_path);
+    if (!file) {
+        return -1;
+    }
+
+    int result = fputs(key_field, file) < 0 ? -1 : 0;
+    if (fclose(file) != 0) {
+        result = -1;
+    }
+    return result;
+}
+
+static int read_definition(const char* topic_file_path, char* key_field, size_t key_field_size) {
+    char* view_path = build_view_path(topic_file_path);
+    if (!view_path) {
+        return -1;
+    }
+
+    FILE* file = fopen(view_path, "r");
+    free(view_path);
+    if (!file) {
+        return -1;
+    }
+
+    size_t length = fread(key_field, 1, key_field_size - 1, file);
+    fclose(file);
+
+    while (length > 0 && (key_field[length - 1] == '\n' || key_field[length - 1] == '\r')) {
+        length--;
+    }
+    key_field[length] = '\0';
+
+    return length > 0 ? 0 : -1;
+}
+
+static void table_view_free(TableView* view) {
+    if (!view) {
+        return;
+    }
+
+    if (view->slots) {
+        clear_slots(view);
+    }
+    if (view->fd >= 0) {
+        close(view->fd);
+    }
+    pthread_mutex_destroy(&view->mutex);
+    free(view->slots);
+    free(view->scratch);
+    free(view->decoded);
+    free(view->quoted_key);
+    free(view->key_field);
+    free(view->topic_file_path);
+    free(view);
+}
+
+static TableView* table_view_build(const char* topic_file_path, const char* key_field) {
+    TableView* view = (TableView*)calloc(1, sizeof(TableView));
+    if (!view) {
+        return NULL;
+    }
+    view->fd = -1;
+
+    if (pthread_mutex_init(&view->mutex, NULL) != 0) {
+        free(view);
+        return NULL;
+    }
+
+    size_t field_len = strlen(key_field);
+    view->topic_file_path = strdup(topic_file_path);
+    view->key_field = strdup(key_field);
+    view->quoted_key = (uint8_t*)malloc(field_len + 2);
+    view->slots = (TableViewSlot*)calloc(INITIAL_VIEW_CAPACITY, sizeof(TableViewSlot));
+    view->capacity = INITIAL_VIEW_CAPACITY;
+    view->scratch = (uint8_t*)malloc(VIEW_SCAN_BUFFER_SIZE);
+    view->scratch_capacity = VIEW_SCAN_BUFFER_SIZE;
+    view->indexed_upto = TOPIC_FILE_HEADER_SIZE;
+
+    if (!view->topic_file_path || !view->key_field || !view->quoted_key || !view->slots || !view->scratch) {
+        table_view_free(view);
+        return NULL;
+    }
+
+    // Keys are matched as quoted JSON names so "id" never hits "user_id".
+    view->quoted_key[0] = '"';
+    memcpy(view->quoted_key + 1, key_field, field_len);
+    view->quoted_key[field_len + 1] = '"';
+    view->quoted_key_size = field_len + 2;
+
+    if (catch_up_locked(view) != 0) {
+        perror("Failed to build table view");
+        table_view_free(view);
+        return NULL;
+    }
+
+    return view;
+}
+
+typedef struct {
+    const char* key_field;
+    int persist;
+} ViewDefinition;
+
+static void* create_view(const char* topic_file_path, void* context) {
+    const ViewDefinition* definition = (const ViewDefinition*)context;
+    if (definition->persist && write_definition(topic_file_path, definition->key_field) != 0) {
+        perror("Failed to persist table view definition");
+        return NULL;
+    }
+
+    TableView* view = table_view_build(topic_file_path, definition->key_field);
+    if (!view && definition->persist) {
+        char* view_path = build_view_path(topic_file_path);
+        if (view_path) {
+            unlink(view_path);
+            free(view_path);
+        }
+    }
+    return view;
+}
+
+// A topic has at most one view; asking for it by another key fails.
+static TableView* register_view(const char* topic_file_path, const char* key_field, int persist) {
+    ViewDefinition definition = { key_field, persist };
+    TableView* view = (TableView*)path_registry_get(&g_views, topic_file_path, create_view, &definition);
+    return view && strcmp(view->key_field, key_field) == 0 ? view : NULL;
+}
+
+TableView* table_view_open(const char* topic_file_path, const char* key_field) {
+    if (!topic_file_path || !key_field) {
+        return NULL;
+    }
+
+    size_t field_len = strlen(key_field);
+    if (field_len == 0 || field_len > MAX_KEY_FIELD_SIZE || strpbrk(key_field, "\"\\\r\n")) {
+        return NULL;
+    }
+
+    return register_view(topic_file_path, key_field, 1);
+}
+
+TableView* table_view_find(const char* topic_file_path) {
+    if (!topic_file_path) {
+        return NULL;
+    }
+
+    TableView* view = (TableView*)path_registry_find(&g_views, topic_file_path);
+    if (view) {
+        return view;
+    }
+
+    char key_field[MAX_KEY_FIELD_SIZE + 1];
+    if (read_definition(topic_file_path, key_field, sizeof(key_field)) != 0) {
+        return NULL;
+    }
+
+    return register_view(topic_file_path, key_field, 0);
+}
+
+int table_view_refresh(TableView* view) {
+    if (!view) {
+        return -1;
+    }
+
+    pthread_mutex_lock(&view->mutex);
+    int result = catch_up_locked(view);
+    pthread_mutex_unlock(&view->mutex);
+
+    return result;
+}
+
+void table_view_notify(const char* topic_file_path) {
+    if (!topic_file_path) {
+        return;
+    }
+
+    TableView* view = (TableView*)path_registry_find(&g_views, topic_file_path);
+    if (view) {
+        table_view_refresh(view);
+    }
+}
+
+int table_view_get(TableView* view, const char* key, size_t key_size,
+                   uint8_t** value, size_t* value_size) {
+    if (!view || !key || !value || !value_size) {
+        return -1;
+    }
+
+    pthread_mutex_lock(&view->mutex);
+
+    if (catch_up_locked(view) != 0) {
+        pthread_mutex_unlock(&view->mutex);
+        return -1;
+    }
+
+    uint64_t key_hash = hash_key((const uint8_t*)key, key_size);
+    TableViewSlot* slot = find_slot(view->slots, view->capacity, key_hash, (const uint8_t*)key, key_size);
+    size_t record_offset = (size_t)slot->record_offset;
+
+    pthread_mutex_unlock(&view->mutex);
+
+    if (record_offset == 0) {
+        return TABLE_VIEW_NOT_FOUND;
+    }
+
+    BlockCacheFile* log = block_cache_open(view->topic_file_path);
+    if (!log) {
+        return -1;
+    }
+
+    uint32_t header;
+    if (block_cache_read(log, &header, RECORD_SIZE_HEADER_SIZE, record_offset) != (long)RECORD_SIZE_HEADER_SIZE) {
+        return -1;
+    }
+
+    uint32_t record_size = RECORD_HEADER_PAYLOAD_SIZE(header);
+    if (record_size == 0 || record_size > MAX_RECORD_SIZE) {
+        return -1;
+    }
+
+    uint8_t* data = (uint8_t*)malloc(record_size);
+    if (!data) {
+        return -1;
+    }
+
+    if (block_cache_read(log, data, record_size, record_offset + RECORD_SIZE_HEADER_SIZE) != (long)record_size) {
+        free(data);
+        return -1;
+    }
+
+    // Values are always returned as published.
+    const uint8_t* payload = data;
+    size_t payload_size = record_size;
+    uint8_t* decoded = NULL;
+    size_t decoded_capacity = 0;
+
+    if (decode_payload(view->topic_file_path, RECORD_HEADER_CODEC(header), &payload, &payload_size,
+                       &decoded, &decoded_capacity) != 0) {
+        free(data);
+        free(decoded);
+        return -1;
+    }
+
+    if (decoded) {
+        free(data);
+        data = decoded;
+    }
+
+    *value = data;
+    *value_size = payload_size;
+    return 0;
+}
+
+int table_view_start(const char* base_path) {
+    if (!base_path) {
+        return -1;
+    }
+
+    DIR* dir = opendir(base_path);
+    if (!dir) {
+        return -1;
+    }
+
+    struct dirent* entry;
+    size_t suffix_len = strlen(TABLE_VIEW_TOPIC_SUFFIX) + strlen(TABLE_VIEW_EXTENSION);
+
+    while ((entry = readdir(dir)) != NULL) {
+        size_t name_len = strlen(entry->d_name);
+        if (name_len <= suffix_len ||
+            strcmp(entry->d_name + name_len - strlen(TABLE_VIEW_EXTENSION), TABLE_VIEW_EXTENSION) != 0 ||
+            strncmp(entry->d_name + name_len - suffix_len, TABLE_VIEW_TOPIC_SUFFIX, strlen(TABLE_VIEW_TOPIC_SUFFIX)) != 0) {
+            continue;
+        }
+
+        char topic_file_path[512];
+        snprintf(topic_file_path, sizeof(topic_file_path), "%s/%.*s", base_path,
+                 (int)(name_len - strlen(TABLE_VIEW_EXTENSION)), entry->d_name);
+
+        if (!table_view_find(topic_file_path)) {
+            fprintf(stderr, "Failed to rebuild table view for %s\n", topic_file_path);
+        }
+    }
+
+    closedir(dir);
+    return 0;
+}
+
+void table_views_free(void) {
+    TableView* view = (TableView*)path_registry_take_all(&g_views);
+    while (view) {
+        TableView* next = view->next;
+        table_view_free(view);
+        view = next;
+    }
+}
@@ -0,0 +1,93 @@
+#include "headers/topic_watch.h"
+#include "../utils/header/path_registry.h"
+#include <stdlib.h>
+#include <string.h>
+
+// Publishers notify every append, so a topic nobody watches costs one walk
+// of the registry and an atomic load.
+static PathRegistry g_watchers = PATH_REGISTRY_INITIALIZER(TopicWatchers, topic_file_path);
+
+static void* create_watchers(const char* topic_file_path, void* context) {
+    (void)context;
+    TopicWatchers* watchers = (TopicWatchers*)calloc(1, sizeof(TopicWatchers));
+    if (!watchers) {
+        return NULL;
+    }
+
+    watchers->topic_file_path = strdup(topic_file_path);
+    if (!watchers->topic_file_path) {
+        free(watchers);
+        return NULL;
+    }
+
+    pthread_mutex_init(&watchers->mutex, NULL);
+    return watchers;
+}
+
+static TopicWatchers* watchers_for_topic(const char* topic_file_path) {
+    return (TopicWatchers*)path_registry_get(&g_watchers, topic_file_path, create_watchers, NULL);
+}
+
+TopicWatch* topic_watch_add(const char* topic_file_path, TopicWatchCallback callback, void* context) {
+    if (!topic_file_path || !callback) {
+        return NULL;
+    }
+
+    TopicWatchers* watchers = watchers_for_topic(topic_file_path);
+    if (!watchers) {
+        return NULL;
+    }
+
+    TopicWatch* watch = (TopicWatch*)calloc(1, sizeof(TopicWatch));
+    if (!watch) {
+        return NULL;
+    }
+
+    watch->callback = callback;
+    watch->context = context;
+    watch->watchers = watchers;
+
+    pthread_mutex_lock(&watchers->mutex);
+    watch->next = watchers->watches;
+    watchers->watches = watch;
+    __atomic_store_n(&watchers->watch_count, watchers->watch_count + 1, __ATOMIC_RELEASE);
+    pthread_mutex_unlock(&watchers->mutex);
+
+    return watch;
+}
+
+void topic_watch_remove(TopicWatch* watch) {
+    if (!watch) {
+        return;
+    }
+
+    TopicWatchers* watchers = watch->watchers;
+    pthread_mutex_lock(&watchers->mutex);
+    for (TopicWatch** link = &watchers->watches; *link; link = &(*link)->next) {
+        if (*link == watch) {
+            *link = watch->next;
+            __atomic_store_n(&watchers->watch_count, watchers->watch_count - 1, __ATOMIC_RELEASE);
+            break;
+        }
+    }
+    pthread_mutex_unlock(&watchers->mutex);
+
+    free(watch);
+}
+
+void topic_watch_notify(const char* topic_file_path) {
+    if (!topic_file_path) {
+        return;
+    }
+
+    TopicWatchers* watchers = (TopicWatchers*)path_registry_find(&g_watchers, topic_file_path);
+    if (!watchers || __atomic_load_n(&watchers->watch_count, __ATOMIC_ACQUIRE) == 0) {
+        return;
+    }
+
+    pthread_mutex_lock(&watchers->mutex);
+    for (TopicWatch* watch = watchers->watches; watch; watch = watch->next) {
+        watch->callback(watch->context);
+    }
+    pthread_mutex_unlock(&watchers->mutex);
+}
@@ -0,0 +1,798 @@
+#include "headers/binary_protocol.h"
+#include "headers/byte_ring.h"
+#include "send_message.h"
+#include "../../messaging/headers/ack_packet.h"
+#include "../../messaging/headers/publish_event.h"
+#include "../../messaging/headers/table_view.h"
+#include "../../messaging/headers/record_format.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define DEFAULT_CONSUME_RECORDS 1
+#define MAX_CONSUME_RECORDS 10000
+#define MAX_CONSUME_BYTES (4 * 1024 * 1024)
+#define PUSH_BATCH_RECORDS 256
+#define PUSH_BATCH_BYTES (256 * 1024)
+#define PUSH_ROUNDS 8
+
+static void put_u16(uint8_t* bytes, uint16_t value) {
+    bytes[0] = (uint8_t)value;
+    bytes[1] = (uint8_t)(value >> 8);
+}
+
+static void put_u32(uint8_t* bytes, uint32_t value) {
+    for (int i = 0; i < 4; i++) {
+        bytes[i] = (uint8_t)(value >> (8 * i));
+    }
+}
+
+static void put_u64(uint8_t* bytes, uint64_t value) {
+    for (int i = 0; i < 8; i++) {
+        bytes[i] = (uint8_t)(value >> (8 * i));
+    }
+}
+
+static uint16_t get_u16(const uint8_t* bytes) {
+    return (uint16_t)(bytes[0] | (bytes[1] << 8));
+}
+
+static uint32_t get_u32(const uint8_t* bytes) {
+    uint32_t value = 0;
+    for (int i = 3; i >= 0; i--) {
+        value = (value << 8) | bytes[i];
+    }
+    return value;
+}
+
+static uint64_t get_u64(const uint8_t* bytes) {
+    uint64_t value = 0;
+    for (int i = 7; i >= 0; i--) {
+        value = (value << 8) | bytes[i];
+    }
+    return value;
+}
+
+void frame_header_encode(const FrameHeader* header, uint8_t* bytes) {
+    put_u32(bytes, header->length);
+    put_u32(bytes + 4, header->request_id);
+    bytes[8] = header->opcode;
+    bytes[9] = header->status;
+    put_u16(bytes + 10, header->flags);
+}
+
+void frame_header_decode(const uint8_t* bytes, FrameHeader* header) {
+    header->length = get_u32(bytes);
+    header->request_id = get_u32(bytes + 4);
+    header->opcode = bytes[8];
+    header->status = bytes[9];
+    header->flags = get_u16(bytes + 10);
+}
+
+static int send_frame_header(ClientSession* session, const FrameHeader* request, uint8_t status, size_t body_size) {
+    FrameHeader response = {0};
+    response.length = (uint32_t)(FRAME_HEADER_SIZE - FRAME_LENGTH_SIZE + body_size);
+    response.request_id = request->request_id;
+    response.opcode = request->opcode;
+    response.status = status;
+
+    uint8_t bytes[FRAME_HEADER_SIZE];
+    frame_header_encode(&response, bytes);
+    return send_gather_append(&session->output, bytes, FRAME_HEADER_SIZE);
+}
+
+int binary_reply(ClientSession* session, const FrameHeader* request, uint8_t status, const void* body,
+                 size_t body_size) {
+    if ((request->flags & FRAME_FLAG_NO_REPLY) && status == STATUS_OK && body_size == 0) {
+        return 0;
+    }
+    if (send_frame_header(session, request, status, body_size) != 0 ||
+        send_gather_append(&session->output, body, body_size) != 0) {
+        return -1;
+    }
+    return send_gather_end_message(&session->output);
+}
+
+static int reply_message(ClientSession* session, const FrameHeader* request, uint8_t status, const char* message) {
+    return binary_reply(session, request, status, message, strlen(message));
+}
+
+// Names are copied out of the frame and must be usable as file names.
+static int read_name(const uint8_t** cursor, const uint8_t* end, char* name, int optional) {
+    if (end - *cursor < 2) {
+        return -1;
+    }
+
+    size_t size = get_u16(*cursor);
+    *cursor += 2;
+    if ((size == 0 && !optional) || size > MAX_NAME_SIZE || (size_t)(end - *cursor) < size ||
+        memchr(*cursor, '\0', size) || memchr(*cursor, '/', size)) {
+        return -1;
+    }
+
+    memcpy(name, *cursor, size);
+    name[size] = '\0';
+    *cursor += size;
+    return 0;
+}
+
+static int handle_subscribe(ClientSession* session, const FrameHeader* request, const uint8_t* payload,
+                            size_t payload_size) {
+    char topic_name[MAX_NAME_SIZE + 1];
+    char group_name[MAX_NAME_SIZE + 1];
+    const uint8_t* cursor = payload;
+    const uint8_t* end = payload + payload_size;
+
+    if (read_name(&cursor, end, topic_name, 0) != 0 || read_name(&cursor, end, group_name, 1) != 0) {
+        return reply_message(session, request, STATUS_BAD_REQUEST, "Expected topic and group names");
+    }
+
+    // Producers subscribe with an empty group and only get the topic.
+    int producer = group_name[0] == '\0';
+    if (client_session_set_group(session, producer ? NULL : group_name) != 0 ||
+        client_session_set_topic(session, topic_name) != 0 || (!producer && !session->group)) {
+        return reply_message(session, request, STATUS_FAILED, "Could not open topic");
+    }
+    return binary_reply(session, request, STATUS_OK, NULL, 0);
+}
+
+// Frames a batch as a CONSUME or DELIVER response.
+static int send_records(ClientSession* session, const FrameHeader* request, const BatchRecord* records,
+                        size_t count) {
+    size_t body_size = sizeof(uint32_t);
+    for (size_t i = 0; i < count; i++) {
+        body_size += RECORD_ENTRY_HEADER_SIZE + records[i].data_size;
+    }
+
+    uint8_t count_bytes[sizeof(uint32_t)];
+    put_u32(count_bytes, (uint32_t)count);
+    SendGather* output = &session->output;
+    int result = send_frame_header(session, request, STATUS_OK, body_size);
+    if (result == 0) {
+        result = send_gather_append(output, count_bytes, sizeof(count_bytes));
+    }
+
+    for (size_t i = 0; i < count && result == 0; i++) {
+        uint8_t entry[RECORD_ENTRY_HEADER_SIZE] = {0};
+        put_u64(entry, records[i].offset_in_topic);
+        put_u32(entry + 8, records[i].packet_size);
+        put_u32(entry + 12, (uint32_t)records[i].data_size);
+        entry[16] = records[i].codec;
+
+        result = send_gather_append(output, entry, RECORD_ENTRY_HEADER_SIZE);
+        if (result == 0) {
+            result = send_gather_append(output, records[i].data, records[i].data_size);
+        }
+        if (result == 0 && output->pending >= output->flush_bytes) {
+            result = send_gather_flush(output, 1);
+        }
+    }
+
+    // Records are referenced from the batch, which the caller releases next.
+    return result == 0 ? send_gather_end_message(output) : result;
+}
+
+static int ensure_batch(ClientSession* session) {
+    if (!session->batch) {
+        session->batch = record_batch_create();
+    }
+    return session->batch ? 0 : -1;
+}
+
+static int handle_consume(ClientSession* session, const FrameHeader* request, const uint8_t* payload,
+                          size_t payload_size) {
+    if (!session->group || !session->topic) {
+        return reply_message(session, request, STATUS_NOT_SUBSCRIBED, "Subscribe first");
+    }
+
+    size_t max_records = payload_size >= 4 ? get_u32(payload) : DEFAULT_CONSUME_RECORDS;
+    size_t max_bytes = payload_size >= 8 ? get_u32(payload + 4) : 0;
+    if (max_records == 0) {
+        max_records = DEFAULT_CONSUME_RECORDS;
+    } else if (max_records > MAX_CONSUME_RECORDS) {
+        max_records = MAX_CONSUME_RECORDS;
+    }
+    if (max_bytes == 0 || max_bytes > MAX_CONSUME_BYTES) {
+        max_bytes = MAX_CONSUME_BYTES;
+    }
+
+    if (ensure_batch(session) != 0) {
+        return reply_message(session, request, STATUS_FAILED, "Out of memory");
+    }
+
+    int records = consume_batch(session->group, session->topic, session->filter, max_records, max_bytes,
+                                session->accepted_codecs, session->batch);
+    if (records < 0) {
+        return reply_message(session, request, STATUS_FAILED, "Failed to read records");
+    }
+    if (records == 0) {
+        return binary_reply(session, request, STATUS_NO_DATA, NULL, 0);
+    }
+
+    int result = send_records(session, request, session->batch->records, (size_t)records);
+    record_batch_release(session->batch);
+    return result;
+}
+
+static size_t fetch_limit(const uint8_t* payload, size_t payload_size) {
+    size_t max_bytes = payload_size >= 4 ? get_u32(payload) : 0;
+    if (max_bytes == 0) {
+        return DEFAULT_FETCH_BYTES;
+    }
+    return max_bytes < MAX_FETCH_BYTES ? max_bytes : MAX_FETCH_BYTES;
+}
+
+static int handle_fetch(ClientSession* session, const FrameHeader* request, const uint8_t* payload,
+                        size_t payload_size) {
+    if (!session->group || !session->topic) {
+        return reply_message(session, request, STATUS_NOT_SUBSCRIBED, "Subscribe first");
+    }
+
+    LogRange range;
+    int records = consume_range(session->group, session->topic, fetch_limit(payload, payload_size), &range);
+    if (records < 0) {
+        return reply_message(session, request, STATUS_FAILED, "Failed to read records");
+    }
+    if (records == 0) {
+        return binary_reply(session, request, STATUS_NO_DATA, NULL, 0);
+    }
+
+    uint8_t header[FETCH_RESPONSE_HEADER_SIZE];
+    put_u64(header, range.offset);
+    put_u32(header + 8, (uint32_t)records);
+    int result = send_frame_header(session, request, STATUS_OK, sizeof(header) + range.size);
+    if (result == 0) {
+        result = send_gather_append(&session->output, header, sizeof(header));
+    }
+    if (result == 0) {
+        result = send_gather_flush(&session->output, 1);
+    }
+    if (result == 0) {
+        result = send_file_range(session->client_fd, range.fd, range.offset, range.size);
+    }
+    return result;
+}
+
+// FETCH without the bytes: the client gets the log's descriptor and reads
+// the range itself, so nothing but the reply header crosses the socket.
+static int handle_fetch_fd(ClientSession* session, const FrameHeader* request, const uint8_t* payload,
+                           size_t payload_size) {
+    if (!session->local) {
+        return reply_message(session, request, STATUS_BAD_REQUEST, "FETCH_FD needs a unix socket");
+    }
+    if (!session->group || !session->topic) {
+        return reply_message(session, request, STATUS_NOT_SUBSCRIBED, "Subscribe first");
+    }
+
+    LogRange range;
+    int records = consume_range(session->group, session->topic, fetch_limit(payload, payload_size), &range);
+    if (records < 0) {
+        return reply_message(session, request, STATUS_FAILED, "Failed to read records");
+    }
+    if (records == 0) {
+        return binary_reply(session, request, STATUS_NO_DATA, NULL, 0);
+    }
+
+    FrameHeader response = {0};
+    response.length = FRAME_HEADER_SIZE - FRAME_LENGTH_SIZE + FETCH_FD_RESPONSE_SIZE;
+    response.request_id = request->request_id;
+    response.opcode = request->opcode;
+
+    uint8_t reply[FRAME_HEADER_SIZE + FETCH_FD_RESPONSE_SIZE];
+    frame_header_encode(&response, reply);
+    put_u64(reply + FRAME_HEADER_SIZE, range.offset);
+    put_u32(reply + FRAME_HEADER_SIZE + 8, (uint32_t)records);
+    put_u32(reply + FRAME_HEADER_SIZE + 12, (uint32_t)range.size);
+
+    if (send_gather_flush(&session->output, 1) != 0) {
+        return -1;
+    }
+    return send_with_fd(session->client_fd, reply, sizeof(reply), range.fd);
+}
+
+static int handle_shm_subscribe(ClientSession* session, const FrameHeader* request, const uint8_t* payload,
+                                size_t payload_size) {
+    if (!session->local) {
+        return reply_message(session, request, STATUS_BAD_REQUEST, "SHM_SUBSCRIBE needs a unix socket");
+    }
+    if (!session->group || !session->topic) {
+        return reply_message(session, request, STATUS_NOT_SUBSCRIBED, "Subscribe first");
+    }
+    if (session->ring) {
+        return reply_message(session, request, STATUS_BAD_REQUEST, "Already streaming to a ring");
+    }
+
+    size_t capacity = payload_size >= 4 ? get_u32(payload) : 0;
+    ShmRing* ring = (ShmRing*)malloc(sizeof(ShmRing));
+    if (!ring || shm_ring_create(ring, capacity ? capacity : SHM_RING_DEFAULT_CAPACITY) != 0) {
+        free(ring);
+        return reply_message(session, request, STATUS_FAILED, "Could not create ring");
+    }
+    ring->header->acked_offset = session->group->read_pointer;
+
+    FrameHeader response = {0};
+    response.length = FRAME_HEADER_SIZE - FRAME_LENGTH_SIZE + SHM_SUBSCRIBE_RESPONSE_SIZE;
+    response.request_id = request->request_id;
+    response.opcode = request->opcode;
+
+    uint8_t reply[FRAME_HEADER_SIZE + SHM_SUBSCRIBE_RESPONSE_SIZE];
+    frame_header_encode(&response, reply);
+    put_u64(reply + FRAME_HEADER_SIZE, ring->capacity);
+
+    if (send_gather_flush(&session->output, 1) != 0 ||
+        send_with_fd(session->client_fd, reply, sizeof(reply), ring->fd) != 0) {
+        shm_ring_unmap(ring);
+        free(ring);
+        return -1;
+    }
+
+    session->ring = ring;
+    session->ring_position = session->group->read_pointer;
+    return 0;
+}
+
+static int handle_set_option(ClientSession* session, const FrameHeader* request, const uint8_t* payload,
+                             size_t payload_size) {
+    if (payload_size < 5 || client_session_set_option(session, payload[0], get_u32(payload + 1)) != 0) {
+        return reply_message(session, request, STATUS_BAD_REQUEST, "Expected a known option and a value");
+    }
+    return binary_reply(session, request, STATUS_OK, NULL, 0);
+}
+
+static int handle_ack(ClientSession* session, const FrameHeader* request, const uint8_t* payload,
+                      size_t payload_size) {
+    if (!session->group || !session->topic) {
+        return reply_message(session, request, STATUS_NOT_SUBSCRIBED, "Subscribe first");
+    }
+    if (payload_size < 12) {
+        return reply_message(session, request, STATUS_BAD_REQUEST, "Expected offset and packet size");
+    }
+
+    if (ack_packet_by_offset(session->group, session->topic, (size_t)get_u64(payload), get_u32(payload + 8)) != 0) {
+        return reply_message(session, request, STATUS_BAD_REQUEST, "No such record");
+    }
+    return binary_reply(session, request, STATUS_OK, NULL, 0);
+}
+
+static int handle_seek(ClientSession* session, const FrameHeader* request, const uint8_t* payload,
+                       size_t payload_size) {
+    if (!session->group || !session->topic) {
+        return reply_message(session, request, STATUS_NOT_SUBSCRIBED, "Subscribe first");
+    }
+    if (payload_size < 8) {
+        return reply_message(session, request, STATUS_BAD_REQUEST, "Expected offset");
+    }
+
+    uint64_t offset = get_u64(payload);
+    int result;
+    if (offset == 0) {
+        result = reset_group_pointer(session->group);
+    } else if (offset < TOPIC_FILE_HEADER_SIZE) {
+        result = -1;
+    } else {
+        result = set_group_pointer(session->group, (size_t)offset);
+    }
+
+    if (result != 0) {
+        return reply_message(session, request, STATUS_BAD_REQUEST, "Bad offset");
+    }
+    return binary_reply(session, request, STATUS_OK, NULL, 0);
+}
+
+static int handle_publish(ClientSession* session, const FrameHeader* request, const uint8_t* payload,
+                          size_t payload_size) {
+    if (!session->topic) {
+        return reply_message(session, request, STATUS_NOT_SUBSCRIBED, "Subscribe first");
+    }
+    if (payload_size == 0) {
+        return reply_message(session, request, STATUS_BAD_REQUEST, "Empty event");
+    }
+
+    if (publish_event_encoded(session->topic, payload, payload_size) != 0) {
+        return reply_message(session, request, STATUS_FAILED, "Failed to publish event");
+    }
+    return binary_reply(session, request, STATUS_OK, NULL, 0);
+}
+
+static int handle_set_filter(ClientSession* session, const FrameHeader* request, const uint8_t* payload,
+                             size_t payload_size) {
+    RecordFilter* filter = NULL;
+    if (payload_size > 0) {
+        char* expression = strndup((const char*)payload, payload_size);
+        if (!expression) {
+            return reply_message(session, request, STATUS_FAILED, "Out of memory");
+        }
+        filter = record_filter_compile(expression);
+        free(expression);
+
+        if (!filter) {
+            return reply_message(session, request, STATUS_BAD_REQUEST, "Invalid filter");
+        }
+    }
+
+    record_filter_free(session->filter);
+    session->filter = filter;
+    return binary_reply(session, request, STATUS_OK, NULL, 0);
+}
+
+static int handle_set_codecs(ClientSession* session, const FrameHeader* request, const uint8_t* payload,
+                             size_t payload_size) {
+    if (payload_size < 4) {
+        return reply_message(session, request, STATUS_BAD_REQUEST, "Expected codec mask");
+    }
+
+    // Columnar records need the topic's shapes, so they are always
+    // delivered as JSON.
+    session->accepted_codecs = get_u32(payload) & (RECORD_CODEC_BIT(RECORD_CODEC_ZSTD) |
+                                                   RECORD_CODEC_BIT(RECORD_CODEC_LZ4));
+    return binary_reply(session, request, STATUS_OK, NULL, 0);
+}
+
+static int handle_get(ClientSession* session, const FrameHeader* request, const uint8_t* payload,
+                      size_t payload_size) {
+    if (!session->topic) {
+        return reply_message(session, request, STATUS_NOT_SUBSCRIBED, "Subscribe first");
+    }
+
+    TableView* view = table_view_find(session->topic->file_path);
+    if (!view) {
+        return reply_message(session, request, STATUS_NOT_FOUND, "Topic has no table view");
+    }
+
+    uint8_t* value = NULL;
+    size_t value_size = 0;
+    int result = table_view_get(view, (const char*)payload, payload_size, &value, &value_size);
+    if (result == TABLE_VIEW_NOT_FOUND) {
+        return binary_reply(session, request, STATUS_NOT_FOUND, NULL, 0);
+    }
+    if (result != 0) {
+        return reply_message(session, request, STATUS_FAILED, "Failed to read table view");
+    }
+
+    result = binary_reply(session, request, STATUS_OK, value, value_size);
+    free(value);
+    return result;
+}
+
+static void add_credit(uint64_t* credit, uint32_t grant) {
+    if (grant == CREDIT_UNLIMITED) {
+        *credit = UINT64_MAX;
+    } else if (*credit != UINT64_MAX) {
+        *credit += grant;
+    }
+}
+
+static void take_credit(uint64_t* credit, uint64_t used) {
+    if (*credit != UINT64_MAX) {
+        *credit = used < *credit ? *credit - used : 0;
+    }
+}
+
+static int handle_credit(ClientSession* session, const FrameHeader* request, const uint8_t* payload,
+                         size_t payload_size) {
+    if (payload_size < 8) {
+        return reply_message(session, request, STATUS_BAD_REQUEST, "Expected record and byte credit");
+    }
+
+    add_credit(&session->credit_records, get_u32(payload));
+    add_credit(&session->credit_bytes, get_u32(payload + 4));
+    return binary_reply(session, request, STATUS_OK, NULL, 0);
+}
+
+static void wake_session(void* context) {
+    ClientSession* session = (ClientSession*)context;
+    if (session->wake) {
+        session->wake(session->wake_context);
+    }
+}
+
+// The watch is only kept while there is credit, so appends to a topic
+// whose subscribers are all paused wake nobody.
+static int watch_topic(ClientSession* session, int wanted) {
+    if (session->watch && (!wanted || strcmp(session->watch->watchers->topic_file_path,
+                                             session->topic->file_path) != 0)) {
+        topic_watch_remove(session->watch);
+        session->watch = NULL;
+    }
+    if (wanted && !session->watch) {
+        session->watch = topic_watch_add(session->topic->file_path, wake_session, session);
+        if (!session->watch) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+// Stages one batch's records in the ring. Returns how many went in; when
+// one does not fit, the reader has been asked to say when it has room, or
+// the ring is too small for it.
+static size_t write_ring(ShmRing* ring, const BatchRecord* records, size_t count, int* too_large) {
+    for (size_t i = 0; i < count; i++) {
+        ShmRecord record;
+        record.data = records[i].data;
+        record.data_size = records[i].data_size;
+        record.offset = records[i].offset_in_topic;
+        record.packet_size = records[i].packet_size;
+        record.codec = records[i].codec;
+
+        int written = shm_ring_write(ring, &record);
+        while (written == 1) {
+            // The reader can only free space for what it can see.
+            shm_ring_commit(ring);
+            if (!shm_ring_wait_space(ring, record.data_size)) {
+                return i;
+            }
+            written = shm_ring_write(ring, &record);
+        }
+        if (written < 0) {
+            *too_large = 1;
+            return i;
+        }
+    }
+    return count;
+}
+
+// Fills the session's shared ring from where it left off. The group's read
+// pointer is moved to what the client acked, so records it never acked are
+// read again by the next consumer of the group.
+static int push_ring(ClientSession* session) {
+    Group* group = session->group;
+    size_t acked = group->read_pointer;
+    uint64_t shared_ack = shm_ring_acked(session->ring);
+    if (shared_ack > acked && shared_ack <= session->ring_position) {
+        acked = (size_t)shared_ack;
+    }
+
+    int result = 1;
+    int too_large = 0;
+    for (int round = 0; round < PUSH_ROUNDS && result == 1; round++) {
+        group->read_pointer = session->ring_position;
+        int records = consume_batch(group, session->topic, session->filter, PUSH_BATCH_RECORDS, PUSH_BATCH_BYTES,
+                                    session->accepted_codecs, session->batch);
+        if (records <= 0) {
+            result = records;
+            break;
+        }
+
+        size_t written = write_ring(session->ring, session->batch->records, (size_t)records, &too_large);
+        session->ring_position = written < (size_t)records ? session->batch->records[written].offset_in_topic
+                                                           : group->read_pointer;
+        record_batch_release(session->batch);
+        if (written < (size_t)records) {
+            result = 0;
+        }
+    }
+
+    group->read_pointer = acked;
+    if (too_large) {
+        fprintf(stderr, "Record at %zu does not fit in the subscriber's ring\n", session->ring_position);
+        client_session_close_ring(session, SHM_RING_TOO_SMALL);
+        return 0;
+    }
+    shm_ring_commit(session->ring);
+    return result;
+}
+
+// Each call sends a bounded amount so other connections on the same worker
+// get their turn; the caller comes back when the socket can take more.
+static int push_records(ClientSession* session) {
+    if (session->protocol_version == 0 || !session->group || !session->topic) {
+        return 0;
+    }
+
+    if (session->ring) {
+        if (watch_topic(session, 1) != 0 || ensure_batch(session) != 0) {
+            return -1;
+        }
+        return push_ring(session);
+    }
+
+    int has_credit = session->credit_records > 0 && session->credit_bytes > 0;
+    if (watch_topic(session, has_credit) != 0) {
+        return -1;
+    }
+    if (!has_credit) {
+        return 0;
+    }
+    if (ensure_batch(session) != 0) {
+        return -1;
+    }
+
+    FrameHeader deliver = {0};
+    deliver.opcode = OP_DELIVER;
+
+    for (int round = 0; round < PUSH_ROUNDS; round++) {
+        if (!send_writable(session->client_fd)) {
+            return 1;
+        }
+
+        size_t max_records = session->credit_records < PUSH_BATCH_RECORDS ? (size_t)session->credit_records
+                                                                          : PUSH_BATCH_RECORDS;
+        size_t max_bytes = session->credit_bytes < PUSH_BATCH_BYTES ? (size_t)session->credit_bytes
+                                                                    : PUSH_BATCH_BYTES;
+        int records = consume_batch(session->group, session->topic, session->filter, max_records, max_bytes,
+                                    session->accepted_codecs, session->batch);
+        if (records <= 0) {
+            return records;
+        }
+
+        size_t delivered_bytes = 0;
+        for (int i = 0; i < records; i++) {
+            delivered_bytes += session->batch->records[i].data_size;
+        }
+
+        int result = send_records(session, &deliver, session->batch->records, (size_t)records);
+        record_batch_release(session->batch);
+        if (result != 0) {
+            return -1;
+        }
+
+        take_credit(&session->credit_records, (uint64_t)records);
+        take_credit(&session->credit_bytes, delivered_bytes);
+        if (session->credit_records == 0 || session->credit_bytes == 0) {
+            watch_topic(session, 0);
+            return 0;
+        }
+    }
+    return 1;
+}
+
+int binary_session_push(ClientSession* session) {
+    if (!session) {
+        return 0;
+    }
+
+    int result = push_records(session);
+    if (send_gather_flush(&session->output, 0) != 0) {
+        result = -1;
+    }
+    return result;
+}
+
+// Returns 1 to go on, 0 after BYE and -1 when the reply could not be sent.
+static int dispatch_frame(ClientSession* session, const FrameHeader* request, const uint8_t* payload,
+                          size_t payload_size) {
+    int result;
+    switch (request->opcode) {
+    case OP_SUBSCRIBE:
+        result = handle_subscribe(session, request, payload, payload_size);
+        break;
+    case OP_CONSUME:
+        result = handle_consume(session, request, payload, payload_size);
+        break;
+    case OP_SET_OPTION:
+        result = handle_set_option(session, request, payload, payload_size);
+        break;
+    case OP_FETCH:
+        result = handle_fetch(session, request, payload, payload_size);
+        break;
+    case OP_FETCH_FD:
+        result = handle_fetch_fd(session, request, payload, payload_size);
+        break;
+    case OP_SHM_SUBSCRIBE:
+        result = handle_shm_subscribe(session, request, payload, payload_size);
+        break;
+    case OP_ACK:
+        result = handle_ack(session, request, payload, payload_size);
+        break;
+    case OP_SEEK:
+        result = handle_seek(session, request, payload, payload_size);
+        break;
+    case OP_PUBLISH:
+        result = handle_publish(session, request, payload, payload_size);
+        break;
+    case OP_SET_FILTER:
+        result = handle_set_filter(session, request, payload, payload_size);
+        break;
+    case OP_SET_CODECS:
+        result = handle_set_codecs(session, request, payload, payload_size);
+        break;
+    case OP_GET:
+        result = handle_get(session, request, payload, payload_size);
+        break;
+    case OP_PING:
+        result = binary_reply(session, request, STATUS_OK, payload, payload_size);
+        break;
+    case OP_CREDIT:
+        result = handle_credit(session, request, payload, payload_size);
+        break;
+    case OP_BYE:
+        return binary_reply(session, request, STATUS_OK, NULL, 0) == 0 ? 0 : -1;
+    default:
+        result = binary_reply(session, request, STATUS_UNKNOWN_OPCODE, NULL, 0);
+        break;
+    }
+    return result == 0 ? 1 : -1;
+}
+
+static int process_hello(ClientSession* session) {
+    uint8_t hello[BINARY_HELLO_SIZE];
+    byte_ring_peek(&session->input, hello, BINARY_HELLO_SIZE);
+    byte_ring_consume(&session->input, BINARY_HELLO_SIZE);
+
+    if (memcmp(hello, BINARY_PROTOCOL_MAGIC, BINARY_PROTOCOL_MAGIC_SIZE) != 0) {
+        return -1;
+    }
+
+    uint8_t version = hello[BINARY_PROTOCOL_MAGIC_SIZE] >= BINARY_PROTOCOL_VERSION ? BINARY_PROTOCOL_VERSION : 0;
+    uint8_t reply[BINARY_HELLO_SIZE] = {0};
+    memcpy(reply, BINARY_PROTOCOL_MAGIC, BINARY_PROTOCOL_MAGIC_SIZE);
+    reply[BINARY_PROTOCOL_MAGIC_SIZE] = version;
+    if (send_all(session->client_fd, reply, BINARY_HELLO_SIZE) != 0 || version == 0) {
+        return 0;
+    }
+
+    session->protocol_version = version;
+    return 1;
+}
+
+static int process_frames(ClientSession* session) {
+    ByteRing* input = &session->input;
+    if (session->protocol_version == 0) {
+        if (input->size < BINARY_HELLO_SIZE) {
+            return 1;
+        }
+        int result = process_hello(session);
+        if (result <= 0) {
+            return result;
+        }
+    }
+
+    session->input_held = 0;
+    while (input->size >= FRAME_HEADER_SIZE) {
+        // A reply queue at its limit stops commands the way it stops pushes.
+        if (send_backlogged(session->client_fd)) {
+            session->input_held = 1;
+            return 1;
+        }
+
+        uint8_t bytes[FRAME_HEADER_SIZE];
+        FrameHeader header;
+        byte_ring_peek(input, bytes, FRAME_HEADER_SIZE);
+        frame_header_decode(bytes, &header);
+
+        if (header.length < FRAME_HEADER_SIZE - FRAME_LENGTH_SIZE ||
+            header.length - (FRAME_HEADER_SIZE - FRAME_LENGTH_SIZE) > MAX_FRAME_PAYLOAD) {
+            fprintf(stderr, "Malformed frame from client (fd: %d)\n", session->client_fd);
+            return -1;
+        }
+
+        // Wait for the rest, making room for it in one step.
+        size_t frame_size = FRAME_LENGTH_SIZE + (size_t)header.length;
+        if (input->size < frame_size) {
+            return byte_ring_reserve(input, frame_size - input->size) == 0 ? 1 : -1;
+        }
+
+        const uint8_t* frame = byte_ring_linearize(input, frame_size);
+        if (!frame) {
+            return -1;
+        }
+
+        int result = dispatch_frame(session, &header, frame + FRAME_HEADER_SIZE, frame_size - FRAME_HEADER_SIZE);
+        byte_ring_consume(input, frame_size);
+        if (result <= 0) {
+            return result;
+        }
+    }
+    return 1;
+}
+
+// Replies to frames that arrived together are gathered and written once,
+// unless the batching threshold is reached first.
+int binary_session_process(ClientSession* session) {
+    if (!session) {
+        return -1;
+    }
+
+    if (session->cork) {
+        send_set_cork(session->client_fd, 1);
+    }
+    int result = process_frames(session);
+    if (send_gather_flush(&session->output, 0) != 0 && result > 0) {
+        result = -1;
+    }
+    if (session->cork) {
+        send_set_cork(session->client_fd, 0);
+    }
+    return result;
+}
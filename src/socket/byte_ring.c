@@ -0,0 +1,120 @@
+#include "headers/byte_ring.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define BYTE_RING_INITIAL_CAPACITY 4096
+// An emptied ring larger than this gives its memory back, so a connection
+// that once sent a large frame does not keep the buffer while idle.
+#define BYTE_RING_KEEP_CAPACITY (64 * 1024)
+
+static int byte_ring_resize(ByteRing* ring, size_t capacity) {
+    uint8_t* data = (uint8_t*)malloc(capacity);
+    if (!data) {
+        return -1;
+    }
+
+    if (ring->size > 0) {
+        byte_ring_peek(ring, data, ring->size);
+    }
+    free(ring->data);
+    ring->data = data;
+    ring->capacity = capacity;
+    ring->head = 0;
+    return 0;
+}
+
+int byte_ring_reserve(ByteRing* ring, size_t extra) {
+    if (!ring) {
+        return -1;
+    }
+    if (ring->size + extra <= ring->capacity) {
+        return 0;
+    }
+
+    size_t capacity = ring->capacity ? ring->capacity : BYTE_RING_INITIAL_CAPACITY;
+    while (capacity < ring->size + extra) {
+        capacity *= 2;
+    }
+    return byte_ring_resize(ring, capacity);
+}
+
+size_t byte_ring_writable(ByteRing* ring, uint8_t** region) {
+    if (!ring || !ring->data || ring->size == ring->capacity) {
+        return 0;
+    }
+
+    size_t tail = (ring->head + ring->size) & (ring->capacity - 1);
+    *region = ring->data + tail;
+    if (tail >= ring->head) {
+        return ring->capacity - tail;
+    }
+    return ring->head - tail;
+}
+
+void byte_ring_commit(ByteRing* ring, size_t size) {
+    ring->size += size;
+}
+
+int byte_ring_append(ByteRing* ring, const void* data, size_t size) {
+    if (byte_ring_reserve(ring, size) != 0) {
+        return -1;
+    }
+
+    const uint8_t* bytes = (const uint8_t*)data;
+    while (size > 0) {
+        uint8_t* region = NULL;
+        size_t writable = byte_ring_writable(ring, &region);
+        size_t chunk = size < writable ? size : writable;
+        memcpy(region, bytes, chunk);
+        byte_ring_commit(ring, chunk);
+        bytes += chunk;
+        size -= chunk;
+    }
+    return 0;
+}
+
+void byte_ring_peek(const ByteRing* ring, void* out, size_t size) {
+    size_t first = ring->capacity - ring->head;
+    if (first > size) {
+        first = size;
+    }
+    memcpy(out, ring->data + ring->head, first);
+    memcpy((uint8_t*)out + first, ring->data, size - first);
+}
+
+const uint8_t* byte_ring_linearize(ByteRing* ring, size_t size) {
+    if (!ring || size > ring->size) {
+        return NULL;
+    }
+    if (ring->head + size > ring->capacity && byte_ring_resize(ring, ring->capacity) != 0) {
+        return NULL;
+    }
+    return ring->data + ring->head;
+}
+
+void byte_ring_consume(ByteRing* ring, size_t size) {
+    if (size >= ring->size) {
+        ring->head = 0;
+        ring->size = 0;
+        if (ring->capacity > BYTE_RING_KEEP_CAPACITY) {
+            free(ring->data);
+            ring->data = NULL;
+            ring->capacity = 0;
+        }
+        return;
+    }
+
+    ring->head = (ring->head + size) & (ring->capacity - 1);
+    ring->size -= size;
+}
+
+void byte_ring_free(ByteRing* ring) {
+    if (!ring) {
+        return;
+    }
+    free(ring->data);
+    ring->data = NULL;
+    ring->capacity = 0;
+    ring->head = 0;
+    ring->size = 0;
+}
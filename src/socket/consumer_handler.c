@@ -4,6 +4,11 @@
 #include "../../messaging/headers/consume_packet.h"
 #include "../../messaging/headers/ack_packet.h"
 #include "../../messaging/headers/manage_groups.h"
+#include "../../messaging/headers/record_format.h"
+#include "../../messaging/headers/dictionary_registry.h"
+#include "../../messaging/headers/stream_codec.h"
+#include "../../messaging/headers/codec.h"
+#include "../../messaging/headers/encoder.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -13,29 +18,76 @@
 
 #define PACKET_HEADER_SIZE 8
 #define MAX_PACKET_SIZE (10 * 1024 * 1024) // 10MB
+#define PACKET_MAGIC 0x5041434B      // "PACK": payload as published
+#define PACKET_MAGIC_ZSTD 0x5041435A // "PACZ": payload is a zstd frame
+#define PACKET_MAGIC_LZ4 0x5041434C  // "PACL": payload is a size-prefixed LZ4 block
+#define STREAMED_DECODE_THRESHOLD (1024 * 1024)
 
-static int send_packet_header(int client_fd, size_t packet_size) {
-    if (client_fd < 0) {
-        return -1;
-    }
-
+static void encode_packet_header(uint8_t* header, size_t packet_size, uint8_t codec) {
     uint32_t size = (uint32_t)packet_size;
-    uint32_t magic = 0x5041434B; // "PACK" magic number
+    uint32_t magic = PACKET_MAGIC;
+    if (codec == RECORD_CODEC_ZSTD) {
+        magic = PACKET_MAGIC_ZSTD;
+    } else if (codec == RECORD_CODEC_LZ4) {
+        magic = PACKET_MAGIC_LZ4;
+    }
 
-    uint8_t header[PACKET_HEADER_SIZE];
     memcpy(header, &magic, sizeof(uint32_t));
     memcpy(header + sizeof(uint32_t), &size, sizeof(uint32_t));
+}
 
-    ssize_t sent = send(client_fd, header, PACKET_HEADER_SIZE, 0);
-    if (sent != PACKET_HEADER_SIZE) {
-        perror("Failed to send packet header");
+static int send_packet_header(int client_fd, size_t packet_size, uint8_t codec) {
+    if (client_fd < 0) {
+        return -1;
+    }
+
+    uint8_t header[PACKET_HEADER_SIZE];
+    encode_packet_header(header, packet_size, codec);
+    if (send_all(client_fd, header, PACKET_HEADER_SIZE) != 0) {
+        fprintf(stderr, "Failed to send packet header\n");
         return -1;
     }
 
     return 0;
 }
 
+static int send_decoded_chunk(void* context, const uint8_t* data, size_t size) {
+    return send_all(*(int*)context, data, size);
+}
+
+// Large zstd records are decoded straight into the socket a window at a
+// time instead of being materialised (and cached) whole.
+static int send_streamed_zstd_packet(int client_fd, Packet* packet, Topic* topic, size_t content_size) {
+    const ZSTD_DDict* ddict = NULL;
+    if (dictionaries_ddict_for_frame(dictionaries_for_topic(topic->file_path), packet->data, packet->data_size,
+                                     &ddict) != 0) {
+        return -1;
+    }
+
+    DecodeStream* stream = decode_stream_create(ddict, content_size, send_decoded_chunk, &client_fd);
+    if (!stream) {
+        return -1;
+    }
+
+    int result = send_packet_header(client_fd, content_size, RECORD_CODEC_NONE);
+    if (result == 0) {
+        result = decode_stream_write(stream, packet->data, packet->data_size);
+    }
+    if (result == 0) {
+        result = decode_stream_finish(stream);
+    }
+    if (result == 0 && stream->output_size != content_size) {
+        result = -1;
+    }
+    decode_stream_free(stream);
+    return result;
+}
+
 int send_packet_to_consumer(int client_fd, const void* data, size_t data_size) {
+    return send_encoded_packet_to_consumer(client_fd, data, data_size, RECORD_CODEC_NONE);
+}
+
+int send_encoded_packet_to_consumer(int client_fd, const void* data, size_t data_size, uint8_t codec) {
     if (client_fd < 0 || !data || data_size == 0) {
         return -1;
     }
@@ -45,29 +97,74 @@ int send_packet_to_consumer(int client_fd, const void* data, size_t data_size) {
         return -1;
     }
 
-    if (send_packet_header(client_fd, data_size) != 0) {
+    // Header and payload leave in one segment instead of waiting on Nagle
+    // or a delayed ACK between them.
+    uint8_t header[PACKET_HEADER_SIZE];
+    encode_packet_header(header, data_size, codec);
+    struct iovec iov[2] = {
+        { .iov_base = header, .iov_len = PACKET_HEADER_SIZE },
+        { .iov_base = (void*)data, .iov_len = data_size },
+    };
+    if (send_allv(client_fd, iov, 2, 0) != 0) {
+        fprintf(stderr, "Failed to send packet\n");
         return -1;
     }
+    return 0;
+}
 
-    size_t total_sent = 0;
-    while (total_sent < data_size) {
-        ssize_t sent = send(client_fd, (const char*)data + total_sent, data_size - total_sent, 0);
-        if (sent < 0) {
-            perror("Failed to send packet data");
-            return -1;
+// Encoded records go out untouched to consumers that accept their codec and
+// can decode them without the topic's dictionaries. The rest are decoded
+// (once, through the shared cache) here.
+int send_packet_for_consumer(int client_fd, Packet* packet, Topic* topic, unsigned accepted_codecs) {
+    if (!packet) {
+        return -1;
+    }
+
+    int pass_through = (accepted_codecs & RECORD_CODEC_BIT(packet->codec)) &&
+                       codec_record_portable(packet->codec, packet->data, packet->data_size);
+    if (packet->codec != RECORD_CODEC_NONE && !pass_through) {
+        size_t content_size = 0;
+        if (packet->codec == RECORD_CODEC_ZSTD && topic &&
+            encoded_content_size(packet->data, packet->data_size, &content_size) == 0 &&
+            content_size >= STREAMED_DECODE_THRESHOLD && content_size <= MAX_PACKET_SIZE) {
+            return send_streamed_zstd_packet(client_fd, packet, topic, content_size);
         }
-        if (sent == 0) {
-            fprintf(stderr, "Connection closed while sending packet\n");
+
+        if (packet_decode(packet, topic) != 0) {
+            fprintf(stderr, "Failed to decode packet at offset %zu\n", packet->offset_in_topic);
             return -1;
         }
-        total_sent += sent;
     }
 
-    printf("Sent packet to consumer: %zu bytes\n", data_size);
-    return 0;
+    return send_encoded_packet_to_consumer(client_fd, packet->data, packet->data_size, packet->codec);
+}
+
+// Records of a batch arrive already decoded unless the consumer accepts
+// their codec, so they go out as they are, gathered into as few sends as
+// the output's batching threshold allows. Nothing is left pending.
+int send_batch_to_consumer(SendGather* output, const BatchRecord* records, size_t count) {
+    if (!output || (!records && count > 0)) {
+        return -1;
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        uint8_t header[PACKET_HEADER_SIZE];
+        encode_packet_header(header, records[i].data_size, records[i].codec);
+        if (send_gather_append(output, header, PACKET_HEADER_SIZE) != 0 ||
+            send_gather_append(output, records[i].data, records[i].data_size) != 0 ||
+            (output->pending >= output->flush_bytes && send_gather_flush(output, 1) != 0)) {
+            return -1;
+        }
+    }
+    return send_gather_flush(output, 0);
 }
 
 int consume_and_send_packet(int client_fd, Group* group, Topic* topic) {
+    return consume_and_send_packet_filtered(client_fd, group, topic, NULL, 0);
+}
+
+int consume_and_send_packet_filtered(int client_fd, Group* group, Topic* topic, const RecordFilter* filter,
+                                     unsigned accepted_codecs) {
     if (client_fd < 0 || !group || !topic) {
         return -1;
     }
@@ -77,12 +174,12 @@ int consume_and_send_packet(int client_fd, Group* group, Topic* topic) {
         return -1;
     }
 
-    Packet* packet = consume_packet(group, topic);
+    Packet* packet = consume_packet_filtered(group, topic, filter);
     if (!packet) {
         return 0;
     }
 
-    int result = send_packet_to_consumer(client_fd, packet->data, packet->data_size);
+    int result = send_packet_for_consumer(client_fd, packet, topic, accepted_codecs);
     
     if (result == 0) {
         int ack_result = wait_for_ack(client_fd);
@@ -0,0 +1,410 @@
+#define _GNU_SOURCE // accept4
+#include "headers/event_loop.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+
+// Loops only wait and accept; a ready connection is handed to a worker,
+// which runs one command, pushes what a streaming subscriber has credit
+// for, and re-arms it. EPOLLONESHOT keeps a connection on one worker at a
+// time, and re-arming reports data that arrived meanwhile, so pipelined
+// commands are not lost to the edge trigger. A connection with more to push
+// is armed for EPOLLOUT as well, which is also how an append wakes a
+// caught-up one: a full socket buffer then simply holds the stream back.
+// Each loop watches a listening socket and drains its accept queue with
+// accept4(), so a reconnect storm is taken in by every loop at once.
+//
+// Workers never wait for a slow client: what its socket will not take goes
+// to the connection's output queue, and once that reaches the high
+// watermark the connection is throttled, waiting only for EPOLLOUT, with
+// neither commands read nor the log streamed, until the queue has drained
+// to the low watermark. Binary frames read in one go stop there too, or at
+// a queued file range, and wait in the session's input for the next step.
+// A sweep shuts down connections that stayed idle or whose queue stalled
+// for too long, and the usual close path frees them.
+#define EVENT_LOOP_MAX_EVENTS 256
+#define EVENT_LOOP_SWEEP_MS 1000
+#define CONNECTION_EVENTS (EPOLLIN | EPOLLRDHUP | EPOLLET | EPOLLONESHOT)
+#define CONNECTION_PUSH_EVENTS (CONNECTION_EVENTS | EPOLLOUT)
+#define CONNECTION_THROTTLED_EVENTS (EPOLLOUT | EPOLLRDHUP | EPOLLET | EPOLLONESHOT)
+
+static size_t online_cores(void) {
+    long cores = sysconf(_SC_NPROCESSORS_ONLN);
+    return cores > 0 ? (size_t)cores : 1;
+}
+
+static int connection_arm(Connection* connection, int operation, uint32_t events) {
+    struct epoll_event event = {0};
+    event.events = events;
+    event.data.ptr = connection;
+    return epoll_ctl(connection->loop->epoll_fd, operation, connection->client_fd, &event);
+}
+
+static void connection_free(Connection* connection) {
+    client_session_free(connection->session);
+    send_capture_free(&connection->output);
+    pthread_mutex_destroy(&connection->lock);
+    free(connection);
+}
+
+static void connection_close(Connection* connection) {
+    pthread_mutex_lock(&connection->lock);
+    connection->closed = 1;
+    pthread_mutex_unlock(&connection->lock);
+
+    // Unlinked before the descriptor goes, so the sweep never shuts down
+    // a number that has since been reused.
+    EventLoop* loop = connection->loop;
+    pthread_mutex_lock(&loop->connections_lock);
+    if (connection->prev) {
+        connection->prev->next = connection->next;
+    } else {
+        loop->connections = connection->next;
+    }
+    if (connection->next) {
+        connection->next->prev = connection->prev;
+    }
+    pthread_mutex_unlock(&loop->connections_lock);
+
+    epoll_ctl(connection->loop->epoll_fd, EPOLL_CTL_DEL, connection->client_fd, NULL);
+    close(connection->client_fd);
+    // Freeing the session drops its topic watch, after which nothing can
+    // wake the connection any more.
+    connection_free(connection);
+}
+
+// The stall clock restarts whenever queued output moves, and stops once
+// nothing is queued.
+static void connection_note_output(Connection* connection, uint64_t now, int moved) {
+    uint64_t since = 0;
+    if (send_capture_pending(&connection->output) > 0) {
+        since = __atomic_load_n(&connection->stalled_since_ms, __ATOMIC_RELAXED);
+        if (moved || since == 0) {
+            since = now;
+        }
+    }
+    __atomic_store_n(&connection->stalled_since_ms, since, __ATOMIC_RELAXED);
+}
+
+static void connection_run(WorkerTask* task) {
+    Connection* connection = (Connection*)task;
+    const ConnectionLimits* limits = connection_limits();
+    uint64_t now = connection_clock_ms();
+    __atomic_store_n(&connection->last_active_ms, now, __ATOMIC_RELAXED);
+
+    send_capture_begin(&connection->output);
+    for (;;) {
+        size_t queued = send_capture_pending(&connection->output);
+        long pending = send_capture_flush(&connection->output);
+        if (pending < 0) {
+            break;
+        }
+        int moved = (size_t)pending < queued;
+
+        uint32_t events;
+        if (connection->throttled && (size_t)pending > limits->output_low_watermark) {
+            events = CONNECTION_THROTTLED_EVENTS;
+        } else {
+            connection->throttled = 0;
+            int keep = client_session_step(connection->session);
+            int push = keep > 0 ? client_session_push(connection->session) : 0;
+            if (keep <= 0 || push < 0) {
+                break;
+            }
+
+            queued = send_capture_pending(&connection->output);
+            if (queued >= limits->output_high_watermark) {
+                connection->throttled = 1;
+                events = CONNECTION_THROTTLED_EVENTS;
+            } else {
+                events = push > 0 || queued > 0 ? CONNECTION_PUSH_EVENTS : CONNECTION_EVENTS;
+            }
+        }
+        connection_note_output(connection, now, moved);
+
+        pthread_mutex_lock(&connection->lock);
+        if (connection->again) {
+            connection->again = 0;
+            pthread_mutex_unlock(&connection->lock);
+            continue;
+        }
+
+        int armed = connection_arm(connection, EPOLL_CTL_MOD, events);
+        connection->running = 0;
+        pthread_mutex_unlock(&connection->lock);
+        if (armed == 0) {
+            send_capture_end();
+            return;
+        }
+        break;
+    }
+
+    send_capture_end();
+    connection_close(connection);
+}
+
+// Runs on whichever thread appended to a topic the connection streams.
+static void connection_wake(void* context) {
+    Connection* connection = (Connection*)context;
+
+    pthread_mutex_lock(&connection->lock);
+    if (connection->running) {
+        connection->again = 1;
+    } else if (!connection->closed && !connection->throttled) {
+        connection_arm(connection, EPOLL_CTL_MOD, CONNECTION_PUSH_EVENTS);
+    }
+    pthread_mutex_unlock(&connection->lock);
+}
+
+static void connection_dispatch(Connection* connection) {
+    pthread_mutex_lock(&connection->lock);
+    if (connection->running) {
+        connection->again = 1;
+        pthread_mutex_unlock(&connection->lock);
+        return;
+    }
+    connection->running = 1;
+    pthread_mutex_unlock(&connection->lock);
+
+    if (worker_pool_submit(connection->loop->workers, &connection->task) != 0) {
+        connection_close(connection);
+    }
+}
+
+static int add_connection(EventLoop* loop, int client_fd) {
+    Connection* connection = (Connection*)calloc(1, sizeof(Connection));
+    if (!connection) {
+        return -1;
+    }
+
+    connection->session = client_session_create(client_fd);
+    if (!connection->session) {
+        free(connection);
+        return -1;
+    }
+
+    connection->task.run = connection_run;
+    connection->client_fd = client_fd;
+    connection->loop = loop;
+    connection->output.client_fd = client_fd;
+    connection->output.spill = 1;
+    connection->output.limit = connection_limits()->output_high_watermark;
+    connection->last_active_ms = connection_clock_ms();
+    pthread_mutex_init(&connection->lock, NULL);
+    client_session_set_waker(connection->session, connection_wake, connection);
+
+    // Listed before it is armed, so its first run can already unlink it.
+    pthread_mutex_lock(&loop->connections_lock);
+    connection->next = loop->connections;
+    if (loop->connections) {
+        loop->connections->prev = connection;
+    }
+    loop->connections = connection;
+    pthread_mutex_unlock(&loop->connections_lock);
+
+    if (connection_arm(connection, EPOLL_CTL_ADD, CONNECTION_EVENTS) != 0) {
+        perror("Failed to watch client");
+        // Never armed, so nothing else can hold it.
+        pthread_mutex_lock(&loop->connections_lock);
+        loop->connections = connection->next;
+        if (connection->next) {
+            connection->next->prev = NULL;
+        }
+        pthread_mutex_unlock(&loop->connections_lock);
+        connection_free(connection);
+        return -1;
+    }
+    return 0;
+}
+
+// Shutting a socket down wakes its connection, whose worker then finds it
+// closed and frees it like any other.
+static void event_loop_sweep(EventLoop* loop) {
+    const ConnectionLimits* limits = connection_limits();
+    uint64_t now = connection_clock_ms();
+
+    pthread_mutex_lock(&loop->connections_lock);
+    for (Connection* connection = loop->connections; connection; connection = connection->next) {
+        if (connection->expired) {
+            continue;
+        }
+
+        uint64_t active = __atomic_load_n(&connection->last_active_ms, __ATOMIC_RELAXED);
+        uint64_t stalled = __atomic_load_n(&connection->stalled_since_ms, __ATOMIC_RELAXED);
+        const char* reason = NULL;
+        if (limits->stall_timeout_ms && stalled && now - stalled >= limits->stall_timeout_ms) {
+            reason = "stalled";
+        } else if (limits->idle_timeout_ms && now - active >= limits->idle_timeout_ms) {
+            reason = "idle";
+        }
+
+        if (reason) {
+            connection->expired = 1;
+            fprintf(stderr, "Closing %s client (fd: %d)\n", reason, connection->client_fd);
+            shutdown(connection->client_fd, SHUT_RDWR);
+        }
+    }
+    pthread_mutex_unlock(&loop->connections_lock);
+}
+
+static void accept_connections(EventLoop* loop) {
+    for (;;) {
+        int client_fd = accept4(loop->server_fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (client_fd < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) {
+                continue;
+            }
+            // Another loop sharing the socket may have taken the rest.
+            if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                perror("Accept failed");
+            }
+            return;
+        }
+
+        if (add_connection(loop, client_fd) != 0) {
+            close(client_fd);
+        }
+    }
+}
+
+// Listener events carry the loop itself rather than a connection.
+static void* event_loop_main(void* arg) {
+    EventLoop* loop = (EventLoop*)arg;
+    struct epoll_event events[EVENT_LOOP_MAX_EVENTS];
+    const ConnectionLimits* limits = connection_limits();
+    int sweeping = limits->idle_timeout_ms || limits->stall_timeout_ms;
+
+    for (;;) {
+        if (sweeping && connection_clock_ms() >= loop->next_sweep_ms) {
+            event_loop_sweep(loop);
+            loop->next_sweep_ms = connection_clock_ms() + EVENT_LOOP_SWEEP_MS;
+        }
+
+        int ready = epoll_wait(loop->epoll_fd, events, EVENT_LOOP_MAX_EVENTS, sweeping ? EVENT_LOOP_SWEEP_MS : -1);
+        if (ready < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            perror("epoll_wait failed");
+            return NULL;
+        }
+
+        for (int i = 0; i < ready; i++) {
+            if (events[i].data.ptr == loop) {
+                accept_connections(loop);
+            } else {
+                connection_dispatch((Connection*)events[i].data.ptr);
+            }
+        }
+    }
+}
+
+static int set_non_blocking(int fd) {
+    int flags = fcntl(fd, F_GETFL, 0);
+    if (flags < 0) {
+        return -1;
+    }
+    return fcntl(fd, F_SETFL, flags | O_NONBLOCK);
+}
+
+static int event_loop_open(EventLoop* loop, int server_fd, WorkerPool* workers) {
+    loop->workers = workers;
+    loop->server_fd = server_fd;
+    loop->connections = NULL;
+    loop->next_sweep_ms = 0;
+    pthread_mutex_init(&loop->connections_lock, NULL);
+    loop->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (loop->epoll_fd < 0) {
+        perror("epoll_create1 failed");
+        return -1;
+    }
+
+    // Level-triggered, so a backlog one wakeup did not drain is reported
+    // again; exclusive, so a connection wakes one of the loops sharing it.
+    struct epoll_event event = {0};
+    event.events = EPOLLIN | EPOLLEXCLUSIVE;
+    event.data.ptr = loop;
+    if (epoll_ctl(loop->epoll_fd, EPOLL_CTL_ADD, server_fd, &event) != 0) {
+        perror("Failed to watch listening socket");
+        close(loop->epoll_fd);
+        return -1;
+    }
+    return 0;
+}
+
+int run_event_server(int server_fd, size_t loop_count, size_t worker_count) {
+    return run_event_server_listeners(&server_fd, 1, loop_count, worker_count);
+}
+
+int run_event_server_listeners(const int* server_fds, size_t server_count, size_t loop_count,
+                               size_t worker_count) {
+    if (!server_fds || server_count == 0) {
+        return -1;
+    }
+    for (size_t i = 0; i < server_count; i++) {
+        if (server_fds[i] < 0 || set_non_blocking(server_fds[i]) != 0) {
+            return -1;
+        }
+    }
+
+    size_t cores = online_cores();
+    if (loop_count == 0) {
+        loop_count = cores;
+    }
+    if (loop_count < server_count) {
+        loop_count = server_count;
+    }
+    if (loop_count > MAX_EVENT_LOOPS) {
+        loop_count = MAX_EVENT_LOOPS;
+    }
+    if (worker_count == 0) {
+        worker_count = cores * 2;
+    }
+    if (worker_count > MAX_EVENT_WORKERS) {
+        worker_count = MAX_EVENT_WORKERS;
+    }
+
+    WorkerPool* workers = worker_pool_create(worker_count);
+    if (!workers) {
+        return -1;
+    }
+
+    EventLoop loops[MAX_EVENT_LOOPS];
+    size_t opened = 0;
+    for (; opened < loop_count; opened++) {
+        if (event_loop_open(&loops[opened], server_fds[opened % server_count], workers) != 0) {
+            break;
+        }
+    }
+
+    // A socket nobody accepts from would still be handed connections by
+    // the kernel, so all of them must have a loop.
+    if (opened < loop_count && opened < server_count) {
+        for (size_t i = 0; i < opened; i++) {
+            close(loops[i].epoll_fd);
+        }
+        worker_pool_destroy(workers);
+        return -1;
+    }
+
+    size_t started = 1;
+    for (size_t i = 1; i < opened; i++) {
+        if (pthread_create(&loops[i].thread, NULL, event_loop_main, &loops[i]) != 0) {
+            perror("Failed to create event loop thread");
+            close(loops[i].epoll_fd);
+            continue;
+        }
+        pthread_detach(loops[i].thread);
+        started++;
+    }
+
+    printf("Serving clients from %zu event loops on %zu listeners and %zu workers\n", started,
+           server_count < started ? server_count : started, workers->thread_count);
+
+    event_loop_main(&loops[0]);
+    return 0;
+}
@@ -1,13 +1,23 @@
 #include "handle_ack.h"
 #include <stdio.h>
 #include <string.h>
+#include <unistd.h>
+#include <poll.h>
 #include <sys/socket.h>
 
 #define BUFFER_SIZE 1024
+#define ACK_TIMEOUT_MS 30000
 
 int wait_for_ack(int client_fd) {
     char buffer[BUFFER_SIZE] = {0};
 
+    // The socket may be non-blocking, so wait for the ACK to arrive first.
+    struct pollfd readable = { .fd = client_fd, .events = POLLIN };
+    if (poll(&readable, 1, ACK_TIMEOUT_MS) <= 0) {
+        fprintf(stderr, "Timed out waiting for ACK.\n");
+        return -1;
+    }
+
     ssize_t valread = read(client_fd, buffer, BUFFER_SIZE - 1);
     
     if (valread < 0) {
@@ -0,0 +1,108 @@
+#ifndef BINARY_PROTOCOL_H
+#define BINARY_PROTOCOL_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "server_event_handler.h"
+
+// A binary client opens with an 8-byte hello: the magic below followed by
+// the highest version it speaks and three reserved bytes. Text commands
+// never start with a NUL byte, so the first byte on a connection decides
+// the protocol. The server answers with the same layout and the version it
+// picked, 0 if it speaks none the client does.
+#define BINARY_PROTOCOL_MAGIC "\0SPB"
+#define BINARY_PROTOCOL_MAGIC_SIZE 4
+#define BINARY_PROTOCOL_VERSION 1
+#define BINARY_HELLO_SIZE 8
+
+// Every request and response is a frame, all integers little-endian:
+//   u32 length      bytes after this field (header rest + payload)
+//   u32 request_id  chosen by the client, echoed in the response
+//   u8  opcode
+//   u8  status      0 in requests
+//   u16 flags       reserved, 0
+// Responses come back in request order, so clients can keep any number of
+// requests in flight.
+#define FRAME_HEADER_SIZE 12
+#define FRAME_LENGTH_SIZE 4
+#define MAX_FRAME_PAYLOAD (10 * 1024 * 1024 + 1024)
+#define MAX_NAME_SIZE 255     // topic and group names
+
+#define OP_SUBSCRIBE 0x01   // u16 topic length, topic, u16 group length, group
+#define OP_CONSUME 0x02     // optional u32 max records (default 1), u32 max bytes
+#define OP_ACK 0x03         // u64 offset, u32 packet size
+#define OP_SEEK 0x04        // u64 offset of a record, or 0 for the start
+#define OP_PUBLISH 0x05     // the event itself
+#define OP_SET_FILTER 0x06  // filter expression, empty to clear
+#define OP_SET_CODECS 0x07  // u32 mask of RECORD_CODEC_BIT()s the client decodes
+#define OP_GET 0x08         // table view key
+#define OP_PING 0x09
+#define OP_BYE 0x0A
+#define OP_CREDIT 0x0B      // u32 records, u32 bytes to add; 0xFFFFFFFF lifts that limit
+#define OP_DELIVER 0x0C     // pushed by the server with request id 0, payload as CONSUME
+#define OP_FETCH 0x0D       // optional u32 max bytes of log
+#define OP_SET_OPTION 0x0E  // u8 SESSION_OPTION_*, u32 value
+#define OP_FETCH_FD 0x0F    // as FETCH, unix sockets only
+#define OP_SHM_SUBSCRIBE 0x10 // optional u32 ring capacity, unix sockets only
+
+// Requests flagged NO_REPLY get no response when it would be an empty OK,
+// so acks for streamed records can flow back without replies of their own.
+#define FRAME_FLAG_NO_REPLY 0x0001
+#define CREDIT_UNLIMITED 0xFFFFFFFFu
+
+#define STATUS_OK 0
+#define STATUS_NO_DATA 1
+#define STATUS_NOT_FOUND 2
+#define STATUS_BAD_REQUEST 3
+#define STATUS_NOT_SUBSCRIBED 4
+#define STATUS_UNKNOWN_OPCODE 5
+#define STATUS_FAILED 6
+
+// A CONSUME response carries u32 record count, then per record:
+//   u64 offset, u32 packet size, u32 data size, u8 codec, 3 reserved, data
+#define RECORD_ENTRY_HEADER_SIZE 20
+
+// A FETCH response carries u64 offset of the first record, u32 record
+// count, then the records exactly as stored: u32 header, payload.
+#define FETCH_RESPONSE_HEADER_SIZE 12
+
+// A FETCH_FD response carries u64 offset of the first record, u32 record
+// count and u32 bytes, with a read-only descriptor for the topic file
+// attached (SCM_RIGHTS). The records are those bytes of the file from that
+// offset, for the client to pread() or mmap() itself.
+#define FETCH_FD_RESPONSE_SIZE 16
+
+// A SHM_SUBSCRIBE response carries the u64 capacity of the ring, with the
+// memfd holding it attached (SCM_RIGHTS); see shm_ring.h. From then on the
+// session's records are written to the ring instead of the socket, and the
+// group's read pointer follows the acks the client stores in it.
+#define SHM_SUBSCRIBE_RESPONSE_SIZE 8
+
+typedef struct {
+    uint32_t length;
+    uint32_t request_id;
+    uint8_t opcode;
+    uint8_t status;
+    uint16_t flags;
+} FrameHeader;
+
+void frame_header_encode(const FrameHeader* header, uint8_t* bytes);
+
+void frame_header_decode(const uint8_t* bytes, FrameHeader* header);
+
+int binary_reply(ClientSession* session, const FrameHeader* request, uint8_t status, const void* body,
+                 size_t body_size);
+
+// Runs every complete frame in the session's input, stopping with the rest
+// held there (input_held) once the reply output is backlogged. Returns 1 to
+// keep the connection, 0 when the client said BYE and -1 on a malformed
+// stream.
+int binary_session_process(ClientSession* session);
+
+// Streams records to a subscribed session while it has credit. Returns 1
+// when more could be sent once the socket drains, 0 when the session is out
+// of credit or caught up (the session's waker is called when records are
+// appended), and -1 if sending failed.
+int binary_session_push(ClientSession* session);
+
+#endif
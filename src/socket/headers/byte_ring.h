@@ -0,0 +1,34 @@
+#ifndef BYTE_RING_H
+#define BYTE_RING_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Growable ring of received bytes. Capacity is a power of two and is only
+// allocated once something arrives.
+typedef struct {
+    uint8_t* data;
+    size_t capacity;
+    size_t head;
+    size_t size;
+} ByteRing;
+
+int byte_ring_reserve(ByteRing* ring, size_t extra);
+
+// Contiguous free space after the stored bytes, to receive into directly.
+size_t byte_ring_writable(ByteRing* ring, uint8_t** region);
+
+void byte_ring_commit(ByteRing* ring, size_t size);
+
+int byte_ring_append(ByteRing* ring, const void* data, size_t size);
+
+void byte_ring_peek(const ByteRing* ring, void* out, size_t size);
+
+// Makes the first size bytes contiguous and returns them.
+const uint8_t* byte_ring_linearize(ByteRing* ring, size_t size);
+
+void byte_ring_consume(ByteRing* ring, size_t size);
+
+void byte_ring_free(ByteRing* ring);
+
+#endif
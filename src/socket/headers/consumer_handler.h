@@ -4,13 +4,26 @@
 #include <stddef.h>
 #include "../../messaging/headers/manage_groups.h"
 #include "../../messaging/headers/create_topic.h"
+#include "../../messaging/headers/record_filter.h"
+#include "../../messaging/headers/consume_packet.h"
+#include "../../messaging/headers/consume_batch.h"
+#include "send_message.h"
 
 int send_packet_to_consumer(int client_fd, const void* data, size_t data_size);
 
+int send_encoded_packet_to_consumer(int client_fd, const void* data, size_t data_size, uint8_t codec);
+
+int send_packet_for_consumer(int client_fd, Packet* packet, Topic* topic, unsigned accepted_codecs);
+
+int send_batch_to_consumer(SendGather* output, const BatchRecord* records, size_t count);
+
 int handle_consumer_request(int client_fd, Group* group, Topic* topic);
 
 int consume_and_send_packet(int client_fd, Group* group, Topic* topic);
 
+int consume_and_send_packet_filtered(int client_fd, Group* group, Topic* topic, const RecordFilter* filter,
+                                     unsigned accepted_codecs);
+
 int wait_and_acknowledge_packet(int client_fd, Group* group, Topic* topic, void* packet_data, size_t packet_size);
 
 #endif
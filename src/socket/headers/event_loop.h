@@ -0,0 +1,64 @@
+#ifndef EVENT_LOOP_H
+#define EVENT_LOOP_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <pthread.h>
+#include "worker_pool.h"
+#include "server_event_handler.h"
+
+#define MAX_EVENT_LOOPS 8
+#define MAX_EVENT_WORKERS 64
+
+struct Connection;
+
+// connections lists every open connection of the loop for the sweep that
+// times them out, under connections_lock.
+typedef struct {
+    int epoll_fd;
+    int server_fd;
+    pthread_t thread;
+    WorkerPool* workers;
+    pthread_mutex_t connections_lock;
+    struct Connection* connections;
+    uint64_t next_sweep_ms;
+} EventLoop;
+
+// A connection is served by one worker at a time, so its session and
+// output queue need no lock. lock only guards the hand-over: an event or
+// append wake that comes in while a worker is running sets again instead
+// of dispatching it twice. The worker publishes last_active_ms and
+// stalled_since_ms for the sweep, which sets expired once it shut the
+// socket down.
+typedef struct Connection {
+    WorkerTask task;
+    int client_fd;
+    EventLoop* loop;
+    ClientSession* session;
+    SendCapture output;
+    int throttled;
+    pthread_mutex_t lock;
+    int running;
+    int again;
+    int closed;
+    uint64_t last_active_ms;
+    uint64_t stalled_since_ms;
+    int expired;
+    struct Connection* prev;
+    struct Connection* next;
+} Connection;
+
+// Serves clients from server_fd on loop_count epoll loops whose commands
+// run on worker_count threads. 0 picks a count from the number of cores.
+// Every loop accepts for itself. Returns -1 if the loops could not be
+// started and does not return otherwise.
+int run_event_server(int server_fd, size_t loop_count, size_t worker_count);
+
+// The same for several listening sockets bound with SO_REUSEPORT: loop i
+// accepts from server_fds[i % server_count], and there are at least as many
+// loops as sockets (up to MAX_EVENT_LOOPS; any further sockets are unused).
+// Loops that share a socket are woken for it one at a time.
+int run_event_server_listeners(const int* server_fds, size_t server_count, size_t loop_count,
+                               size_t worker_count);
+
+#endif
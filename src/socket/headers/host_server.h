@@ -1,10 +1,40 @@
 #ifndef HOST_SERVER_H
 #define HOST_SERVER_H
 
+#include <stddef.h>
 #include "../../messaging/headers/manage_groups.h"
 
+// Connections the kernel queues per listening socket before they are
+// accepted; it caps this at net.core.somaxconn.
+#define DEFAULT_ACCEPT_BACKLOG 4096
+
 int start_hosting(int port);
 
+// Opens count listening sockets on port with SO_REUSEPORT, so the kernel
+// spreads new connections over them, each queueing up to backlog (0 for
+// the default). Returns count, or -1 with none left open.
+int start_hosting_listeners(int port, int backlog, int* server_fds, size_t count);
+
+// Opens a listening unix stream socket at path for clients on this host.
+// They speak the same text and binary protocols as TCP clients, without
+// the loopback TCP stack, and binary clients may use FETCH_FD. A stale
+// socket file at path is replaced. Pass the fd to run_server_listeners
+// along with any TCP listeners.
+int start_hosting_unix(const char* path, int backlog);
+
+#define SERVER_BACKEND_AUTO 0
+#define SERVER_BACKEND_EPOLL 1
+#define SERVER_BACKEND_IO_URING 2
+
 int run_server_loop(int server_fd, GroupManager* group_manager);
 
+// AUTO uses io_uring when the kernel supports everything the ring needs
+// and epoll otherwise, saying so when it falls back; IO_URING returns -1
+// instead, without having accepted anything.
+int run_server_loop_backend(int server_fd, GroupManager* group_manager, int backend);
+
+// Serves from listeners opened by start_hosting_listeners and
+// start_hosting_unix, one event loop (or ring) accepting from each.
+int run_server_listeners(const int* server_fds, size_t count, GroupManager* group_manager, int backend);
+
 #endif
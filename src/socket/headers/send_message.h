@@ -1,6 +1,135 @@
 #ifndef SEND_MESSAGE_H
 #define SEND_MESSAGE_H
 
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/uio.h>
+
+// While a capture is active on the calling thread, send_all to its fd
+// appends to data instead of writing to the socket, so the caller can
+// submit the whole reply at once.
+//
+// A capture in spill mode is an output queue for a non-blocking socket
+// instead: sends go straight out while nothing is queued, and only what
+// the socket would not take is kept, from head to size, for
+// send_capture_flush. Only send_with_fd waits for the socket under it.
+//
+// A file range is not copied into a capture. It is queued by descriptor at
+// file_at in data: send_capture_flush sends it with sendfile() once the
+// bytes before it are out, and a capture that is not spilling leaves it to
+// its owner, which must send data up to file_at, then the range, then the
+// rest. The capture owns file_fd (a duplicate) while file_size is not 0.
+//
+// Once limit bytes are queued (0 for no limit), or while a file range is,
+// send_writable reports the socket as full and send_backlogged is set, so
+// streaming and the reading of further commands stop there.
+typedef struct {
+    int client_fd;
+    uint8_t* data;
+    size_t size;
+    size_t capacity;
+    size_t head;
+    size_t limit;
+    int spill;
+    int file_fd;
+    size_t file_at;
+    size_t file_offset;
+    size_t file_size;
+} SendCapture;
+
+// Collects the pieces of one or more replies so they go out in a single
+// sendmsg(). Small pieces are copied, larger ones are only referenced and
+// must stay valid until the gather is flushed. Pieces are written once the
+// table is full, or at the end of a message when flush_bytes are pending
+// or something is referenced.
+#define SEND_GATHER_MAX_PIECES 64
+#define SEND_GATHER_COPY_LIMIT 2048
+#define SEND_GATHER_DEFAULT_FLUSH (64 * 1024)
+
+typedef struct {
+    const uint8_t* data;    // NULL for bytes at offset in the copy buffer
+    size_t offset;
+    size_t size;
+} SendPiece;
+
+typedef struct {
+    int client_fd;
+    size_t flush_bytes;
+    SendPiece pieces[SEND_GATHER_MAX_PIECES];
+    int piece_count;
+    int referenced;
+    size_t pending;
+    uint8_t* copy;
+    size_t copy_size;
+    size_t copy_capacity;
+} SendGather;
+
+void send_capture_begin(SendCapture* capture);
+
+void send_capture_end(void);
+
+// Spill mode: writes as much of the queue as the socket takes. Returns the
+// bytes still queued, or -1 once the connection failed.
+long send_capture_flush(SendCapture* capture);
+
+// Queued bytes, counting a queued file range.
+size_t send_capture_pending(const SendCapture* capture);
+
+// Drops a queued file range once it has been sent or abandoned.
+void send_capture_clear_file(SendCapture* capture);
+
+void send_capture_free(SendCapture* capture);
+
+// How long a send to a blocking caller waits for a full socket before
+// giving up on the client; 0 waits for ever.
+void send_set_stall_timeout(unsigned timeout_ms);
+
+int send_all(int client_fd, const void* data, size_t data_size);
+
+// send_all for several buffers at once, in one sendmsg() when the socket
+// takes them. MSG_MORE is passed along with more.
+int send_allv(int client_fd, const struct iovec* iov, int iov_count, int more);
+
+void send_gather_init(SendGather* gather, int client_fd, size_t flush_bytes);
+
+int send_gather_append(SendGather* gather, const void* data, size_t size);
+
+int send_gather_end_message(SendGather* gather);
+
+// Writes everything pending; more tells the kernel further data follows.
+int send_gather_flush(SendGather* gather, int more);
+
+void send_gather_free(SendGather* gather);
+
+// Holds back partial segments while set and pushes them out when cleared.
+// Ignored while a capture is active, which makes one send anyway.
+int send_set_cork(int client_fd, int corked);
+
+int send_set_nodelay(int client_fd, int nodelay);
+
+// Sends size bytes of file_fd starting at offset with sendfile(), so they
+// go from the page cache to the socket without a copy through user space.
+// A capture queues the range by descriptor; only a second range queued
+// behind one it still holds is copied into it.
+int send_file_range(int client_fd, int file_fd, size_t offset, size_t size);
+
+// Sends data with file_fd attached as SCM_RIGHTS, so a client on a unix
+// socket receives its own descriptor for the file along with the first of
+// these bytes. A capture cannot carry a descriptor; whatever it holds,
+// file range included, is written out first, so its owner must have
+// nothing else queued for the client while the capture is active. That
+// holds for spill mode too, which waits for its queue to drain here.
+int send_with_fd(int client_fd, const void* data, size_t data_size, int file_fd);
+
+// 1 under a capture for client_fd that holds its limit or a file range, when
+// no further commands should be read until it drains. Always 0 without one,
+// as plain sends wait for the socket themselves.
+int send_backlogged(int client_fd);
+
+// 1 when a send to client_fd would not wait for the socket to drain, or
+// under a capture, while it holds less than its limit and no file range.
+int send_writable(int client_fd);
+
 int send_msg(int client_fd, const char *message);
 
-#endif
\ No newline at end of file
+#endif
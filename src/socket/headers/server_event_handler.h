@@ -4,6 +4,40 @@
 #include <stddef.h>
 #include "../../messaging/headers/manage_groups.h"
 #include "../../messaging/headers/create_topic.h"
+#include "../../messaging/headers/record_filter.h"
+#include "../../messaging/headers/consume_batch.h"
+#include "../../messaging/headers/topic_watch.h"
+#include "byte_ring.h"
+#include "send_message.h"
+#include "shm_ring.h"
+
+#define SESSION_PROTOCOL_UNKNOWN 0
+#define SESSION_PROTOCOL_TEXT 1
+#define SESSION_PROTOCOL_BINARY 2
+
+// Per-connection options, set with SET_OPTION or OP_SET_OPTION.
+#define SESSION_OPTION_NODELAY 1        // 0 or 1, on unless the client turns it off
+#define SESSION_OPTION_CORK 2           // 0 or 1, hold partial segments until a reply is complete
+#define SESSION_OPTION_BATCH_BYTES 3    // replies gathered before a write, 0 to write each one
+#define MAX_OUTPUT_BATCH_BYTES (4 * 1024 * 1024)
+
+// Bytes of log a FETCH returns when the client names no limit, and at most.
+#define DEFAULT_FETCH_BYTES (1024 * 1024)
+#define MAX_FETCH_BYTES (8 * 1024 * 1024)
+
+// How much output a connection may have queued, and how long it may go
+// quiet, before the server holds it back or gives up on it.
+#define DEFAULT_OUTPUT_HIGH_WATERMARK (1024 * 1024)
+#define DEFAULT_OUTPUT_LOW_WATERMARK (256 * 1024)
+#define DEFAULT_IDLE_TIMEOUT_MS 0
+#define DEFAULT_STALL_TIMEOUT_MS 30000
+
+typedef struct {
+    size_t output_high_watermark;   // queued bytes at which a session stops reading the log
+    size_t output_low_watermark;    // queued bytes at which it starts again
+    unsigned idle_timeout_ms;       // no command or delivery for this long closes it, 0 never
+    unsigned stall_timeout_ms;      // queued output not moving for this long closes it, 0 never
+} ConnectionLimits;
 
 typedef struct {
     int client_fd;
@@ -11,14 +45,95 @@ typedef struct {
     Topic* topic;
     char* group_id;
     char* topic_name;
+    RecordFilter* filter;
+    unsigned accepted_codecs;
+    RecordBatch* batch;
+    int protocol;
+    uint8_t protocol_version;
+    ByteRing input;
+    int input_held;     // complete frames left in input until output drains
+    uint64_t credit_records;
+    uint64_t credit_bytes;
+    TopicWatch* watch;
+    void (*wake)(void* context);
+    void* wake_context;
+    SendGather output;
+    int cork;
+    int local;      // on a unix socket: no TCP options, FETCH_FD may pass the log
+    ShmRing* ring;
+    size_t ring_position;   // topic offset the ring has been filled up to
 } ClientSession;
 
 int handle_client_session(int client_fd, GroupManager* group_manager, const char* default_topic_base_path);
 
+// Applies to connections accepted from then on; set it before serving.
+// Returns -1, changing nothing, unless 0 < low <= high.
+int connection_limits_set(const ConnectionLimits* limits);
+
+const ConnectionLimits* connection_limits(void);
+
+// The monotonic clock the timeouts are measured on.
+uint64_t connection_clock_ms(void);
+
+ClientSession* client_session_create(int client_fd);
+
+// Reads and runs one command. Returns 1 to keep the connection, 0 when the
+// client left or quit, -1 on a read error.
+int client_session_step(ClientSession* session);
+
+// Runs one text command that has already been received. buffer must have
+// room for a terminator after size bytes. Returns 1 to keep the connection,
+// 0 when the client quit.
+int client_session_run(ClientSession* session, char* buffer, size_t size);
+
+// Hands bytes that arrived on the connection to whichever protocol the
+// client opened with: a text command per receive, or binary frames that
+// may be split or coalesced arbitrarily. Same returns as
+// client_session_step, with -1 also for a malformed binary stream.
+int client_session_receive(ClientSession* session, char* buffer, size_t size);
+
+// Runs binary frames that were held back in the input while the reply
+// output was backlogged; see binary_session_process. Same returns as
+// client_session_step, 1 when nothing is held.
+int client_session_resume(ClientSession* session);
+
+int client_session_input_held(const ClientSession* session);
+
+// Streams records a subscribed client has credit for; see
+// binary_session_push. Text sessions never have anything to push.
+int client_session_push(ClientSession* session);
+
+// wake is called, possibly on a publishing thread, when records arrive on
+// a topic the session is streaming and it should push again.
+void client_session_set_waker(ClientSession* session, void (*wake)(void* context), void* context);
+
+int client_session_set_option(ClientSession* session, int option, uint32_t value);
+
+// Stops streaming into the session's shared ring, telling the reader why
+// with a SHM_RING_* reason.
+void client_session_close_ring(ClientSession* session, uint32_t reason);
+
+int client_session_set_topic(ClientSession* session, const char* topic_name);
+
+// A NULL group leaves the session without one, able to publish but not consume.
+int client_session_set_group(ClientSession* session, const char* group_name);
+
 int process_client_command(int client_fd, ClientSession* session, const char* command);
 
 int handle_consume_command(int client_fd, ClientSession* session);
 
+int handle_consume_batch_command(int client_fd, ClientSession* session, const char* count);
+
+int handle_fetch_command(int client_fd, ClientSession* session, const char* max_bytes);
+
+int handle_set_filter_command(int client_fd, ClientSession* session, const char* expression);
+
+int handle_set_option_command(int client_fd, ClientSession* session, const char* option);
+
+int handle_set_codecs_command(int client_fd, ClientSession* session, const char* codecs);
+
+int handle_get_command(int client_fd, ClientSession* session, const char* key);
+
 int handle_ack_command(int client_fd, ClientSession* session, const char* command_data);
 
 void client_session_free(ClientSession* session);
@@ -0,0 +1,126 @@
+#ifndef SHM_RING_H
+#define SHM_RING_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// A single-producer, single-consumer ring of records in a memfd, shared by
+// the broker (writer) and one subscriber process on the same host (reader).
+// The first page is the header below; capacity bytes of entries follow.
+// Positions only grow, and index the data modulo capacity, a power of two.
+//
+// Each entry, in the host's byte order and padded to 8 bytes:
+//   u32 data size   SHM_ENTRY_WRAP for filler up to the end of the data
+//   u8  codec
+//   3 reserved
+//   u64 offset      of the record in the topic, as CONSUME reports it
+//   u32 packet size
+//   u32 reserved
+//   data
+// An entry never wraps, so readers get the record in place.
+#define SHM_RING_MAGIC 0x52535053u   // "SPSR"
+#define SHM_RING_VERSION 1
+#define SHM_RING_HEADER_SIZE 4096
+#define SHM_RING_MIN_CAPACITY (64 * 1024)
+#define SHM_RING_MAX_CAPACITY ((size_t)1 << 30)
+#define SHM_RING_DEFAULT_CAPACITY (4 * 1024 * 1024)
+#define SHM_ENTRY_HEADER_SIZE 24
+#define SHM_ENTRY_ALIGN 8
+#define SHM_ENTRY_WRAP 0xFFFFFFFFu
+
+// Why the writer stopped, in closed.
+#define SHM_RING_OPEN 0
+#define SHM_RING_CLOSED 1           // the subscription ended
+#define SHM_RING_TOO_SMALL 2        // a record did not fit in the whole ring
+
+// Each side's fields sit on their own cache line, so the writer publishing
+// and the reader releasing do not contend for one.
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t capacity;
+    uint32_t closed;
+    uint8_t reserved[44];
+
+    // Written by the broker.
+    uint64_t write_position __attribute__((aligned(64)));
+
+    // Written by the subscriber. reader_parked is the futex it sleeps on;
+    // writer_waiting is set by the broker when the ring was full and asks
+    // the reader to tell it, over the control socket, once it frees space.
+    uint64_t read_position __attribute__((aligned(64)));
+    uint64_t acked_offset;
+    uint32_t reader_parked;
+    uint32_t writer_waiting;
+} ShmRingHeader;
+
+// One side's mapping. The writer keeps its own copy of the capacity and of
+// the position it has written up to, and never trusts the reader's fields
+// for anything but how much room there is.
+typedef struct {
+    ShmRingHeader* header;
+    uint8_t* data;
+    size_t capacity;
+    size_t map_size;
+    uint64_t position;      // writer: staged up to; reader: peeked up to
+    uint64_t next;          // reader: end of the peeked entry
+    int fd;
+} ShmRing;
+
+typedef struct {
+    const uint8_t* data;
+    size_t data_size;
+    uint64_t offset;
+    uint32_t packet_size;
+    uint8_t codec;
+} ShmRecord;
+
+// Writer: creates a sealed memfd with room for capacity bytes of entries,
+// rounded up to a power of two. Returns 0 or -1.
+int shm_ring_create(ShmRing* ring, size_t capacity);
+
+// Reader: maps a ring received from the broker, taking over fd.
+int shm_ring_attach(ShmRing* ring, int fd);
+
+void shm_ring_unmap(ShmRing* ring);
+
+// Writer: stages one record. Returns 0 when staged, 1 when the ring has no
+// room for it yet and -1 when it never will. Nothing is visible to the
+// reader before shm_ring_commit.
+int shm_ring_write(ShmRing* ring, const ShmRecord* record);
+
+// Writer: publishes the staged records and wakes the reader if it parked.
+void shm_ring_commit(ShmRing* ring);
+
+// Writer: called after shm_ring_write returned 1 for data_size bytes.
+// Returns 1 if the reader has freed enough space meanwhile, 0 if it will
+// ask for more records once it does.
+int shm_ring_wait_space(ShmRing* ring, size_t data_size);
+
+// Writer: marks the ring closed with a SHM_RING_* reason and wakes the reader.
+void shm_ring_close(ShmRing* ring, uint32_t reason);
+
+// Writer: the topic offset the reader acknowledged up to.
+uint64_t shm_ring_acked(const ShmRing* ring);
+
+// Reader: the next record, left in place until shm_ring_release. Returns 1
+// with record filled in, 0 when the ring is empty, -1 once it is closed
+// and drained.
+int shm_ring_peek(ShmRing* ring, ShmRecord* record);
+
+// Reader: frees the peeked record's space.
+void shm_ring_release(ShmRing* ring);
+
+// Reader: 1, once, if the writer stopped on a full ring and has to be told
+// there is room again. Checked after releasing and before waiting.
+int shm_ring_writer_waiting(ShmRing* ring);
+
+// Reader: acknowledges everything up to and including record.
+void shm_ring_ack(ShmRing* ring, const ShmRecord* record);
+
+// Reader: waits for a record, spinning spin_count times before parking on
+// the futex for up to timeout_ms (-1 for no limit). Returns 1 when a record
+// or the close is ready, 0 on timeout or a stray wakeup.
+int shm_ring_wait(ShmRing* ring, unsigned spin_count, int timeout_ms);
+
+#endif
@@ -0,0 +1,102 @@
+#ifndef URING_SERVER_H
+#define URING_SERVER_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <pthread.h>
+#include "worker_pool.h"
+#include "send_message.h"
+#include "server_event_handler.h"
+
+#define URING_QUEUE_DEPTH 4096
+#define URING_RECV_BUFFERS 1024
+#define URING_RECV_BUFFER_SIZE 4096
+
+typedef struct UringCommand {
+    size_t size;
+    struct UringCommand* next;
+    char data[];
+} UringCommand;
+
+struct UringLoop;
+
+// Owned by its ring thread, except while a worker runs one of its commands
+// or a push (busy), when the worker has the session and reply to itself.
+// wake_queued and next_woken belong to the loop's done_mutex. sending is
+// set while the ring sends the reply; prev and next link the loop's open
+// connections for the sweep. A file range queued in the reply is spliced
+// through pipe_fds, piped bytes of it at a time waiting to go out.
+typedef struct UringConnection {
+    WorkerTask task;
+    int client_fd;
+    struct UringLoop* loop;
+    ClientSession* session;
+    UringCommand* commands;
+    UringCommand* last_command;
+    UringCommand* running;
+    SendCapture reply;
+    size_t reply_sent;
+    int pipe_fds[2];
+    size_t pipe_capacity;
+    size_t piped;
+    int sending;
+    uint64_t last_active_ms;
+    uint64_t sent_at_ms;
+    int busy;
+    int recv_armed;
+    int quit;
+    int closing;
+    int shut_down;
+    int push_again;
+    int push_pending;
+    int wake_queued;
+    struct UringConnection* next_done;
+    struct UringConnection* next_woken;
+    struct UringConnection* prev;
+    struct UringConnection* next;
+} UringConnection;
+
+typedef struct UringLoop {
+    int ring_fd;
+    int server_fd;
+    unsigned* sq_head;
+    unsigned* sq_tail;
+    unsigned sq_mask;
+    unsigned sq_entries;
+    unsigned* sq_array;
+    unsigned sq_local_tail;
+    struct io_uring_sqe* sqes;
+    unsigned* cq_head;
+    unsigned* cq_tail;
+    unsigned cq_mask;
+    struct io_uring_cqe* cqes;
+    void* sq_ring;
+    size_t sq_ring_size;
+    void* cq_ring;
+    size_t cq_ring_size;
+    size_t sqes_size;
+    struct io_uring_buf_ring* buffer_ring;
+    uint8_t* buffer_memory;
+    int wake_fd;
+    uint64_t wake_value;
+    int wake_pending;
+    pthread_mutex_t done_mutex;
+    UringConnection* done;
+    UringConnection* woken;
+    UringConnection* connections;
+    WorkerPool* workers;
+    pthread_t thread;
+} UringLoop;
+
+// Serves clients on server_fd from loop_count io_uring rings (0 picks one
+// per core), running commands on worker_count threads. Returns -1 without
+// having accepted anything if the kernel lacks multishot accept and recv
+// or provided buffer rings, so the caller can fall back to epoll.
+int run_uring_server(int server_fd, size_t loop_count, size_t worker_count);
+
+// The same for several listening sockets bound with SO_REUSEPORT, as for
+// run_event_server_listeners: ring i accepts from server_fds[i % server_count].
+int run_uring_server_listeners(const int* server_fds, size_t server_count, size_t loop_count,
+                               size_t worker_count);
+
+#endif
@@ -0,0 +1,31 @@
+#ifndef WORKER_POOL_H
+#define WORKER_POOL_H
+
+#include <stddef.h>
+#include <pthread.h>
+
+// Tasks are embedded in the caller's own state, so submitting never
+// allocates. A task must not be submitted again before it has run.
+typedef struct WorkerTask {
+    void (*run)(struct WorkerTask* task);
+    struct WorkerTask* next;
+} WorkerTask;
+
+typedef struct {
+    pthread_t* threads;
+    size_t thread_count;
+    WorkerTask* head;
+    WorkerTask* tail;
+    int stopping;
+    pthread_mutex_t mutex;
+    pthread_cond_t available;
+} WorkerPool;
+
+WorkerPool* worker_pool_create(size_t thread_count);
+
+int worker_pool_submit(WorkerPool* pool, WorkerTask* task);
+
+// Runs what is already queued, then joins the threads.
+void worker_pool_destroy(WorkerPool* pool);
+
+#endif
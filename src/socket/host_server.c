@@ -1,19 +1,23 @@
 #include "host_server.h"
-#include "headers/server_event_handler.h"
+#include "headers/event_loop.h"
+#include "headers/uring_server.h"
 #include "connect_to_client.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <signal.h>
 #include <unistd.h>
 #include <arpa/inet.h>
-#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
 
-int start_hosting(int port) {
+static int open_listener(int port, int backlog, int reuse_port) {
     int server_fd;
     struct sockaddr_in address;
     int opt = 1;
 
-    if ((server_fd = socket(AF_INET, SOCK_STREAM, 0)) == 0) {
+    if ((server_fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0)) < 0) {
         perror("Socket creation failed");
         return -1;
     }
@@ -24,6 +28,13 @@ int start_hosting(int port) {
         return -1;
     }
 
+    if (reuse_port && setsockopt(server_fd, SOL_SOCKET, SO_REUSEPORT, &opt, sizeof(opt))) {
+        perror("SO_REUSEPORT failed");
+        close(server_fd);
+        return -1;
+    }
+
+    memset(&address, 0, sizeof(address));
     address.sin_family = AF_INET;
     address.sin_addr.s_addr = INADDR_ANY;
     address.sin_port = htons(port);
@@ -34,61 +45,115 @@ int start_hosting(int port) {
         return -1;
     }
 
-    if (listen(server_fd, 3) < 0) {
+    if (listen(server_fd, backlog > 0 ? backlog : DEFAULT_ACCEPT_BACKLOG) < 0) {
         perror("Listen failed");
         close(server_fd);
         return -1;
     }
 
+    return server_fd;
+}
+
+int start_hosting(int port) {
+    int server_fd = open_listener(port, DEFAULT_ACCEPT_BACKLOG, 0);
+    if (server_fd < 0) {
+        return -1;
+    }
+
     printf("Server hosted successfully on port %d\n", port);
     return server_fd;
 }
 
-typedef struct {
-    int client_fd;
-    GroupManager* group_manager;
-} ClientThreadData;
-
-static void* handle_client_thread(void* arg) {
-    ClientThreadData* thread_data = (ClientThreadData*)arg;
-    
-    handle_client_session(thread_data->client_fd, thread_data->group_manager, "./topics");
-    free(thread_data);
-    return NULL;
+int start_hosting_listeners(int port, int backlog, int* server_fds, size_t count) {
+    if (!server_fds || count == 0) {
+        return -1;
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        server_fds[i] = open_listener(port, backlog, 1);
+        if (server_fds[i] < 0) {
+            while (i > 0) {
+                close(server_fds[--i]);
+            }
+            return -1;
+        }
+    }
+
+    printf("Server hosted successfully on port %d with %zu listeners\n", port, count);
+    return (int)count;
 }
 
-int run_server_loop(int server_fd, GroupManager* group_manager) {
+int start_hosting_unix(const char* path, int backlog) {
+    struct sockaddr_un address;
+    if (!path || strlen(path) >= sizeof(address.sun_path)) {
+        fprintf(stderr, "Unix socket path is missing or too long\n");
+        return -1;
+    }
+
+    // A socket file left by a previous run would fail the bind; anything
+    // else at that path is not ours to remove.
+    struct stat existing;
+    if (lstat(path, &existing) == 0 && S_ISSOCK(existing.st_mode)) {
+        unlink(path);
+    }
+
+    int server_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
     if (server_fd < 0) {
+        perror("Socket creation failed");
         return -1;
     }
 
-    printf("Server loop started. Waiting for clients...\n");
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    memcpy(address.sun_path, path, strlen(path) + 1);
 
-    while (1) {
-        int client_fd = accept_client(server_fd);
-        if (client_fd < 0) {
-            continue;
-        }
+    if (bind(server_fd, (struct sockaddr *)&address, sizeof(address)) < 0) {
+        perror("Bind failed");
+        close(server_fd);
+        return -1;
+    }
 
-        ClientThreadData* thread_data = malloc(sizeof(ClientThreadData));
-        if (!thread_data) {
-            close(client_fd);
-            continue;
-        }
+    if (listen(server_fd, backlog > 0 ? backlog : DEFAULT_ACCEPT_BACKLOG) < 0) {
+        perror("Listen failed");
+        close(server_fd);
+        unlink(path);
+        return -1;
+    }
 
-        thread_data->client_fd = client_fd;
-        thread_data->group_manager = group_manager;
+    printf("Server hosted successfully on %s\n", path);
+    return server_fd;
+}
 
-        pthread_t thread;
-        if (pthread_create(&thread, NULL, handle_client_thread, thread_data) != 0) {
-            perror("Failed to create thread");
-            free(thread_data);
-            close(client_fd);
-            continue;
-        }
+int run_server_loop(int server_fd, GroupManager* group_manager) {
+    return run_server_loop_backend(server_fd, group_manager, SERVER_BACKEND_AUTO);
+}
+
+int run_server_loop_backend(int server_fd, GroupManager* group_manager, int backend) {
+    return run_server_listeners(&server_fd, 1, group_manager, backend);
+}
 
-        pthread_detach(thread);
+int run_server_listeners(const int* server_fds, size_t count, GroupManager* group_manager, int backend) {
+    if (!server_fds || count == 0) {
+        return -1;
     }
 
-    return 0;
-}
\ No newline at end of file
+    (void)group_manager;
+    printf("Server loop started. Waiting for clients...\n");
+
+    // sendfile() has no MSG_NOSIGNAL; a consumer that goes away mid-FETCH
+    // must fail the send, not the process.
+    signal(SIGPIPE, SIG_IGN);
+
+    if (backend != SERVER_BACKEND_EPOLL) {
+        if (run_uring_server_listeners(server_fds, count, 0, 0) == 0) {
+            return 0;
+        }
+        if (backend == SERVER_BACKEND_IO_URING) {
+            fprintf(stderr, "io_uring is not available\n");
+            return -1;
+        }
+        printf("io_uring is not available, falling back to epoll\n");
+    }
+
+    return run_event_server_listeners(server_fds, count, 0, 0);
+}
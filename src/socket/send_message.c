@@ -1,7 +1,611 @@
 #include "send_message.h"
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#include <errno.h>
+#include <poll.h>
+#include <fcntl.h>
+#include <unistd.h>
 #include <sys/socket.h>
+#include <sys/sendfile.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+
+// Client sockets are non-blocking once a loop owns them. Its workers queue
+// what a full socket buffer will not take; other callers wait it out here,
+// for up to the stall timeout, rather than treat it as an error.
+#define SEND_STALL_TIMEOUT_MS 30000
+#define SEND_CAPTURE_INITIAL_SIZE 4096
+#define SEND_CAPTURE_KEEP_SIZE (256 * 1024)
+#define SEND_FILE_COPY_SIZE (64 * 1024)
+#define SEND_GATHER_KEEP_SIZE (256 * 1024)
+
+static __thread SendCapture* active_capture;
+static unsigned stall_timeout_ms = SEND_STALL_TIMEOUT_MS;
+
+void send_set_stall_timeout(unsigned timeout_ms) {
+    stall_timeout_ms = timeout_ms;
+}
+
+void send_capture_begin(SendCapture* capture) {
+    active_capture = capture;
+}
+
+void send_capture_end(void) {
+    active_capture = NULL;
+}
+
+static SendCapture* capture_for(int client_fd) {
+    return active_capture && active_capture->client_fd == client_fd ? active_capture : NULL;
+}
+
+// Whether a send goes into the capture rather than to the socket: always,
+// unless it spills, when only behind what is already queued.
+static int capture_holds(const SendCapture* capture) {
+    return !capture->spill || capture->head < capture->size || capture->file_size > 0;
+}
+
+// A drained queue starts over at the front of its buffer. A file range
+// still queued is then at its front too.
+static void capture_rewind(SendCapture* capture) {
+    if (capture->head == capture->size) {
+        capture->head = 0;
+        capture->size = 0;
+        capture->file_at = 0;
+    }
+}
+
+static int capture_reserve(SendCapture* capture, size_t data_size) {
+    capture_rewind(capture);
+    if (capture->size + data_size > capture->capacity) {
+        size_t capacity = capture->capacity ? capture->capacity : SEND_CAPTURE_INITIAL_SIZE;
+        while (capacity < capture->size + data_size) {
+            capacity *= 2;
+        }
+
+        uint8_t* grown = (uint8_t*)realloc(capture->data, capacity);
+        if (!grown) {
+            return -1;
+        }
+        capture->data = grown;
+        capture->capacity = capacity;
+    }
+    return 0;
+}
+
+static int capture_append(SendCapture* capture, const void* data, size_t data_size) {
+    if (capture_reserve(capture, data_size) != 0) {
+        return -1;
+    }
+
+    memcpy(capture->data + capture->size, data, data_size);
+    capture->size += data_size;
+    return 0;
+}
+
+static int capture_appendv(SendCapture* capture, const struct iovec* iov, int iov_count) {
+    for (int i = 0; i < iov_count; i++) {
+        if (capture_append(capture, iov[i].iov_base, iov[i].iov_len) != 0) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+static int read_file_range(int file_fd, uint8_t* buffer, size_t offset, size_t size) {
+    size_t total_read = 0;
+    while (total_read < size) {
+        ssize_t bytes_read = pread(file_fd, buffer + total_read, size - total_read, (off_t)(offset + total_read));
+        if (bytes_read > 0) {
+            total_read += (size_t)bytes_read;
+        } else if (bytes_read < 0 && errno == EINTR) {
+            continue;
+        } else {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+// One sendfile() of what is left of a range, or a copied piece of it on
+// file systems sendfile() does not support. Returns like send().
+static ssize_t send_file_some(int client_fd, int file_fd, size_t offset, size_t size) {
+    off_t position = (off_t)offset;
+    ssize_t sent = sendfile(client_fd, file_fd, &position, size);
+    if (sent >= 0 || (errno != EINVAL && errno != ENOSYS)) {
+        return sent;
+    }
+
+    size_t step = size < SEND_FILE_COPY_SIZE ? size : SEND_FILE_COPY_SIZE;
+    uint8_t* buffer = (uint8_t*)malloc(step);
+    if (!buffer) {
+        return -1;
+    }
+    if (read_file_range(file_fd, buffer, offset, step) == 0) {
+        sent = send(client_fd, buffer, step, MSG_NOSIGNAL);
+    } else {
+        errno = EIO;
+        sent = -1;
+    }
+    free(buffer);
+    return sent;
+}
+
+long send_capture_flush(SendCapture* capture) {
+    for (;;) {
+        size_t end = capture->file_size > 0 ? capture->file_at : capture->size;
+        int from_file = capture->head == end;
+        if (from_file && capture->file_size == 0) {
+            break;
+        }
+
+        ssize_t sent = from_file
+            ? send_file_some(capture->client_fd, capture->file_fd, capture->file_offset, capture->file_size)
+            : send(capture->client_fd, capture->data + capture->head, end - capture->head, MSG_NOSIGNAL);
+        if (sent > 0 && from_file) {
+            capture->file_offset += (size_t)sent;
+            capture->file_size -= (size_t)sent;
+            if (capture->file_size == 0) {
+                send_capture_clear_file(capture);
+            }
+            continue;
+        }
+        if (sent > 0) {
+            capture->head += (size_t)sent;
+            continue;
+        }
+        if (sent < 0 && errno == EINTR) {
+            continue;
+        }
+        if (sent < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            return (long)send_capture_pending(capture);
+        }
+
+        if (sent == 0 && from_file) {
+            fprintf(stderr, "Log ended before the requested range\n");
+        } else if (sent < 0) {
+            perror("Failed to send data");
+        }
+        return -1;
+    }
+
+    capture->head = 0;
+    capture->size = 0;
+    if (capture->capacity > SEND_CAPTURE_KEEP_SIZE) {
+        free(capture->data);
+        capture->data = NULL;
+        capture->capacity = 0;
+    }
+    return 0;
+}
+
+size_t send_capture_pending(const SendCapture* capture) {
+    return capture->size - capture->head + capture->file_size;
+}
+
+void send_capture_clear_file(SendCapture* capture) {
+    if (capture->file_size > 0) {
+        close(capture->file_fd);
+    }
+    capture->file_fd = -1;
+    capture->file_size = 0;
+}
+
+void send_capture_free(SendCapture* capture) {
+    send_capture_clear_file(capture);
+    free(capture->data);
+    capture->data = NULL;
+    capture->head = 0;
+    capture->size = 0;
+    capture->capacity = 0;
+}
+
+// Called after a send reported EAGAIN. Returns 0 once the socket can take
+// more and -1 if it stayed full for the whole stall timeout.
+static int wait_writable(int client_fd) {
+    struct pollfd writable = { .fd = client_fd, .events = POLLOUT };
+    int ready = poll(&writable, 1, stall_timeout_ms ? (int)stall_timeout_ms : -1);
+    if (ready > 0 || (ready < 0 && errno == EINTR)) {
+        return 0;
+    }
+    fprintf(stderr, "Timed out sending to client (fd: %d)\n", client_fd);
+    return -1;
+}
+
+int send_all(int client_fd, const void* data, size_t data_size) {
+    SendCapture* capture = capture_for(client_fd);
+    if (capture && capture_holds(capture)) {
+        return capture_append(capture, data, data_size);
+    }
+
+    size_t total_sent = 0;
+    while (total_sent < data_size) {
+        ssize_t sent = send(client_fd, (const char*)data + total_sent, data_size - total_sent, MSG_NOSIGNAL);
+        if (sent > 0) {
+            total_sent += (size_t)sent;
+            continue;
+        }
+
+        if (sent < 0 && errno == EINTR) {
+            continue;
+        }
+
+        if (sent < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            if (capture) {
+                return capture_append(capture, (const char*)data + total_sent, data_size - total_sent);
+            }
+            if (wait_writable(client_fd) == 0) {
+                continue;
+            }
+            return -1;
+        }
+
+        if (sent == 0) {
+            fprintf(stderr, "Connection closed while sending\n");
+        } else {
+            perror("Failed to send data");
+        }
+        return -1;
+    }
+    return 0;
+}
+
+int send_allv(int client_fd, const struct iovec* iov, int iov_count, int more) {
+    SendCapture* capture = capture_for(client_fd);
+    if (capture && capture_holds(capture)) {
+        return capture_appendv(capture, iov, iov_count);
+    }
+
+    struct iovec remaining[SEND_GATHER_MAX_PIECES];
+    int flags = MSG_NOSIGNAL | (more ? MSG_MORE : 0);
+    while (iov_count > 0) {
+        // Long lists go out a table at a time.
+        int count = iov_count < SEND_GATHER_MAX_PIECES ? iov_count : SEND_GATHER_MAX_PIECES;
+        memcpy(remaining, iov, (size_t)count * sizeof(struct iovec));
+        iov += count;
+        iov_count -= count;
+
+        struct iovec* next = remaining;
+        while (count > 0) {
+            struct msghdr message = {0};
+            message.msg_iov = next;
+            message.msg_iovlen = (size_t)count;
+            ssize_t sent = sendmsg(client_fd, &message, iov_count > 0 ? flags | MSG_MORE : flags);
+            if (sent < 0 && errno == EINTR) {
+                continue;
+            }
+            if (sent < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+                if (capture) {
+                    return capture_appendv(capture, next, count) == 0 ? capture_appendv(capture, iov, iov_count) : -1;
+                }
+                if (wait_writable(client_fd) == 0) {
+                    continue;
+                }
+                return -1;
+            }
+            if (sent <= 0) {
+                if (sent == 0) {
+                    fprintf(stderr, "Connection closed while sending\n");
+                } else {
+                    perror("Failed to send data");
+                }
+                return -1;
+            }
+
+            size_t done = (size_t)sent;
+            while (count > 0 && done >= next->iov_len) {
+                done -= next->iov_len;
+                next++;
+                count--;
+            }
+            if (count > 0) {
+                next->iov_base = (uint8_t*)next->iov_base + done;
+                next->iov_len -= done;
+            }
+        }
+    }
+    return 0;
+}
+
+void send_gather_init(SendGather* gather, int client_fd, size_t flush_bytes) {
+    memset(gather, 0, sizeof(*gather));
+    gather->client_fd = client_fd;
+    gather->flush_bytes = flush_bytes;
+}
+
+int send_gather_append(SendGather* gather, const void* data, size_t size) {
+    if (size == 0) {
+        return 0;
+    }
+
+    SendPiece* last = gather->piece_count > 0 ? &gather->pieces[gather->piece_count - 1] : NULL;
+    int copied = size <= SEND_GATHER_COPY_LIMIT;
+    int extends = copied && last && !last->data && last->offset + last->size == gather->copy_size;
+    if (!extends && gather->piece_count == SEND_GATHER_MAX_PIECES) {
+        if (send_gather_flush(gather, 1) != 0) {
+            return -1;
+        }
+        last = NULL;
+    }
+
+    if (!copied) {
+        SendPiece* piece = &gather->pieces[gather->piece_count++];
+        piece->data = (const uint8_t*)data;
+        piece->offset = 0;
+        piece->size = size;
+        gather->referenced = 1;
+        gather->pending += size;
+        return 0;
+    }
+
+    if (gather->copy_size + size > gather->copy_capacity) {
+        size_t capacity = gather->copy_capacity ? gather->copy_capacity : SEND_CAPTURE_INITIAL_SIZE;
+        while (capacity < gather->copy_size + size) {
+            capacity *= 2;
+        }
+
+        uint8_t* grown = (uint8_t*)realloc(gather->copy, capacity);
+        if (!grown) {
+            return -1;
+        }
+        gather->copy = grown;
+        gather->copy_capacity = capacity;
+    }
+
+    memcpy(gather->copy + gather->copy_size, data, size);
+    if (last && !last->data && last->offset + last->size == gather->copy_size) {
+        last->size += size;
+    } else {
+        SendPiece* piece = &gather->pieces[gather->piece_count++];
+        piece->data = NULL;
+        piece->offset = gather->copy_size;
+        piece->size = size;
+    }
+    gather->copy_size += size;
+    gather->pending += size;
+    return 0;
+}
+
+int send_gather_end_message(SendGather* gather) {
+    if (gather->referenced || gather->pending >= gather->flush_bytes) {
+        return send_gather_flush(gather, 0);
+    }
+    return 0;
+}
+
+int send_gather_flush(SendGather* gather, int more) {
+    if (gather->piece_count == 0) {
+        return 0;
+    }
+
+    // The copy buffer only moves while appending, so it is resolved here.
+    struct iovec iov[SEND_GATHER_MAX_PIECES];
+    for (int i = 0; i < gather->piece_count; i++) {
+        const SendPiece* piece = &gather->pieces[i];
+        iov[i].iov_base = (void*)(piece->data ? piece->data : gather->copy + piece->offset);
+        iov[i].iov_len = piece->size;
+    }
+
+    int result = send_allv(gather->client_fd, iov, gather->piece_count, more);
+
+    gather->piece_count = 0;
+    gather->referenced = 0;
+    gather->pending = 0;
+    gather->copy_size = 0;
+    if (gather->copy_capacity > SEND_GATHER_KEEP_SIZE) {
+        free(gather->copy);
+        gather->copy = NULL;
+        gather->copy_capacity = 0;
+    }
+    return result;
+}
+
+void send_gather_free(SendGather* gather) {
+    free(gather->copy);
+    gather->copy = NULL;
+    gather->copy_capacity = 0;
+    gather->piece_count = 0;
+    gather->pending = 0;
+}
+
+int send_set_cork(int client_fd, int corked) {
+    SendCapture* capture = capture_for(client_fd);
+    if (capture && !capture->spill) {
+        return 0;
+    }
+    return setsockopt(client_fd, IPPROTO_TCP, TCP_CORK, &corked, sizeof(corked));
+}
+
+int send_set_nodelay(int client_fd, int nodelay) {
+    return setsockopt(client_fd, IPPROTO_TCP, TCP_NODELAY, &nodelay, sizeof(nodelay));
+}
+
+// For file systems sendfile() does not support.
+static int send_file_copy(int client_fd, int file_fd, size_t offset, size_t size) {
+    uint8_t* buffer = (uint8_t*)malloc(size < SEND_FILE_COPY_SIZE ? size : SEND_FILE_COPY_SIZE);
+    if (!buffer) {
+        return -1;
+    }
+
+    int result = 0;
+    while (size > 0 && result == 0) {
+        size_t step = size < SEND_FILE_COPY_SIZE ? size : SEND_FILE_COPY_SIZE;
+        result = read_file_range(file_fd, buffer, offset, step);
+        if (result == 0) {
+            result = send_all(client_fd, buffer, step);
+        }
+        offset += step;
+        size -= step;
+    }
+
+    free(buffer);
+    return result;
+}
+
+static int capture_file_range(SendCapture* capture, int file_fd, size_t offset, size_t size) {
+    if (size == 0) {
+        return 0;
+    }
+
+    if (capture->file_size == 0) {
+        int queued_fd = fcntl(file_fd, F_DUPFD_CLOEXEC, 0);
+        if (queued_fd >= 0) {
+            capture_rewind(capture);
+            capture->file_fd = queued_fd;
+            capture->file_at = capture->size;
+            capture->file_offset = offset;
+            capture->file_size = size;
+            return 0;
+        }
+    }
+
+    // Only one range is queued by descriptor; another behind it is copied.
+    if (capture_reserve(capture, size) != 0 ||
+        read_file_range(file_fd, capture->data + capture->size, offset, size) != 0) {
+        return -1;
+    }
+    capture->size += size;
+    return 0;
+}
+
+int send_file_range(int client_fd, int file_fd, size_t offset, size_t size) {
+    SendCapture* capture = capture_for(client_fd);
+    if (capture && capture_holds(capture)) {
+        return capture_file_range(capture, file_fd, offset, size);
+    }
+
+    off_t position = (off_t)offset;
+    size_t remaining = size;
+    while (remaining > 0) {
+        ssize_t sent = sendfile(client_fd, file_fd, &position, remaining);
+        if (sent > 0) {
+            remaining -= (size_t)sent;
+            continue;
+        }
+
+        if (sent < 0 && errno == EINTR) {
+            continue;
+        }
+
+        if (sent < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            if (capture) {
+                return capture_file_range(capture, file_fd, (size_t)position, remaining);
+            }
+            if (wait_writable(client_fd) == 0) {
+                continue;
+            }
+            return -1;
+        }
+
+        if (sent < 0 && (errno == EINVAL || errno == ENOSYS) && remaining == size) {
+            return send_file_copy(client_fd, file_fd, offset, size);
+        }
+
+        if (sent == 0) {
+            fprintf(stderr, "Log ended before the requested range\n");
+        } else {
+            perror("Failed to send file range");
+        }
+        return -1;
+    }
+    return 0;
+}
+
+// Writes out all a capture holds, waiting for the socket as needed. Called
+// with the capture inactive.
+static int capture_write_out(SendCapture* capture) {
+    int result = 0;
+    if (capture->file_size > 0) {
+        result = send_all(capture->client_fd, capture->data + capture->head, capture->file_at - capture->head);
+        if (result == 0) {
+            capture->head = capture->file_at;
+            result = send_file_range(capture->client_fd, capture->file_fd, capture->file_offset, capture->file_size);
+        }
+        send_capture_clear_file(capture);
+    }
+    if (result == 0) {
+        result = send_all(capture->client_fd, capture->data + capture->head, capture->size - capture->head);
+    }
+    if (result == 0) {
+        capture->head = 0;
+        capture->size = 0;
+    }
+    return result;
+}
+
+int send_with_fd(int client_fd, const void* data, size_t data_size, int file_fd) {
+    if (!data || data_size == 0 || file_fd < 0) {
+        return -1;
+    }
+
+    SendCapture* capture = capture_for(client_fd);
+    if (capture) {
+        active_capture = NULL;
+        int result = capture_write_out(capture);
+        if (result == 0) {
+            result = send_with_fd(client_fd, data, data_size, file_fd);
+        }
+        active_capture = capture;
+        return result;
+    }
+
+    union {
+        struct cmsghdr header;
+        char space[CMSG_SPACE(sizeof(int))];
+    } control;
+    memset(&control, 0, sizeof(control));
+
+    struct iovec iov = { .iov_base = (void*)data, .iov_len = data_size };
+    struct msghdr message = {0};
+    message.msg_iov = &iov;
+    message.msg_iovlen = 1;
+    message.msg_control = control.space;
+    message.msg_controllen = sizeof(control.space);
+
+    struct cmsghdr* rights = CMSG_FIRSTHDR(&message);
+    rights->cmsg_level = SOL_SOCKET;
+    rights->cmsg_type = SCM_RIGHTS;
+    rights->cmsg_len = CMSG_LEN(sizeof(int));
+    memcpy(CMSG_DATA(rights), &file_fd, sizeof(int));
+
+    for (;;) {
+        ssize_t sent = sendmsg(client_fd, &message, MSG_NOSIGNAL);
+        if (sent > 0) {
+            // The descriptor went with the first byte; the rest is plain data.
+            return send_all(client_fd, (const uint8_t*)data + sent, data_size - (size_t)sent);
+        }
+
+        if (sent < 0 && errno == EINTR) {
+            continue;
+        }
+
+        if (sent < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            if (wait_writable(client_fd) == 0) {
+                continue;
+            }
+            return -1;
+        }
+
+        perror("Failed to pass file descriptor");
+        return -1;
+    }
+}
+
+int send_backlogged(int client_fd) {
+    SendCapture* capture = capture_for(client_fd);
+    return capture && (capture->file_size != 0 ||
+                       (capture->limit && send_capture_pending(capture) >= capture->limit));
+}
+
+int send_writable(int client_fd) {
+    // A spilling capture takes what the socket will not, up to its limit.
+    if (capture_for(client_fd)) {
+        return !send_backlogged(client_fd);
+    }
+
+    struct pollfd writable = { .fd = client_fd, .events = POLLOUT };
+    return poll(&writable, 1, 0) > 0 && (writable.revents & POLLOUT);
+}
 
 int send_msg(int client_fd, const char *message) {
     if (client_fd < 0) {
@@ -9,13 +613,11 @@ int send_msg(int client_fd, const char *message) {
         return -1;
     }
 
-    ssize_t sent_bytes = send(client_fd, message, strlen(message), 0);
-    
-    if (sent_bytes < 0) {
+    if (send_all(client_fd, message, strlen(message)) != 0) {
         perror("Send failed");
         return -1;
     }
 
     printf("Message sent: %s\n", message);
     return 0;
-}
\ No newline at end of file
+}
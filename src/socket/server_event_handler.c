@@ -1,39 +1,93 @@
 #include "headers/server_event_handler.h"
 #include "headers/consumer_handler.h"
+#include "headers/binary_protocol.h"
 #include "send_message.h"
 #include "../../messaging/headers/consume_packet.h"
 #include "../../messaging/headers/ack_packet.h"
 #include "../../messaging/headers/create_topic.h"
+#include "../../messaging/headers/table_view.h"
+#include "../../messaging/headers/record_format.h"
+#include "../../messaging/headers/codec.h"
 #include "../../writer/headers/read_write_data.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <time.h>
 #include <sys/socket.h>
 
 #define BUFFER_SIZE 4096
+#define COMMAND_WOULD_BLOCK -2
 #define COMMAND_CONSUME "CONSUME"
+#define COMMAND_CONSUME_BATCH "CONSUME_BATCH"
+#define COMMAND_FETCH "FETCH"
 #define COMMAND_ACK "ACK"
 #define COMMAND_SET_GROUP "SET_GROUP"
 #define COMMAND_SET_TOPIC "SET_TOPIC"
+#define COMMAND_SET_FILTER "SET_FILTER"
+#define COMMAND_GET "GET"
+#define COMMAND_SET_CODECS "SET_CODECS"
+#define COMMAND_SET_OPTION "SET_OPTION"
 #define DEFAULT_TOPIC_BASE_PATH "./topics"
-
-static int read_command(int client_fd, char* buffer, size_t buffer_size) {
-    if (client_fd < 0 || !buffer || buffer_size == 0) {
+#define DEFAULT_BATCH_RECORDS 100
+#define MAX_BATCH_RECORDS 10000
+#define MAX_BATCH_BYTES (4 * 1024 * 1024)
+
+static ConnectionLimits limits = {
+    DEFAULT_OUTPUT_HIGH_WATERMARK,
+    DEFAULT_OUTPUT_LOW_WATERMARK,
+    DEFAULT_IDLE_TIMEOUT_MS,
+    DEFAULT_STALL_TIMEOUT_MS,
+};
+
+int connection_limits_set(const ConnectionLimits* new_limits) {
+    if (!new_limits || new_limits->output_low_watermark == 0 ||
+        new_limits->output_low_watermark > new_limits->output_high_watermark) {
         return -1;
     }
 
-    ssize_t bytes_read = recv(client_fd, buffer, buffer_size - 1, 0);
+    limits = *new_limits;
+    send_set_stall_timeout(limits.stall_timeout_ms);
+    return 0;
+}
+
+const ConnectionLimits* connection_limits(void) {
+    return &limits;
+}
+
+uint64_t connection_clock_ms(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000 + (uint64_t)now.tv_nsec / 1000000;
+}
+
+static int receive_bytes(int client_fd, void* buffer, size_t size) {
+    ssize_t bytes_read = recv(client_fd, buffer, size, 0);
     if (bytes_read < 0) {
+        if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) {
+            return COMMAND_WOULD_BLOCK;
+        }
         perror("Failed to read command");
         return -1;
     }
-    if (bytes_read == 0) {
-        return 0;
+    return (int)bytes_read;
+}
+
+static int read_command(int client_fd, char* buffer, size_t buffer_size) {
+    if (client_fd < 0 || !buffer || buffer_size == 0) {
+        return -1;
+    }
+
+    int bytes_read = receive_bytes(client_fd, buffer, buffer_size - 1);
+    if (bytes_read <= 0) {
+        return bytes_read;
     }
 
     buffer[bytes_read] = '\0';
-    return (int)bytes_read;
+    return bytes_read;
 }
 
 static char* extract_json_value(const char* json, const char* key) {
@@ -95,28 +149,25 @@ int handle_consume_command(int client_fd, ClientSession* session) {
 
     if (!session->group || !session->topic) {
         const char* error = "{\"error\":\"Group or topic not set. Use SET_GROUP and SET_TOPIC commands first\"}\n";
-        send(client_fd, error, strlen(error), 0);
+        send_all(client_fd, error, strlen(error));
         return -1;
     }
 
     if (!group_has_more_data(session->group)) {
         const char* response = "{\"status\":\"no_data\",\"message\":\"No more data available\"}\n";
-        send(client_fd, response, strlen(response), 0);
+        send_all(client_fd, response, strlen(response));
         return 0;
     }
 
-    Packet* packet = consume_packet(session->group, session->topic);
+    Packet* packet = consume_packet_filtered(session->group, session->topic, session->filter);
     if (!packet) {
         const char* response = "{\"status\":\"no_packet\",\"message\":\"No packet available\"}\n";
-        send(client_fd, response, strlen(response), 0);
+        send_all(client_fd, response, strlen(response));
         return 0;
     }
 
-    int result = send_packet_to_consumer(client_fd, packet->data, packet->data_size);
-    
-    if (result == 0) {
-        printf("Sent packet to client (size: %zu bytes)\n", packet->data_size);
-    } else {
+    int result = send_packet_for_consumer(client_fd, packet, session->topic, session->accepted_codecs);
+    if (result != 0) {
         fprintf(stderr, "Failed to send packet to client\n");
     }
 
@@ -124,6 +175,306 @@ int handle_consume_command(int client_fd, ClientSession* session) {
     return result;
 }
 
+// Sends a {"status":"batch","count":N} line followed by N packets. The batch
+// arena stays with the session, so catching up allocates nothing per call.
+int handle_consume_batch_command(int client_fd, ClientSession* session, const char* count) {
+    if (client_fd < 0 || !session || !count) {
+        return -1;
+    }
+
+    if (!session->group || !session->topic) {
+        const char* error = "{\"error\":\"Group or topic not set. Use SET_GROUP and SET_TOPIC commands first\"}\n";
+        send_all(client_fd, error, strlen(error));
+        return -1;
+    }
+
+    long max_records = strtol(count, NULL, 10);
+    if (max_records <= 0) {
+        max_records = DEFAULT_BATCH_RECORDS;
+    } else if (max_records > MAX_BATCH_RECORDS) {
+        max_records = MAX_BATCH_RECORDS;
+    }
+
+    if (!session->batch) {
+        session->batch = record_batch_create();
+        if (!session->batch) {
+            return -1;
+        }
+    }
+
+    int records = consume_batch(session->group, session->topic, session->filter, (size_t)max_records,
+                                MAX_BATCH_BYTES, session->accepted_codecs, session->batch);
+    if (records < 0) {
+        const char* error = "{\"error\":\"Failed to read batch\"}\n";
+        send_all(client_fd, error, strlen(error));
+        return -1;
+    }
+
+    if (records == 0) {
+        const char* response = "{\"status\":\"no_data\",\"message\":\"No more data available\"}\n";
+        send_all(client_fd, response, strlen(response));
+        return 0;
+    }
+
+    char response[64];
+    int response_len = snprintf(response, sizeof(response), "{\"status\":\"batch\",\"count\":%d}\n", records);
+    int result = send_gather_append(&session->output, response, (size_t)response_len);
+    if (result == 0) {
+        result = send_batch_to_consumer(&session->output, session->batch->records, session->batch->count);
+    }
+    record_batch_release(session->batch);
+    return result;
+}
+
+// Sends a {"status":"range",...} line followed by that many bytes of the
+// topic file, whole records in their stored form for the client to split.
+// The group moves past them without an ACK.
+int handle_fetch_command(int client_fd, ClientSession* session, const char* max_bytes) {
+    if (client_fd < 0 || !session || !max_bytes) {
+        return -1;
+    }
+
+    if (!session->group || !session->topic) {
+        const char* error = "{\"error\":\"Group or topic not set. Use SET_GROUP and SET_TOPIC commands first\"}\n";
+        send_all(client_fd, error, strlen(error));
+        return -1;
+    }
+
+    long limit = strtol(max_bytes, NULL, 10);
+    if (limit <= 0) {
+        limit = DEFAULT_FETCH_BYTES;
+    } else if (limit > MAX_FETCH_BYTES) {
+        limit = MAX_FETCH_BYTES;
+    }
+
+    LogRange range;
+    int records = consume_range(session->group, session->topic, (size_t)limit, &range);
+    if (records < 0) {
+        const char* error = "{\"error\":\"Failed to read range\"}\n";
+        send_all(client_fd, error, strlen(error));
+        return -1;
+    }
+
+    if (records == 0) {
+        const char* response = "{\"status\":\"no_data\",\"message\":\"No more data available\"}\n";
+        send_all(client_fd, response, strlen(response));
+        return 0;
+    }
+
+    char response[128];
+    int response_len = snprintf(response, sizeof(response),
+                                "{\"status\":\"range\",\"offset\":%zu,\"bytes\":%zu,\"count\":%d}\n", range.offset,
+                                range.size, records);
+    if (send_all(client_fd, response, (size_t)response_len) != 0) {
+        return -1;
+    }
+    return send_file_range(client_fd, range.fd, range.offset, range.size);
+}
+
+int client_session_set_option(ClientSession* session, int option, uint32_t value) {
+    if (!session) {
+        return -1;
+    }
+
+    // The TCP options mean nothing on a unix socket, which sends every
+    // write at once; they are accepted there so clients need not care.
+    switch (option) {
+    case SESSION_OPTION_NODELAY:
+        return session->local ? 0 : send_set_nodelay(session->client_fd, value != 0);
+    case SESSION_OPTION_CORK:
+        session->cork = !session->local && value != 0;
+        return 0;
+    case SESSION_OPTION_BATCH_BYTES:
+        session->output.flush_bytes = value < MAX_OUTPUT_BATCH_BYTES ? value : MAX_OUTPUT_BATCH_BYTES;
+        return 0;
+    default:
+        return -1;
+    }
+}
+
+// SET_OPTION nodelay|cork|batch_bytes <value>
+int handle_set_option_command(int client_fd, ClientSession* session, const char* option) {
+    if (client_fd < 0 || !session || !option) {
+        return -1;
+    }
+
+    static const struct {
+        const char* name;
+        int option;
+    } options[] = {
+        { "nodelay", SESSION_OPTION_NODELAY },
+        { "cork", SESSION_OPTION_CORK },
+        { "batch_bytes", SESSION_OPTION_BATCH_BYTES },
+    };
+
+    while (*option == ' ' || *option == '\t') {
+        option++;
+    }
+
+    int id = 0;
+    const char* value = option;
+    for (size_t i = 0; i < sizeof(options) / sizeof(options[0]); i++) {
+        size_t name_len = strlen(options[i].name);
+        if (strncmp(option, options[i].name, name_len) == 0 &&
+            (option[name_len] == ' ' || option[name_len] == '\t')) {
+            id = options[i].option;
+            value = option + name_len;
+            break;
+        }
+    }
+
+    char* end = NULL;
+    long number = strtol(value, &end, 10);
+    if (id == 0 || end == value || number < 0 || client_session_set_option(session, id, (uint32_t)number) != 0) {
+        const char* error = "{\"error\":\"Expected nodelay, cork or batch_bytes and a value\"}\n";
+        send_all(client_fd, error, strlen(error));
+        return -1;
+    }
+
+    const char* response = "{\"status\":\"success\",\"message\":\"Option set\"}\n";
+    send_all(client_fd, response, strlen(response));
+    return 0;
+}
+
+int handle_set_filter_command(int client_fd, ClientSession* session, const char* expression) {
+    if (client_fd < 0 || !session || !expression) {
+        return -1;
+    }
+
+    while (*expression && (*expression == ' ' || *expression == '\t')) {
+        expression++;
+    }
+
+    size_t expression_len = strlen(expression);
+    while (expression_len > 0 && (expression[expression_len - 1] == '\n' || expression[expression_len - 1] == '\r' ||
+                                  expression[expression_len - 1] == ' ' || expression[expression_len - 1] == '\t')) {
+        expression_len--;
+    }
+
+    if (expression_len == 0) {
+        record_filter_free(session->filter);
+        session->filter = NULL;
+        const char* response = "{\"status\":\"success\",\"message\":\"Filter cleared\"}\n";
+        send_all(client_fd, response, strlen(response));
+        return 0;
+    }
+
+    char* expression_copy = strndup(expression, expression_len);
+    if (!expression_copy) {
+        return -1;
+    }
+
+    RecordFilter* filter = record_filter_compile(expression_copy);
+    free(expression_copy);
+
+    if (!filter) {
+        const char* error = "{\"error\":\"Invalid filter. Use equals:, prefix:, contains: or json:field=value joined by &&\"}\n";
+        send_all(client_fd, error, strlen(error));
+        return -1;
+    }
+
+    record_filter_free(session->filter);
+    session->filter = filter;
+
+    const char* response = "{\"status\":\"success\",\"message\":\"Filter set\"}\n";
+    send_all(client_fd, response, strlen(response));
+    return 0;
+}
+
+int handle_set_codecs_command(int client_fd, ClientSession* session, const char* codecs) {
+    if (client_fd < 0 || !session || !codecs) {
+        return -1;
+    }
+
+    unsigned accepted = 0;
+    const char* cursor = codecs;
+
+    while (*cursor) {
+        while (*cursor == ' ' || *cursor == '\t' || *cursor == ',' || *cursor == '\n' || *cursor == '\r') {
+            cursor++;
+        }
+        if (!*cursor) {
+            break;
+        }
+
+        char name[16];
+        size_t name_len = strcspn(cursor, " \t,\r\n");
+        const Codec* codec = NULL;
+        if (name_len < sizeof(name)) {
+            memcpy(name, cursor, name_len);
+            name[name_len] = '\0';
+            codec = codec_by_name(name);
+        }
+
+        if (!codec) {
+            const char* error = "{\"error\":\"Unknown codec. Supported codecs: zstd, lz4, none\"}\n";
+            send_all(client_fd, error, strlen(error));
+            return -1;
+        }
+        // Columnar records need the topic's shapes, so they are always
+        // delivered as JSON.
+        if (codec->id != RECORD_CODEC_NONE && codec->id != RECORD_CODEC_COLUMNAR) {
+            accepted |= RECORD_CODEC_BIT(codec->id);
+        }
+        cursor += name_len;
+    }
+
+    session->accepted_codecs = accepted;
+
+    const char* response = "{\"status\":\"success\",\"message\":\"Codecs set\"}\n";
+    send_all(client_fd, response, strlen(response));
+    return 0;
+}
+
+int handle_get_command(int client_fd, ClientSession* session, const char* key) {
+    if (client_fd < 0 || !session || !key) {
+        return -1;
+    }
+
+    if (!session->topic) {
+        const char* error = "{\"error\":\"Topic not set. Use SET_TOPIC command first\"}\n";
+        send_all(client_fd, error, strlen(error));
+        return -1;
+    }
+
+    TableView* view = table_view_find(session->topic->file_path);
+    if (!view) {
+        const char* error = "{\"error\":\"Topic has no table view\"}\n";
+        send_all(client_fd, error, strlen(error));
+        return -1;
+    }
+
+    while (*key && (*key == ' ' || *key == '\t')) {
+        key++;
+    }
+
+    size_t key_len = strlen(key);
+    while (key_len > 0 && (key[key_len - 1] == '\n' || key[key_len - 1] == '\r' ||
+                           key[key_len - 1] == ' ' || key[key_len - 1] == '\t')) {
+        key_len--;
+    }
+
+    uint8_t* value = NULL;
+    size_t value_size = 0;
+    int result = table_view_get(view, key, key_len, &value, &value_size);
+
+    if (result == TABLE_VIEW_NOT_FOUND) {
+        const char* response = "{\"status\":\"no_key\",\"message\":\"Key not found\"}\n";
+        send_all(client_fd, response, strlen(response));
+        return 0;
+    }
+
+    if (result != 0) {
+        const char* error = "{\"error\":\"Failed to read table view\"}\n";
+        send_all(client_fd, error, strlen(error));
+        return -1;
+    }
+
+    result = send_packet_to_consumer(client_fd, value, value_size);
+    free(value);
+    return result;
+}
+
 int handle_ack_command(int client_fd, ClientSession* session, const char* command_data) {
     if (client_fd < 0 || !session) {
         return -1;
@@ -131,7 +482,7 @@ int handle_ack_command(int client_fd, ClientSession* session, const char* comman
 
     if (!session->group || !session->topic) {
         const char* error = "{\"error\":\"Group or topic not set\"}\n";
-        send(client_fd, error, strlen(error), 0);
+        send_all(client_fd, error, strlen(error));
         return -1;
     }
 
@@ -143,8 +494,7 @@ int handle_ack_command(int client_fd, ClientSession* session, const char* comman
             
             if (ack_packet_by_size(session->group, session->topic, packet_size) == 0) {
                 const char* response = "{\"status\":\"success\",\"message\":\"Packet acknowledged\"}\n";
-                send(client_fd, response, strlen(response), 0);
-                printf("Packet acknowledged by client (size: %zu)\n", packet_size);
+                send_all(client_fd, response, strlen(response));
                 return 0;
             }
         }
@@ -152,23 +502,95 @@ int handle_ack_command(int client_fd, ClientSession* session, const char* comman
 
     if (ack_packet_batch(session->group, session->topic, 1) == 0) {
         const char* response = "{\"status\":\"success\",\"message\":\"Packet acknowledged\"}\n";
-        send(client_fd, response, strlen(response), 0);
-        printf("Packet acknowledged by client\n");
+        send_all(client_fd, response, strlen(response));
         return 0;
     }
 
     const char* error = "{\"error\":\"Failed to acknowledge packet\"}\n";
-    send(client_fd, error, strlen(error), 0);
+    send_all(client_fd, error, strlen(error));
     return -1;
 }
 
+int client_session_set_group(ClientSession* session, const char* group_name) {
+    if (!session) {
+        return -1;
+    }
+
+    if (session->group_id) {
+        free(session->group_id);
+        session->group_id = NULL;
+    }
+    if (!group_name) {
+        if (session->group) {
+            group_free(session->group);
+            session->group = NULL;
+        }
+        return 0;
+    }
+    session->group_id = strdup(group_name);
+
+    if (session->topic) {
+        if (session->group) {
+            group_free(session->group);
+        }
+        session->group = create_group(session->group_id, session->topic);
+    }
+    return session->group_id ? 0 : -1;
+}
+
+int client_session_set_topic(ClientSession* session, const char* topic_name) {
+    if (!session || !topic_name) {
+        return -1;
+    }
+
+    if (session->topic_name) {
+        free(session->topic_name);
+    }
+    session->topic_name = strdup(topic_name);
+    if (!session->topic_name) {
+        return -1;
+    }
+
+    if (topic_exists(session->topic_name, DEFAULT_TOPIC_BASE_PATH)) {
+        if (session->topic) {
+            topic_free(session->topic);
+        }
+
+        session->topic = (Topic*)malloc(sizeof(Topic));
+        if (session->topic) {
+            session->topic->topic_name = strdup(session->topic_name);
+            char file_path[512];
+            snprintf(file_path, sizeof(file_path), "%s/%s.topic", DEFAULT_TOPIC_BASE_PATH, session->topic_name);
+            session->topic->file_path = strdup(file_path);
+            session->topic->chunk_handle = chunk_init(file_path);
+            if (session->topic->chunk_handle) {
+                chunk_load(session->topic->chunk_handle);
+            }
+        }
+    } else {
+        session->topic = create_topic(session->topic_name, DEFAULT_TOPIC_BASE_PATH);
+    }
+
+    if (session->topic && session->group_id) {
+        if (session->group) {
+            group_free(session->group);
+        }
+        session->group = create_group(session->group_id, session->topic);
+    }
+    return session->topic ? 0 : -1;
+}
+
 int process_client_command(int client_fd, ClientSession* session, const char* command) {
     if (client_fd < 0 || !session || !command) {
         return -1;
     }
 
-    if (strncmp(command, COMMAND_CONSUME, strlen(COMMAND_CONSUME)) == 0) {
+    if (strncmp(command, COMMAND_CONSUME_BATCH, strlen(COMMAND_CONSUME_BATCH)) == 0) {
+        return handle_consume_batch_command(client_fd, session, command + strlen(COMMAND_CONSUME_BATCH));
+    } else if (strncmp(command, COMMAND_CONSUME, strlen(COMMAND_CONSUME)) == 0) {
         return handle_consume_command(client_fd, session);
+    } else if (strncmp(command, COMMAND_FETCH, strlen(COMMAND_FETCH)) == 0) {
+        return handle_fetch_command(client_fd, session, command + strlen(COMMAND_FETCH));
     } else if (strncmp(command, COMMAND_ACK, strlen(COMMAND_ACK)) == 0) {
         const char* ack_data = strchr(command, '\n');
         if (ack_data) {
@@ -185,75 +607,72 @@ int process_client_command(int client_fd, ClientSession* session, const char* co
         while (*group_name && (*group_name == ' ' || *group_name == '\t' || *group_name == '\n')) {
             group_name++;
         }
-        
-        if (session->group_id) {
-            free(session->group_id);
-        }
-        session->group_id = strdup(group_name);
-        
-        if (session->topic) {
-            if (session->group) {
-                group_free(session->group);
-            }
-            session->group = create_group(session->group_id, session->topic);
-        }
-        
+
+        client_session_set_group(session, group_name);
+
         const char* response = "{\"status\":\"success\",\"message\":\"Group set\"}\n";
-        send(client_fd, response, strlen(response), 0);
+        send_all(client_fd, response, strlen(response));
         return 0;
+    } else if (strncmp(command, COMMAND_GET, strlen(COMMAND_GET)) == 0) {
+        return handle_get_command(client_fd, session, command + strlen(COMMAND_GET));
+    } else if (strncmp(command, COMMAND_SET_CODECS, strlen(COMMAND_SET_CODECS)) == 0) {
+        return handle_set_codecs_command(client_fd, session, command + strlen(COMMAND_SET_CODECS));
+    } else if (strncmp(command, COMMAND_SET_OPTION, strlen(COMMAND_SET_OPTION)) == 0) {
+        return handle_set_option_command(client_fd, session, command + strlen(COMMAND_SET_OPTION));
+    } else if (strncmp(command, COMMAND_SET_FILTER, strlen(COMMAND_SET_FILTER)) == 0) {
+        return handle_set_filter_command(client_fd, session, command + strlen(COMMAND_SET_FILTER));
     } else if (strncmp(command, COMMAND_SET_TOPIC, strlen(COMMAND_SET_TOPIC)) == 0) {
         const char* topic_name = command + strlen(COMMAND_SET_TOPIC);
         while (*topic_name && (*topic_name == ' ' || *topic_name == '\t' || *topic_name == '\n')) {
             topic_name++;
         }
-        
-        if (session->topic_name) {
-            free(session->topic_name);
-        }
-        session->topic_name = strdup(topic_name);
-        
-        if (topic_exists(session->topic_name, DEFAULT_TOPIC_BASE_PATH)) {
-            if (session->topic) {
-                topic_free(session->topic);
-            }
-            
-            session->topic = (Topic*)malloc(sizeof(Topic));
-            if (session->topic) {
-                session->topic->topic_name = strdup(session->topic_name);
-                char file_path[512];
-                snprintf(file_path, sizeof(file_path), "%s/%s.topic", DEFAULT_TOPIC_BASE_PATH, session->topic_name);
-                session->topic->file_path = strdup(file_path);
-                session->topic->chunk_handle = chunk_init(file_path);
-                if (session->topic->chunk_handle) {
-                    chunk_load(session->topic->chunk_handle);
-                }
-            }
-        } else {
-            session->topic = create_topic(session->topic_name, DEFAULT_TOPIC_BASE_PATH);
-        }
-        
-        if (session->topic && session->group_id) {
-            if (session->group) {
-                group_free(session->group);
-            }
-            session->group = create_group(session->group_id, session->topic);
-        }
-        
+
+        client_session_set_topic(session, topic_name);
+
         const char* response = "{\"status\":\"success\",\"message\":\"Topic set\"}\n";
-        send(client_fd, response, strlen(response), 0);
+        send_all(client_fd, response, strlen(response));
         return 0;
     } else {
         const char* error = "{\"error\":\"Unknown command\"}\n";
-        send(client_fd, error, strlen(error), 0);
+        send_all(client_fd, error, strlen(error));
         return -1;
     }
 }
 
+int client_session_push(ClientSession* session) {
+    if (!session || session->protocol != SESSION_PROTOCOL_BINARY) {
+        return 0;
+    }
+    return binary_session_push(session);
+}
+
+void client_session_set_waker(ClientSession* session, void (*wake)(void* context), void* context) {
+    if (!session) {
+        return;
+    }
+    session->wake = wake;
+    session->wake_context = context;
+}
+
+void client_session_close_ring(ClientSession* session, uint32_t reason) {
+    if (!session || !session->ring) {
+        return;
+    }
+
+    shm_ring_close(session->ring, reason);
+    shm_ring_unmap(session->ring);
+    free(session->ring);
+    session->ring = NULL;
+}
+
 void client_session_free(ClientSession* session) {
     if (!session) {
         return;
     }
 
+    topic_watch_remove(session->watch);
+    client_session_close_ring(session, SHM_RING_CLOSED);
+
     if (session->group) {
         group_free(session->group);
     }
@@ -270,57 +689,180 @@ void client_session_free(ClientSession* session) {
         free(session->topic_name);
     }
 
+    if (session->filter) {
+        record_filter_free(session->filter);
+    }
+
+    record_batch_free(session->batch);
+    byte_ring_free(&session->input);
+    send_gather_free(&session->output);
+
     free(session);
 }
 
-int handle_client_session(int client_fd, GroupManager* group_manager, const char* default_topic_base_path) {
+ClientSession* client_session_create(int client_fd) {
     if (client_fd < 0) {
-        return -1;
+        return NULL;
     }
 
     ClientSession* session = (ClientSession*)calloc(1, sizeof(ClientSession));
     if (!session) {
-        return -1;
+        return NULL;
     }
 
     session->client_fd = client_fd;
-    (void)group_manager;
-    (void)default_topic_base_path;
+    send_gather_init(&session->output, client_fd, SEND_GATHER_DEFAULT_FLUSH);
 
-    char buffer[BUFFER_SIZE];
-    int keep_alive = 1;
+    struct sockaddr_storage address;
+    socklen_t address_size = sizeof(address);
+    session->local = getsockname(client_fd, (struct sockaddr*)&address, &address_size) == 0 &&
+                     address.ss_family == AF_UNIX;
 
-    printf("Client session started (fd: %d)\n", client_fd);
+    // Replies are gathered into whole writes, so Nagle would only delay
+    // them. Unix sockets never hold data back to begin with.
+    if (!session->local) {
+        send_set_nodelay(client_fd, 1);
+    }
+    return session;
+}
 
-    while (keep_alive) {
-        int bytes_read = read_command(client_fd, buffer, BUFFER_SIZE);
-        
-        if (bytes_read <= 0) {
-            printf("Client disconnected or read error\n");
-            break;
+int client_session_run(ClientSession* session, char* buffer, size_t size) {
+    if (!session || !buffer) {
+        return -1;
+    }
+
+    int client_fd = session->client_fd;
+    buffer[size] = '\0';
+
+    char* command = buffer;
+    while (*command && (*command == ' ' || *command == '\t' || *command == '\n' || *command == '\r')) {
+        command++;
+    }
+
+    if (strlen(command) == 0) {
+        return 1;
+    }
+
+    if (strncmp(command, "QUIT", 4) == 0 || strncmp(command, "EXIT", 4) == 0) {
+        const char* response = "{\"status\":\"goodbye\"}\n";
+        send_all(client_fd, response, strlen(response));
+        return 0;
+    }
+
+    if (session->cork) {
+        send_set_cork(client_fd, 1);
+    }
+    if (process_client_command(client_fd, session, command) < 0) {
+        fprintf(stderr, "Error processing command\n");
+    }
+    if (session->cork) {
+        send_set_cork(client_fd, 0);
+    }
+    return 1;
+}
+
+int client_session_receive(ClientSession* session, char* buffer, size_t size) {
+    if (!session || !buffer) {
+        return -1;
+    }
+
+    if (session->protocol == SESSION_PROTOCOL_UNKNOWN && size > 0) {
+        session->protocol = buffer[0] == '\0' ? SESSION_PROTOCOL_BINARY : SESSION_PROTOCOL_TEXT;
+    }
+
+    if (session->protocol == SESSION_PROTOCOL_BINARY) {
+        if (byte_ring_append(&session->input, buffer, size) != 0) {
+            return -1;
         }
+        return binary_session_process(session);
+    }
+    return client_session_run(session, buffer, size);
+}
+
+int client_session_resume(ClientSession* session) {
+    if (!session || !session->input_held) {
+        return session ? 1 : -1;
+    }
+    return binary_session_process(session);
+}
+
+int client_session_input_held(const ClientSession* session) {
+    return session && session->input_held;
+}
+
+// Binary clients receive straight into their input ring; for text clients
+// one recv is one command, as they have always sent them.
+int client_session_step(ClientSession* session) {
+    if (!session) {
+        return -1;
+    }
 
-        buffer[bytes_read] = '\0';
-        
-        char* command = buffer;
-        while (*command && (*command == ' ' || *command == '\t' || *command == '\n' || *command == '\r')) {
-            command++;
+    if (session->protocol == SESSION_PROTOCOL_BINARY) {
+        // Frames already read go first; nothing more is read while they wait.
+        if (session->input_held) {
+            int result = binary_session_process(session);
+            if (result <= 0 || session->input_held) {
+                return result;
+            }
         }
 
-        if (strlen(command) == 0) {
-            continue;
+        uint8_t* region = NULL;
+        if (byte_ring_reserve(&session->input, BUFFER_SIZE) != 0) {
+            return -1;
+        }
+        size_t writable = byte_ring_writable(&session->input, &region);
+        int bytes_read = receive_bytes(session->client_fd, region, writable);
+        if (bytes_read == COMMAND_WOULD_BLOCK) {
+            return 1;
         }
+        if (bytes_read <= 0) {
+            return bytes_read;
+        }
+        byte_ring_commit(&session->input, (size_t)bytes_read);
+        return binary_session_process(session);
+    }
 
-        if (strncmp(command, "QUIT", 4) == 0 || strncmp(command, "EXIT", 4) == 0) {
-            const char* response = "{\"status\":\"goodbye\"}\n";
-            send(client_fd, response, strlen(response), 0);
-            keep_alive = 0;
+    char buffer[BUFFER_SIZE];
+    int bytes_read = read_command(session->client_fd, buffer, BUFFER_SIZE);
+
+    if (bytes_read == COMMAND_WOULD_BLOCK) {
+        return 1;
+    }
+    if (bytes_read <= 0) {
+        return bytes_read;
+    }
+
+    return client_session_receive(session, buffer, (size_t)bytes_read);
+}
+
+int handle_client_session(int client_fd, GroupManager* group_manager, const char* default_topic_base_path) {
+    (void)group_manager;
+    (void)default_topic_base_path;
+
+    ClientSession* session = client_session_create(client_fd);
+    if (!session) {
+        return -1;
+    }
+
+    printf("Client session started (fd: %d)\n", client_fd);
+
+    // Non-blocking, so a send to a client that stopped reading gives up
+    // after the stall timeout; a client that goes quiet is waited for here.
+    int flags = fcntl(client_fd, F_GETFL, 0);
+    if (flags >= 0) {
+        fcntl(client_fd, F_SETFL, flags | O_NONBLOCK);
+    }
+
+    struct pollfd readable = { .fd = client_fd, .events = POLLIN };
+    int idle_timeout = limits.idle_timeout_ms ? (int)limits.idle_timeout_ms : -1;
+    for (;;) {
+        int ready = poll(&readable, 1, idle_timeout);
+        if (ready == 0) {
+            printf("Closing idle client (fd: %d)\n", client_fd);
             break;
         }
-
-        int result = process_client_command(client_fd, session, command);
-        if (result < 0) {
-            fprintf(stderr, "Error processing command\n");
+        if ((ready < 0 && errno != EINTR) || (ready > 0 && client_session_step(session) <= 0)) {
+            break;
         }
     }
 
@@ -329,4 +871,3 @@ int handle_client_session(int client_fd, GroupManager* group_manager, const char
     close(client_fd);
     return 0;
 }
-
@@ -0,0 +1,338 @@
+#define _GNU_SOURCE // memfd_create
+#include "headers/shm_ring.h"
+#include "../../messaging/headers/record_format.h"
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#include <linux/futex.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+
+static void cpu_relax(void) {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#elif defined(__aarch64__)
+    __asm__ __volatile__("yield");
+#endif
+}
+
+static long futex(uint32_t* word, int op, uint32_t value, const struct timespec* timeout) {
+    // Not FUTEX_PRIVATE: the word is in memory shared with another process.
+    return syscall(SYS_futex, word, op, value, timeout, NULL, 0);
+}
+
+static size_t entry_size(size_t data_size) {
+    return (SHM_ENTRY_HEADER_SIZE + data_size + SHM_ENTRY_ALIGN - 1) & ~(size_t)(SHM_ENTRY_ALIGN - 1);
+}
+
+static int map_ring(ShmRing* ring, int fd, size_t map_size) {
+    void* map = mmap(NULL, map_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (map == MAP_FAILED) {
+        perror("Failed to map shared ring");
+        return -1;
+    }
+
+    ring->header = (ShmRingHeader*)map;
+    ring->data = (uint8_t*)map + SHM_RING_HEADER_SIZE;
+    ring->map_size = map_size;
+    ring->fd = fd;
+    return 0;
+}
+
+int shm_ring_create(ShmRing* ring, size_t capacity) {
+    if (!ring) {
+        return -1;
+    }
+
+    memset(ring, 0, sizeof(ShmRing));
+    ring->fd = -1;
+
+    size_t rounded = SHM_RING_MIN_CAPACITY;
+    while (rounded < capacity && rounded < SHM_RING_MAX_CAPACITY) {
+        rounded *= 2;
+    }
+
+    int fd = memfd_create("suparna-ring", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+    if (fd < 0) {
+        perror("Failed to create shared ring");
+        return -1;
+    }
+
+    // Sealed at its size, so a subscriber cannot shrink the file under the
+    // broker and fault it with SIGBUS.
+    size_t map_size = SHM_RING_HEADER_SIZE + rounded;
+    if (ftruncate(fd, (off_t)map_size) != 0 ||
+        fcntl(fd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_SEAL) != 0) {
+        perror("Failed to size shared ring");
+        close(fd);
+        return -1;
+    }
+
+    if (map_ring(ring, fd, map_size) != 0) {
+        close(fd);
+        return -1;
+    }
+
+    ring->capacity = rounded;
+    ring->header->magic = SHM_RING_MAGIC;
+    ring->header->version = SHM_RING_VERSION;
+    ring->header->capacity = rounded;
+    return 0;
+}
+
+int shm_ring_attach(ShmRing* ring, int fd) {
+    if (!ring || fd < 0) {
+        return -1;
+    }
+
+    memset(ring, 0, sizeof(ShmRing));
+    ring->fd = -1;
+
+    struct stat status;
+    if (fstat(fd, &status) != 0 || (size_t)status.st_size <= SHM_RING_HEADER_SIZE ||
+        map_ring(ring, fd, (size_t)status.st_size) != 0) {
+        close(fd);
+        return -1;
+    }
+
+    size_t capacity = (size_t)ring->header->capacity;
+    if (ring->header->magic != SHM_RING_MAGIC || ring->header->version != SHM_RING_VERSION ||
+        capacity == 0 || (capacity & (capacity - 1)) != 0 || SHM_RING_HEADER_SIZE + capacity != ring->map_size) {
+        fprintf(stderr, "Not a shared ring this client understands\n");
+        shm_ring_unmap(ring);
+        return -1;
+    }
+
+    ring->capacity = capacity;
+    ring->position = __atomic_load_n(&ring->header->read_position, __ATOMIC_ACQUIRE);
+    ring->next = ring->position;
+    return 0;
+}
+
+void shm_ring_unmap(ShmRing* ring) {
+    if (!ring) {
+        return;
+    }
+    if (ring->header) {
+        munmap(ring->header, ring->map_size);
+        ring->header = NULL;
+        ring->data = NULL;
+    }
+    if (ring->fd >= 0) {
+        close(ring->fd);
+        ring->fd = -1;
+    }
+}
+
+// Bytes the reader has not released yet. A reader writing nonsense into
+// read_position only makes the ring look full to itself.
+static size_t ring_used(const ShmRing* ring) {
+    uint64_t read_position = __atomic_load_n(&ring->header->read_position, __ATOMIC_SEQ_CST);
+    uint64_t used = ring->position - read_position;
+    return used > ring->capacity ? ring->capacity : (size_t)used;
+}
+
+// Room the next step of writing an entry of size bytes takes: the filler
+// up to the end of the data when the entry would not fit before it, else
+// the entry itself.
+static size_t space_needed(const ShmRing* ring, size_t size) {
+    size_t index = (size_t)(ring->position & (ring->capacity - 1));
+    return ring->capacity - index < size ? ring->capacity - index : size;
+}
+
+int shm_ring_write(ShmRing* ring, const ShmRecord* record) {
+    if (!ring || !ring->header || !record || record->data_size >= SHM_ENTRY_WRAP) {
+        return -1;
+    }
+
+    size_t size = entry_size(record->data_size);
+    if (size > ring->capacity) {
+        return -1;
+    }
+
+    // The filler goes in as soon as it fits on its own: the reader may be
+    // waiting on an empty ring at this very spot, and only skipping the
+    // filler moves it out of the way of the entry.
+    size_t index = (size_t)(ring->position & (ring->capacity - 1));
+    if (ring->capacity - index < size) {
+        if (ring_used(ring) + space_needed(ring, size) > ring->capacity) {
+            return 1;
+        }
+        uint32_t wrap = SHM_ENTRY_WRAP;
+        memcpy(ring->data + index, &wrap, sizeof(wrap));
+        ring->position += ring->capacity - index;
+        index = 0;
+    }
+    if (ring_used(ring) + size > ring->capacity) {
+        return 1;
+    }
+
+    uint8_t* entry = ring->data + index;
+    uint32_t data_size = (uint32_t)record->data_size;
+    memset(entry, 0, SHM_ENTRY_HEADER_SIZE);
+    memcpy(entry, &data_size, sizeof(data_size));
+    entry[4] = record->codec;
+    memcpy(entry + 8, &record->offset, sizeof(record->offset));
+    memcpy(entry + 16, &record->packet_size, sizeof(record->packet_size));
+    if (record->data_size > 0) {
+        memcpy(entry + SHM_ENTRY_HEADER_SIZE, record->data, record->data_size);
+    }
+    ring->position += size;
+    return 0;
+}
+
+// The store to write_position (or closed) before this and the reader's
+// store to reader_parked before its last look are both sequentially
+// consistent, so at least one side sees the other: either the reader does
+// not sleep or the writer wakes it.
+static void wake_reader(ShmRing* ring) {
+    ShmRingHeader* header = ring->header;
+    if (__atomic_load_n(&header->reader_parked, __ATOMIC_SEQ_CST) &&
+        __atomic_exchange_n(&header->reader_parked, 0, __ATOMIC_SEQ_CST)) {
+        futex(&header->reader_parked, FUTEX_WAKE, 1, NULL);
+    }
+}
+
+void shm_ring_commit(ShmRing* ring) {
+    if (!ring || !ring->header) {
+        return;
+    }
+    if (__atomic_load_n(&ring->header->write_position, __ATOMIC_RELAXED) == ring->position) {
+        return;
+    }
+
+    __atomic_store_n(&ring->header->write_position, ring->position, __ATOMIC_SEQ_CST);
+    wake_reader(ring);
+}
+
+int shm_ring_wait_space(ShmRing* ring, size_t data_size) {
+    if (!ring || !ring->header) {
+        return 0;
+    }
+
+    // As for reader_parked: the reader either sees the flag when it
+    // releases, or this sees what it released.
+    __atomic_store_n(&ring->header->writer_waiting, 1, __ATOMIC_SEQ_CST);
+    if (ring_used(ring) + space_needed(ring, entry_size(data_size)) <= ring->capacity) {
+        __atomic_store_n(&ring->header->writer_waiting, 0, __ATOMIC_SEQ_CST);
+        return 1;
+    }
+    return 0;
+}
+
+void shm_ring_close(ShmRing* ring, uint32_t reason) {
+    if (!ring || !ring->header) {
+        return;
+    }
+
+    shm_ring_commit(ring);
+    __atomic_store_n(&ring->header->closed, reason, __ATOMIC_SEQ_CST);
+    wake_reader(ring);
+}
+
+uint64_t shm_ring_acked(const ShmRing* ring) {
+    return ring && ring->header ? __atomic_load_n(&ring->header->acked_offset, __ATOMIC_ACQUIRE) : 0;
+}
+
+static int ring_ready(const ShmRing* ring) {
+    return __atomic_load_n(&ring->header->write_position, __ATOMIC_SEQ_CST) != ring->position ||
+           __atomic_load_n(&ring->header->closed, __ATOMIC_SEQ_CST) != SHM_RING_OPEN;
+}
+
+int shm_ring_peek(ShmRing* ring, ShmRecord* record) {
+    if (!ring || !ring->header || !record) {
+        return -1;
+    }
+
+    for (;;) {
+        // closed is set after the last commit, so once it shows, so does
+        // every record before it.
+        uint32_t closed = __atomic_load_n(&ring->header->closed, __ATOMIC_ACQUIRE);
+        uint64_t written = __atomic_load_n(&ring->header->write_position, __ATOMIC_ACQUIRE);
+        if (ring->position == written) {
+            return closed != SHM_RING_OPEN ? -1 : 0;
+        }
+
+        size_t index = (size_t)(ring->position & (ring->capacity - 1));
+        const uint8_t* entry = ring->data + index;
+        uint32_t data_size;
+        memcpy(&data_size, entry, sizeof(data_size));
+        if (data_size == SHM_ENTRY_WRAP) {
+            // Released at once: the writer may be waiting for exactly this.
+            ring->position += ring->capacity - index;
+            ring->next = ring->position;
+            __atomic_store_n(&ring->header->read_position, ring->position, __ATOMIC_SEQ_CST);
+            continue;
+        }
+
+        size_t size = entry_size(data_size);
+        if (size > ring->capacity - index || size > written - ring->position) {
+            fprintf(stderr, "Shared ring is corrupt at %llu\n", (unsigned long long)ring->position);
+            return -1;
+        }
+
+        record->data = entry + SHM_ENTRY_HEADER_SIZE;
+        record->data_size = data_size;
+        record->codec = entry[4];
+        memcpy(&record->offset, entry + 8, sizeof(record->offset));
+        memcpy(&record->packet_size, entry + 16, sizeof(record->packet_size));
+        ring->next = ring->position + size;
+        return 1;
+    }
+}
+
+void shm_ring_release(ShmRing* ring) {
+    if (!ring || !ring->header || ring->next <= ring->position) {
+        return;
+    }
+
+    ring->position = ring->next;
+    __atomic_store_n(&ring->header->read_position, ring->position, __ATOMIC_SEQ_CST);
+}
+
+int shm_ring_writer_waiting(ShmRing* ring) {
+    if (!ring || !ring->header) {
+        return 0;
+    }
+    return __atomic_load_n(&ring->header->writer_waiting, __ATOMIC_SEQ_CST) &&
+           __atomic_exchange_n(&ring->header->writer_waiting, 0, __ATOMIC_SEQ_CST);
+}
+
+void shm_ring_ack(ShmRing* ring, const ShmRecord* record) {
+    if (!ring || !ring->header || !record) {
+        return;
+    }
+    __atomic_store_n(&ring->header->acked_offset, record->offset + RECORD_HEADER_SIZE + record->packet_size,
+                     __ATOMIC_RELEASE);
+}
+
+int shm_ring_wait(ShmRing* ring, unsigned spin_count, int timeout_ms) {
+    if (!ring || !ring->header) {
+        return 0;
+    }
+
+    for (unsigned i = 0; i < spin_count; i++) {
+        if (ring_ready(ring)) {
+            return 1;
+        }
+        cpu_relax();
+    }
+
+    struct timespec timeout;
+    timeout.tv_sec = timeout_ms / 1000;
+    timeout.tv_nsec = (long)(timeout_ms % 1000) * 1000000L;
+
+    __atomic_store_n(&ring->header->reader_parked, 1, __ATOMIC_SEQ_CST);
+    if (!ring_ready(ring)) {
+        if (futex(&ring->header->reader_parked, FUTEX_WAIT, 1, timeout_ms < 0 ? NULL : &timeout) != 0 &&
+            errno != EAGAIN && errno != EINTR && errno != ETIMEDOUT) {
+            perror("Failed to wait on shared ring");
+        }
+    }
+    __atomic_store_n(&ring->header->reader_parked, 0, __ATOMIC_SEQ_CST);
+    return ring_ready(ring);
+}
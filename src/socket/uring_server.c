@@ -0,0 +1,904 @@
+#define _GNU_SOURCE // pipe2, F_SETPIPE_SZ
+#include "headers/uring_server.h"
+#include "headers/event_loop.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/socket.h>
+
+#if defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#endif
+#endif
+
+#if defined(IORING_RECV_MULTISHOT)
+
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/eventfd.h>
+
+// Each ring keeps a multishot accept on the listening socket and one
+// multishot recv per connection that picks buffers from a provided buffer
+// ring, so reading commands costs no syscalls of its own. Commands still
+// run on the worker pool; what a command writes is captured and submitted
+// back on the ring as one send, and workers wake the ring through an
+// eventfd only when it is not already awake. Streaming subscribers are
+// pushed to the same way, by worker runs without a command, queued when an
+// append wakes them or while the last push still had more; waiting for each
+// send to complete is what holds a stream to the client's pace. Everything
+// queued while handling a batch of completions goes in with the next
+// io_uring_enter.
+//
+// A file range in the reply (FETCH) is not copied: after the bytes before
+// it have been sent, it is spliced from the page cache into a pipe and from
+// the pipe into the socket, a pipe's worth at a time, before the rest of
+// the reply follows.
+//
+// A push stops once the reply holds the high watermark of output, or a file
+// range, so a subscriber never has more than that in flight, and the next
+// push starts only after the send has drained it. Binary frames that arrived
+// together stop there as well, held in the session's input for a worker run
+// without a command to pick up after the send. When timeouts are configured a
+// timeout on the ring runs a sweep every second, shutting down connections
+// that were idle or whose send stalled for too long.
+#define URING_TAG_MASK 7ULL
+#define URING_TAG_ACCEPT 1
+#define URING_TAG_RECV 2
+#define URING_TAG_SEND 3
+#define URING_TAG_WAKE 4
+#define URING_TAG_PROBE 5
+#define URING_TAG_SWEEP 6
+#define URING_TAG_SPLICE 7
+#define URING_BUFFER_GROUP 0
+#define URING_REPLY_KEEP_SIZE (64 * 1024)
+#define URING_SPLICE_PIPE_SIZE (1024 * 1024)
+
+// The kernel copies the interval when the timeout is submitted.
+static const struct __kernel_timespec sweep_interval = { .tv_sec = 1, .tv_nsec = 0 };
+
+static int uring_setup(unsigned entries, struct io_uring_params* params) {
+    return (int)syscall(__NR_io_uring_setup, entries, params);
+}
+
+static int uring_enter(int ring_fd, unsigned to_submit, unsigned min_complete, unsigned flags) {
+    return (int)syscall(__NR_io_uring_enter, ring_fd, to_submit, min_complete, flags, NULL, 0);
+}
+
+static int uring_register(int ring_fd, unsigned opcode, void* arg, unsigned count) {
+    return (int)syscall(__NR_io_uring_register, ring_fd, opcode, arg, count);
+}
+
+static uint64_t user_data(void* pointer, unsigned tag) {
+    return (uint64_t)(uintptr_t)pointer | tag;
+}
+
+static int uring_submit(UringLoop* loop, unsigned wait) {
+    __atomic_store_n(loop->sq_tail, loop->sq_local_tail, __ATOMIC_RELEASE);
+    unsigned pending = loop->sq_local_tail - __atomic_load_n(loop->sq_head, __ATOMIC_ACQUIRE);
+
+    for (;;) {
+        int result = uring_enter(loop->ring_fd, pending, wait, wait ? IORING_ENTER_GETEVENTS : 0);
+        if (result >= 0 || errno == EBUSY) {
+            return 0;
+        }
+        if (errno != EINTR) {
+            perror("io_uring_enter failed");
+            return -1;
+        }
+    }
+}
+
+static struct io_uring_sqe* uring_sqe(UringLoop* loop) {
+    if (loop->sq_local_tail - __atomic_load_n(loop->sq_head, __ATOMIC_ACQUIRE) >= loop->sq_entries) {
+        uring_submit(loop, 0);
+        if (loop->sq_local_tail - __atomic_load_n(loop->sq_head, __ATOMIC_ACQUIRE) >= loop->sq_entries) {
+            return NULL;
+        }
+    }
+
+    unsigned index = loop->sq_local_tail & loop->sq_mask;
+    struct io_uring_sqe* sqe = &loop->sqes[index];
+    memset(sqe, 0, sizeof(*sqe));
+    loop->sq_array[index] = index;
+    loop->sq_local_tail++;
+    return sqe;
+}
+
+static void recycle_buffer(UringLoop* loop, unsigned buffer_id) {
+    unsigned short tail = loop->buffer_ring->tail;
+    struct io_uring_buf* buffer = &loop->buffer_ring->bufs[tail & (URING_RECV_BUFFERS - 1)];
+    buffer->addr = (uint64_t)(uintptr_t)(loop->buffer_memory + (size_t)buffer_id * URING_RECV_BUFFER_SIZE);
+    buffer->len = URING_RECV_BUFFER_SIZE;
+    buffer->bid = (unsigned short)buffer_id;
+    __atomic_store_n(&loop->buffer_ring->tail, (unsigned short)(tail + 1), __ATOMIC_RELEASE);
+}
+
+static int submit_accept(UringLoop* loop) {
+    struct io_uring_sqe* sqe = uring_sqe(loop);
+    if (!sqe) {
+        return -1;
+    }
+    sqe->opcode = IORING_OP_ACCEPT;
+    sqe->fd = loop->server_fd;
+    sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+    sqe->accept_flags = SOCK_CLOEXEC;
+    sqe->user_data = user_data(NULL, URING_TAG_ACCEPT);
+    return 0;
+}
+
+static int submit_recv(UringLoop* loop, int fd, void* owner, unsigned tag) {
+    struct io_uring_sqe* sqe = uring_sqe(loop);
+    if (!sqe) {
+        return -1;
+    }
+    sqe->opcode = IORING_OP_RECV;
+    sqe->fd = fd;
+    sqe->ioprio = IORING_RECV_MULTISHOT;
+    sqe->flags = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = URING_BUFFER_GROUP;
+    sqe->user_data = user_data(owner, tag);
+    return 0;
+}
+
+static int submit_wake_read(UringLoop* loop) {
+    struct io_uring_sqe* sqe = uring_sqe(loop);
+    if (!sqe) {
+        return -1;
+    }
+    sqe->opcode = IORING_OP_READ;
+    sqe->fd = loop->wake_fd;
+    sqe->addr = (uint64_t)(uintptr_t)&loop->wake_value;
+    sqe->len = sizeof(loop->wake_value);
+    sqe->user_data = user_data(NULL, URING_TAG_WAKE);
+    return 0;
+}
+
+static int submit_sweep_timeout(UringLoop* loop) {
+    struct io_uring_sqe* sqe = uring_sqe(loop);
+    if (!sqe) {
+        return -1;
+    }
+    sqe->opcode = IORING_OP_TIMEOUT;
+    sqe->fd = -1;
+    sqe->addr = (uint64_t)(uintptr_t)&sweep_interval;
+    sqe->len = 1;
+    sqe->user_data = user_data(NULL, URING_TAG_SWEEP);
+    return 0;
+}
+
+// The bytes of the reply that go out before its file range, or all of them.
+static size_t reply_end(const UringConnection* connection) {
+    return connection->reply.file_size > 0 ? connection->reply.file_at : connection->reply.size;
+}
+
+static int submit_send(UringConnection* connection) {
+    struct io_uring_sqe* sqe = uring_sqe(connection->loop);
+    if (!sqe) {
+        return -1;
+    }
+    sqe->opcode = IORING_OP_SEND;
+    sqe->fd = connection->client_fd;
+    sqe->addr = (uint64_t)(uintptr_t)(connection->reply.data + connection->reply_sent);
+    sqe->len = (unsigned)(reply_end(connection) - connection->reply_sent);
+    sqe->msg_flags = MSG_NOSIGNAL | MSG_WAITALL;
+    sqe->user_data = user_data(connection, URING_TAG_SEND);
+    return 0;
+}
+
+// Moves what the pipe holds into the socket, or once it is empty the next
+// pipe's worth of the file range into the pipe.
+static int submit_splice(UringConnection* connection) {
+    if (connection->pipe_fds[0] < 0) {
+        if (pipe2(connection->pipe_fds, O_CLOEXEC) != 0) {
+            perror("Failed to create splice pipe");
+            connection->pipe_fds[0] = connection->pipe_fds[1] = -1;
+            return -1;
+        }
+        int capacity = fcntl(connection->pipe_fds[1], F_SETPIPE_SZ, URING_SPLICE_PIPE_SIZE);
+        if (capacity < 0) {
+            capacity = fcntl(connection->pipe_fds[1], F_GETPIPE_SZ);
+        }
+        connection->pipe_capacity = capacity > 0 ? (size_t)capacity : 4096;
+    }
+
+    struct io_uring_sqe* sqe = uring_sqe(connection->loop);
+    if (!sqe) {
+        return -1;
+    }
+    sqe->opcode = IORING_OP_SPLICE;
+    if (connection->piped > 0) {
+        sqe->splice_fd_in = connection->pipe_fds[0];
+        sqe->splice_off_in = (uint64_t)-1;
+        sqe->fd = connection->client_fd;
+        sqe->len = (unsigned)connection->piped;
+    } else {
+        const SendCapture* reply = &connection->reply;
+        sqe->splice_fd_in = reply->file_fd;
+        sqe->splice_off_in = reply->file_offset;
+        sqe->fd = connection->pipe_fds[1];
+        sqe->len = (unsigned)(reply->file_size < connection->pipe_capacity ? reply->file_size
+                                                                           : connection->pipe_capacity);
+    }
+    sqe->off = (uint64_t)-1;
+    sqe->user_data = user_data(connection, URING_TAG_SPLICE);
+    return 0;
+}
+
+// Submits the next part of the reply: the bytes before its file range, the
+// range, then the rest. Returns 1 once everything has gone out.
+static int reply_continue(UringConnection* connection) {
+    if (connection->piped > 0) {
+        return submit_splice(connection);
+    }
+    if (connection->reply_sent < reply_end(connection)) {
+        return submit_send(connection);
+    }
+    if (connection->reply.file_size > 0) {
+        return submit_splice(connection);
+    }
+    return 1;
+}
+
+static void connection_release(UringConnection* connection) {
+    connection->closing = 1;
+
+    // A live multishot recv holds the socket; shutting it down ends the
+    // recv, and the connection is freed when that completion arrives.
+    if (connection->recv_armed) {
+        if (!connection->shut_down) {
+            connection->shut_down = 1;
+            shutdown(connection->client_fd, SHUT_RDWR);
+        }
+        return;
+    }
+    if (connection->busy) {
+        return;
+    }
+
+    close(connection->client_fd);
+    // With its watch gone nothing can queue the connection again, so it
+    // only has to be taken off a wake list it may still be on.
+    client_session_free(connection->session);
+
+    UringLoop* loop = connection->loop;
+    if (connection->prev) {
+        connection->prev->next = connection->next;
+    } else {
+        loop->connections = connection->next;
+    }
+    if (connection->next) {
+        connection->next->prev = connection->prev;
+    }
+
+    pthread_mutex_lock(&loop->done_mutex);
+    if (connection->wake_queued) {
+        UringConnection** link = &loop->woken;
+        while (*link != connection) {
+            link = &(*link)->next_woken;
+        }
+        *link = connection->next_woken;
+    }
+    pthread_mutex_unlock(&loop->done_mutex);
+
+    while (connection->commands) {
+        UringCommand* next = connection->commands->next;
+        free(connection->commands);
+        connection->commands = next;
+    }
+    if (connection->pipe_fds[0] >= 0) {
+        close(connection->pipe_fds[0]);
+        close(connection->pipe_fds[1]);
+    }
+    send_capture_free(&connection->reply);
+    free(connection);
+}
+
+static void wake_loop(UringLoop* loop) {
+    if (!__atomic_exchange_n(&loop->wake_pending, 1, __ATOMIC_ACQ_REL)) {
+        uint64_t one = 1;
+        if (write(loop->wake_fd, &one, sizeof(one)) != (ssize_t)sizeof(one)) {
+            perror("Failed to wake io_uring loop");
+        }
+    }
+}
+
+static void connection_run(WorkerTask* task) {
+    UringConnection* connection = (UringConnection*)task;
+    UringCommand* command = connection->running;
+
+    connection->reply.size = 0;
+    send_capture_begin(&connection->reply);
+    int keep = command ? client_session_receive(connection->session, command->data, command->size) > 0
+                       : client_session_resume(connection->session) > 0;
+    int push = keep ? client_session_push(connection->session) : 0;
+    send_capture_end();
+
+    connection->quit = !keep || push < 0;
+    connection->push_again = push > 0;
+    connection->running = NULL;
+    free(command);
+
+    UringLoop* loop = connection->loop;
+    pthread_mutex_lock(&loop->done_mutex);
+    connection->next_done = loop->done;
+    loop->done = connection;
+    pthread_mutex_unlock(&loop->done_mutex);
+
+    wake_loop(loop);
+}
+
+// Runs on whichever thread appended to a topic the connection streams.
+static void connection_wake(void* context) {
+    UringConnection* connection = (UringConnection*)context;
+    UringLoop* loop = connection->loop;
+
+    pthread_mutex_lock(&loop->done_mutex);
+    int queued = connection->wake_queued;
+    if (!queued) {
+        connection->wake_queued = 1;
+        connection->next_woken = loop->woken;
+        loop->woken = connection;
+    }
+    pthread_mutex_unlock(&loop->done_mutex);
+
+    if (!queued) {
+        wake_loop(loop);
+    }
+}
+
+// Commands go first; a push run only starts once they have all been served.
+static void dispatch_next(UringConnection* connection) {
+    if (connection->busy || connection->closing) {
+        return;
+    }
+
+    if (connection->commands) {
+        connection->running = connection->commands;
+        connection->commands = connection->commands->next;
+        if (!connection->commands) {
+            connection->last_command = NULL;
+        }
+    } else if (connection->push_pending || connection->push_again ||
+               client_session_input_held(connection->session)) {
+        connection->running = NULL;
+        connection->push_pending = 0;
+        connection->push_again = 0;
+    } else {
+        return;
+    }
+
+    connection->busy = 1;
+    if (worker_pool_submit(connection->loop->workers, &connection->task) != 0) {
+        free(connection->running);
+        connection->running = NULL;
+        connection->busy = 0;
+        connection_release(connection);
+    }
+}
+
+static void handle_accept(UringLoop* loop, struct io_uring_cqe* cqe) {
+    if (!(cqe->flags & IORING_CQE_F_MORE)) {
+        submit_accept(loop);
+    }
+    if (cqe->res < 0) {
+        if (cqe->res != -ECANCELED) {
+            fprintf(stderr, "Accept failed: %s\n", strerror(-cqe->res));
+        }
+        return;
+    }
+
+    int client_fd = cqe->res;
+    UringConnection* connection = (UringConnection*)calloc(1, sizeof(UringConnection));
+    if (connection) {
+        connection->session = client_session_create(client_fd);
+    }
+    if (!connection || !connection->session || submit_recv(loop, client_fd, connection, URING_TAG_RECV) != 0) {
+        if (connection) {
+            client_session_free(connection->session);
+            free(connection);
+        }
+        close(client_fd);
+        return;
+    }
+
+    connection->task.run = connection_run;
+    connection->client_fd = client_fd;
+    connection->loop = loop;
+    connection->pipe_fds[0] = connection->pipe_fds[1] = -1;
+    connection->reply.client_fd = client_fd;
+    connection->reply.limit = connection_limits()->output_high_watermark;
+    connection->last_active_ms = connection_clock_ms();
+    connection->recv_armed = 1;
+    client_session_set_waker(connection->session, connection_wake, connection);
+
+    connection->next = loop->connections;
+    if (loop->connections) {
+        loop->connections->prev = connection;
+    }
+    loop->connections = connection;
+}
+
+static void handle_recv(UringLoop* loop, UringConnection* connection, struct io_uring_cqe* cqe) {
+    if (cqe->flags & IORING_CQE_F_BUFFER) {
+        unsigned buffer_id = cqe->flags >> IORING_CQE_BUFFER_SHIFT;
+        if (cqe->res > 0 && !connection->closing) {
+            connection->last_active_ms = connection_clock_ms();
+            UringCommand* command = (UringCommand*)malloc(sizeof(UringCommand) + (size_t)cqe->res + 1);
+            if (command) {
+                memcpy(command->data, loop->buffer_memory + (size_t)buffer_id * URING_RECV_BUFFER_SIZE,
+                       (size_t)cqe->res);
+                command->size = (size_t)cqe->res;
+                command->next = NULL;
+                if (connection->last_command) {
+                    connection->last_command->next = command;
+                } else {
+                    connection->commands = command;
+                }
+                connection->last_command = command;
+            }
+        }
+        recycle_buffer(loop, buffer_id);
+    }
+
+    int ended = !(cqe->flags & IORING_CQE_F_MORE);
+    if (ended) {
+        connection->recv_armed = 0;
+    }
+
+    if (cqe->res == 0 || (cqe->res < 0 && cqe->res != -ENOBUFS)) {
+        connection_release(connection);
+        return;
+    }
+
+    // Out of buffers ends a multishot recv; this connection's are back now.
+    if (ended && !connection->closing) {
+        if (submit_recv(loop, connection->client_fd, connection, URING_TAG_RECV) != 0) {
+            connection_release(connection);
+            return;
+        }
+        connection->recv_armed = 1;
+    }
+
+    if (connection->closing) {
+        connection_release(connection);
+        return;
+    }
+    dispatch_next(connection);
+}
+
+static void finish_command(UringConnection* connection) {
+    connection->busy = 0;
+    connection->sending = 0;
+    connection->reply_sent = 0;
+    connection->reply.size = 0;
+    connection->piped = 0;
+    send_capture_clear_file(&connection->reply);
+
+    // Idle connections should not each hold on to their largest reply.
+    if (connection->reply.capacity > URING_REPLY_KEEP_SIZE) {
+        free(connection->reply.data);
+        connection->reply.data = NULL;
+        connection->reply.capacity = 0;
+    }
+
+    if (connection->quit || connection->closing) {
+        connection_release(connection);
+        return;
+    }
+    dispatch_next(connection);
+}
+
+static void continue_or_finish(UringConnection* connection) {
+    int result = connection->closing ? 1 : reply_continue(connection);
+    if (result < 0) {
+        connection->busy = 0;
+        connection->sending = 0;
+        connection_release(connection);
+    } else if (result > 0) {
+        finish_command(connection);
+    }
+}
+
+static void handle_send(UringConnection* connection, struct io_uring_cqe* cqe) {
+    if (cqe->res <= 0) {
+        connection->busy = 0;
+        connection->sending = 0;
+        connection_release(connection);
+        return;
+    }
+
+    connection->last_active_ms = connection->sent_at_ms = connection_clock_ms();
+    connection->reply_sent += (size_t)cqe->res;
+    continue_or_finish(connection);
+}
+
+static void handle_splice(UringConnection* connection, struct io_uring_cqe* cqe) {
+    if (cqe->res <= 0) {
+        if (cqe->res == 0 && connection->piped == 0) {
+            fprintf(stderr, "Log ended before the requested range\n");
+        }
+        connection->busy = 0;
+        connection->sending = 0;
+        connection_release(connection);
+        return;
+    }
+
+    connection->last_active_ms = connection->sent_at_ms = connection_clock_ms();
+    SendCapture* reply = &connection->reply;
+    if (connection->piped > 0) {
+        connection->piped -= (size_t)cqe->res;
+    } else {
+        connection->piped = (size_t)cqe->res;
+        reply->file_offset += (size_t)cqe->res;
+        reply->file_size -= (size_t)cqe->res;
+        if (reply->file_size == 0) {
+            send_capture_clear_file(reply);
+        }
+    }
+    continue_or_finish(connection);
+}
+
+static void handle_wake(UringLoop* loop) {
+    __atomic_store_n(&loop->wake_pending, 0, __ATOMIC_SEQ_CST);
+    submit_wake_read(loop);
+
+    pthread_mutex_lock(&loop->done_mutex);
+    UringConnection* connection = loop->done;
+    loop->done = NULL;
+    pthread_mutex_unlock(&loop->done_mutex);
+
+    while (connection) {
+        UringConnection* next = connection->next_done;
+        connection->next_done = NULL;
+
+        if (send_capture_pending(&connection->reply) > 0 && !connection->closing) {
+            connection->sending = 1;
+            connection->sent_at_ms = connection_clock_ms();
+        }
+        continue_or_finish(connection);
+        connection = next;
+    }
+
+    // Taken one at a time: serving one connection may free another that is
+    // still on the list.
+    for (;;) {
+        pthread_mutex_lock(&loop->done_mutex);
+        connection = loop->woken;
+        if (connection) {
+            loop->woken = connection->next_woken;
+            connection->next_woken = NULL;
+            connection->wake_queued = 0;
+        }
+        pthread_mutex_unlock(&loop->done_mutex);
+
+        if (!connection) {
+            break;
+        }
+        if (!connection->closing) {
+            connection->push_pending = 1;
+            dispatch_next(connection);
+        }
+    }
+}
+
+// Releasing a connection that is sending shuts its socket down, which
+// fails the send and the recv and so frees it on their completions.
+static void handle_sweep(UringLoop* loop) {
+    const ConnectionLimits* limits = connection_limits();
+    uint64_t now = connection_clock_ms();
+
+    UringConnection* connection = loop->connections;
+    while (connection) {
+        UringConnection* next = connection->next;
+        if (connection->closing) {
+            connection = next;
+            continue;
+        }
+
+        const char* reason = NULL;
+        if (limits->stall_timeout_ms && connection->sending &&
+                   now - connection->sent_at_ms >= limits->stall_timeout_ms) {
+            reason = "stalled";
+        } else if (limits->idle_timeout_ms && !connection->busy &&
+                   now - connection->last_active_ms >= limits->idle_timeout_ms) {
+            reason = "idle";
+        }
+
+        if (reason) {
+            fprintf(stderr, "Closing %s client (fd: %d)\n", reason, connection->client_fd);
+            connection_release(connection);
+        }
+        connection = next;
+    }
+
+    if (submit_sweep_timeout(loop) != 0) {
+        fprintf(stderr, "Failed to schedule the connection sweep\n");
+    }
+}
+
+static void* uring_loop_main(void* arg) {
+    UringLoop* loop = (UringLoop*)arg;
+
+    for (;;) {
+        if (uring_submit(loop, 1) != 0) {
+            return NULL;
+        }
+
+        unsigned head = *loop->cq_head;
+        unsigned tail = __atomic_load_n(loop->cq_tail, __ATOMIC_ACQUIRE);
+        for (; head != tail; head++) {
+            struct io_uring_cqe* cqe = &loop->cqes[head & loop->cq_mask];
+            void* owner = (void*)(uintptr_t)(cqe->user_data & ~URING_TAG_MASK);
+
+            switch (cqe->user_data & URING_TAG_MASK) {
+            case URING_TAG_ACCEPT:
+                handle_accept(loop, cqe);
+                break;
+            case URING_TAG_RECV:
+                handle_recv(loop, (UringConnection*)owner, cqe);
+                break;
+            case URING_TAG_SEND:
+                handle_send((UringConnection*)owner, cqe);
+                break;
+            case URING_TAG_SPLICE:
+                handle_splice((UringConnection*)owner, cqe);
+                break;
+            case URING_TAG_WAKE:
+                handle_wake(loop);
+                break;
+            case URING_TAG_SWEEP:
+                handle_sweep(loop);
+                break;
+            case URING_TAG_PROBE:
+                if (cqe->flags & IORING_CQE_F_BUFFER) {
+                    recycle_buffer(loop, cqe->flags >> IORING_CQE_BUFFER_SHIFT);
+                }
+                break;
+            }
+        }
+        __atomic_store_n(loop->cq_head, head, __ATOMIC_RELEASE);
+    }
+}
+
+static void uring_loop_close(UringLoop* loop) {
+    if (loop->ring_fd >= 0) {
+        close(loop->ring_fd);
+    }
+    if (loop->wake_fd >= 0) {
+        close(loop->wake_fd);
+    }
+    if (loop->sqes) {
+        munmap(loop->sqes, loop->sqes_size);
+    }
+    if (loop->cq_ring && loop->cq_ring != loop->sq_ring) {
+        munmap(loop->cq_ring, loop->cq_ring_size);
+    }
+    if (loop->sq_ring) {
+        munmap(loop->sq_ring, loop->sq_ring_size);
+    }
+    free(loop->buffer_ring);
+    free(loop->buffer_memory);
+    pthread_mutex_destroy(&loop->done_mutex);
+}
+
+// Multishot recv arrived after provided buffer rings, so a recv that is
+// still armed after one delivery shows the ring has everything needed.
+static int probe_multishot_recv(UringLoop* loop) {
+    int pair[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, pair) != 0) {
+        return -1;
+    }
+
+    int supported = 0;
+    if (submit_recv(loop, pair[0], NULL, URING_TAG_PROBE) == 0 && write(pair[1], "p", 1) == 1 &&
+        uring_submit(loop, 1) == 0) {
+        unsigned head = *loop->cq_head;
+        if (head != __atomic_load_n(loop->cq_tail, __ATOMIC_ACQUIRE)) {
+            struct io_uring_cqe* cqe = &loop->cqes[head & loop->cq_mask];
+            supported = cqe->res == 1 && (cqe->flags & IORING_CQE_F_MORE);
+            if (cqe->flags & IORING_CQE_F_BUFFER) {
+                recycle_buffer(loop, cqe->flags >> IORING_CQE_BUFFER_SHIFT);
+            }
+            __atomic_store_n(loop->cq_head, head + 1, __ATOMIC_RELEASE);
+        }
+    }
+
+    // Closing the peer ends the probe recv; its completion is ignored.
+    close(pair[1]);
+    close(pair[0]);
+    return supported ? 0 : -1;
+}
+
+static int uring_loop_open(UringLoop* loop, int server_fd, WorkerPool* workers) {
+    memset(loop, 0, sizeof(*loop));
+    loop->ring_fd = -1;
+    loop->wake_fd = -1;
+    loop->server_fd = server_fd;
+    loop->workers = workers;
+    pthread_mutex_init(&loop->done_mutex, NULL);
+
+    struct io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    params.flags = IORING_SETUP_SUBMIT_ALL | IORING_SETUP_COOP_TASKRUN;
+    loop->ring_fd = uring_setup(URING_QUEUE_DEPTH, &params);
+    if (loop->ring_fd < 0 || !(params.features & IORING_FEAT_SINGLE_MMAP) ||
+        !(params.features & IORING_FEAT_NODROP)) {
+        return -1;
+    }
+
+    loop->sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    loop->cq_ring_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    if (loop->cq_ring_size > loop->sq_ring_size) {
+        loop->sq_ring_size = loop->cq_ring_size;
+    }
+    loop->cq_ring_size = loop->sq_ring_size;
+
+    loop->sq_ring = mmap(NULL, loop->sq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                         loop->ring_fd, IORING_OFF_SQ_RING);
+    if (loop->sq_ring == MAP_FAILED) {
+        loop->sq_ring = NULL;
+        return -1;
+    }
+    loop->cq_ring = loop->sq_ring;
+
+    loop->sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+    loop->sqes = (struct io_uring_sqe*)mmap(NULL, loop->sqes_size, PROT_READ | PROT_WRITE,
+                                            MAP_SHARED | MAP_POPULATE, loop->ring_fd, IORING_OFF_SQES);
+    if (loop->sqes == MAP_FAILED) {
+        loop->sqes = NULL;
+        return -1;
+    }
+
+    uint8_t* sq = (uint8_t*)loop->sq_ring;
+    loop->sq_head = (unsigned*)(sq + params.sq_off.head);
+    loop->sq_tail = (unsigned*)(sq + params.sq_off.tail);
+    loop->sq_mask = *(unsigned*)(sq + params.sq_off.ring_mask);
+    loop->sq_entries = params.sq_entries;
+    loop->sq_array = (unsigned*)(sq + params.sq_off.array);
+    loop->sq_local_tail = *loop->sq_tail;
+    loop->cq_head = (unsigned*)(sq + params.cq_off.head);
+    loop->cq_tail = (unsigned*)(sq + params.cq_off.tail);
+    loop->cq_mask = *(unsigned*)(sq + params.cq_off.ring_mask);
+    loop->cqes = (struct io_uring_cqe*)(sq + params.cq_off.cqes);
+
+    size_t page_size = (size_t)sysconf(_SC_PAGESIZE);
+    if (posix_memalign((void**)&loop->buffer_ring, page_size, URING_RECV_BUFFERS * sizeof(struct io_uring_buf)) != 0) {
+        loop->buffer_ring = NULL;
+        return -1;
+    }
+    loop->buffer_memory = (uint8_t*)malloc((size_t)URING_RECV_BUFFERS * URING_RECV_BUFFER_SIZE);
+    if (!loop->buffer_memory) {
+        return -1;
+    }
+
+    memset(loop->buffer_ring, 0, URING_RECV_BUFFERS * sizeof(struct io_uring_buf));
+    struct io_uring_buf_reg registration;
+    memset(&registration, 0, sizeof(registration));
+    registration.ring_addr = (uint64_t)(uintptr_t)loop->buffer_ring;
+    registration.ring_entries = URING_RECV_BUFFERS;
+    registration.bgid = URING_BUFFER_GROUP;
+    if (uring_register(loop->ring_fd, IORING_REGISTER_PBUF_RING, &registration, 1) != 0) {
+        return -1;
+    }
+    for (unsigned i = 0; i < URING_RECV_BUFFERS; i++) {
+        recycle_buffer(loop, i);
+    }
+
+    loop->wake_fd = eventfd(0, EFD_CLOEXEC);
+    if (loop->wake_fd < 0 || probe_multishot_recv(loop) != 0) {
+        return -1;
+    }
+
+    if (submit_wake_read(loop) != 0 || submit_accept(loop) != 0) {
+        return -1;
+    }
+
+    const ConnectionLimits* limits = connection_limits();
+    if ((limits->idle_timeout_ms || limits->stall_timeout_ms) && submit_sweep_timeout(loop) != 0) {
+        return -1;
+    }
+    return 0;
+}
+
+int run_uring_server(int server_fd, size_t loop_count, size_t worker_count) {
+    return run_uring_server_listeners(&server_fd, 1, loop_count, worker_count);
+}
+
+int run_uring_server_listeners(const int* server_fds, size_t server_count, size_t loop_count,
+                               size_t worker_count) {
+    if (!server_fds || server_count == 0) {
+        return -1;
+    }
+    for (size_t i = 0; i < server_count; i++) {
+        if (server_fds[i] < 0) {
+            return -1;
+        }
+    }
+
+    long cores = sysconf(_SC_NPROCESSORS_ONLN);
+    if (cores < 1) {
+        cores = 1;
+    }
+    if (loop_count == 0) {
+        loop_count = (size_t)cores;
+    }
+    if (loop_count < server_count) {
+        loop_count = server_count;
+    }
+    if (loop_count > MAX_EVENT_LOOPS) {
+        loop_count = MAX_EVENT_LOOPS;
+    }
+    if (worker_count == 0) {
+        worker_count = (size_t)cores * 2;
+    }
+    if (worker_count > MAX_EVENT_WORKERS) {
+        worker_count = MAX_EVENT_WORKERS;
+    }
+
+    UringLoop* loops = (UringLoop*)calloc(loop_count, sizeof(UringLoop));
+    if (!loops) {
+        return -1;
+    }
+
+    // Every ring is set up before any accepts, so an unsupported kernel
+    // falls back with no client having been taken.
+    size_t opened = 0;
+    for (; opened < loop_count; opened++) {
+        if (uring_loop_open(&loops[opened], server_fds[opened % server_count], NULL) != 0) {
+            uring_loop_close(&loops[opened]);
+            break;
+        }
+    }
+
+    WorkerPool* workers = opened == loop_count ? worker_pool_create(worker_count) : NULL;
+    if (!workers) {
+        for (size_t i = 0; i < opened; i++) {
+            uring_loop_close(&loops[i]);
+        }
+        free(loops);
+        return -1;
+    }
+
+    printf("Serving clients from %zu io_uring rings and %zu workers\n", loop_count, workers->thread_count);
+
+    for (size_t i = 0; i < loop_count; i++) {
+        loops[i].workers = workers;
+    }
+    // A ring that cannot get a thread is closed before its accept was ever
+    // submitted, so no client is left on it.
+    for (size_t i = 1; i < loop_count; i++) {
+        if (pthread_create(&loops[i].thread, NULL, uring_loop_main, &loops[i]) != 0) {
+            perror("Failed to create io_uring loop thread");
+            uring_loop_close(&loops[i]);
+            continue;
+        }
+        pthread_detach(loops[i].thread);
+    }
+
+    uring_loop_main(&loops[0]);
+    return 0;
+}
+
+#else
+
+int run_uring_server(int server_fd, size_t loop_count, size_t worker_count) {
+    (void)server_fd;
+    (void)loop_count;
+    (void)worker_count;
+    return -1;
+}
+
+int run_uring_server_listeners(const int* server_fds, size_t server_count, size_t loop_count,
+                               size_t worker_count) {
+    (void)server_fds;
+    (void)server_count;
+    (void)loop_count;
+    (void)worker_count;
+    return -1;
+}
+
+#endif
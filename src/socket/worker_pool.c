@@ -0,0 +1,107 @@
+#include "headers/worker_pool.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+static void* worker_main(void* arg) {
+    WorkerPool* pool = (WorkerPool*)arg;
+
+    for (;;) {
+        pthread_mutex_lock(&pool->mutex);
+        while (!pool->head && !pool->stopping) {
+            pthread_cond_wait(&pool->available, &pool->mutex);
+        }
+
+        WorkerTask* task = pool->head;
+        if (!task) {
+            pthread_mutex_unlock(&pool->mutex);
+            return NULL;
+        }
+
+        pool->head = task->next;
+        if (!pool->head) {
+            pool->tail = NULL;
+        }
+        pthread_mutex_unlock(&pool->mutex);
+
+        task->next = NULL;
+        task->run(task);
+    }
+}
+
+WorkerPool* worker_pool_create(size_t thread_count) {
+    if (thread_count == 0) {
+        return NULL;
+    }
+
+    WorkerPool* pool = (WorkerPool*)calloc(1, sizeof(WorkerPool));
+    if (!pool) {
+        return NULL;
+    }
+
+    pool->threads = (pthread_t*)calloc(thread_count, sizeof(pthread_t));
+    if (!pool->threads) {
+        free(pool);
+        return NULL;
+    }
+
+    pthread_mutex_init(&pool->mutex, NULL);
+    pthread_cond_init(&pool->available, NULL);
+
+    for (size_t i = 0; i < thread_count; i++) {
+        if (pthread_create(&pool->threads[i], NULL, worker_main, pool) != 0) {
+            perror("Failed to create worker thread");
+            break;
+        }
+        pool->thread_count++;
+    }
+
+    if (pool->thread_count == 0) {
+        worker_pool_destroy(pool);
+        return NULL;
+    }
+    return pool;
+}
+
+int worker_pool_submit(WorkerPool* pool, WorkerTask* task) {
+    if (!pool || !task || !task->run) {
+        return -1;
+    }
+
+    task->next = NULL;
+
+    pthread_mutex_lock(&pool->mutex);
+    if (pool->stopping) {
+        pthread_mutex_unlock(&pool->mutex);
+        return -1;
+    }
+
+    if (pool->tail) {
+        pool->tail->next = task;
+    } else {
+        pool->head = task;
+    }
+    pool->tail = task;
+    pthread_cond_signal(&pool->available);
+    pthread_mutex_unlock(&pool->mutex);
+    return 0;
+}
+
+void worker_pool_destroy(WorkerPool* pool) {
+    if (!pool) {
+        return;
+    }
+
+    pthread_mutex_lock(&pool->mutex);
+    pool->stopping = 1;
+    pthread_cond_broadcast(&pool->available);
+    pthread_mutex_unlock(&pool->mutex);
+
+    for (size_t i = 0; i < pool->thread_count; i++) {
+        pthread_join(pool->threads[i], NULL);
+    }
+
+    pthread_mutex_destroy(&pool->mutex);
+    pthread_cond_destroy(&pool->available);
+    free(pool->threads);
+    free(pool);
+}
@@ -0,0 +1,460 @@
+// Offline codec advisor: samples the records of every topic file in a data
+// directory and measures how each storage option would do on them, then
+// recommends one per topic. Nothing is written to the directory.
+//
+//   gcc -O2 -Isrc/writer/headers -o codec_advisor src/tools/codec_advisor.c
+//       src/messaging/*.c src/writer/*.c -lzstd -llz4 -lpthread
+//   ./codec_advisor [--samples N] [--min-mbps X] [--max-p99-us Y] <data directory>
+//
+// Records are reservoir-sampled and decoded with whatever codec they were
+// stored with. Even samples train the dictionaries, odd samples are what every
+// option is measured on, so dictionaries are not judged on their own
+// training data. The recommendation is the option with the best ratio whose
+// compression keeps up with --min-mbps and whose p99 per-record compress
+// and decompress latency stay under --max-p99-us; when nothing beats
+// storing records as-is by 10%, none is recommended.
+
+#include "../messaging/headers/codec.h"
+#include "../messaging/headers/encoder.h"
+#include "../messaging/headers/record_format.h"
+#include "../messaging/headers/create_topic.h"
+#include "../messaging/headers/compression_controller.h"
+#include "../writer/headers/block_cache.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <dirent.h>
+#include <time.h>
+
+#define DEFAULT_SAMPLE_COUNT 4000
+#define DEFAULT_MIN_MBPS 50.0
+#define DEFAULT_MAX_P99_US 200.0
+#define MAX_SAMPLE_RECORD_SIZE (1024 * 1024)
+#define MIN_USEFUL_RATIO 1.10
+#define MAX_RECORD_SIZE (10 * 1024 * 1024) // 10MB max record size
+#define DICTIONARY_LEVEL 3
+#define TRAINER_DICTIONARY_SIZE (16 * 1024)
+#define ADVISOR_TOPIC_SUFFIX ".topic"
+
+typedef struct {
+    const char* label;
+    uint8_t codec;
+    int level;
+    size_t dictionary_size;
+} AdvisorOption;
+
+typedef struct {
+    int measured;
+    double ratio;
+    double compress_mbps;
+    double decompress_mbps;
+    double compress_p99_us;
+    double decompress_p99_us;
+} OptionResult;
+
+typedef struct {
+    char** records;
+    size_t* sizes;
+    size_t count;
+    size_t capacity;
+} SampleSet;
+
+static const AdvisorOption g_options[] = {
+    { "none", RECORD_CODEC_NONE, 0, 0 },
+    { "lz4", RECORD_CODEC_LZ4, 1, 0 },
+    { "lz4 accel 4", RECORD_CODEC_LZ4, -3, 0 },
+    { "zstd -5", RECORD_CODEC_ZSTD, -5, 0 },
+    { "zstd -1", RECORD_CODEC_ZSTD, -1, 0 },
+    { "zstd 1", RECORD_CODEC_ZSTD, 1, 0 },
+    { "zstd 3", RECORD_CODEC_ZSTD, 3, 0 },
+    { "zstd 6", RECORD_CODEC_ZSTD, 6, 0 },
+    { "zstd 9", RECORD_CODEC_ZSTD, 9, 0 },
+    { "zstd 15", RECORD_CODEC_ZSTD, 15, 0 },
+    { "zstd 19", RECORD_CODEC_ZSTD, 19, 0 },
+    { "zstd 3 dict 4K", RECORD_CODEC_ZSTD, DICTIONARY_LEVEL, 4 * 1024 },
+    { "zstd 3 dict 16K", RECORD_CODEC_ZSTD, DICTIONARY_LEVEL, 16 * 1024 },
+    { "zstd 3 dict 64K", RECORD_CODEC_ZSTD, DICTIONARY_LEVEL, 64 * 1024 },
+    { "zstd 3 dict 112K", RECORD_CODEC_ZSTD, DICTIONARY_LEVEL, 112 * 1024 },
+};
+
+#define OPTION_COUNT (sizeof(g_options) / sizeof(g_options[0]))
+
+static uint64_t now_ns(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000ULL + (uint64_t)now.tv_nsec;
+}
+
+static uint64_t next_random(uint64_t* state) {
+    *state ^= *state << 13;
+    *state ^= *state >> 7;
+    *state ^= *state << 17;
+    return *state;
+}
+
+static int compare_u64(const void* a, const void* b) {
+    uint64_t left = *(const uint64_t*)a;
+    uint64_t right = *(const uint64_t*)b;
+    return (left > right) - (left < right);
+}
+
+static double p99_us(uint64_t* latencies, size_t count) {
+    if (count == 0) {
+        return 0.0;
+    }
+    qsort(latencies, count, sizeof(uint64_t), compare_u64);
+    size_t index = (count * 99 + 99) / 100 - 1;
+    return (double)latencies[index] / 1000.0;
+}
+
+static void sample_set_free(SampleSet* set) {
+    for (size_t i = 0; i < set->count; i++) {
+        free(set->records[i]);
+    }
+    free(set->records);
+    free(set->sizes);
+    memset(set, 0, sizeof(SampleSet));
+}
+
+// Returns the record's payload as published, decoding it if it was stored
+// with a codec. The caller owns the result.
+static char* read_record(BlockCacheFile* log, const char* topic_file_path, size_t offset, uint32_t size,
+                         uint8_t codec, size_t* record_size) {
+    uint8_t* stored = (uint8_t*)malloc(size);
+    if (!stored) {
+        return NULL;
+    }
+
+    if (block_cache_read(log, stored, size, offset) != (long)size) {
+        free(stored);
+        return NULL;
+    }
+
+    if (codec == RECORD_CODEC_NONE) {
+        *record_size = size;
+        return (char*)stored;
+    }
+
+    const Codec* decoder = codec_by_id(codec);
+    size_t decoded_size = 0;
+    if (!decoder || decoder->decoded_size(stored, size, &decoded_size) != 0 ||
+        decoded_size == 0 || decoded_size > MAX_SAMPLE_RECORD_SIZE) {
+        free(stored);
+        return NULL;
+    }
+
+    uint8_t* decoded = (uint8_t*)malloc(decoded_size);
+    if (!decoded || decoder->decode(topic_file_path, stored, size, decoded, decoded_size, record_size) != 0) {
+        free(decoded);
+        free(stored);
+        return NULL;
+    }
+
+    free(stored);
+    return (char*)decoded;
+}
+
+static int sample_topic(const char* topic_file_path, size_t max_samples, SampleSet* set, size_t* total_records) {
+    BlockCacheFile* log = block_cache_open(topic_file_path);
+    if (!log) {
+        return -1;
+    }
+
+    set->records = (char**)calloc(max_samples, sizeof(char*));
+    set->sizes = (size_t*)calloc(max_samples, sizeof(size_t));
+    set->capacity = max_samples;
+    if (!set->records || !set->sizes) {
+        sample_set_free(set);
+        return -1;
+    }
+
+    size_t log_size = block_cache_file_size(log);
+    size_t offset = TOPIC_FILE_HEADER_SIZE;
+    size_t seen = 0;
+    uint64_t random_state = 0x9E3779B97F4A7C15ULL;
+
+    while (offset + RECORD_HEADER_SIZE <= log_size) {
+        uint32_t header;
+        if (block_cache_read(log, &header, RECORD_HEADER_SIZE, offset) != (long)RECORD_HEADER_SIZE) {
+            break;
+        }
+
+        uint32_t size = RECORD_HEADER_PAYLOAD_SIZE(header);
+        if (size == 0 || size > MAX_RECORD_SIZE || offset + RECORD_HEADER_SIZE + size > log_size) {
+            break;
+        }
+
+        size_t slot = seen < max_samples ? seen : (size_t)(next_random(&random_state) % (seen + 1));
+        seen++;
+
+        if (slot < max_samples) {
+            size_t record_size = 0;
+            char* record = read_record(log, topic_file_path, offset + RECORD_HEADER_SIZE, size,
+                                       RECORD_HEADER_CODEC(header), &record_size);
+            if (record && record_size > 0 && record_size <= MAX_SAMPLE_RECORD_SIZE) {
+                if (slot < set->count) {
+                    free(set->records[slot]);
+                } else {
+                    slot = set->count++;
+                }
+                set->records[slot] = record;
+                set->sizes[slot] = record_size;
+            } else {
+                free(record);
+            }
+        }
+
+        offset += RECORD_HEADER_SIZE + size;
+    }
+
+    *total_records = seen;
+    return 0;
+}
+
+static int encode_option(const AdvisorOption* option, const Codec* codec, const void* dictionary,
+                         size_t dictionary_size, const char* data, size_t data_size,
+                         uint8_t* encoded, size_t capacity, size_t* encoded_size) {
+    if (dictionary) {
+        return encode_string_into_with_dict(data, data_size, dictionary, dictionary_size, encoded, capacity,
+                                            encoded_size, option->level);
+    }
+    return codec->encode(NULL, data, data_size, encoded, capacity, encoded_size, option->level);
+}
+
+static int decode_option(const Codec* codec, const void* dictionary, size_t dictionary_size,
+                         const uint8_t* encoded, size_t encoded_size, uint8_t* decoded, size_t capacity,
+                         size_t* decoded_size) {
+    if (dictionary) {
+        return decode_string_into_with_dict(encoded, encoded_size, dictionary, dictionary_size,
+                                            (char*)decoded, capacity, decoded_size);
+    }
+    return codec->decode(NULL, encoded, encoded_size, decoded, capacity, decoded_size);
+}
+
+static int measure_option(const AdvisorOption* option, const SampleSet* set, OptionResult* result) {
+    memset(result, 0, sizeof(OptionResult));
+
+    const Codec* codec = codec_by_id(option->codec);
+    if (!codec) {
+        return -1;
+    }
+
+    void* dictionary = NULL;
+    size_t dictionary_size = 0;
+    if (option->dictionary_size > 0) {
+        size_t training_count = (set->count + 1) / 2;
+        const char** training = (const char**)malloc(training_count * sizeof(char*));
+        size_t* training_sizes = (size_t*)malloc(training_count * sizeof(size_t));
+        int trained = -1;
+        if (training && training_sizes) {
+            for (size_t i = 0; i < training_count; i++) {
+                training[i] = set->records[i * 2];
+                training_sizes[i] = set->sizes[i * 2];
+            }
+            trained = train_dictionary(training, training_sizes, training_count, option->dictionary_size,
+                                       &dictionary, &dictionary_size);
+        }
+        free(training);
+        free(training_sizes);
+        if (trained != 0) {
+            return -1;
+        }
+    }
+
+    size_t evaluated = set->count / 2;
+    uint64_t* compress_latencies = (uint64_t*)malloc((evaluated ? evaluated : 1) * sizeof(uint64_t));
+    uint64_t* decompress_latencies = (uint64_t*)malloc((evaluated ? evaluated : 1) * sizeof(uint64_t));
+    uint8_t* encoded = (uint8_t*)malloc(codec->bound(MAX_SAMPLE_RECORD_SIZE) + encode_bound(MAX_SAMPLE_RECORD_SIZE));
+    uint8_t* decoded = (uint8_t*)malloc(MAX_SAMPLE_RECORD_SIZE);
+
+    int status = compress_latencies && decompress_latencies && encoded && decoded && evaluated > 0 ? 0 : -1;
+    uint64_t raw_bytes = 0;
+    uint64_t encoded_bytes = 0;
+    uint64_t compress_ns = 0;
+    uint64_t decompress_ns = 0;
+    size_t capacity = codec->bound(MAX_SAMPLE_RECORD_SIZE) + encode_bound(MAX_SAMPLE_RECORD_SIZE);
+
+    for (size_t i = 0; i < evaluated && status == 0; i++) {
+        const char* record = set->records[i * 2 + 1];
+        size_t record_size = set->sizes[i * 2 + 1];
+        size_t encoded_size = 0;
+        size_t decoded_size = 0;
+
+        uint64_t start = now_ns();
+        if (encode_option(option, codec, dictionary, dictionary_size, record, record_size,
+                          encoded, capacity, &encoded_size) != 0) {
+            status = -1;
+            break;
+        }
+        uint64_t encoded_at = now_ns();
+        if (decode_option(codec, dictionary, dictionary_size, encoded, encoded_size, decoded,
+                          MAX_SAMPLE_RECORD_SIZE, &decoded_size) != 0 ||
+            decoded_size != record_size || memcmp(decoded, record, record_size) != 0) {
+            status = -1;
+            break;
+        }
+        uint64_t decoded_at = now_ns();
+
+        compress_latencies[i] = encoded_at - start;
+        decompress_latencies[i] = decoded_at - encoded_at;
+        compress_ns += compress_latencies[i];
+        decompress_ns += decompress_latencies[i];
+        raw_bytes += record_size;
+        encoded_bytes += encoded_size;
+    }
+
+    if (status == 0 && encoded_bytes > 0) {
+        result->measured = 1;
+        result->ratio = (double)raw_bytes / (double)encoded_bytes;
+        result->compress_mbps = compress_ns ? (double)raw_bytes * 1000.0 / (double)compress_ns : 0.0;
+        result->decompress_mbps = decompress_ns ? (double)raw_bytes * 1000.0 / (double)decompress_ns : 0.0;
+        result->compress_p99_us = p99_us(compress_latencies, evaluated);
+        result->decompress_p99_us = p99_us(decompress_latencies, evaluated);
+    }
+
+    free(compress_latencies);
+    free(decompress_latencies);
+    free(encoded);
+    free(decoded);
+    free(dictionary);
+    return result->measured ? 0 : -1;
+}
+
+static void print_recommendation(const OptionResult* results, double min_mbps, double max_p99_us) {
+    size_t best = 0;
+    for (size_t i = 1; i < OPTION_COUNT; i++) {
+        const OptionResult* candidate = &results[i];
+        if (!candidate->measured || candidate->compress_mbps < min_mbps ||
+            candidate->compress_p99_us > max_p99_us || candidate->decompress_p99_us > max_p99_us) {
+            continue;
+        }
+        if (candidate->ratio > results[best].ratio) {
+            best = i;
+        }
+    }
+
+    const AdvisorOption* option = &g_options[best];
+    if (best == 0 || results[best].ratio < MIN_USEFUL_RATIO) {
+        printf("  recommendation: \"codec\": \"none\" (nothing saves %.0f%% within the budget)\n",
+               (MIN_USEFUL_RATIO - 1.0) * 100.0);
+        return;
+    }
+
+    const Codec* codec = codec_by_id(option->codec);
+    printf("  recommendation: %s -> \"codec\": \"%s\"", option->label, codec ? codec->name : "?");
+    if (option->codec == RECORD_CODEC_ZSTD) {
+        // Both bounds, ready to paste into create_topic, with the usual floor.
+        int min_level = option->level < COMPRESSION_DEFAULT_MIN_LEVEL ? option->level : COMPRESSION_DEFAULT_MIN_LEVEL;
+        printf(", \"min_compression_level\": %d, \"max_compression_level\": %d", min_level, option->level);
+        if (option->dictionary_size == TRAINER_DICTIONARY_SIZE) {
+            printf(", with the dictionary the broker trains");
+        } else if (option->dictionary_size > 0) {
+            printf(", with a %zuK dictionary (the broker trains %dK ones)", option->dictionary_size / 1024,
+                   TRAINER_DICTIONARY_SIZE / 1024);
+        }
+    }
+    printf(" [ratio %.2f, %.0f MB/s]\n", results[best].ratio, results[best].compress_mbps);
+}
+
+static int advise_topic(const char* topic_file_path, size_t max_samples, double min_mbps, double max_p99_us) {
+    SampleSet set = { 0 };
+    size_t total_records = 0;
+    if (sample_topic(topic_file_path, max_samples, &set, &total_records) != 0) {
+        fprintf(stderr, "%s: could not read topic\n", topic_file_path);
+        return -1;
+    }
+
+    size_t sampled_bytes = 0;
+    for (size_t i = 0; i < set.count; i++) {
+        sampled_bytes += set.sizes[i];
+    }
+
+    printf("%s: %zu records, %zu sampled (avg %zu bytes)\n", topic_file_path, total_records, set.count,
+           set.count ? sampled_bytes / set.count : 0);
+
+    if (set.count < 2) {
+        printf("  not enough records to measure\n\n");
+        sample_set_free(&set);
+        return 0;
+    }
+
+    printf("  %-18s %8s %10s %10s %12s %12s\n", "option", "ratio", "comp MB/s", "dec MB/s", "comp p99 us",
+           "dec p99 us");
+
+    OptionResult results[OPTION_COUNT];
+    for (size_t i = 0; i < OPTION_COUNT; i++) {
+        if (measure_option(&g_options[i], &set, &results[i]) == 0) {
+            printf("  %-18s %8.2f %10.1f %10.1f %12.1f %12.1f\n", g_options[i].label, results[i].ratio,
+                   results[i].compress_mbps, results[i].decompress_mbps, results[i].compress_p99_us,
+                   results[i].decompress_p99_us);
+        } else {
+            printf("  %-18s %8s\n", g_options[i].label, "n/a");
+        }
+    }
+
+    print_recommendation(results, min_mbps, max_p99_us);
+    printf("\n");
+
+    sample_set_free(&set);
+    return 0;
+}
+
+static int has_topic_suffix(const char* name) {
+    size_t name_len = strlen(name);
+    size_t suffix_len = strlen(ADVISOR_TOPIC_SUFFIX);
+    return name_len > suffix_len && strcmp(name + name_len - suffix_len, ADVISOR_TOPIC_SUFFIX) == 0;
+}
+
+static void usage(const char* program) {
+    fprintf(stderr, "usage: %s [--samples N] [--min-mbps X] [--max-p99-us Y] <data directory>\n", program);
+}
+
+int main(int argc, char** argv) {
+    size_t max_samples = DEFAULT_SAMPLE_COUNT;
+    double min_mbps = DEFAULT_MIN_MBPS;
+    double max_p99_us = DEFAULT_MAX_P99_US;
+    const char* data_directory = NULL;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--samples") == 0 && i + 1 < argc) {
+            max_samples = (size_t)strtoul(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--min-mbps") == 0 && i + 1 < argc) {
+            min_mbps = strtod(argv[++i], NULL);
+        } else if (strcmp(argv[i], "--max-p99-us") == 0 && i + 1 < argc) {
+            max_p99_us = strtod(argv[++i], NULL);
+        } else if (argv[i][0] != '-' && !data_directory) {
+            data_directory = argv[i];
+        } else {
+            usage(argv[0]);
+            return 2;
+        }
+    }
+
+    if (!data_directory || max_samples < 2) {
+        usage(argv[0]);
+        return 2;
+    }
+
+    DIR* directory = opendir(data_directory);
+    if (!directory) {
+        perror(data_directory);
+        return 1;
+    }
+
+    int result = 0;
+    struct dirent* entry;
+    while ((entry = readdir(directory)) != NULL) {
+        if (!has_topic_suffix(entry->d_name)) {
+            continue;
+        }
+
+        char topic_file_path[1024];
+        snprintf(topic_file_path, sizeof(topic_file_path), "%s/%s", data_directory, entry->d_name);
+        if (advise_topic(topic_file_path, max_samples, min_mbps, max_p99_us) != 0) {
+            result = 1;
+        }
+    }
+
+    closedir(directory);
+    return result;
+}
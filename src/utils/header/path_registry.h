@@ -0,0 +1,34 @@
+#ifndef PATH_REGISTRY_H
+#define PATH_REGISTRY_H
+
+#include <pthread.h>
+#include <stddef.h>
+
+// Per-file state (block cache files, codecs, dictionaries, controllers, ...)
+// is kept in a list keyed by path. Entries are only ever prepended and live
+// until shutdown, so lookups walk the list without the lock; only creating
+// an entry takes it. Entries are found through the offsets of their
+// char* path and next pointer.
+typedef struct PathRegistry {
+    void* head;
+    pthread_mutex_t mutex;
+    size_t path_offset;
+    size_t next_offset;
+} PathRegistry;
+
+#define PATH_REGISTRY_INITIALIZER(type, path_field) \
+    { NULL, PTHREAD_MUTEX_INITIALIZER, offsetof(type, path_field), offsetof(type, next) }
+
+// Builds the entry for a path seen for the first time, with the registry
+// lock held, or returns NULL.
+typedef void* (*PathRegistryCreate)(const char* path, void* context);
+
+void* path_registry_find(PathRegistry* registry, const char* path);
+
+// Returns the path's entry, creating it on first use.
+void* path_registry_get(PathRegistry* registry, const char* path, PathRegistryCreate create, void* context);
+
+// Empties the registry and hands back its list for freeing at shutdown.
+void* path_registry_take_all(PathRegistry* registry);
+
+#endif
@@ -0,0 +1,58 @@
+#include "header/path_registry.h"
+#include <string.h>
+
+static const char* entry_path(const PathRegistry* registry, void* entry) {
+    return *(char**)((char*)entry + registry->path_offset);
+}
+
+static void** entry_next(const PathRegistry* registry, void* entry) {
+    return (void**)((char*)entry + registry->next_offset);
+}
+
+void* path_registry_find(PathRegistry* registry, const char* path) {
+    if (!registry || !path) {
+        return NULL;
+    }
+
+    void* head = __atomic_load_n(&registry->head, __ATOMIC_ACQUIRE);
+    for (void* entry = head; entry; entry = *entry_next(registry, entry)) {
+        if (strcmp(entry_path(registry, entry), path) == 0) {
+            return entry;
+        }
+    }
+    return NULL;
+}
+
+void* path_registry_get(PathRegistry* registry, const char* path, PathRegistryCreate create, void* context) {
+    void* entry = path_registry_find(registry, path);
+    if (entry || !registry || !path || !create) {
+        return entry;
+    }
+
+    pthread_mutex_lock(&registry->mutex);
+
+    entry = path_registry_find(registry, path);
+    if (!entry) {
+        entry = create(path, context);
+        if (entry) {
+            *entry_next(registry, entry) = registry->head;
+            __atomic_store_n(&registry->head, entry, __ATOMIC_RELEASE);
+        }
+    }
+
+    pthread_mutex_unlock(&registry->mutex);
+    return entry;
+}
+
+void* path_registry_take_all(PathRegistry* registry) {
+    if (!registry) {
+        return NULL;
+    }
+
+    pthread_mutex_lock(&registry->mutex);
+    void* head = registry->head;
+    __atomic_store_n(&registry->head, NULL, __ATOMIC_RELEASE);
+    pthread_mutex_unlock(&registry->mutex);
+
+    return head;
+}
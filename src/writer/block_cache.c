@@ -0,0 +1,407 @@
+#include "block_cache.h"
+#include "../utils/header/path_registry.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#define DEFAULT_CACHE_CAPACITY (64 * 1024 * 1024)
+#define SHARD_BUCKETS 1024
+
+typedef struct {
+    pthread_mutex_t mutex;
+    BlockCacheEntry *buckets[SHARD_BUCKETS];
+    BlockCacheEntry *lru_head;   // Most recently used
+    BlockCacheEntry *lru_tail;   // Eviction candidate
+    size_t bytes;
+    uint64_t hits;
+    uint64_t misses;
+} BlockCacheShard;
+
+static BlockCacheShard g_shards[BLOCK_CACHE_SHARDS];
+static pthread_once_t g_shards_once = PTHREAD_ONCE_INIT;
+static size_t g_capacity = DEFAULT_CACHE_CAPACITY;
+
+static PathRegistry g_files = PATH_REGISTRY_INITIALIZER(BlockCacheFile, file_path);
+static uint32_t g_next_file_id = 1;
+
+static void init_shards(void) {
+    for (size_t i = 0; i < BLOCK_CACHE_SHARDS; i++) {
+        memset(&g_shards[i], 0, sizeof(BlockCacheShard));
+        pthread_mutex_init(&g_shards[i].mutex, NULL);
+    }
+}
+
+static uint64_t hash_key(uint32_t file_id, uint32_t segment, size_t block_offset) {
+    uint64_t h = ((uint64_t)file_id << 32) ^ ((uint64_t)segment << 56) ^ (uint64_t)block_offset;
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ULL;
+    h ^= h >> 33;
+    return h;
+}
+
+static BlockCacheShard *shard_for(uint64_t hash) {
+    pthread_once(&g_shards_once, init_shards);
+    return &g_shards[hash % BLOCK_CACHE_SHARDS];
+}
+
+static size_t bucket_for(uint64_t hash) {
+    return (size_t)((hash / BLOCK_CACHE_SHARDS) % SHARD_BUCKETS);
+}
+
+static size_t entry_charge(const BlockCacheEntry *entry) {
+    return entry->segment == BLOCK_CACHE_SEGMENT_LOG ? BLOCK_CACHE_BLOCK_SIZE : entry->length;
+}
+
+static void entry_free(BlockCacheEntry *entry) {
+    free(entry->data);
+    free(entry);
+}
+
+static void lru_remove(BlockCacheShard *shard, BlockCacheEntry *entry) {
+    if (entry->lru_prev) entry->lru_prev->lru_next = entry->lru_next;
+    else shard->lru_head = entry->lru_next;
+
+    if (entry->lru_next) entry->lru_next->lru_prev = entry->lru_prev;
+    else shard->lru_tail = entry->lru_prev;
+
+    entry->lru_prev = NULL;
+    entry->lru_next = NULL;
+}
+
+static void lru_push_front(BlockCacheShard *shard, BlockCacheEntry *entry) {
+    entry->lru_prev = NULL;
+    entry->lru_next = shard->lru_head;
+    if (shard->lru_head) shard->lru_head->lru_prev = entry;
+    shard->lru_head = entry;
+    if (!shard->lru_tail) shard->lru_tail = entry;
+}
+
+static BlockCacheEntry *find_entry(BlockCacheShard *shard, uint64_t hash, uint32_t file_id,
+                                   uint32_t segment, size_t block_offset) {
+    BlockCacheEntry *entry = shard->buckets[bucket_for(hash)];
+    while (entry) {
+        if (entry->file_id == file_id && entry->segment == segment && entry->block_offset == block_offset) {
+            return entry;
+        }
+        entry = entry->hash_next;
+    }
+    return NULL;
+}
+
+// Removes the entry from the shard; it is freed once its last reference goes.
+static void unlink_entry(BlockCacheShard *shard, BlockCacheEntry *entry) {
+    uint64_t hash = hash_key(entry->file_id, entry->segment, entry->block_offset);
+    BlockCacheEntry **link = &shard->buckets[bucket_for(hash)];
+
+    while (*link && *link != entry) {
+        link = &(*link)->hash_next;
+    }
+    if (*link) {
+        *link = entry->hash_next;
+    }
+
+    lru_remove(shard, entry);
+    shard->bytes -= entry_charge(entry);
+    entry->cached = 0;
+    entry->hash_next = NULL;
+
+    if (entry->refcount == 0) {
+        entry_free(entry);
+    }
+}
+
+static void evict_to_capacity(BlockCacheShard *shard) {
+    size_t shard_capacity = g_capacity / BLOCK_CACHE_SHARDS;
+    BlockCacheEntry *candidate = shard->lru_tail;
+
+    while (shard->bytes > shard_capacity && candidate) {
+        BlockCacheEntry *prev = candidate->lru_prev;
+        if (candidate->refcount == 0) {
+            unlink_entry(shard, candidate);
+        }
+        candidate = prev;
+    }
+}
+
+static void link_entry(BlockCacheShard *shard, uint64_t hash, BlockCacheEntry *entry) {
+    size_t bucket = bucket_for(hash);
+    entry->hash_next = shard->buckets[bucket];
+    shard->buckets[bucket] = entry;
+    entry->cached = 1;
+    lru_push_front(shard, entry);
+    shard->bytes += entry_charge(entry);
+}
+
+void block_cache_configure(size_t capacity_bytes) {
+    if (capacity_bytes < BLOCK_CACHE_BLOCK_SIZE * BLOCK_CACHE_SHARDS) {
+        capacity_bytes = BLOCK_CACHE_BLOCK_SIZE * BLOCK_CACHE_SHARDS;
+    }
+    g_capacity = capacity_bytes;
+}
+
+static void *create_file(const char *file_path, void *context) {
+    (void)context;
+    int fd = open(file_path, O_RDONLY);
+    if (fd < 0) return NULL;
+
+    BlockCacheFile *file = (BlockCacheFile*)malloc(sizeof(BlockCacheFile));
+    if (!file) {
+        close(fd);
+        return NULL;
+    }
+
+    file->file_path = strdup(file_path);
+    if (!file->file_path) {
+        close(fd);
+        free(file);
+        return NULL;
+    }
+
+    // Runs under the registry lock, which also guards the id counter.
+    file->fd = fd;
+    file->file_id = g_next_file_id++;
+    return file;
+}
+
+BlockCacheFile* block_cache_open(const char *file_path) {
+    return (BlockCacheFile*)path_registry_get(&g_files, file_path, create_file, NULL);
+}
+
+size_t block_cache_file_size(BlockCacheFile *file) {
+    if (!file) return 0;
+
+    struct stat st;
+    if (fstat(file->fd, &st) != 0 || st.st_size < 0) return 0;
+    return (size_t)st.st_size;
+}
+
+BlockCacheEntry* block_cache_acquire(BlockCacheFile *file, size_t block_offset, size_t needed_end) {
+    if (!file || block_offset % BLOCK_CACHE_BLOCK_SIZE != 0) return NULL;
+
+    uint64_t hash = hash_key(file->file_id, BLOCK_CACHE_SEGMENT_LOG, block_offset);
+    BlockCacheShard *shard = shard_for(hash);
+
+    pthread_mutex_lock(&shard->mutex);
+
+    BlockCacheEntry *entry = find_entry(shard, hash, file->file_id, BLOCK_CACHE_SEGMENT_LOG, block_offset);
+    if (entry && !entry->complete && entry->length < needed_end) {
+        // The tail block grew on disk since it was cached.
+        unlink_entry(shard, entry);
+        entry = NULL;
+    }
+
+    if (entry) {
+        shard->hits++;
+        lru_remove(shard, entry);
+        lru_push_front(shard, entry);
+        entry->refcount++;
+        pthread_mutex_unlock(&shard->mutex);
+        return entry;
+    }
+
+    shard->misses++;
+
+    // Loading under the shard lock means concurrent groups missing on the same
+    // block wait for one read instead of each issuing their own.
+    entry = (BlockCacheEntry*)calloc(1, sizeof(BlockCacheEntry));
+    if (!entry) {
+        pthread_mutex_unlock(&shard->mutex);
+        return NULL;
+    }
+
+    entry->data = (uint8_t*)malloc(BLOCK_CACHE_BLOCK_SIZE);
+    if (!entry->data) {
+        free(entry);
+        pthread_mutex_unlock(&shard->mutex);
+        return NULL;
+    }
+
+    ssize_t bytes_read = pread(file->fd, entry->data, BLOCK_CACHE_BLOCK_SIZE, (off_t)block_offset);
+    if (bytes_read <= 0) {
+        entry_free(entry);
+        pthread_mutex_unlock(&shard->mutex);
+        return NULL;
+    }
+
+    entry->file_id = file->file_id;
+    entry->segment = BLOCK_CACHE_SEGMENT_LOG;
+    entry->block_offset = block_offset;
+    entry->length = (size_t)bytes_read;
+    entry->complete = (bytes_read == BLOCK_CACHE_BLOCK_SIZE);
+    entry->refcount = 1;
+
+    link_entry(shard, hash, entry);
+    evict_to_capacity(shard);
+
+    pthread_mutex_unlock(&shard->mutex);
+    return entry;
+}
+
+BlockCacheEntry* block_cache_lookup(BlockCacheFile *file, uint32_t segment, size_t block_offset) {
+    if (!file) return NULL;
+
+    uint64_t hash = hash_key(file->file_id, segment, block_offset);
+    BlockCacheShard *shard = shard_for(hash);
+
+    pthread_mutex_lock(&shard->mutex);
+
+    BlockCacheEntry *entry = find_entry(shard, hash, file->file_id, segment, block_offset);
+    if (entry) {
+        shard->hits++;
+        lru_remove(shard, entry);
+        lru_push_front(shard, entry);
+        entry->refcount++;
+    } else {
+        shard->misses++;
+    }
+
+    pthread_mutex_unlock(&shard->mutex);
+    return entry;
+}
+
+BlockCacheEntry* block_cache_insert(BlockCacheFile *file, uint32_t segment, size_t block_offset,
+                                    uint8_t *data, size_t length) {
+    if (!file || !data) return NULL;
+
+    uint64_t hash = hash_key(file->file_id, segment, block_offset);
+    BlockCacheShard *shard = shard_for(hash);
+
+    pthread_mutex_lock(&shard->mutex);
+
+    BlockCacheEntry *entry = find_entry(shard, hash, file->file_id, segment, block_offset);
+    if (entry) {
+        // Another reader produced it first; keep theirs.
+        free(data);
+        entry->refcount++;
+        pthread_mutex_unlock(&shard->mutex);
+        return entry;
+    }
+
+    entry = (BlockCacheEntry*)calloc(1, sizeof(BlockCacheEntry));
+    if (!entry) {
+        free(data);
+        pthread_mutex_unlock(&shard->mutex);
+        return NULL;
+    }
+
+    entry->file_id = file->file_id;
+    entry->segment = segment;
+    entry->block_offset = block_offset;
+    entry->data = data;
+    entry->length = length;
+    entry->complete = 1;
+    entry->refcount = 1;
+
+    link_entry(shard, hash, entry);
+    evict_to_capacity(shard);
+
+    pthread_mutex_unlock(&shard->mutex);
+    return entry;
+}
+
+void block_cache_release(BlockCacheEntry *entry) {
+    if (!entry) return;
+
+    uint64_t hash = hash_key(entry->file_id, entry->segment, entry->block_offset);
+    BlockCacheShard *shard = shard_for(hash);
+
+    pthread_mutex_lock(&shard->mutex);
+
+    entry->refcount--;
+    if (entry->refcount == 0) {
+        if (!entry->cached) {
+            entry_free(entry);
+        } else {
+            evict_to_capacity(shard);
+        }
+    }
+
+    pthread_mutex_unlock(&shard->mutex);
+}
+
+long block_cache_read(BlockCacheFile *file, void *buffer, size_t size, size_t offset) {
+    if (!file || !buffer) return -1;
+
+    size_t total = 0;
+
+    while (total < size) {
+        size_t position = offset + total;
+        size_t block_offset = position - (position % BLOCK_CACHE_BLOCK_SIZE);
+        size_t within = position - block_offset;
+        size_t wanted = size - total;
+        if (wanted > BLOCK_CACHE_BLOCK_SIZE - within) {
+            wanted = BLOCK_CACHE_BLOCK_SIZE - within;
+        }
+
+        BlockCacheEntry *entry = block_cache_acquire(file, block_offset, within + wanted);
+        if (!entry) break;
+
+        size_t available = entry->length > within ? entry->length - within : 0;
+        size_t to_copy = wanted < available ? wanted : available;
+        memcpy((uint8_t*)buffer + total, entry->data + within, to_copy);
+        block_cache_release(entry);
+
+        total += to_copy;
+        if (to_copy < wanted) break;
+    }
+
+    return (long)total;
+}
+
+void block_cache_invalidate(const char *file_path) {
+    if (!file_path) return;
+
+    BlockCacheFile *file = (BlockCacheFile*)path_registry_find(&g_files, file_path);
+    if (!file) return;
+
+    pthread_once(&g_shards_once, init_shards);
+
+    for (size_t i = 0; i < BLOCK_CACHE_SHARDS; i++) {
+        BlockCacheShard *shard = &g_shards[i];
+        pthread_mutex_lock(&shard->mutex);
+
+        BlockCacheEntry *entry = shard->lru_head;
+        while (entry) {
+            BlockCacheEntry *next = entry->lru_next;
+            if (entry->file_id == file->file_id) {
+                unlink_entry(shard, entry);
+            }
+            entry = next;
+        }
+
+        pthread_mutex_unlock(&shard->mutex);
+    }
+
+    // Point the existing descriptor at the file now on disk so readers never
+    // see a closed fd.
+    int fd = open(file_path, O_RDONLY);
+    if (fd >= 0) {
+        dup2(fd, file->fd);
+        close(fd);
+    }
+}
+
+void block_cache_stats(uint64_t *hits, uint64_t *misses, size_t *bytes) {
+    uint64_t total_hits = 0;
+    uint64_t total_misses = 0;
+    size_t total_bytes = 0;
+
+    pthread_once(&g_shards_once, init_shards);
+
+    for (size_t i = 0; i < BLOCK_CACHE_SHARDS; i++) {
+        pthread_mutex_lock(&g_shards[i].mutex);
+        total_hits += g_shards[i].hits;
+        total_misses += g_shards[i].misses;
+        total_bytes += g_shards[i].bytes;
+        pthread_mutex_unlock(&g_shards[i].mutex);
+    }
+
+    if (hits) *hits = total_hits;
+    if (misses) *misses = total_misses;
+    if (bytes) *bytes = total_bytes;
+}
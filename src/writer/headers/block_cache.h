@@ -0,0 +1,116 @@
+#ifndef BLOCK_CACHE_H
+#define BLOCK_CACHE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <pthread.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define BLOCK_CACHE_BLOCK_SIZE (64 * 1024)
+#define BLOCK_CACHE_SHARDS 16
+#define BLOCK_CACHE_SEGMENT_LOG 0
+#define BLOCK_CACHE_SEGMENT_DECODED 1   // Decoded records, keyed by record offset
+
+// A topic file known to the cache
+typedef struct BlockCacheFile {
+    char *file_path;            // Path to the topic file
+    uint32_t file_id;           // Compact id used in cache keys
+    int fd;                     // Descriptor used for block reads
+    struct BlockCacheFile *next;
+} BlockCacheFile;
+
+// A cached block, keyed by (file, segment, block offset)
+typedef struct BlockCacheEntry {
+    uint32_t file_id;
+    uint32_t segment;
+    size_t block_offset;
+    uint8_t *data;              // Block contents
+    size_t length;              // Valid bytes in data
+    int complete;               // Block is full and will never change
+    int refcount;               // Outstanding references (guarded by the shard mutex)
+    int cached;                 // Still reachable from the shard
+    struct BlockCacheEntry *hash_next;
+    struct BlockCacheEntry *lru_prev;
+    struct BlockCacheEntry *lru_next;
+} BlockCacheEntry;
+
+/**
+ * Set the total number of bytes the cache may hold across all shards.
+ * Takes effect for subsequent insertions.
+ * @param capacity_bytes Byte budget for cached blocks.
+ */
+void block_cache_configure(size_t capacity_bytes);
+
+/**
+ * Look up (or register) a topic file in the cache.
+ * @param file_path The path to the topic file.
+ * @return Pointer to the cache file handle, or NULL on failure.
+ */
+BlockCacheFile* block_cache_open(const char *file_path);
+
+/**
+ * Current size of the file on disk.
+ * @param file Cache file handle.
+ * @return Size in bytes, or 0 on failure.
+ */
+size_t block_cache_file_size(BlockCacheFile *file);
+
+/**
+ * Get a referenced block of the log, loading it from disk on a miss.
+ * A partial tail block is re-read if it holds fewer than needed_end bytes.
+ * @param file Cache file handle.
+ * @param block_offset Block-aligned offset into the file.
+ * @param needed_end Offset (relative to the block) the caller needs to read up to.
+ * @return Referenced entry, or NULL on failure. Release with block_cache_release.
+ */
+BlockCacheEntry* block_cache_acquire(BlockCacheFile *file, size_t block_offset, size_t needed_end);
+
+/**
+ * Get a referenced entry from an arbitrary segment without loading anything.
+ * @return Referenced entry, or NULL if it is not cached.
+ */
+BlockCacheEntry* block_cache_lookup(BlockCacheFile *file, uint32_t segment, size_t block_offset);
+
+/**
+ * Insert caller-produced bytes (e.g. decoded records) into a segment.
+ * The cache takes ownership of data.
+ * @return Referenced entry for the inserted (or already present) block, or NULL on failure.
+ */
+BlockCacheEntry* block_cache_insert(BlockCacheFile *file, uint32_t segment, size_t block_offset,
+                                    uint8_t *data, size_t length);
+
+/**
+ * Drop a reference obtained from block_cache_acquire, lookup or insert.
+ * @param entry Entry to release.
+ */
+void block_cache_release(BlockCacheEntry *entry);
+
+/**
+ * Copy bytes out of the log through the cache.
+ * @param file Cache file handle.
+ * @param buffer Destination buffer.
+ * @param size Number of bytes to read.
+ * @param offset Offset from the beginning of the file.
+ * @return Number of bytes actually read, or -1 on failure.
+ */
+long block_cache_read(BlockCacheFile *file, void *buffer, size_t size, size_t offset);
+
+/**
+ * Forget every cached block of a file, e.g. after it was deleted or recreated.
+ * @param file_path The path to the topic file.
+ */
+void block_cache_invalidate(const char *file_path);
+
+/**
+ * Aggregate hit/miss counters and resident bytes across shards.
+ */
+void block_cache_stats(uint64_t *hits, uint64_t *misses, size_t *bytes);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
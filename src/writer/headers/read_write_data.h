@@ -49,6 +49,19 @@ int chunk_load(Chunk *chunk);
  */
 int chunk_append(Chunk *chunk, const void *data, size_t size);
 
+/**
+ * Append a header followed by its payload to the chunk in RAM.
+ * Both parts are written under a single lock so they can never interleave
+ * with another writer's record.
+ * @param chunk Pointer to the chunk.
+ * @param header Pointer to the header bytes.
+ * @param header_size Size of the header.
+ * @param data Pointer to the payload.
+ * @param size Size of the payload.
+ * @return 0 on success, -1 on failure.
+ */
+int chunk_append_record(Chunk *chunk, const void *header, size_t header_size, const void *data, size_t size);
+
 /**
  * Read data from the chunk in RAM at a specific offset.
  * @param chunk Pointer to the chunk.
@@ -92,26 +92,30 @@ int chunk_load(Chunk *chunk) {
     return 0;
 }
 
+static int chunk_reserve(Chunk *chunk, size_t required_capacity) {
+    if (required_capacity <= chunk->capacity) return 0;
+
+    size_t new_capacity = chunk->capacity == 0 ? INITIAL_CAPACITY : chunk->capacity * 2;
+    while (new_capacity < required_capacity) {
+        new_capacity *= 2;
+    }
+
+    unsigned char *new_ptr = realloc(chunk->data, new_capacity);
+    if (!new_ptr) return -1;
+
+    chunk->data = new_ptr;
+    chunk->capacity = new_capacity;
+    return 0;
+}
+
 int chunk_append(Chunk *chunk, const void *data, size_t size) {
     if (!chunk || !data || size == 0) return -1;
 
     pthread_mutex_lock(&chunk->mutex);
 
-    size_t required_capacity = chunk->size + size;
-
-    if (required_capacity > chunk->capacity) {
-        size_t new_capacity = chunk->capacity == 0 ? INITIAL_CAPACITY : chunk->capacity * 2;
-        while (new_capacity < required_capacity) {
-            new_capacity *= 2;
-        }
-
-        unsigned char *new_ptr = realloc(chunk->data, new_capacity);
-        if (!new_ptr) {
-            pthread_mutex_unlock(&chunk->mutex);
-            return -1;
-        }
-        chunk->data = new_ptr;
-        chunk->capacity = new_capacity;
+    if (chunk_reserve(chunk, chunk->size + size) != 0) {
+        pthread_mutex_unlock(&chunk->mutex);
+        return -1;
     }
 
     memcpy(chunk->data + chunk->size, data, size);
@@ -121,6 +125,24 @@ int chunk_append(Chunk *chunk, const void *data, size_t size) {
     return 0;
 }
 
+int chunk_append_record(Chunk *chunk, const void *header, size_t header_size, const void *data, size_t size) {
+    if (!chunk || !header || header_size == 0 || !data || size == 0) return -1;
+
+    pthread_mutex_lock(&chunk->mutex);
+
+    if (chunk_reserve(chunk, chunk->size + header_size + size) != 0) {
+        pthread_mutex_unlock(&chunk->mutex);
+        return -1;
+    }
+
+    memcpy(chunk->data + chunk->size, header, header_size);
+    memcpy(chunk->data + chunk->size + header_size, data, size);
+    chunk->size += header_size + size;
+
+    pthread_mutex_unlock(&chunk->mutex);
+    return 0;
+}
+
 long chunk_read(Chunk *chunk, void *buffer, size_t size, size_t offset) {
     if (!chunk || !buffer) return -1;
 